@@ -17,6 +17,7 @@
 #define GNSS_SDR_VERSION "0.0.5"
 #endif
 
+#include <algorithm>
 #include <ctime>
 #include <memory>
 #include <queue>
@@ -28,8 +29,7 @@
 #include <glog/logging.h>
 #include <gnuradio/msg_queue.h>
 #include "control_thread.h"
-#include "concurrent_queue.h"
-#include "concurrent_map.h"
+#include "file_configuration.h"
 #include "gps_ephemeris.h"
 #include "gps_almanac.h"
 #include "gps_iono.h"
@@ -46,7 +46,24 @@
 #include "math.h"
 #include "string.h"
 #include <GnssMetadata/Metadata.h>
-#include <GnssMetadata/Xml/XmlProcessor.h>
+#include "analysis_pipeline.h"
+#include "auto_conf_flags.h"
+#include "bds_file_reader.h"
+#include "bit_depth_analyzer.h"
+#include "metadata_builder.h"
+#include "metadata_cache.h"
+#include "polyphase_channelizer.h"
+#include "position_index.h"
+#include "position_sweep.h"
+#include "psd_estimator.h"
+#include "receiver_run.h"
+#include "sample_count.h"
+#include "sample_format_classifier.h"
+#include "sample_rate_detector.h"
+#include "sample_unpacker.h"
+#include "satellite_visibility.h"
+#include "stage_timer.h"
+#include "work_stealing_pool.h"
 
 /* !
 * Please add all the GnssMetadata/Metadata.h files from the following link:
@@ -60,19 +77,13 @@ using google::LogMessage;
 
 void ReadXmlFile(const char* pszFilename);
 
-void WriteXmlFile(const char* pszFilename, char* file_name, int count, long double Sat_latitude, long double Sat_longitude, long double Sat_height);
-
-double msToSamples(double ms, double SampleRate, double channels);
-
 DECLARE_string(log_dir);
-
-/*!
-* \todo make this queue generic for all the GNSS systems (javi)
-*/
+DECLARE_string(config_file);
 
 /*
-* Concurrent queues that communicates the Telemetry Decoder
-* to the Observables modules
+* The queues that communicate the Telemetry Decoder to the Observables
+* modules, and the maps of the navigation data collected from them, are
+* defined once, in global_queues.cc and global_maps.cc
 */
 
 
@@ -91,6 +102,10 @@ int main(int argc, char** argv)
     google::SetUsageMessage(intro_help);
     google::SetVersionString(gnss_sdr_version);
     google::ParseCommandLineFlags(&argc, &argv, true);
+    if (FLAGS_stage_report)
+        {
+            report_stages_at_exit();
+        }
     std::cout << "Initializing GNSS-SDR v" << gnss_sdr_version << " ... Please wait." << std::endl;
 
     google::InitGoogleLogging(argv[0]);
@@ -117,179 +132,152 @@ int main(int argc, char** argv)
                       << FLAGS_log_dir << std::endl;
         }
 
-    std::unique_ptr<ControlThread> control_thread(new ControlThread());
+    // Every receiver run is a ControlThread on this configuration
+    std::shared_ptr<ConfigurationInterface> configuration = std::make_shared<FileConfiguration>(FLAGS_config_file);
     
-    long int i=1; 
-    long double _latitude[10000], _longitude[10000], _height[10000];
-    long long int begin[10000], end[10000], active_time[10000];
+    // The receiver run collects the almanacs into the global maps, over the whole recording
+    long long int nav_time = 0;
+    try
+    {
+        nav_time = run_receiver(configuration);
+    }
+    catch( boost::exception & e )
+    {
+        LOG(FATAL) << "Boost exception: " << boost::diagnostic_information(e);
+    }
+    catch(std::exception const&  ex)
+    {
+        LOG(FATAL) << "STD exception: " << ex.what();
+    }
+    std::cout << "Total GNSS-SDR run time "
+              << (static_cast<double>(nav_time)) / 1000000.0
+              << " [seconds]" << std::endl;
+
+    // Place the constellation once; every grid point then costs a few multiply-adds per satellite
+    SatelliteVisibility visibility(FLAGS_elevation_mask);
+    publish_navigation_snapshot();
+    visibility.load_snapshot(navigation_publisher().current());
+    visibility.set_epoch(FLAGS_visibility_tow < 0.0 ? visibility.current_gps_tow() : FLAGS_visibility_tow);
+    if (visibility.satellites() == 0)
+    {
+        LOG(WARNING) << "No almanac available, no satellite can be located";
+    }
 
-    while(i!=0)
+    // Sweep the grid in tiles on all the cores
+    WorkStealingPool pool(FLAGS_sweep_threads);
+    PositionSweep sweep(visibility, pool);
+    Sweep_Grid grid = default_sweep_grid();
+    if (FLAGS_sweep_adaptive)
     {
-        for(long double lat = fabs(-90); lat <= fabs(90); lat = lat + power(10,-5))
-        {
-            for(long double longi = fabs(-180); longi <= fabs(180); longi = longi + power(10,-5))
-	    {
-	        for(long int height = 2000; height <= 20000; height = height + 100)
- 		{
-		    ////////////////////////////////
-      	            //Define the Session.
-		    Session sess("%ld",i);
-		    sess.Scenario("Example %ld", i);
-		    sess.Campaign("GNSS Metadata Satellite Positioning");
-		    sess.Contact("CTTC");
-		    sess.Position( Position(lat, longi, height));
-		    sess.AddComment("This is an example of locating the satellites that can be tuned by the receiver.");
-        	   	        
-		    // record the position of located satellite.
-                    if(sess.Position!=0)
-		    {
-		         _latitude(i) = lat; _longitude(i) = longi; _height(i) = height;
-			 i++;
-		    }
- 
-                    // record startup time
-    	   	    struct timeval tv;
-    	   	    gettimeofday(&tv, NULL);
-    	   	    begin(i) = tv.tv_sec * 1000000 + tv.tv_usec;
-           	    try
-    	   	    {
-            	        control_thread->run();
-    	   	    }
-    	   	    catch( boost::exception & e )
-    	   	    {
-            	        LOG(FATAL) << "Boost exception: " << boost::diagnostic_information(e);
-    	   	    }
-    	   	    catch(std::exception const&  ex)
-    	   	    {
-            	    	LOG(FATAL) << "STD exception: " << ex.what();
-    	   	    }
-    	   	    // report the elapsed time
-    	   	    gettimeofday(&tv, NULL);
-    	   	    end(i) = tv.tv_sec * 1000000 + tv.tv_usec;
-    	   	    std::cout << "Total GNSS-SDR run time "
-              	              << (static_cast<double>(end(i) - begin(i))) / 1000000.0
-              	     	      << " [seconds]" << std::endl;
-           	    active_time(i) = end(i) - begin(i);
-
-	        }
-	    }
-        }
- 	if(lat == fabs(90) && longi == fabs(180) && height == 20000)
-	{
-	    long int n = i; i = 0;
-        }
-    } 	  
-    
+        sweep.run_adaptive(grid);
+    }
+    else
+    {
+        sweep.run(grid);
+    }
+    std::cout << "Evaluated " << sweep.evaluated_points() << " of " << grid.points() << " grid points" << std::endl;
+    Visible_Set located = sweep.located();
+
+    // Positions from which satellites are in view, on the heap and without any size limit
+    const PositionStore& positions = sweep.positions();
+
     // Displaying the total number of satellites found
-    std::cout << "Total number of Satellites Located : " << n;
+    std::cout << "Total number of Satellites Located : " << located.count() << std::endl;
+    for (unsigned int slot = 0; slot < VISIBILITY_SLOTS; slot++)
+    {
+        if (located.test(slot)) std::cout << SatelliteVisibility::slot_name(slot) << " ";
+    }
+    std::cout << std::endl;
+    std::cout << "Positions with satellites in view : " << sweep.in_view_points() << std::endl;
+
+    BdsFileReader recording(FLAGS_bds_window_kb * 1024, FLAGS_bds_huge_pages);
+    recording.open(FLAGS_recording_file, FLAGS_recording_header_bytes);
+
+    // Sample layout of the recording, scored on its first bytes: the analyzers read the samples decoded with it
+    SampleFormatClassifier format_classifier;
+    Sample_Layout layout = format_classifier.classify(recording);
+    std::cout << "Sample Format of the recording : " << layout.name() << std::endl;
+    SampleUnpacker unpacker;
+    unpacker.compile(layout.unpack_layout());
+
+    // One pass over the recording: every window is read once and handed to all the analyzers
+    SampleRateDetector rate_detector;
+    rate_detector.add_candidate(FLAGS_sample_rate);
+    PsdEstimator spectrum(FLAGS_psd_fft_size, FLAGS_sample_rate, FLAGS_rf_center_frequency);
+    PolyphaseChannelizer channelizer(FLAGS_channelizer_channels, FLAGS_channelizer_taps, FLAGS_sample_rate, FLAGS_rf_center_frequency);
+    BitDepthAnalyzer bit_depth_analyzer;
+
+    SampleRateStage rate_stage(rate_detector, FLAGS_sample_rate_window);
+    PsdStage psd_stage(spectrum);
+    ChannelizerStage channelizer_stage(channelizer);
+    BitDepthStage bit_depth_stage(bit_depth_analyzer, static_cast<size_t>(FLAGS_bit_depth_window_mb) << 20);
+
+    AnalysisPipeline pipeline(recording, unpacker, pool);
+    pipeline.add(rate_stage);
+    pipeline.add(psd_stage);
+    pipeline.add(channelizer_stage);
+    pipeline.add(bit_depth_stage);
+    if (!pipeline.run())
+    {
+        LOG(WARNING) << "Unable to read the recording " << FLAGS_recording_file;
+    }
+
+    // Sample rate from the chipping rate line of the recording; --sample_rate if no line is found
+    double sample_rate = rate_stage.rate();
+    if (sample_rate == 0.0)
+    {
+        LOG(WARNING) << "Sample rate not detected, using " << FLAGS_sample_rate << " Hz";
+        sample_rate = FLAGS_sample_rate;
+    }
+
+    // Occupied band of the recorded signal, from its averaged spectrum
+    spectrum.set_sample_rate(sample_rate);
+    double bandwidth = spectrum.occupied_bandwidth();
+    double center_freq = spectrum.center_frequency();
+
+    // RF channels of the capture, from the power of the sub-bands of a polyphase filter bank
+    channelizer.set_sample_rate(sample_rate);
+    std::vector<Rf_Band> rf_bands = channelizer.bands(FLAGS_channelizer_threshold_db);
+
+    // Effective quantization of the samples, from the histogram of their decoded values; never wider than their container
+    Bit_Depth resolution = bit_depth_analyzer.result();
+    if (resolution.samples == 0)
+    {
+        LOG(WARNING) << "Resolution not measured, assuming " << layout.bits << " bits";
+        resolution.bits = layout.bits;
+    }
+    resolution.bits = std::min(resolution.bits, layout.bits);
 
     long double Sat_latitude, Sat_longitude, Sat_height;
-    int count = 0, Number_of_Bands = 0;
+    int count = 0, Number_of_Bands = static_cast<int>(rf_bands.size());
 
     std::cin >> "Enter the latitude value of Satellite : " >> Sat_latitude >> std::endl;
     std::cin >> "Enter the longitude value of Satellite : " >> Sat_longitude >> std::endl;	
     std::cin >> "Enter the height value of Satellite : " >> Sat_height >> std::endl;
 
-    for (long int j = 1; j <= n; j++)
-    {    if (_lattitude(j) == Sat_latitude && _longitude(j) == Sat_longitude && _height(j) == Sat_height)
-	     count = 1;
-	 else 
-	     count = 0;
-    } 
+    // Every recorded position within --position_tolerance meters of the requested one
+    PositionIndex position_index(positions);
+    std::vector<size_t> matches = position_index.within(Sat_latitude, Sat_longitude, Sat_height, FLAGS_position_tolerance);
+    std::cout << "Recorded positions within " << FLAGS_position_tolerance << " m : " << matches.size() << std::endl;
+    size_t nearest;
+    double nearest_distance;
+    if (matches.empty() && position_index.nearest(Sat_latitude, Sat_longitude, Sat_height, nearest, nearest_distance))
+    {
+        std::cout << "Nearest recorded position ("
+                  << positions.latitude(nearest) << ", " << positions.longitude(nearest) << ", " << positions.height(nearest)
+                  << ") is " << nearest_distance << " m away" << std::endl;
+    }
+    count = matches.empty() ? 0 : 1;
 
     if( count == 1)
-    {   //Define the Session.
-        Session sess("%d", j);
-        sess.Scenario("Example %d", j);
-        sess.Campaign("GNSS Metadata API Testing");
-        sess.Contact("CTTC");
-        sess.Position( Position( Sat_latitude, Sat_longitude, Sat_height));
-        sess.AddComment("This part tunes the receiver to the specified positions.");
-
-        //Define the System, Sources, and cluster.
-	System sys("A2300-1");
-	sys.BaseFrequency( Frequency( 4, Frequency::MHz));
-	sys.Equipment("ASR-2300");
-	sys.AddComment( "ASR-2300 configured with standard firmware and FPGA id=1, version=1.18.");
-
-	Cluster clstr("Antenna");
-
-	Source src( Source::Patch, Source::RHCP, "L1 C/A");
-	src.IdCluster("Antenna");
-
-	sys.AddSource( src);
-	sys.AddCluster(clstr);
-
-        // record startup time
-        struct timeval tv;
-        gettimeofday(&tv, NULL);
-        long long int begin = tv.tv_sec * 1000000 + tv.tv_usec;
-
-        try
-        {
-                control_thread->run();
-        }
-        catch( boost::exception & e )
-        {
-                LOG(FATAL) << "Boost exception: " << boost::diagnostic_information(e);
-        }
-        catch(std::exception const&  ex)
-        {
-                LOG(FATAL) << "STD exception: " << ex.what();
-        }
-        // report the elapsed time
-        gettimeofday(&tv, NULL);
-        long long int end = tv.tv_sec * 1000000 + tv.tv_usec;
-        long long int total_time = end - begin;
-        std::cout << "Total GNSS-SDR run time "
-                  << (static_cast<double>(total_time)) / 1000000.0
-                  << " [seconds]" << std::endl;
-
-        // retrieve the bandwidth of the signal
-        long long int bandwidth = 1.0/total_time;
+    {
+        // bandwidth and center frequency of the signal, from its PSD
         std::cout << "Total Bandwidth "
-                  << (static_cast<double>(bandwidth))  
-                  << " [MHz]" << std::endl;
-
-	// finding the center frequency
-	long long int center_freq = mean(bandwidth);
+                  << bandwidth
+                  << " [hertz]" << std::endl;
         std::cout << "Center Frequency  "
-                  << (static_cast<double>(center_freq))  
-                  << " [MHz]" << std::endl;
-
-	////////////////////////////////
-	//Define Band 1 and L1 C/A Stream.
-	Band ch("L1External");
-	ch.CenterFrequency(Frequency( center_freq, Frequency::MHz));
-	ch.TranslatedFrequency(Frequency( 38400, Frequency::Hz));
-
-	Stream sm("L1ca");
-	sm.RateFactor(1);
-	sm.Quantization(8);
-	sm.Packedbits(16);
-	sm.Encoding("INT8");
-	sm.Format(Stream::IQ);
-	sm.Bands().push_back( ch);
-        Number_of_Bands = sizeof(sm.Bands().push_back( ch)) / sizeof(int);
-
-	////////////////////////////////
-	//Define the lane
-	Lump lump;
-	lump.Streams().push_back( sm);
-
-	Chunk chunk;
-	chunk.SizeWord(4);
-	chunk.CountWords(1);
-	chunk.Lumps().push_back(lump);
-
-	Block blk(256);
-	blk.Chunks().push_back(chunk);
-	
-	Lane lane("GPS SPS Data");
-	lane.Sessions().push_back( sess);
-	lane.Blocks().push_back(blk);
-	lane.AddBandSource(ch, src);
-	lane.Systems().push_back( sys.ToReference<System>());
+                  << center_freq
+                  << " [hertz]" << std::endl;
     }
     else
     {
@@ -297,46 +285,64 @@ int main(int argc, char** argv)
     }
 
     std::cout << "Number of RF Channels =  "
-              << (static_cast<double>(Number_of_Bands))  
-              << " [MHz]" << std::endl;
+              << Number_of_Bands << std::endl;
+    for (size_t b = 0; b < rf_bands.size(); b++)
+    {
+        std::cout << "  " << rf_bands[b].name << " : "
+                  << rf_bands[b].center_frequency << " [hertz], "
+                  << rf_bands[b].bandwidth << " [hertz] wide, "
+                  << rf_bands[b].snr_db << " [dB] over the floor" << std::endl;
+    }
 
-    // Calculation of Sample Rate
+    // Calculation of Sample Rate, detected from the recording
 
-    long long int SR;
+    std::cout << "Sample Rate of the recording "
+              << sample_rate << " [hertz] (line at "
+              << rate_detector.confidence() << " sigma)" << std::endl;
 
-    std::cout << "Please enter the Sample Rate ( < " 
-              << 2 * bandwidth << ") " << std::endl;
-
-    std::cin >> SR >> std::endl;
-    
-    double Sample_Rate = msToSamples(total_time * power(10, -3), SR, Number_of_Bands);
+    double Sample_Rate = msToSamples(nav_time * 1.0e-3, sample_rate, Number_of_Bands);
 
     std::cout << "The Sample Rate for this channel = " << Sample_Rate << std::endl;     
 
-    // Get the filename if specified.
-    
-    for(int iter = 1; iter <= Number_of_Bands; iter++)
+    // Metadata of every band, written in one pass, only for a position evaluated above
+    std::string prefix = "141230-gps-4msps_";
+    if( argc > 1) prefix = argv[1];
+
+    if( count == 1)
     {
- 	char* file_name_1 = "141230-gps-4msps_";
-	char* char_add = itoa (iter);
-        char* file_name;
-        strcat(file_name_1, iter);
-	strcpy(file_name, file_name_1);
-	strcat(file_name, ".xml");
-                
-	const char* pszFilename = file_name;
-    	if( argc > 1) pszFilename = argv[1];
-
-	printf("GNSS Metadata XML file translation\n");
-    	printf("\n");
-    	printf("Application implements writing and reading an XML file\n");
-    	printf("Program creates a metadata file using the API and then parses it.\n");
-    	printf("\n");
-    	printf("Command line\n");
-    	printf("GnssMetadataTestApp [xmlfile (default: '%s')]\n", pszfilename);
-
-    	WriteXmlFile(pszFilename, file_name_1, iter, Sat_latitude, Sat_longitude, Sat_height);
-    	ReadXmlFile(pszFilename);
+        printf("GNSS Metadata XML file translation\n");
+        printf("\n");
+        printf("Application implements writing and reading an XML file\n");
+        printf("Program creates a metadata file per band using the API (--metadata_reparse parses it back).\n");
+        printf("\n");
+        printf("Command line\n");
+        printf("GnssMetadataTestApp [file prefix (default: '%s')]\n", prefix.c_str());
+
+        //First sample at UTC 24-Aug-2015 21:05:05, GPS 1825/254334.906
+        MetadataBuilder metadata(1, Date( 254334.906, 1825));
+        metadata.set_position(Sat_latitude, Sat_longitude, Sat_height);
+        metadata.set_sample_rate(sample_rate);
+        metadata.set_stream(resolution.bits, layout.packed_bits(), layout.encoding(), layout.iq, layout.big_endian);
+        for (size_t b = 0; b < rf_bands.size(); b++)
+        {
+            // A single channel takes the finer center frequency of the PSD
+            metadata.add_band(rf_bands[b].name, rf_bands.size() == 1 ? center_freq : rf_bands[b].center_frequency);
+        }
+        // The description is validated in memory; the files are only parsed again for debugging
+        std::vector<std::string> xml_files = metadata.write(prefix);
+        std::cout << "Metadata files written : " << xml_files.size() << std::endl;
+        for (size_t f = 0; f < xml_files.size() && FLAGS_metadata_cache; f++)
+        {
+            std::string error;
+            if (!MetadataCache::build(xml_files[f], &error))
+            {
+                LOG(WARNING) << "No binary metadata image for " << xml_files[f] << ": " << error;
+            }
+        }
+        for (size_t f = 0; f < xml_files.size() && FLAGS_metadata_reparse; f++)
+        {
+            ReadXmlFile(xml_files[f].c_str());
+        }
     }
 
     google::ShutDownCommandLineFlags();
@@ -345,166 +351,20 @@ int main(int argc, char** argv)
     return(0);
 }
 
-/*!
-* This part converts milliseconds to samples of buffer	
-* @param ms the tume in milliseconds
-* @return the size of the buffer in samples
-*/
-double msToSamples(double ms, double SampleRate, double channels)
-{
-    return (double)((long) ms) * SampleRate * channels / 1000);
-}
-
 void ReadXmlFile(const char* pszFilename)
 {
     printf("\nReading GNSS Metadata to xml file: %s\n", pszFilename);
 
-    Metadata md;
-    XmlProcessor xproc;
-
-    try
+    // The binary image is mapped; the XML is only parsed again when the image is missing or stale
+    MetadataCache metadata;
+    if( metadata.open( pszFilename) )
     {
-        if( xproc.Load( pszFilename, false, md) )
-        {
-            printf("Xml Processed successfully.\n");
-
-
-        }
+        printf("Xml Processed successfully: %u files, %u streams%s.\n",
+               static_cast<unsigned int>(metadata.file_count()), static_cast<unsigned int>(metadata.stream_count()),
+               metadata.rebuilt() ? " (image rebuilt from the xml file)" : "");
     }
-    catch( ApiException& e)
-    {
-        printf("An error occurred while saving the xml file: %s\n", e.what() );
-    }
-    catch( std::exception& ge)
-    {
-        printf("Unknown Exception Occured: %s\n", ge.what() );
-    }
-}
-
-
-void WriteXmlFile(const char* pszFilename, char* file_name, int count, long double Sat_latitude, long double Sat_longitude, long double Sat_height)
-{
-    printf("\nWriting GNSS Metadata to xml file: %s\n", pszFilename);
-
-    ////////////////////////////////
-    //Define information about the datafile.
-
-    //UTC:    24-Aug-2015 21:05:05
-    //GPS:    1825/254334.906
-    Date dt0( 254334.906, 1825);
-    size_t offset = 588;
-    strcat(file_name, ".bds");
-    String sfile = file_name;
-    String sfilemd = pszFilename;
-
-    ////////////////////////////////
-    //Define the Session.
-    Session sess("%d", count);
-    sess.Scenario("Example %d", count);
-    sess.Campaign("GNSS Metadata API");
-    sess.Contact("CTTC");
-    sess.Position( Position(Sat_latitude, Sat_longitude, Sat_height));
-    sess.AddComment("This locates the satellite with metadata specification having interleaved streams.");
-
-    ////////////////////////////////
-    //Define the System, Sources, and cluster.
-    System sys("A2300-1");
-    sys.BaseFrequency( Frequency( 4, Frequency::MHz));
-    sys.Equipment("ASR-2300");
-    sys.AddComment( "ASR-2300 configured with standard firmware and FPGA id=1, version=1.18.");
-
-    Cluster clstr("Antenna");
-
-    Source src( Source::Patch, Source::RHCP, "L1 C/A");
-    src.IdCluster("Antenna");
-
-    sys.AddSource(src);
-    sys.AddCluster(clstr);
-
-    // record startup time
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    long long int begin = tv.tv_sec * 1000000 + tv.tv_usec;
-
-    try
-    {
-            control_thread->run();
-    }
-    catch( boost::exception & e )
-    {
-            LOG(FATAL) << "Boost exception: " << boost::diagnostic_information(e);
-    }
-    catch(std::exception const&  ex)
-    {
-            LOG(FATAL) << "STD exception: " << ex.what();
-    }
-    // report the elapsed time
-    gettimeofday(&tv, NULL);
-    long long int end = tv.tv_sec * 1000000 + tv.tv_usec;
-    long long int total_time = end - begin;
-    long long int bandwidth = 1.0/total_time;
-    long long int center_freq = mean(bandwidth);
-    
-    ////////////////////////////////
-    //Define Band 1 and L1 C/A Stream.
-    Band ch("L1External");
-    ch.CenterFrequency(Frequency( center_freq, Frequency::MHz));
-    ch.TranslatedFrequency(Frequency( 38400, Frequency::Hz));
-
-    //Stream sm will be added to the global metadata and as a reference to the lump.
-
-    stream sm("L1ca");
-    sm.RateFactor(1);
-    sm.Quantization(8);
-    sm.Packedbits(16);
-    sm.Encoding("INT8");
-    sm.Format(Stream::IQ);
-    sm.Bands().push_back(ch);
-
-    ////////////////////////////////
-    //Define the lane
-    Lump lump;
-    lump.Streams().push_back(sm);
-    lump.Streams().push_back(sm.ToReference<Stream>());	
-
-    Chunk chunk;
-    chunk.SizeWord(4);
-    chunk.CountWords(1);
-    chunk.Lumps().push_back(lump);
-
-    Block blk(256);
-    blk.Chunks().push_back(chunk);
-	
-    Lane lane("GPS SPS Data");
-    lane.Sessions().push_back(sess);
-    lane.Blocks().push_back(blk);
-    lane.AddBandSource(ch, src);
-	
-    lane.Systems().push_back( sys.ToReference<System>());
-
-    ////////////////////////////////
-    //Define the file
-    File df;
-    df.Url(sfile);
-    df.TimeStamp(dt0);
-    df.Lane( lane, true);
-
-    ////////////////////////////////
-    //Assemble the Metadata object and write XML
- 
-    Metadata md;
-    XmlProcessor proc;
-    md.Lanes().push_back(lane);
-    md.Files().push_back(df);
-    md.Systems().push_back(sys);
-    md.Streams().push_back(sm); 
-
-    try
-    {
-        proc.Save(sfilemd.c_str(), md);
-    }
-    catch( ApiException& e)
+    else
     {
-	printf("An error occurred while saving the xml file: %s\n", e.what());
+        printf("An error occurred while reading the xml file: %s\n", metadata.error().c_str() );
     }
 }
@@ -0,0 +1,743 @@
+/*!
+* \file auto_conf_benchmark.cc
+* \brief Google Benchmark suite of the auto-configuration modules.
+*
+* Every benchmark runs offline on synthetic data made with fixed seeds: a
+* 24 satellite GPS constellation for the visibility engine and the position
+* sweep, int8 I/Q recordings of four C/A signals (RecordingGenerator) of
+* several sizes for the spectrum, sample rate, resolution, format and RF
+* channel analyzers, packed buffers for the sample unpackers, metadata
+* files written and read back in a temporary directory, and navigation
+* sized items sent through the queues and navigation maps. Unless told
+* otherwise with --benchmark_out, the results are also written as JSON to
+* auto_conf_benchmark.json, to be compared across commits.
+*
+* -------------------------------------------------------------------------
+*
+*/
+
+#include <algorithm>
+#include <complex>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include <boost/filesystem.hpp>
+#include <gflags/gflags.h>
+#include <GnssMetadata/Metadata.h>
+#include "auto_conf_flags.h"
+#include "bds_file_reader.h"
+#include "bit_depth_analyzer.h"
+#include "bit_unpacker.h"
+#include "concurrent_map.h"
+#include "concurrent_queue.h"
+#include "lockfree_queue.h"
+#include "metadata_builder.h"
+#include "metadata_cache.h"
+#include "metadata_loader.h"
+#include "navigation_snapshot.h"
+#include "polyphase_channelizer.h"
+#include "position_sweep.h"
+#include "prn_table.h"
+#include "psd_estimator.h"
+#include "recording_generator.h"
+#include "sample_count.h"
+#include "sample_format_classifier.h"
+#include "sample_rate_detector.h"
+#include "sample_unpacker.h"
+#include "satellite_visibility.h"
+#include "work_stealing_pool.h"
+
+namespace
+{
+const double BENCH_SAMPLE_RATE = 4.0e6;         //!< Complex sample rate of the synthetic recordings [Hz]
+const double BENCH_CENTER_FREQUENCY = 1575.42e6; //!< [Hz]
+const double BENCH_TOW = 345600.0;              //!< GPS time of week of the visibility epoch [s]
+const unsigned int BENCH_SEED = 20150801;       //!< Seed of every synthetic data set
+
+//! Default JSON result file, written when --benchmark_out is not given
+const char* const BENCH_JSON = "auto_conf_benchmark.json";
+
+boost::filesystem::path& work_dir()
+{
+    static boost::filesystem::path dir = boost::filesystem::temp_directory_path()
+            / boost::filesystem::unique_path("auto_conf_benchmark-%%%%-%%%%");
+    return dir;
+}
+
+WorkStealingPool& pool()
+{
+    static WorkStealingPool workers(FLAGS_sweep_threads > 0 ? FLAGS_sweep_threads : 0);
+    return workers;
+}
+
+/*
+* 24 GPS satellites on 6 planes of 4 slots, inclination 55 deg, as in the
+* nominal constellation. Angles are in semi-circles, as in the almanac.
+*/
+std::map<int, Gps_Almanac> synthetic_almanacs()
+{
+    std::map<int, Gps_Almanac> almanacs;
+    for (int plane = 0; plane < 6; plane++)
+        {
+            for (int slot = 0; slot < 4; slot++)
+                {
+                    int prn = plane * 4 + slot + 1;
+                    Gps_Almanac alm;
+                    alm.i_satellite_PRN = prn;
+                    alm.i_SV_health = 0;
+                    alm.d_Toa = BENCH_TOW - 3600.0;
+                    alm.d_sqrt_A = 5153.6;
+                    alm.d_e_eccentricity = 0.005 + 0.001 * slot;
+                    alm.d_Delta_i = 55.0 / 180.0 - 0.30;
+                    alm.d_OMEGA0 = -1.0 + plane / 3.0;
+                    alm.d_OMEGA = 0.1 * (slot - 2);
+                    alm.d_OMEGA_DOT = -2.6e-9;
+                    alm.d_M_0 = -1.0 + slot * 0.5 + plane * 0.08;
+                    almanacs[prn] = alm;
+                }
+        }
+    return almanacs;
+}
+
+SatelliteVisibility& visibility()
+{
+    static SatelliteVisibility* engine = 0;
+    if (!engine)
+        {
+            engine = new SatelliteVisibility(FLAGS_elevation_mask);
+            engine->load_almanacs(synthetic_almanacs(), std::map<int, Galileo_Almanac>());
+            engine->set_epoch(BENCH_TOW);
+        }
+    return *engine;
+}
+
+//! Interleaved int8 I/Q recording of four C/A signals at 45 dB-Hz over the noise
+Synthetic_Recording bench_recording()
+{
+    Synthetic_Recording recording;
+    recording.sample_rate = BENCH_SAMPLE_RATE;
+    recording.intermediate_frequency = 0.0;
+    recording.quantization = 8;
+    recording.packed_bits = 16;
+    recording.encoding = "TC";
+    recording.iq = true;
+    recording.big_endian = false;
+    recording.noise_lsb = 0.0;
+    recording.navigation_data = true;
+    recording.seed = BENCH_SEED;
+    parse_synthetic_satellites("1:1200:0:45,7:-2300:311.5:45,13:400:720.25:45,24:3100:95:45", recording.satellites);
+    return recording;
+}
+
+const std::string& recording_file(size_t bytes)
+{
+    static std::map<size_t, std::string> files;
+    std::map<size_t, std::string>::iterator found = files.find(bytes);
+    if (found != files.end())
+        {
+            return found->second;
+        }
+    std::string filename = (work_dir() / ("recording-" + std::to_string(bytes) + ".bds")).string();
+    RecordingGenerator generator(bench_recording());
+    generator.write(filename, bytes / 2, pool());
+    return files[bytes] = filename;
+}
+
+std::vector<uint8_t> random_bytes(size_t bytes)
+{
+    std::mt19937 generator(BENCH_SEED);
+    std::vector<uint8_t> data(bytes);
+    for (size_t n = 0; n < bytes; n++)
+        {
+            data[n] = static_cast<uint8_t>(generator());
+        }
+    return data;
+}
+
+bool open_recording(BdsFileReader& recording, benchmark::State& state)
+{
+    if (!recording.open(recording_file(static_cast<size_t>(state.range(0)))))
+        {
+            state.SkipWithError("Cannot map the synthetic recording");
+            return false;
+        }
+    return true;
+}
+
+//! Recording sizes of the analyzer benchmarks: 1, 8 and 64 MiB
+void recording_sizes(benchmark::internal::Benchmark* bench)
+{
+    bench->Arg(1 << 20)->Arg(8 << 20)->Arg(64 << 20)->Unit(benchmark::kMillisecond)->UseRealTime();
+}
+
+std::string metadata_prefix()
+{
+    return (work_dir() / "bench_metadata").string();
+}
+
+MetadataBuilder metadata_builder(int bands)
+{
+    MetadataBuilder metadata(1, GnssMetadata::Date(254334.906, 1825));
+    metadata.set_position(41.27, 1.99, 100.0);
+    metadata.set_stream(2, 4, "TC", true, false);
+    for (int b = 0; b < bands; b++)
+        {
+            metadata.add_band("L1External" + std::to_string(b + 1), BENCH_CENTER_FREQUENCY + b * 1.0e6);
+        }
+    return metadata;
+}
+
+const std::string& metadata_file()
+{
+    static std::string written;
+    if (written.empty())
+        {
+            MetadataBuilder metadata = metadata_builder(1);
+            std::vector<std::string> files = metadata.write(metadata_prefix());
+            if (!files.empty())
+                {
+                    written = files[0];
+                }
+        }
+    return written;
+}
+}
+
+
+/////////////////////////////////////////////
+// Satellites: visibility and position sweep
+
+static void BM_VisibilityPoint(benchmark::State& state)
+{
+    const SatelliteVisibility& engine = visibility();
+    double latitude = -89.0;
+    size_t seen = 0;
+    for (auto _ : state)
+        {
+            Visible_Set in_view = engine.visible(latitude, 2.0 * latitude, 2000.0);
+            benchmark::DoNotOptimize(in_view);
+            seen += in_view.count();
+            latitude = latitude < 89.0 ? latitude + 0.37 : -89.0;
+        }
+    state.SetItemsProcessed(state.iterations());
+    state.counters["satellites_per_point"] = static_cast<double>(seen) / state.iterations();
+}
+BENCHMARK(BM_VisibilityPoint);
+
+
+// What a data collector pays for every new almanac: a snapshot of the constellation published
+static void BM_NavigationPublish(benchmark::State& state)
+{
+    std::map<int, Gps_Almanac> almanacs = synthetic_almanacs();
+    NavigationPublisher publisher;
+    for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(publisher.publish(make_navigation_snapshot(almanacs, std::map<int, Galileo_Almanac>())));
+        }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_NavigationPublish);
+
+
+// What a consumer pays to take the current snapshot, with several threads taking it at once
+static void BM_NavigationCurrent(benchmark::State& state)
+{
+    static NavigationPublisher publisher;
+    if (state.thread_index() == 0)
+        {
+            publisher.publish(make_navigation_snapshot(synthetic_almanacs(), std::map<int, Galileo_Almanac>()));
+        }
+    for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(publisher.current());
+        }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_NavigationCurrent)->ThreadRange(1, 8)->UseRealTime();
+
+
+static Sweep_Grid bench_grid(int step_centideg)
+{
+    Sweep_Grid grid;
+    grid.lat_min = -90.0;
+    grid.lat_max = 90.0;
+    grid.lon_min = -180.0;
+    grid.lon_max = 180.0;
+    grid.step_deg = step_centideg / 100.0;
+    grid.height_min = 2000;
+    grid.height_max = 20000;
+    grid.height_step = 6000;
+    return grid;
+}
+
+
+// Argument: latitude / longitude step [hundredths of a degree]
+static void BM_PositionSweep(benchmark::State& state)
+{
+    Sweep_Grid grid = bench_grid(static_cast<int>(state.range(0)));
+    for (auto _ : state)
+        {
+            PositionSweep sweep(visibility(), pool());
+            sweep.run(grid);
+            benchmark::DoNotOptimize(sweep.in_view_points());
+        }
+    state.SetItemsProcessed(state.iterations() * grid.points());
+}
+BENCHMARK(BM_PositionSweep)->Arg(400)->Arg(100)->Arg(50)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+
+static void BM_PositionSweepAdaptive(benchmark::State& state)
+{
+    Sweep_Grid grid = bench_grid(static_cast<int>(state.range(0)));
+    unsigned long long evaluated = 0;
+    for (auto _ : state)
+        {
+            PositionSweep sweep(visibility(), pool());
+            sweep.run_adaptive(grid);
+            evaluated = sweep.evaluated_points();
+        }
+    state.SetItemsProcessed(state.iterations() * grid.points());
+    state.counters["evaluated_points"] = static_cast<double>(evaluated);
+}
+BENCHMARK(BM_PositionSweepAdaptive)->Arg(400)->Arg(100)->Arg(50)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+
+/////////////////////////////////////////////
+// Automatic_Rx_Conf and Sample_Rate: buffer size
+
+static void BM_MsToSamples(benchmark::State& state)
+{
+    double ms = 1.0;
+    for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(msToSamples(ms, BENCH_SAMPLE_RATE, 2.0));
+            ms = ms < 100000.0 ? ms + 1.0 : 1.0;
+        }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_MsToSamples);
+
+
+/////////////////////////////////////////////
+// Metadata files
+
+// Argument: bands, one file each
+static void BM_MetadataWrite(benchmark::State& state)
+{
+    MetadataBuilder metadata = metadata_builder(static_cast<int>(state.range(0)));
+    for (auto _ : state)
+        {
+            std::vector<std::string> files = metadata.write(metadata_prefix() + "_write");
+            if (files.size() != static_cast<size_t>(state.range(0)))
+                {
+                    state.SkipWithError("Metadata not written");
+                    break;
+                }
+        }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_MetadataWrite)->Arg(1)->Arg(4)->Unit(benchmark::kMicrosecond);
+
+
+static void BM_MetadataRead(benchmark::State& state)
+{
+    const std::string& xml = metadata_file();
+    for (auto _ : state)
+        {
+            MetadataLoader loader(MetadataLoader::FILES | MetadataLoader::STREAMS);
+            if (!loader.load(xml))
+                {
+                    state.SkipWithError("Metadata not loaded");
+                    break;
+                }
+            benchmark::DoNotOptimize(loader.streams().size());
+        }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_MetadataRead)->Unit(benchmark::kMicrosecond);
+
+
+static void BM_MetadataCacheOpen(benchmark::State& state)
+{
+    const std::string& xml = metadata_file();
+    if (!MetadataCache::build(xml))
+        {
+            state.SkipWithError("Metadata cache not built");
+        }
+    for (auto _ : state)
+        {
+            MetadataCache cache;
+            if (!cache.open(xml))
+                {
+                    state.SkipWithError("Metadata cache not opened");
+                    break;
+                }
+            benchmark::DoNotOptimize(cache.stream_count());
+        }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_MetadataCacheOpen)->Unit(benchmark::kMicrosecond);
+
+
+/////////////////////////////////////////////
+// Recording analyzers (argument: recording size [bytes])
+
+static void BM_WelchPsd(benchmark::State& state)
+{
+    BdsFileReader recording;
+    if (!open_recording(recording, state))
+        {
+            return;
+        }
+    SampleUnpacker unpacker;   // 8 bit I/Q, as bench_recording()
+    for (auto _ : state)
+        {
+            PsdEstimator spectrum(FLAGS_psd_fft_size, BENCH_SAMPLE_RATE, BENCH_CENTER_FREQUENCY);
+            estimate_psd(recording, unpacker, spectrum, pool());
+            benchmark::DoNotOptimize(spectrum.occupied_bandwidth());
+            benchmark::DoNotOptimize(spectrum.center_frequency());
+        }
+    state.SetBytesProcessed(state.iterations() * recording.size());
+}
+BENCHMARK(BM_WelchPsd)->Apply(recording_sizes);
+
+
+static void BM_SampleRateDetect(benchmark::State& state)
+{
+    BdsFileReader recording;
+    if (!open_recording(recording, state))
+        {
+            return;
+        }
+    SampleUnpacker unpacker;
+    for (auto _ : state)
+        {
+            SampleRateDetector detector;
+            detector.add_candidate(BENCH_SAMPLE_RATE);
+            benchmark::DoNotOptimize(detector.detect(recording, unpacker, FLAGS_sample_rate_window, pool()));
+        }
+    // Only the first --sample_rate_window samples are analyzed, as in Sample_Rate
+    state.SetBytesProcessed(state.iterations() * std::min(recording.size(), 2 * static_cast<size_t>(FLAGS_sample_rate_window)));
+}
+BENCHMARK(BM_SampleRateDetect)->Apply(recording_sizes);
+
+
+static void BM_BitDepth(benchmark::State& state)
+{
+    BdsFileReader recording;
+    if (!open_recording(recording, state))
+        {
+            return;
+        }
+    SampleUnpacker unpacker;
+    for (auto _ : state)
+        {
+            BitDepthAnalyzer analyzer;
+            analyze_bit_depth(recording, unpacker, analyzer, pool());
+            benchmark::DoNotOptimize(analyzer.result().bits);
+        }
+    state.SetBytesProcessed(state.iterations() * recording.size());
+}
+BENCHMARK(BM_BitDepth)->Apply(recording_sizes);
+
+
+static void BM_SampleFormatClassify(benchmark::State& state)
+{
+    BdsFileReader recording;
+    if (!open_recording(recording, state))
+        {
+            return;
+        }
+    SampleFormatClassifier classifier(std::min(recording.size(), static_cast<size_t>(state.range(0))));
+    for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(classifier.classify(recording).bits);
+        }
+    state.SetBytesProcessed(state.iterations() * classifier.prefix_bytes());
+}
+BENCHMARK(BM_SampleFormatClassify)->Apply(recording_sizes);
+
+
+static void BM_Channelizer(benchmark::State& state)
+{
+    BdsFileReader recording;
+    if (!open_recording(recording, state))
+        {
+            return;
+        }
+    SampleUnpacker unpacker;
+    for (auto _ : state)
+        {
+            PolyphaseChannelizer channelizer(FLAGS_channelizer_channels, FLAGS_channelizer_taps, BENCH_SAMPLE_RATE, BENCH_CENTER_FREQUENCY);
+            channelizer.process(recording, unpacker, pool());
+            benchmark::DoNotOptimize(channelizer.bands(FLAGS_channelizer_threshold_db).size());
+        }
+    state.SetBytesProcessed(state.iterations() * recording.size());
+}
+BENCHMARK(BM_Channelizer)->Apply(recording_sizes);
+
+
+/////////////////////////////////////////////
+// Synthetic recordings (arguments: quantization, packed bits, satellites)
+
+static void BM_GenerateRecording(benchmark::State& state)
+{
+    Synthetic_Recording recording = bench_recording();
+    recording.quantization = static_cast<unsigned int>(state.range(0));
+    recording.packed_bits = static_cast<unsigned int>(state.range(1));
+    recording.satellites.resize(static_cast<size_t>(state.range(2)));
+    RecordingGenerator generator(recording);
+    if (!generator.valid())
+        {
+            state.SkipWithError(generator.error().c_str());
+            return;
+        }
+    const size_t samples = 1 << 22;
+    std::vector<uint8_t> data(static_cast<size_t>(generator.bytes(samples)));
+    unsigned long long first = 0;
+    for (auto _ : state)
+        {
+            generator.generate(first, samples, data.data());
+            benchmark::ClobberMemory();
+            first += samples;
+        }
+    state.SetItemsProcessed(state.iterations() * samples);
+    state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_GenerateRecording)->Args({2, 4, 0})->Args({2, 4, 4})->Args({8, 16, 4})->Unit(benchmark::kMillisecond);
+
+
+/////////////////////////////////////////////
+// Queues (argument: producer threads) and navigation maps
+
+//! About the size of a Gps_Ephemeris
+struct Bench_Navigation_Item
+{
+    double values[44];
+    int prn;
+};
+
+/*
+* The producers push their share of the items as the telemetry decoders of
+* several channels would, while the benchmark thread pops all of them, as
+* the data collector does. Items per second is the throughput of the queue.
+*/
+template <typename Queue>
+static void BM_GlobalQueue(benchmark::State& state)
+{
+    const int producers = static_cast<int>(state.range(0));
+    const int items = 1 << 16;
+    Queue queue;
+    for (auto _ : state)
+        {
+            std::vector<std::thread> threads;
+            for (int p = 0; p < producers; p++)
+                {
+                    threads.push_back(std::thread([&queue, p, producers, items]()
+                        {
+                            Bench_Navigation_Item item = Bench_Navigation_Item();
+                            item.prn = p;
+                            for (int i = p; i < items; i += producers)
+                                {
+                                    item.values[0] = i;
+                                    queue.push(item);
+                                }
+                        }));
+                }
+            Bench_Navigation_Item item;
+            double sum = 0.0;
+            for (int i = 0; i < items; i++)
+                {
+                    queue.wait_and_pop(item);
+                    sum += item.values[0];
+                }
+            for (size_t t = 0; t < threads.size(); t++)
+                {
+                    threads[t].join();
+                }
+            benchmark::DoNotOptimize(sum);
+        }
+    state.SetItemsProcessed(state.iterations() * items);
+}
+BENCHMARK_TEMPLATE(BM_GlobalQueue, concurrent_queue<Bench_Navigation_Item>)
+    ->Arg(1)->Arg(2)->Arg(4)->Arg(8)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_GlobalQueue, MpmcQueue<Bench_Navigation_Item>)
+    ->Arg(1)->Arg(2)->Arg(4)->Arg(8)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_GlobalQueue, SpscQueue<Bench_Navigation_Item>)
+    ->Arg(1)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+
+/*
+* Every thread reads the items of 32 PRNs in turn, as visibility and PVT
+* look up ephemerides, while the first one also rewrites an item every 16
+* reads, as the data collector does.
+*/
+template <typename Map>
+static void BM_GlobalMap(benchmark::State& state)
+{
+    static Map map;
+    Bench_Navigation_Item item = Bench_Navigation_Item();
+    if (state.thread_index() == 0)
+        {
+            for (int prn = 1; prn <= 32; prn++)
+                {
+                    item.prn = prn;
+                    map.write(prn, item);
+                }
+        }
+    unsigned int n = static_cast<unsigned int>(state.thread_index());
+    double sum = 0.0;
+    for (auto _ : state)
+        {
+            int prn = 1 + static_cast<int>(n % 32);
+            if (state.thread_index() == 0 && n % 16 == 0)
+                {
+                    item.prn = prn;
+                    item.values[0] = n;
+                    map.write(prn, item);
+                }
+            if (map.read(prn, item))
+                {
+                    sum += item.values[0];
+                }
+            n++;
+        }
+    benchmark::DoNotOptimize(sum);
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(BM_GlobalMap, concurrent_map<Bench_Navigation_Item>)->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_GlobalMap, PrnTable<Bench_Navigation_Item>)->ThreadRange(1, 8)->UseRealTime();
+
+
+/////////////////////////////////////////////
+// Sample unpacking (arguments: quantization, packed bits, big endian, buffer size [bytes])
+
+static void BM_SampleUnpacker(benchmark::State& state)
+{
+    Unpack_Layout layout = make_unpack_layout(static_cast<unsigned int>(state.range(0)), static_cast<unsigned int>(state.range(1)),
+            "TC", true, state.range(2) != 0);
+    SampleUnpacker unpacker;
+    if (!unpacker.compile(layout))
+        {
+            state.SkipWithError(unpacker.error().c_str());
+            return;
+        }
+    std::vector<uint8_t> data = random_bytes(static_cast<size_t>(state.range(3)));
+    std::vector<std::complex<float> > samples(unpacker.samples(data.size()));
+    for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(unpacker.unpack(data.data(), data.size(), samples.data()));
+            benchmark::ClobberMemory();
+        }
+    state.SetBytesProcessed(state.iterations() * data.size());
+    state.SetLabel(unpacker.kernel_name());
+}
+BENCHMARK(BM_SampleUnpacker)
+    ->Args({2, 4, 0, 1 << 16})->Args({2, 4, 0, 16 << 20})
+    ->Args({4, 8, 0, 1 << 16})->Args({4, 8, 0, 16 << 20})
+    ->Args({8, 16, 0, 1 << 16})->Args({8, 16, 0, 16 << 20})
+    ->Args({16, 32, 0, 1 << 16})->Args({16, 32, 1, 16 << 20})
+    ->Args({3, 8, 0, 1 << 16});
+
+
+static void BM_SampleUnpackerPool(benchmark::State& state)
+{
+    Unpack_Layout layout = make_unpack_layout(static_cast<unsigned int>(state.range(0)), static_cast<unsigned int>(state.range(1)),
+            "TC", true, false);
+    SampleUnpacker unpacker;
+    if (!unpacker.compile(layout))
+        {
+            state.SkipWithError(unpacker.error().c_str());
+            return;
+        }
+    std::vector<uint8_t> data = random_bytes(static_cast<size_t>(state.range(2)));
+    std::vector<std::complex<float> > samples(unpacker.samples(data.size()));
+    for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(unpacker.unpack(data.data(), data.size(), samples.data(), pool()));
+            benchmark::ClobberMemory();
+        }
+    state.SetBytesProcessed(state.iterations() * data.size());
+    state.SetLabel(unpacker.kernel_name());
+}
+BENCHMARK(BM_SampleUnpackerPool)->Args({2, 4, 64 << 20})->Args({8, 16, 64 << 20})->Unit(benchmark::kMillisecond)->UseRealTime();
+
+
+// Arguments: bits per value, buffer size [bytes]
+template <typename T>
+static void BM_UnpackBits(benchmark::State& state)
+{
+    Packed_Format format;
+    format.bits = static_cast<unsigned int>(state.range(0));
+    format.offset_binary = false;
+    format.msb_first = false;
+    std::vector<uint8_t> data = random_bytes(static_cast<size_t>(state.range(1)));
+    std::vector<T> values(data.size() * 8 / format.bits);
+    for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(unpack_bits(data.data(), data.size(), format, values.data()));
+            benchmark::ClobberMemory();
+        }
+    state.SetBytesProcessed(state.iterations() * data.size());
+    state.SetLabel(bit_unpacker_isa());
+}
+BENCHMARK_TEMPLATE(BM_UnpackBits, int8_t)->ArgsProduct({{1, 2, 4, 8}, {1 << 16, 16 << 20}});
+BENCHMARK_TEMPLATE(BM_UnpackBits, int16_t)->ArgsProduct({{1, 2, 4, 8}, {1 << 16, 16 << 20}});
+BENCHMARK_TEMPLATE(BM_UnpackBits, std::complex<float>)->ArgsProduct({{1, 2, 4, 8}, {1 << 16, 16 << 20}});
+
+
+static void BM_UnpackBitsReference(benchmark::State& state)
+{
+    Packed_Format format;
+    format.bits = static_cast<unsigned int>(state.range(0));
+    format.offset_binary = false;
+    format.msb_first = false;
+    std::vector<uint8_t> data = random_bytes(static_cast<size_t>(state.range(1)));
+    std::vector<int8_t> values(data.size() * 8 / format.bits);
+    for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(unpack_bits_reference(data.data(), data.size(), format, values.data()));
+            benchmark::ClobberMemory();
+        }
+    state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_UnpackBitsReference)->ArgsProduct({{1, 2, 4, 8}, {1 << 16}});
+
+
+int main(int argc, char** argv)
+{
+    // JSON results by default, so that every run can be compared with tools/compare.py
+    std::vector<char*> args(argv, argv + argc);
+    bool json_out = false;
+    for (int a = 1; a < argc; a++)
+        {
+            json_out = json_out || std::strncmp(argv[a], "--benchmark_out=", 16) == 0;
+        }
+    std::string out_flag = std::string("--benchmark_out=") + BENCH_JSON;
+    std::string format_flag = "--benchmark_out_format=json";
+    if (!json_out)
+        {
+            args.push_back(&out_flag[0]);
+            args.push_back(&format_flag[0]);
+        }
+    int count = static_cast<int>(args.size());
+    args.push_back(0);
+    char** arguments = args.data();
+
+    // Benchmark flags first; the rest are the flags of the programs (--psd_fft_size, ...)
+    benchmark::Initialize(&count, arguments);
+    google::ParseCommandLineFlags(&count, &arguments, true);
+
+    boost::filesystem::create_directories(work_dir());
+    benchmark::RunSpecifiedBenchmarks();
+    boost::system::error_code ec;
+    boost::filesystem::remove_all(work_dir(), ec);
+    google::ShutDownCommandLineFlags();
+    return 0;
+}
@@ -0,0 +1,144 @@
+/*!
+* \file analysis_pipeline.cc
+* \brief Single pass over a recording feeding every analyzer from one read.
+*
+* -------------------------------------------------------------------------
+*
+*/
+
+#include "analysis_pipeline.h"
+#include <algorithm>
+#include <atomic>
+#include "stage_timer.h"
+#include "work_stealing_pool.h"
+
+namespace
+{
+//! Bytes of recording walked by each task; a run is one continuous stream for the stages
+const size_t PIPELINE_TASK_BYTES = 8 * 1024 * 1024;
+//! Samples decoded at a time for the stages
+const size_t PIPELINE_SLICE_SAMPLES = 32768;
+}
+
+
+AnalysisPipeline::AnalysisPipeline(const BdsFileReader& recording, const SampleUnpacker& unpacker, WorkStealingPool& pool)
+    : recording_(recording), unpacker_(unpacker), pool_(pool), bytes_read_(0)
+{
+}
+
+
+bool AnalysisPipeline::run()
+{
+    StageTimer timer(STAGE_ANALYSIS);
+    bytes_read_ = 0;
+    if (!recording_.is_open())
+        {
+            return false;
+        }
+
+    for (size_t s = 0; s < stages_.size(); s++)
+        {
+            stages_[s]->start(recording_, unpacker_, pool_.workers());
+        }
+
+    // The pass stops where the most demanding stage does
+    size_t needed = 0;
+    bool whole = false;
+    size_t history = 0;
+    size_t lookahead = 0;
+    for (size_t s = 0; s < stages_.size(); s++)
+        {
+            size_t wanted = stages_[s]->wanted_bytes();
+            whole = whole || wanted == 0;
+            needed = std::max(needed, wanted);
+            history = std::max(history, stages_[s]->history_samples());
+            lookahead = std::max(lookahead, stages_[s]->lookahead_samples());
+        }
+    if (whole || needed > recording_.size())
+        {
+            needed = recording_.size();
+        }
+
+    // Units are decoded in slices; a unit belongs to the window it starts in
+    size_t unit_bytes = unpacker_.unit_bytes();
+    size_t unit_samples = unpacker_.samples(unit_bytes);
+    size_t units = recording_.size() / unit_bytes;
+    size_t samples = units * unit_samples;
+    size_t slice_units = std::max<size_t>(1, PIPELINE_SLICE_SAMPLES / unit_samples);
+    std::vector<std::vector<std::complex<float> > > buffers(pool_.workers(),
+            std::vector<std::complex<float> >(history + slice_units * unit_samples + lookahead));
+
+    size_t windows_per_task = std::max<size_t>(1, PIPELINE_TASK_BYTES / recording_.window_bytes());
+    size_t windows = std::min(recording_.windows(), needed / recording_.window_bytes() + 2);
+    size_t tasks = (windows + windows_per_task - 1) / windows_per_task;
+    std::atomic<size_t> bytes_read(0);
+    const BdsFileReader& recording = recording_;
+    const SampleUnpacker& unpacker = unpacker_;
+    const std::vector<PipelineStage*>& stages = stages_;
+    pool_.parallel_for(tasks, [&](size_t task, unsigned int worker)
+            {
+                std::complex<float>* buffer = &buffers[worker][0];
+                bool run_start = true;
+                size_t first = task * windows_per_task;
+                size_t last = std::min(first + windows_per_task, windows);
+                for (size_t index = first; index < last; index++)
+                    {
+                        Bds_Window window = recording.window(index);
+                        if (window.offset >= needed)
+                            {
+                                break;
+                            }
+                        size_t end = std::min(window.offset + window.bytes, needed);
+                        bytes_read += end - window.offset;
+
+                        size_t unit = (window.offset + unit_bytes - 1) / unit_bytes;
+                        size_t end_unit = std::min((end + unit_bytes - 1) / unit_bytes, units);
+                        for (; unit < end_unit; unit += slice_units)
+                            {
+                                Bds_Window part;
+                                part.offset = unit * unit_bytes;
+                                part.data = recording.data() + part.offset;
+                                part.bytes = std::min(slice_units, end_unit - unit) * unit_bytes;
+
+                                // The slice, with the margins of the stages around it
+                                Decoded_Samples decoded;
+                                decoded.first = unit * unit_samples;
+                                decoded.count = unpacker.samples(part.bytes);
+                                size_t before = std::min(history, decoded.first);
+                                decoded.following = std::min(lookahead, samples - decoded.first - decoded.count);
+                                std::fill(buffer, buffer + history - before, std::complex<float>(0.0f, 0.0f));
+                                unpacker.unpack_samples(recording.data(), units * unit_bytes, decoded.first - before,
+                                        before + decoded.count + decoded.following, buffer + history - before);
+                                decoded.samples = buffer + history;
+
+                                // All the stages see the slice while it is in the cache of this worker
+                                for (size_t s = 0; s < stages.size(); s++)
+                                    {
+                                        size_t wanted = stages[s]->wanted_bytes();
+                                        if (wanted > 0 && part.offset >= wanted)
+                                            {
+                                                continue;
+                                            }
+                                        Bds_Window stage_part = part;
+                                        Decoded_Samples stage_samples = decoded;
+                                        if (wanted > 0)
+                                            {
+                                                stage_part.bytes = std::min(part.bytes, wanted - part.offset);
+                                                stage_samples.count = std::min(decoded.count, unpacker.samples(stage_part.bytes));
+                                                stage_samples.following += decoded.count - stage_samples.count;
+                                            }
+                                        stages[s]->process(stage_part, stage_samples, run_start, worker);
+                                    }
+                                run_start = false;
+                            }
+                        recording.release(index);
+                    }
+            });
+    bytes_read_ = bytes_read;
+
+    for (size_t s = 0; s < stages_.size(); s++)
+        {
+            stages_[s]->finish();
+        }
+    return true;
+}
@@ -0,0 +1,101 @@
+/*!
+* \file analysis_pipeline.h
+* \brief Single pass over a recording feeding every analyzer from one read.
+*
+* Each estimator (spectrum, sample rate, resolution, format, RF channels)
+* used to walk the whole recording on its own, so a capture was read from
+* disk once per quantity. The pipeline walks the windows of the recording
+* once: runs of consecutive windows are shared among the workers of the
+* pool and every window, while it is in the cache of the worker that read
+* it, is handed to all the stages before it is released. A stage keeps one
+* partial result per worker and merges them at the end of the pass.
+*
+* The samples are decoded once for all the stages, with the SampleUnpacker
+* of the layout found for the recording, a slice of a window at a time so
+* that the floats stay in the cache too.
+*
+* -------------------------------------------------------------------------
+*
+*/
+
+#ifndef GNSS_SDR_ANALYSIS_PIPELINE_H_
+#define GNSS_SDR_ANALYSIS_PIPELINE_H_
+
+#include <complex>
+#include <cstddef>
+#include <vector>
+#include "bds_file_reader.h"
+#include "sample_unpacker.h"
+
+class WorkStealingPool;
+
+/*!
+* \brief Decoded samples of a part of the recording. The history_samples() before
+* samples[0] can be read as well (zeros before the recording), and so can the
+* following samples after the count ones (up to lookahead_samples(), fewer at the
+* end of the recording).
+*/
+struct Decoded_Samples
+{
+    const std::complex<float>* samples;
+    size_t count;
+    size_t first;          //!< Index of samples[0] in the recording
+    size_t following;
+};
+
+/*!
+* \brief One analyzer of the pipeline. process() is called concurrently by the
+* workers, each with its own index; start() and finish() from the calling thread.
+*/
+class PipelineStage
+{
+public:
+    virtual ~PipelineStage() {}
+
+    //! Before the pass; the sizes below are read after it
+    virtual void start(const BdsFileReader& recording, const SampleUnpacker& unpacker, unsigned int workers) = 0;
+
+    //! Sample bytes from the start of the recording the stage needs (0: all of them)
+    virtual size_t wanted_bytes() const { return 0; }
+    //! Samples before each part the stage reads
+    virtual size_t history_samples() const { return 0; }
+    //! Samples after each part the stage reads
+    virtual size_t lookahead_samples() const { return 0; }
+
+    /*!
+    * \brief One part of a window, cut to wanted_bytes(): its bytes and its samples.
+    * run_start is false when the part follows the previous one given to the same worker.
+    */
+    virtual void process(const Bds_Window& part, const Decoded_Samples& decoded, bool run_start, unsigned int worker) = 0;
+
+    //! After the pass: merges the results of the workers
+    virtual void finish() = 0;
+};
+
+class AnalysisPipeline
+{
+public:
+    //! The samples of the recording are decoded by unpacker
+    AnalysisPipeline(const BdsFileReader& recording, const SampleUnpacker& unpacker, WorkStealingPool& pool);
+
+    //! Adds a stage, owned by the caller
+    void add(PipelineStage& stage) { stages_.push_back(&stage); }
+
+    /*!
+    * \brief Reads the recording once, up to the largest wanted_bytes() of the stages.
+    * Returns false if the recording is not open.
+    */
+    bool run();
+
+    //! Sample bytes read by the last run()
+    size_t bytes_read() const { return bytes_read_; }
+
+private:
+    const BdsFileReader& recording_;
+    const SampleUnpacker& unpacker_;
+    WorkStealingPool& pool_;
+    std::vector<PipelineStage*> stages_;
+    size_t bytes_read_;
+};
+
+#endif
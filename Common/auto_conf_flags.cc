@@ -0,0 +1,118 @@
+/*!
+* \file auto_conf_flags.cc
+* \brief Command line flags shared by the auto-configuration programs.
+*
+* -------------------------------------------------------------------------
+*
+*/
+
+#include "auto_conf_flags.h"
+#include <cstdint>
+#include <iostream>
+
+namespace
+{
+// Sizes of the analyzers: a null or negative one would loop forever or divide by zero
+bool ValidateFftSize(const char* flagname, int32_t value)
+{
+    if (value >= 2)
+        {
+            return true;
+        }
+    std::cout << "Invalid value for flag -" << flagname << ": " << value << ". Allowed values: 2 or more." << std::endl;
+    return false;
+}
+
+bool ValidateChannels(const char* flagname, int32_t value)
+{
+    if (value >= 2 && (value & (value - 1)) == 0)
+        {
+            return true;
+        }
+    std::cout << "Invalid value for flag -" << flagname << ": " << value << ". Allowed values: a power of two, 2 or more." << std::endl;
+    return false;
+}
+
+bool ValidatePositive(const char* flagname, int32_t value)
+{
+    if (value > 0)
+        {
+            return true;
+        }
+    std::cout << "Invalid value for flag -" << flagname << ": " << value << ". Allowed values: 1 or more." << std::endl;
+    return false;
+}
+}
+
+DEFINE_double(elevation_mask, 5.0, "Elevation mask [deg] above which a satellite is considered visible");
+
+DEFINE_double(visibility_tow, -1.0, "GPS time of week [s] at which satellite visibility is evaluated (negative: current time)");
+
+DEFINE_double(sweep_step_deg, 1.0, "Latitude and longitude step of the position sweep [deg]");
+
+DEFINE_int32(sweep_height_step, 100, "Height step of the position sweep [m]");
+
+DEFINE_int32(sweep_threads, 0, "Worker threads of the position sweep (0: one per hardware thread)");
+
+DEFINE_bool(sweep_adaptive, false, "Refine the position sweep only where the visible constellation changes");
+
+DEFINE_int32(sweep_coarse_cells, 64, "Grid points per side of the coarse cells of the adaptive sweep");
+
+DEFINE_double(position_tolerance, 100.0, "Distance [m] within which a recorded position matches the requested one");
+
+DEFINE_string(recording_file, "", "Recording whose spectrum is analyzed, in the sample layout found by the format classifier");
+
+DEFINE_double(sample_rate, 4.0e6, "Complex sample rate of the recording [Hz]");
+
+DEFINE_double(rf_center_frequency, 1575.42e6, "RF frequency of the DC bin of the recording [Hz]");
+
+DEFINE_int32(psd_fft_size, 4096, "Segment length of the Welch power spectral density");
+const bool psd_fft_size_dummy = google::RegisterFlagValidator(&FLAGS_psd_fft_size, &ValidateFftSize);
+
+DEFINE_int32(recording_header_bytes, 0, "Bytes before the first sample of the recording");
+
+DEFINE_int32(bds_window_kb, 0, "Window of the recording handed to the analyzers [KiB] (0: size of the L2 cache)");
+
+DEFINE_bool(bds_huge_pages, false, "Back the mapping of the recording with transparent huge pages");
+
+DEFINE_int32(sample_rate_window, 8388608, "Samples of the recording analyzed to detect the sample rate");
+
+DEFINE_int32(bit_depth_window_mb, 0, "Megabytes of the recording analyzed for the sample resolution (0: all of it)");
+
+DEFINE_int32(channelizer_channels, 64, "Sub-bands of the polyphase channelizer (a power of two)");
+const bool channelizer_channels_dummy = google::RegisterFlagValidator(&FLAGS_channelizer_channels, &ValidateChannels);
+
+DEFINE_int32(channelizer_taps, 12, "Taps of each polyphase branch of the channelizer");
+const bool channelizer_taps_dummy = google::RegisterFlagValidator(&FLAGS_channelizer_taps, &ValidatePositive);
+
+DEFINE_double(channelizer_threshold_db, 3.0, "Power over the noise floor [dB] of the sub-bands holding an RF channel");
+
+DEFINE_bool(metadata_reparse, false, "Load every metadata file back after writing it (debugging)");
+
+DEFINE_bool(metadata_cache, true, "Write next to every metadata file its binary image (<xml>.cache), mapped by the tools reading it");
+
+DEFINE_bool(stage_report, true, "Print the timing of the receiver runs, analysis and metadata files at exit");
+
+DEFINE_string(synthetic_satellites, "1:1200:0:45,7:-2300:311.5:42,13:400:720.25:48,24:3100:95:40", "Satellites of the synthetic recording: PRN:Doppler [Hz]:code phase [chips]:C/N0 [dB-Hz], separated by commas");
+
+DEFINE_double(synthetic_seconds, 1.0, "Duration of the synthetic recording [s]");
+
+DEFINE_double(synthetic_if, 0.0, "Intermediate frequency of the synthetic recording [Hz]");
+
+DEFINE_int32(synthetic_quantization, 8, "Bits of each I, Q or real value of the synthetic recording (1 to 16)");
+
+DEFINE_int32(synthetic_packed_bits, 16, "Bits of each sample of the synthetic recording, I and Q together");
+
+DEFINE_string(synthetic_encoding, "TC", "Encoding of the synthetic recording: TC (two's complement) or OB (offset binary)");
+
+DEFINE_bool(synthetic_iq, true, "Complex (I/Q) synthetic recording rather than real samples");
+
+DEFINE_bool(synthetic_big_endian, false, "Big endian chunk words in the synthetic recording (first sample in the high bits)");
+
+DEFINE_double(synthetic_noise_lsb, 0.0, "Noise standard deviation of the synthetic recording [quantization steps] (0: suited to the quantization)");
+
+DEFINE_bool(synthetic_navigation_data, true, "Modulate pseudo random 50 bit/s data on the synthetic signals");
+
+DEFINE_int32(synthetic_seed, 1, "Seed of the noise and data of the synthetic recording");
+
+DEFINE_string(synthetic_prefix, "synthetic", "Prefix of the synthetic recording <prefix>1.bds and its metadata <prefix>1.xml");
@@ -0,0 +1,53 @@
+/*!
+* \file auto_conf_flags.h
+* \brief Command line flags shared by the auto-configuration programs.
+*
+* Every program of the auto-configuration suite links auto_conf_flags.cc,
+* so the same flag names are accepted by all of them.
+*
+* -------------------------------------------------------------------------
+*
+*/
+
+#ifndef GNSS_SDR_AUTO_CONF_FLAGS_H_
+#define GNSS_SDR_AUTO_CONF_FLAGS_H_
+
+#include <gflags/gflags.h>
+
+DECLARE_double(elevation_mask);
+DECLARE_double(visibility_tow);
+DECLARE_double(sweep_step_deg);
+DECLARE_int32(sweep_height_step);
+DECLARE_int32(sweep_threads);
+DECLARE_bool(sweep_adaptive);
+DECLARE_int32(sweep_coarse_cells);
+DECLARE_double(position_tolerance);
+DECLARE_string(recording_file);
+DECLARE_double(sample_rate);
+DECLARE_double(rf_center_frequency);
+DECLARE_int32(psd_fft_size);
+DECLARE_int32(recording_header_bytes);
+DECLARE_int32(bds_window_kb);
+DECLARE_bool(bds_huge_pages);
+DECLARE_int32(sample_rate_window);
+DECLARE_int32(bit_depth_window_mb);
+DECLARE_int32(channelizer_channels);
+DECLARE_int32(channelizer_taps);
+DECLARE_double(channelizer_threshold_db);
+DECLARE_bool(metadata_reparse);
+DECLARE_bool(metadata_cache);
+DECLARE_bool(stage_report);
+DECLARE_string(synthetic_satellites);
+DECLARE_double(synthetic_seconds);
+DECLARE_double(synthetic_if);
+DECLARE_int32(synthetic_quantization);
+DECLARE_int32(synthetic_packed_bits);
+DECLARE_string(synthetic_encoding);
+DECLARE_bool(synthetic_iq);
+DECLARE_bool(synthetic_big_endian);
+DECLARE_double(synthetic_noise_lsb);
+DECLARE_bool(synthetic_navigation_data);
+DECLARE_int32(synthetic_seed);
+DECLARE_string(synthetic_prefix);
+
+#endif
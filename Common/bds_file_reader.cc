@@ -0,0 +1,164 @@
+/*!
+* \file bds_file_reader.cc
+* \brief Memory-mapped, window by window access to a .bds sample recording.
+*
+* -------------------------------------------------------------------------
+*
+*/
+
+#include "bds_file_reader.h"
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <glog/logging.h>
+
+namespace
+{
+const size_t BDS_DEFAULT_WINDOW = 1024 * 1024;   //!< Used when the L2 size is unknown
+const size_t BDS_HUGE_PAGE = 2 * 1024 * 1024;
+}
+
+
+BdsFileReader::BdsFileReader(size_t window_bytes, bool huge_pages)
+    : mapping_(0), file_bytes_(0), header_bytes_(0), huge_pages_(huge_pages), cursor_(0)
+{
+    if (window_bytes == 0)
+        {
+            long l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+            window_bytes = l2 > 0 ? static_cast<size_t>(l2) : BDS_DEFAULT_WINDOW;
+        }
+
+    // Windows span whole pages (whole huge pages if requested), so every
+    // window holds a whole number of samples of any size dividing the page
+    page_bytes_ = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t page = huge_pages_ ? BDS_HUGE_PAGE : page_bytes_;
+    window_bytes_ = (window_bytes + page - 1) / page * page;
+}
+
+
+BdsFileReader::~BdsFileReader()
+{
+    close();
+}
+
+
+bool BdsFileReader::open(const std::string& filename, size_t header_bytes)
+{
+    close();
+    filename_ = filename;
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        {
+            return false;
+        }
+    struct stat status;
+    if (fstat(fd, &status) != 0 || static_cast<size_t>(status.st_size) <= header_bytes)
+        {
+            ::close(fd);
+            return false;
+        }
+    void* mapping = mmap(0, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED)
+        {
+            return false;
+        }
+
+    mapping_ = static_cast<const uint8_t*>(mapping);
+    file_bytes_ = status.st_size;
+    header_bytes_ = header_bytes;
+    cursor_ = 0;
+    madvise(mapping, file_bytes_, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+    if (huge_pages_ && madvise(mapping, file_bytes_, MADV_HUGEPAGE) != 0)
+        {
+            LOG(INFO) << "No transparent huge pages for " << filename;
+        }
+#endif
+    return true;
+}
+
+
+void BdsFileReader::close()
+{
+    if (mapping_)
+        {
+            munmap(const_cast<uint8_t*>(mapping_), file_bytes_);
+            mapping_ = 0;
+        }
+    file_bytes_ = 0;
+    header_bytes_ = 0;
+}
+
+
+size_t BdsFileReader::windows() const
+{
+    if (!mapping_)
+        {
+            return 0;
+        }
+    return (size() + window_bytes_ - 1) / window_bytes_;
+}
+
+
+Bds_Window BdsFileReader::window(size_t index) const
+{
+    // Windows are counted from the first sample, not from the start of the
+    // file, so each one starts on a sample whatever the size of the header
+    size_t begin = header_bytes_ + index * window_bytes_;
+    size_t end = std::min(begin + window_bytes_, file_bytes_);
+    Bds_Window result;
+    result.data = mapping_ + begin;
+    result.bytes = end - begin;
+    result.offset = begin - header_bytes_;
+    if (index + 1 < windows())
+        {
+            advise(index + 1, MADV_WILLNEED);
+        }
+    return result;
+}
+
+
+void BdsFileReader::release(size_t index) const
+{
+    advise(index, MADV_DONTNEED);
+}
+
+
+bool BdsFileReader::next(Bds_Window& result)
+{
+    if (cursor_ >= windows())
+        {
+            return false;
+        }
+    if (cursor_ > 0)
+        {
+            release(cursor_ - 1);
+        }
+    result = window(cursor_++);
+    return true;
+}
+
+
+void BdsFileReader::advise(size_t index, int advice) const
+{
+    // madvise() takes whole pages: prefetching may cover the neighbouring
+    // windows, but only the pages lying entirely in the window are dropped
+    size_t begin = header_bytes_ + index * window_bytes_;
+    size_t end = std::min(begin + window_bytes_, file_bytes_);
+    if (advice == MADV_DONTNEED)
+        {
+            begin = (begin + page_bytes_ - 1) / page_bytes_ * page_bytes_;
+            end = end == file_bytes_ ? end : end / page_bytes_ * page_bytes_;
+        }
+    else
+        {
+            begin = begin / page_bytes_ * page_bytes_;
+        }
+    if (begin < end)
+        {
+            madvise(const_cast<uint8_t*>(mapping_) + begin, end - begin, advice);
+        }
+}
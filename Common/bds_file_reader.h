@@ -0,0 +1,94 @@
+/*!
+* \file bds_file_reader.h
+* \brief Memory-mapped, window by window access to a .bds sample recording.
+*
+* The whole recording is mapped read-only and handed out in windows of
+* about the size of the L2 cache, a whole number of pages long and counted
+* from the first sample, so that a file header of any length never splits
+* a sample between two windows. Analyzers
+* read the samples in place, without copies. The mapping is advised as
+* sequential; window() asks the kernel to prefetch the following window and
+* release() drops the pages of a window already consumed, so the resident
+* memory stays bounded whatever the size of the capture. Optionally the
+* mapping is backed by transparent huge pages.
+*
+* -------------------------------------------------------------------------
+*
+*/
+
+#ifndef GNSS_SDR_BDS_FILE_READER_H_
+#define GNSS_SDR_BDS_FILE_READER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+struct Bds_Window
+{
+    const uint8_t* data;
+    size_t bytes;
+    size_t offset;     //!< Offset of data from the first sample of the recording [bytes]
+};
+
+class BdsFileReader
+{
+public:
+    /*!
+    * \param window_bytes Window size, rounded up to whole pages (0: size of the L2 cache)
+    * \param huge_pages Ask for transparent huge pages on the mapping
+    */
+    explicit BdsFileReader(size_t window_bytes = 0, bool huge_pages = false);
+    ~BdsFileReader();
+
+    /*!
+    * \brief Maps a recording whose samples start header_bytes into the file.
+    * Returns false if the file cannot be opened or mapped.
+    */
+    bool open(const std::string& filename, size_t header_bytes = 0);
+    void close();
+
+    bool is_open() const { return mapping_ != 0; }
+    const std::string& filename() const { return filename_; }
+
+    //! Sample bytes of the recording, header excluded
+    size_t size() const { return file_bytes_ - header_bytes_; }
+    //! First sample byte; the whole recording is addressable
+    const uint8_t* data() const { return mapping_ + header_bytes_; }
+
+    size_t window_bytes() const { return window_bytes_; }
+    size_t windows() const;
+
+    /*!
+    * \brief Window number index, prefetching the next one. Safe to call from several threads.
+    */
+    Bds_Window window(size_t index) const;
+
+    /*!
+    * \brief Drops the pages of a window that is not needed anymore.
+    */
+    void release(size_t index) const;
+
+    /*!
+    * \brief Sequential walk: releases the previous window and returns the next one.
+    * Returns false at the end of the recording.
+    */
+    bool next(Bds_Window& window);
+    void rewind() { cursor_ = 0; }
+
+private:
+    BdsFileReader(const BdsFileReader&);
+    BdsFileReader& operator=(const BdsFileReader&);
+
+    void advise(size_t index, int advice) const;
+
+    std::string filename_;
+    const uint8_t* mapping_;
+    size_t file_bytes_;
+    size_t header_bytes_;
+    size_t window_bytes_;
+    size_t page_bytes_;     //!< Granularity of madvise()
+    bool huge_pages_;
+    size_t cursor_;
+};
+
+#endif
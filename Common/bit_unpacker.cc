@@ -0,0 +1,474 @@
+/*!
+* \file bit_unpacker.cc
+* \brief Vectorized unpacking of 1, 2, 4 and 8 bit packed samples.
+*
+* -------------------------------------------------------------------------
+*
+*/
+
+#include "bit_unpacker.h"
+#include <algorithm>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// AVX2 code is built whatever the compiler flags and only called if the processor has it
+#if defined(__SSE2__) && defined(__GNUC__)
+#define BIT_UNPACKER_AVX2
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+
+namespace
+{
+//! Values unpacked to int8 at a time before being widened to int16 or float
+const size_t UNPACK_BATCH_VALUES = 4096;
+
+typedef void (*Expand_Function)(const uint8_t* in, size_t bytes, const Packed_Format& format, int8_t* out);
+typedef void (*Widen_Function)(const int8_t* in, size_t values, int16_t* out);
+typedef void (*Float_Function)(const int8_t* in, size_t values, float* out);
+
+struct Unpack_Functions
+{
+    Expand_Function expand[4];     //!< 1, 2, 4 and 8 bits
+    Widen_Function widen;
+    Float_Function to_float;
+    const char* isa;
+};
+
+int width_index(unsigned int bits)
+{
+    switch (bits)
+        {
+        case 1: return 0;
+        case 2: return 1;
+        case 4: return 2;
+        case 8: return 3;
+        default: return -1;
+        }
+}
+
+void expand_generic(const uint8_t* in, size_t bytes, const Packed_Format& format, int8_t* out)
+{
+    unsigned int per_byte = 8 / format.bits;
+    unsigned int mask = (1u << format.bits) - 1;
+    int half = 1 << (format.bits - 1);
+    for (size_t i = 0; i < bytes; i++)
+        {
+            for (unsigned int k = 0; k < per_byte; k++)
+                {
+                    unsigned int shift = format.msb_first ? 8 - format.bits * (k + 1) : format.bits * k;
+                    int raw = (in[i] >> shift) & mask;
+                    *out++ = static_cast<int8_t>(format.offset_binary ? raw - half : (raw ^ half) - half);
+                }
+        }
+}
+
+void widen_generic(const int8_t* in, size_t values, int16_t* out)
+{
+    for (size_t i = 0; i < values; i++)
+        {
+            out[i] = in[i];
+        }
+}
+
+void to_float_generic(const int8_t* in, size_t values, float* out)
+{
+    for (size_t i = 0; i < values; i++)
+        {
+            out[i] = static_cast<float>(in[i]) + 0.5f;
+        }
+}
+
+#if defined(__SSE2__)
+/*
+* The values of each position in the bytes are isolated in one vector
+* each (v[k]), decoded, then interleaved back into output order: the
+* values of the 16 input bytes end up in r[0] .. r[K-1].
+*/
+template <unsigned int K>
+void interleave_sse2(const __m128i* v, __m128i* r)
+{
+    if (K == 1)
+        {
+            r[0] = v[0];
+        }
+    else if (K == 2)
+        {
+            r[0] = _mm_unpacklo_epi8(v[0], v[1]);
+            r[1] = _mm_unpackhi_epi8(v[0], v[1]);
+        }
+    else if (K == 4)
+        {
+            __m128i a0 = _mm_unpacklo_epi8(v[0], v[1]);
+            __m128i a1 = _mm_unpackhi_epi8(v[0], v[1]);
+            __m128i a2 = _mm_unpacklo_epi8(v[2], v[3]);
+            __m128i a3 = _mm_unpackhi_epi8(v[2], v[3]);
+            r[0] = _mm_unpacklo_epi16(a0, a2);
+            r[1] = _mm_unpackhi_epi16(a0, a2);
+            r[2] = _mm_unpacklo_epi16(a1, a3);
+            r[3] = _mm_unpackhi_epi16(a1, a3);
+        }
+    else
+        {
+            __m128i p[4][2];
+            for (unsigned int j = 0; j < 4; j++)
+                {
+                    p[j][0] = _mm_unpacklo_epi8(v[2 * j], v[2 * j + 1]);
+                    p[j][1] = _mm_unpackhi_epi8(v[2 * j], v[2 * j + 1]);
+                }
+            for (unsigned int h = 0; h < 2; h++)
+                {
+                    __m128i low[2] = { _mm_unpacklo_epi16(p[0][h], p[1][h]), _mm_unpackhi_epi16(p[0][h], p[1][h]) };
+                    __m128i high[2] = { _mm_unpacklo_epi16(p[2][h], p[3][h]), _mm_unpackhi_epi16(p[2][h], p[3][h]) };
+                    for (unsigned int g = 0; g < 2; g++)
+                        {
+                            r[4 * h + 2 * g] = _mm_unpacklo_epi32(low[g], high[g]);
+                            r[4 * h + 2 * g + 1] = _mm_unpackhi_epi32(low[g], high[g]);
+                        }
+                }
+        }
+}
+
+template <unsigned int Bits>
+void expand_sse2(const uint8_t* in, size_t bytes, const Packed_Format& format, int8_t* out)
+{
+    const unsigned int K = 8 / Bits;
+    const __m128i mask = _mm_set1_epi8(static_cast<char>((1 << Bits) - 1));
+    const __m128i half = _mm_set1_epi8(static_cast<char>(1 << (Bits - 1)));
+    size_t i = 0;
+    for (; i + 16 <= bytes; i += 16)
+        {
+            __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+            __m128i v[K];
+            for (unsigned int k = 0; k < K; k++)
+                {
+                    int shift = format.msb_first ? 8 - Bits * (k + 1) : Bits * k;
+                    // 16 bit shifts: the bits coming from the next byte are masked out
+                    __m128i raw = _mm_and_si128(_mm_srl_epi16(x, _mm_cvtsi32_si128(shift)), mask);
+                    v[k] = format.offset_binary ? _mm_sub_epi8(raw, half) : _mm_sub_epi8(_mm_xor_si128(raw, half), half);
+                }
+            __m128i r[K];
+            interleave_sse2<K>(v, r);
+            for (unsigned int k = 0; k < K; k++)
+                {
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 16 * k), r[k]);
+                }
+            out += 16 * K;
+        }
+    expand_generic(in + i, bytes - i, format, out);
+}
+
+void widen_sse2(const int8_t* in, size_t values, int16_t* out)
+{
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= values; i += 16)
+        {
+            __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+            __m128i sign = _mm_cmplt_epi8(x, zero);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_unpacklo_epi8(x, sign));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + 8), _mm_unpackhi_epi8(x, sign));
+        }
+    widen_generic(in + i, values - i, out + i);
+}
+
+void to_float_sse2(const int8_t* in, size_t values, float* out)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 half = _mm_set1_ps(0.5f);
+    size_t i = 0;
+    for (; i + 16 <= values; i += 16)
+        {
+            __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+            __m128i sign = _mm_cmplt_epi8(x, zero);
+            __m128i words[2] = { _mm_unpacklo_epi8(x, sign), _mm_unpackhi_epi8(x, sign) };
+            for (unsigned int w = 0; w < 2; w++)
+                {
+                    __m128i word_sign = _mm_srai_epi16(words[w], 15);
+                    __m128 low = _mm_cvtepi32_ps(_mm_unpacklo_epi16(words[w], word_sign));
+                    __m128 high = _mm_cvtepi32_ps(_mm_unpackhi_epi16(words[w], word_sign));
+                    _mm_storeu_ps(out + i + 8 * w, _mm_add_ps(low, half));
+                    _mm_storeu_ps(out + i + 8 * w + 4, _mm_add_ps(high, half));
+                }
+        }
+    to_float_generic(in + i, values - i, out + i);
+}
+#endif
+
+#if defined(BIT_UNPACKER_AVX2)
+/*
+* As interleave_sse2 on each 128 bit lane; the lanes are put back in
+* order when storing.
+*/
+template <unsigned int K>
+AVX2_TARGET void interleave_avx2(const __m256i* v, __m256i* r)
+{
+    if (K == 1)
+        {
+            r[0] = v[0];
+        }
+    else if (K == 2)
+        {
+            r[0] = _mm256_unpacklo_epi8(v[0], v[1]);
+            r[1] = _mm256_unpackhi_epi8(v[0], v[1]);
+        }
+    else if (K == 4)
+        {
+            __m256i a0 = _mm256_unpacklo_epi8(v[0], v[1]);
+            __m256i a1 = _mm256_unpackhi_epi8(v[0], v[1]);
+            __m256i a2 = _mm256_unpacklo_epi8(v[2], v[3]);
+            __m256i a3 = _mm256_unpackhi_epi8(v[2], v[3]);
+            r[0] = _mm256_unpacklo_epi16(a0, a2);
+            r[1] = _mm256_unpackhi_epi16(a0, a2);
+            r[2] = _mm256_unpacklo_epi16(a1, a3);
+            r[3] = _mm256_unpackhi_epi16(a1, a3);
+        }
+    else
+        {
+            __m256i p[4][2];
+            for (unsigned int j = 0; j < 4; j++)
+                {
+                    p[j][0] = _mm256_unpacklo_epi8(v[2 * j], v[2 * j + 1]);
+                    p[j][1] = _mm256_unpackhi_epi8(v[2 * j], v[2 * j + 1]);
+                }
+            for (unsigned int h = 0; h < 2; h++)
+                {
+                    __m256i low[2] = { _mm256_unpacklo_epi16(p[0][h], p[1][h]), _mm256_unpackhi_epi16(p[0][h], p[1][h]) };
+                    __m256i high[2] = { _mm256_unpacklo_epi16(p[2][h], p[3][h]), _mm256_unpackhi_epi16(p[2][h], p[3][h]) };
+                    for (unsigned int g = 0; g < 2; g++)
+                        {
+                            r[4 * h + 2 * g] = _mm256_unpacklo_epi32(low[g], high[g]);
+                            r[4 * h + 2 * g + 1] = _mm256_unpackhi_epi32(low[g], high[g]);
+                        }
+                }
+        }
+}
+
+template <unsigned int Bits>
+AVX2_TARGET void expand_avx2(const uint8_t* in, size_t bytes, const Packed_Format& format, int8_t* out)
+{
+    const unsigned int K = 8 / Bits;
+    const __m256i mask = _mm256_set1_epi8(static_cast<char>((1 << Bits) - 1));
+    const __m256i half = _mm256_set1_epi8(static_cast<char>(1 << (Bits - 1)));
+    size_t i = 0;
+    for (; i + 32 <= bytes; i += 32)
+        {
+            __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+            __m256i v[K];
+            for (unsigned int k = 0; k < K; k++)
+                {
+                    int shift = format.msb_first ? 8 - Bits * (k + 1) : Bits * k;
+                    __m256i raw = _mm256_and_si256(_mm256_srl_epi16(x, _mm_cvtsi32_si128(shift)), mask);
+                    v[k] = format.offset_binary ? _mm256_sub_epi8(raw, half) : _mm256_sub_epi8(_mm256_xor_si256(raw, half), half);
+                }
+            __m256i r[K];
+            interleave_avx2<K>(v, r);
+            if (K == 1)
+                {
+                    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), r[0]);
+                }
+            else
+                {
+                    // Low lanes hold the values of the first 16 bytes, high lanes those of the next 16
+                    for (unsigned int m = 0; m < K / 2; m++)
+                        {
+                            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 32 * m), _mm256_permute2x128_si256(r[2 * m], r[2 * m + 1], 0x20));
+                            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 16 * K + 32 * m), _mm256_permute2x128_si256(r[2 * m], r[2 * m + 1], 0x31));
+                        }
+                }
+            out += 32 * K;
+        }
+    expand_sse2<Bits>(in + i, bytes - i, format, out);
+}
+
+AVX2_TARGET void widen_avx2(const int8_t* in, size_t values, int16_t* out)
+{
+    size_t i = 0;
+    for (; i + 16 <= values; i += 16)
+        {
+            __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_cvtepi8_epi16(x));
+        }
+    widen_generic(in + i, values - i, out + i);
+}
+
+AVX2_TARGET void to_float_avx2(const int8_t* in, size_t values, float* out)
+{
+    const __m256 half = _mm256_set1_ps(0.5f);
+    size_t i = 0;
+    for (; i + 8 <= values; i += 8)
+        {
+            __m128i x = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(in + i));
+            _mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(x)), half));
+        }
+    to_float_generic(in + i, values - i, out + i);
+}
+#endif
+
+//! Functions of every instruction set usable here, the best last
+std::vector<Unpack_Functions> available_functions()
+{
+    std::vector<Unpack_Functions> available;
+    Unpack_Functions generic = { { &expand_generic, &expand_generic, &expand_generic, &expand_generic },
+        &widen_generic, &to_float_generic, "generic" };
+    available.push_back(generic);
+#if defined(__SSE2__)
+    Unpack_Functions sse2 = { { &expand_sse2<1>, &expand_sse2<2>, &expand_sse2<4>, &expand_sse2<8> },
+        &widen_sse2, &to_float_sse2, "SSE2" };
+    available.push_back(sse2);
+#endif
+#if defined(BIT_UNPACKER_AVX2)
+    if (__builtin_cpu_supports("avx2"))
+        {
+            Unpack_Functions avx2 = { { &expand_avx2<1>, &expand_avx2<2>, &expand_avx2<4>, &expand_avx2<8> },
+                &widen_avx2, &to_float_avx2, "AVX2" };
+            available.push_back(avx2);
+        }
+#endif
+    return available;
+}
+
+const std::vector<Unpack_Functions>& unpack_isas()
+{
+    static const std::vector<Unpack_Functions> available = available_functions();
+    return available;
+}
+
+const Unpack_Functions& unpack_functions()
+{
+    return unpack_isas().back();
+}
+
+const Unpack_Functions* find_functions(const std::string& isa)
+{
+    for (size_t f = 0; f < unpack_isas().size(); f++)
+        {
+            if (isa == unpack_isas()[f].isa)
+                {
+                    return &unpack_isas()[f];
+                }
+        }
+    return 0;
+}
+
+size_t expand_values(const Unpack_Functions& functions, const uint8_t* in, size_t bytes, const Packed_Format& format, int8_t* out)
+{
+    int width = width_index(format.bits);
+    if (width < 0)
+        {
+            return 0;
+        }
+    functions.expand[width](in, bytes, format, out);
+    return bytes * 8 / format.bits;
+}
+
+size_t expand_values(const Unpack_Functions& functions, const uint8_t* in, size_t bytes, const Packed_Format& format, int16_t* out)
+{
+    int width = width_index(format.bits);
+    if (width < 0)
+        {
+            return 0;
+        }
+    int8_t batch[UNPACK_BATCH_VALUES];
+    size_t batch_bytes = UNPACK_BATCH_VALUES * format.bits / 8;
+    for (size_t done = 0; done < bytes; done += batch_bytes)
+        {
+            size_t count = std::min(batch_bytes, bytes - done);
+            functions.expand[width](in + done, count, format, batch);
+            functions.widen(batch, count * 8 / format.bits, out + done * 8 / format.bits);
+        }
+    return bytes * 8 / format.bits;
+}
+
+size_t expand_values(const Unpack_Functions& functions, const uint8_t* in, size_t bytes, const Packed_Format& format, std::complex<float>* out)
+{
+    int width = width_index(format.bits);
+    if (width < 0)
+        {
+            return 0;
+        }
+    size_t values = bytes * 8 / format.bits / 2 * 2;
+    float* output = reinterpret_cast<float*>(out);
+    int8_t batch[UNPACK_BATCH_VALUES];
+    size_t batch_bytes = UNPACK_BATCH_VALUES * format.bits / 8;
+    for (size_t done = 0; done < bytes; done += batch_bytes)
+        {
+            size_t count = std::min(batch_bytes, bytes - done);
+            size_t first = done * 8 / format.bits;
+            functions.expand[width](in + done, count, format, batch);
+            functions.to_float(batch, std::min(count * 8 / format.bits, values - first), output + first);
+        }
+    return values / 2;
+}
+
+template <typename T>
+size_t expand_with(const std::string& isa, const uint8_t* in, size_t bytes, const Packed_Format& format, T* out)
+{
+    const Unpack_Functions* functions = find_functions(isa);
+    return functions ? expand_values(*functions, in, bytes, format, out) : 0;
+}
+}
+
+
+const char* bit_unpacker_isa()
+{
+    return unpack_functions().isa;
+}
+
+
+std::vector<std::string> bit_unpacker_isas()
+{
+    std::vector<std::string> names;
+    for (size_t f = 0; f < unpack_isas().size(); f++)
+        {
+            names.push_back(unpack_isas()[f].isa);
+        }
+    return names;
+}
+
+
+size_t unpack_bits(const uint8_t* in, size_t bytes, const Packed_Format& format, int8_t* out)
+{
+    return expand_values(unpack_functions(), in, bytes, format, out);
+}
+
+
+size_t unpack_bits(const uint8_t* in, size_t bytes, const Packed_Format& format, int16_t* out)
+{
+    return expand_values(unpack_functions(), in, bytes, format, out);
+}
+
+
+size_t unpack_bits(const uint8_t* in, size_t bytes, const Packed_Format& format, std::complex<float>* out)
+{
+    return expand_values(unpack_functions(), in, bytes, format, out);
+}
+
+
+size_t unpack_bits_with(const std::string& isa, const uint8_t* in, size_t bytes, const Packed_Format& format, int8_t* out)
+{
+    return expand_with(isa, in, bytes, format, out);
+}
+
+
+size_t unpack_bits_with(const std::string& isa, const uint8_t* in, size_t bytes, const Packed_Format& format, int16_t* out)
+{
+    return expand_with(isa, in, bytes, format, out);
+}
+
+
+size_t unpack_bits_with(const std::string& isa, const uint8_t* in, size_t bytes, const Packed_Format& format, std::complex<float>* out)
+{
+    return expand_with(isa, in, bytes, format, out);
+}
+
+
+size_t unpack_bits_reference(const uint8_t* in, size_t bytes, const Packed_Format& format, int8_t* out)
+{
+    if (width_index(format.bits) < 0)
+        {
+            return 0;
+        }
+    expand_generic(in, bytes, format, out);
+    return bytes * 8 / format.bits;
+}
@@ -0,0 +1,68 @@
+/*!
+* \file bit_unpacker.h
+* \brief Vectorized unpacking of 1, 2, 4 and 8 bit packed samples.
+*
+* Front-ends pack 2 or 4 bit I/Q samples several to a byte, as described
+* by Stream::Packedbits and Quantization. These functions spread a packed
+* buffer into one int8, int16 or complex float per value with the widest
+* instructions available: AVX2 (picked at run time) or SSE2, and a scalar
+* loop elsewhere and for the tails. The samples of a byte are taken
+* from its low bits first, or from its high bits first with msb_first.
+*
+* Integer outputs hold the signed value of each sample (two's complement,
+* or offset binary minus half the range), e.g. -2 .. 1 for 2 bits and
+* -1 .. 0 for 1 bit. Float outputs hold the symmetric (mid-rise) level,
+* the value plus one half, as the sample format classifier and the sample
+* unpacker read them.
+*
+* -------------------------------------------------------------------------
+*
+*/
+
+#ifndef GNSS_SDR_BIT_UNPACKER_H_
+#define GNSS_SDR_BIT_UNPACKER_H_
+
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct Packed_Format
+{
+    unsigned int bits;      //!< Bits of each value: 1, 2, 4 or 8
+    bool offset_binary;     //!< Offset binary rather than two's complement
+    bool msb_first;         //!< First value of a byte in its high bits
+};
+
+//! Instruction set used by the unpackers: "AVX2", "SSE2" or "generic"
+const char* bit_unpacker_isa();
+
+//! Instruction sets the unpackers can use on this processor, from "generic" to bit_unpacker_isa()
+std::vector<std::string> bit_unpacker_isas();
+
+/*!
+* \brief Unpacks bytes of packed values, bytes * 8 / bits of them. Returns the number of
+* values written, 0 if the width is not supported.
+*/
+size_t unpack_bits(const uint8_t* in, size_t bytes, const Packed_Format& format, int8_t* out);
+size_t unpack_bits(const uint8_t* in, size_t bytes, const Packed_Format& format, int16_t* out);
+
+/*!
+* \brief Unpacks interleaved I/Q values into complex samples. Returns the number of samples
+* written, half the values; a last unpaired value is dropped.
+*/
+size_t unpack_bits(const uint8_t* in, size_t bytes, const Packed_Format& format, std::complex<float>* out);
+
+/*!
+* \brief Same as unpack_bits, with the functions of one of bit_unpacker_isas(), to check
+* or time each of them. Returns 0 for an instruction set not available.
+*/
+size_t unpack_bits_with(const std::string& isa, const uint8_t* in, size_t bytes, const Packed_Format& format, int8_t* out);
+size_t unpack_bits_with(const std::string& isa, const uint8_t* in, size_t bytes, const Packed_Format& format, int16_t* out);
+size_t unpack_bits_with(const std::string& isa, const uint8_t* in, size_t bytes, const Packed_Format& format, std::complex<float>* out);
+
+//! Scalar version of the int8 unpacker, the reference of the vectorized ones
+size_t unpack_bits_reference(const uint8_t* in, size_t bytes, const Packed_Format& format, int8_t* out);
+
+#endif
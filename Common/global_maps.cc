@@ -0,0 +1,32 @@
+/*!
+* \file global_maps.cc
+* \brief Global maps of the navigation data collected from the queues.
+*
+* The only definition of the maps; every program links this file instead
+* of defining them in its main.
+*
+* -------------------------------------------------------------------------
+*
+*/
+
+#include "global_maps.h"
+
+// For GPS NAVIGATION
+global_map<Gps_Ephemeris> global_gps_ephemeris_map;
+global_map<Gps_Iono> global_gps_iono_map;
+global_map<Gps_Utc_Model> global_gps_utc_model_map;
+global_map<Gps_Almanac> global_gps_almanac_map;
+global_map<Gps_Acq_Assist> global_gps_acq_assist_map;
+global_map<Gps_Ref_Time> global_gps_ref_time_map;
+global_map<Gps_Ref_Location> global_gps_ref_location_map;
+
+// For GALILEO NAVIGATION
+global_map<Galileo_Ephemeris> global_galileo_ephemeris_map;
+global_map<Galileo_Iono> global_galileo_iono_map;
+global_map<Galileo_Utc_Model> global_galileo_utc_model_map;
+global_map<Galileo_Almanac> global_galileo_almanac_map;
+
+// For SBAS CORRECTIONS
+global_map<Sbas_Ionosphere_Correction> global_sbas_iono_map;
+global_map<Sbas_Satellite_Correction> global_sbas_sat_corr_map;
+global_map<Sbas_Ephemeris> global_sbas_ephemeris_map;
@@ -0,0 +1,67 @@
+/*!
+* \file global_maps.h
+* \brief Global maps of the navigation data collected from the queues.
+*
+* The maps are defined once, in global_maps.cc, with the type
+* global_map<T>: concurrent_map<T>, or PrnTable<T> (one slot per PRN, read
+* without locks, see prn_table.h) when GLOBAL_MAP_PRN_TABLE is defined
+* when building. The programs read them through this header.
+*
+* The receiver library writes the same globals through its own extern
+* declarations, so with GLOBAL_MAP_PRN_TABLE the library has to be
+* compiled with it too, including this header instead of declaring the
+* maps concurrent_map<T>. Without it, nothing changes for the library.
+*
+* -------------------------------------------------------------------------
+*
+*/
+
+#ifndef GNSS_SDR_GLOBAL_MAPS_H_
+#define GNSS_SDR_GLOBAL_MAPS_H_
+
+#include "concurrent_map.h"
+#include "galileo_almanac.h"
+#include "galileo_ephemeris.h"
+#include "galileo_iono.h"
+#include "galileo_utc_model.h"
+#include "gps_acq_assist.h"
+#include "gps_almanac.h"
+#include "gps_ephemeris.h"
+#include "gps_iono.h"
+#include "gps_ref_location.h"
+#include "gps_ref_time.h"
+#include "gps_utc_model.h"
+#include "prn_table.h"
+#include "sbas_ephemeris.h"
+#include "sbas_ionospheric_correction.h"
+#include "sbas_satellite_correction.h"
+
+#if defined(GLOBAL_MAP_PRN_TABLE)
+template <typename Data>
+using global_map = PrnTable<Data>;
+#else
+template <typename Data>
+using global_map = concurrent_map<Data>;
+#endif
+
+// For GPS NAVIGATION
+extern global_map<Gps_Ephemeris> global_gps_ephemeris_map;
+extern global_map<Gps_Iono> global_gps_iono_map;
+extern global_map<Gps_Utc_Model> global_gps_utc_model_map;
+extern global_map<Gps_Almanac> global_gps_almanac_map;
+extern global_map<Gps_Acq_Assist> global_gps_acq_assist_map;
+extern global_map<Gps_Ref_Time> global_gps_ref_time_map;
+extern global_map<Gps_Ref_Location> global_gps_ref_location_map;
+
+// For GALILEO NAVIGATION
+extern global_map<Galileo_Ephemeris> global_galileo_ephemeris_map;
+extern global_map<Galileo_Iono> global_galileo_iono_map;
+extern global_map<Galileo_Utc_Model> global_galileo_utc_model_map;
+extern global_map<Galileo_Almanac> global_galileo_almanac_map;
+
+// For SBAS CORRECTIONS
+extern global_map<Sbas_Ionosphere_Correction> global_sbas_iono_map;
+extern global_map<Sbas_Satellite_Correction> global_sbas_sat_corr_map;
+extern global_map<Sbas_Ephemeris> global_sbas_ephemeris_map;
+
+#endif
@@ -0,0 +1,33 @@
+/*!
+* \file global_queues.cc
+* \brief Global queues from the Telemetry Decoders to the Observables.
+*
+* The only definition of the queues; every program links this file
+* instead of defining them in its main.
+*
+* -------------------------------------------------------------------------
+*
+*/
+
+#include "global_queues.h"
+
+// For GPS NAVIGATION
+global_queue<Gps_Ephemeris> global_gps_ephemeris_queue;
+global_queue<Gps_Iono> global_gps_iono_queue;
+global_queue<Gps_Utc_Model> global_gps_utc_model_queue;
+global_queue<Gps_Almanac> global_gps_almanac_queue;
+global_queue<Gps_Acq_Assist> global_gps_acq_assist_queue;
+global_queue<Gps_Ref_Location> global_gps_ref_location_queue;
+global_queue<Gps_Ref_Time> global_gps_ref_time_queue;
+
+// For GALILEO NAVIGATION
+global_queue<Galileo_Ephemeris> global_galileo_ephemeris_queue;
+global_queue<Galileo_Iono> global_galileo_iono_queue;
+global_queue<Galileo_Utc_Model> global_galileo_utc_model_queue;
+global_queue<Galileo_Almanac> global_galileo_almanac_queue;
+
+// For SBAS CORRECTIONS
+global_queue<Sbas_Raw_Msg> global_sbas_raw_msg_queue;
+global_queue<Sbas_Ionosphere_Correction> global_sbas_iono_queue;
+global_queue<Sbas_Satellite_Correction> global_sbas_sat_corr_queue;
+global_queue<Sbas_Ephemeris> global_sbas_ephemeris_queue;
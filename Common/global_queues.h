@@ -0,0 +1,81 @@
+/*!
+* \file global_queues.h
+* \brief Global queues from the Telemetry Decoders to the Observables.
+*
+* The queues are defined once, in global_queues.cc, with the type
+* global_queue<T>. It is concurrent_queue<T> unless one of these is
+* defined when building:
+*
+* - GLOBAL_QUEUE_MPMC: MpmcQueue<T>, lock-free, any number of channels
+*   pushing and threads popping.
+* - GLOBAL_QUEUE_SPSC: SpscQueue<T>, lock-free, only for receivers where a
+*   single channel pushes into each queue and a single collector pops.
+*
+* The telemetry decoders of the receiver library access the same globals
+* through their own extern declarations, so with either definition the
+* library has to be compiled with it too, including this header instead
+* of declaring the queues concurrent_queue<T> (e.g. -DGLOBAL_QUEUE_MPMC on
+* the whole build). With neither, nothing changes for the library.
+*
+* -------------------------------------------------------------------------
+*
+*/
+
+#ifndef GNSS_SDR_GLOBAL_QUEUES_H_
+#define GNSS_SDR_GLOBAL_QUEUES_H_
+
+#include "concurrent_queue.h"
+#include "galileo_almanac.h"
+#include "galileo_ephemeris.h"
+#include "galileo_iono.h"
+#include "galileo_utc_model.h"
+#include "gps_acq_assist.h"
+#include "gps_almanac.h"
+#include "gps_ephemeris.h"
+#include "gps_iono.h"
+#include "gps_ref_location.h"
+#include "gps_ref_time.h"
+#include "gps_utc_model.h"
+#include "lockfree_queue.h"
+#include "sbas_ephemeris.h"
+#include "sbas_ionospheric_correction.h"
+#include "sbas_satellite_correction.h"
+#include "sbas_telemetry_data.h"
+
+#if defined(GLOBAL_QUEUE_MPMC) && defined(GLOBAL_QUEUE_SPSC)
+#error "Define only one of GLOBAL_QUEUE_MPMC and GLOBAL_QUEUE_SPSC"
+#endif
+
+#if defined(GLOBAL_QUEUE_MPMC)
+template <typename Data>
+using global_queue = MpmcQueue<Data>;
+#elif defined(GLOBAL_QUEUE_SPSC)
+template <typename Data>
+using global_queue = SpscQueue<Data>;
+#else
+template <typename Data>
+using global_queue = concurrent_queue<Data>;
+#endif
+
+// For GPS NAVIGATION
+extern global_queue<Gps_Ephemeris> global_gps_ephemeris_queue;
+extern global_queue<Gps_Iono> global_gps_iono_queue;
+extern global_queue<Gps_Utc_Model> global_gps_utc_model_queue;
+extern global_queue<Gps_Almanac> global_gps_almanac_queue;
+extern global_queue<Gps_Acq_Assist> global_gps_acq_assist_queue;
+extern global_queue<Gps_Ref_Location> global_gps_ref_location_queue;
+extern global_queue<Gps_Ref_Time> global_gps_ref_time_queue;
+
+// For GALILEO NAVIGATION
+extern global_queue<Galileo_Ephemeris> global_galileo_ephemeris_queue;
+extern global_queue<Galileo_Iono> global_galileo_iono_queue;
+extern global_queue<Galileo_Utc_Model> global_galileo_utc_model_queue;
+extern global_queue<Galileo_Almanac> global_galileo_almanac_queue;
+
+// For SBAS CORRECTIONS
+extern global_queue<Sbas_Raw_Msg> global_sbas_raw_msg_queue;
+extern global_queue<Sbas_Ionosphere_Correction> global_sbas_iono_queue;
+extern global_queue<Sbas_Satellite_Correction> global_sbas_sat_corr_queue;
+extern global_queue<Sbas_Ephemeris> global_sbas_ephemeris_queue;
+
+#endif
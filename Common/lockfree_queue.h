@@ -0,0 +1,288 @@
+/*!
+* \file lockfree_queue.h
+* \brief Bounded lock-free ring queues with the interface of concurrent_queue.
+*
+* concurrent_queue takes a mutex on every push and pop and wakes the
+* consumer through a condition variable, so with many channels the
+* telemetry decoders contend for the same lock. The queues below keep the
+* items in a fixed ring of power of two size:
+*
+* - SpscQueue: one producer and one consumer. The producer only writes the
+*   tail and the consumer only writes the head, each caching the other's
+*   index, so an operation costs one release store.
+* - MpmcQueue: any number of producers and consumers (D. Vyukov's bounded
+*   MPMC queue). Each cell carries a sequence number telling whether it can
+*   be written or read in the current lap; a compare and swap on the tail
+*   or the head claims a cell.
+*
+* push() waits for room when the ring is full, so no item is dropped, and
+* wait_and_pop() spins, then yields, then sleeps with a growing period while
+* the ring is empty. The sleeps are boost interruption points, so a consumer
+* thread stops on interrupt() as it does in concurrent_queue::wait_and_pop().
+* Items must be default constructible and copy assignable.
+*
+* global_queues.h makes the global queues from the telemetry decoders
+* MpmcQueue or SpscQueue with GLOBAL_QUEUE_MPMC or GLOBAL_QUEUE_SPSC.
+*
+* -------------------------------------------------------------------------
+*
+*/
+
+#ifndef GNSS_SDR_LOCKFREE_QUEUE_H_
+#define GNSS_SDR_LOCKFREE_QUEUE_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <boost/thread.hpp>
+
+//! Items of a queue created without a capacity
+const size_t LOCKFREE_QUEUE_CAPACITY = 1024;
+
+//! Bytes kept between the indices written by different threads
+const size_t LOCKFREE_QUEUE_CACHE_LINE = 64;
+
+/*!
+* \brief Waiting strategy of the queues: spins first, then yields, then
+* sleeps from 1 us up to 1 ms. Only the sleeps of an interruptible wait
+* are boost interruption points.
+*/
+class QueueBackoff
+{
+public:
+    QueueBackoff() : round_(0), sleep_us_(1) {}
+
+    void wait(bool interruptible)
+    {
+        if (round_ < 64)
+            {
+                round_++;
+            }
+        else if (round_ < 128)
+            {
+                round_++;
+                std::this_thread::yield();
+            }
+        else
+            {
+                if (interruptible)
+                    {
+                        boost::this_thread::sleep(boost::posix_time::microseconds(sleep_us_));
+                    }
+                else
+                    {
+                        std::this_thread::sleep_for(std::chrono::microseconds(sleep_us_));
+                    }
+                sleep_us_ = sleep_us_ < 1000 ? 2 * sleep_us_ : 1000;
+            }
+    }
+
+private:
+    unsigned int round_;
+    unsigned int sleep_us_;
+};
+
+
+inline size_t lockfree_queue_size(size_t capacity)
+{
+    size_t size = 2;
+    while (size < capacity)
+        {
+            size <<= 1;
+        }
+    return size;
+}
+
+
+template <typename Data>
+class SpscQueue
+{
+public:
+    explicit SpscQueue(size_t capacity = LOCKFREE_QUEUE_CAPACITY)
+        : mask_(lockfree_queue_size(capacity) - 1), items_(new Data[mask_ + 1]),
+          tail_(0), head_cache_(0), head_(0), tail_cache_(0)
+    {
+    }
+
+    //! Only one thread may push
+    void push(const Data& data)
+    {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        QueueBackoff backoff;
+        while (tail - head_cache_ > mask_)
+            {
+                head_cache_ = head_.load(std::memory_order_acquire);
+                if (tail - head_cache_ > mask_)
+                    {
+                        backoff.wait(false);
+                    }
+            }
+        items_[tail & mask_] = data;
+        tail_.store(tail + 1, std::memory_order_release);
+    }
+
+    bool empty() const
+    {
+        return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+    }
+
+    //! Only one thread may pop
+    bool try_pop(Data& popped_value)
+    {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_cache_)
+            {
+                tail_cache_ = tail_.load(std::memory_order_acquire);
+                if (head == tail_cache_)
+                    {
+                        return false;
+                    }
+            }
+        popped_value = items_[head & mask_];
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    void wait_and_pop(Data& popped_value)
+    {
+        QueueBackoff backoff;
+        while (!try_pop(popped_value))
+            {
+                backoff.wait(true);
+            }
+    }
+
+private:
+    SpscQueue(const SpscQueue&);
+    SpscQueue& operator=(const SpscQueue&);
+
+    const size_t mask_;
+    std::unique_ptr<Data[]> items_;
+
+    // Producer side, then consumer side, on separate cache lines
+    char pad0_[LOCKFREE_QUEUE_CACHE_LINE];
+    std::atomic<size_t> tail_;
+    size_t head_cache_;
+    char pad1_[LOCKFREE_QUEUE_CACHE_LINE];
+    std::atomic<size_t> head_;
+    size_t tail_cache_;
+    char pad2_[LOCKFREE_QUEUE_CACHE_LINE];
+};
+
+
+template <typename Data>
+class MpmcQueue
+{
+public:
+    explicit MpmcQueue(size_t capacity = LOCKFREE_QUEUE_CAPACITY)
+        : mask_(lockfree_queue_size(capacity) - 1), cells_(new Cell[mask_ + 1]), tail_(0), head_(0)
+    {
+        for (size_t c = 0; c <= mask_; c++)
+            {
+                cells_[c].sequence.store(c, std::memory_order_relaxed);
+            }
+    }
+
+    void push(const Data& data)
+    {
+        QueueBackoff backoff;
+        while (!try_push(data))
+            {
+                backoff.wait(false);
+            }
+    }
+
+    bool empty() const
+    {
+        size_t head = head_.load(std::memory_order_acquire);
+        return cells_[head & mask_].sequence.load(std::memory_order_acquire) != head + 1;
+    }
+
+    bool try_pop(Data& popped_value)
+    {
+        size_t head = head_.load(std::memory_order_relaxed);
+        for (;;)
+            {
+                Cell& cell = cells_[head & mask_];
+                size_t sequence = cell.sequence.load(std::memory_order_acquire);
+                std::ptrdiff_t lap = static_cast<std::ptrdiff_t>(sequence - (head + 1));
+                if (lap == 0)
+                    {
+                        if (head_.compare_exchange_weak(head, head + 1, std::memory_order_relaxed))
+                            {
+                                popped_value = cell.data;
+                                cell.sequence.store(head + mask_ + 1, std::memory_order_release);
+                                return true;
+                            }
+                    }
+                else if (lap < 0)
+                    {
+                        return false;   // not written yet in this lap: empty
+                    }
+                else
+                    {
+                        head = head_.load(std::memory_order_relaxed);
+                    }
+            }
+    }
+
+    void wait_and_pop(Data& popped_value)
+    {
+        QueueBackoff backoff;
+        while (!try_pop(popped_value))
+            {
+                backoff.wait(true);
+            }
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        Data data;
+    };
+
+    MpmcQueue(const MpmcQueue&);
+    MpmcQueue& operator=(const MpmcQueue&);
+
+    bool try_push(const Data& data)
+    {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        for (;;)
+            {
+                Cell& cell = cells_[tail & mask_];
+                size_t sequence = cell.sequence.load(std::memory_order_acquire);
+                std::ptrdiff_t lap = static_cast<std::ptrdiff_t>(sequence - tail);
+                if (lap == 0)
+                    {
+                        if (tail_.compare_exchange_weak(tail, tail + 1, std::memory_order_relaxed))
+                            {
+                                cell.data = data;
+                                cell.sequence.store(tail + 1, std::memory_order_release);
+                                return true;
+                            }
+                    }
+                else if (lap < 0)
+                    {
+                        return false;   // not read yet in the previous lap: full
+                    }
+                else
+                    {
+                        tail = tail_.load(std::memory_order_relaxed);
+                    }
+            }
+    }
+
+    const size_t mask_;
+    std::unique_ptr<Cell[]> cells_;
+
+    char pad0_[LOCKFREE_QUEUE_CACHE_LINE];
+    std::atomic<size_t> tail_;
+    char pad1_[LOCKFREE_QUEUE_CACHE_LINE];
+    std::atomic<size_t> head_;
+    char pad2_[LOCKFREE_QUEUE_CACHE_LINE];
+};
+
+#endif
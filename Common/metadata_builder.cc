@@ -0,0 +1,222 @@
+/*!
+* \file metadata_builder.cc
+* \brief Writes the GNSS metadata files of all the bands of a capture in one pass.
+*
+* -------------------------------------------------------------------------
+*
+*/
+
+#include "metadata_builder.h"
+#include <cmath>
+#include <cstdio>
+#include <sstream>
+#include <GnssMetadata/Xml/XmlProcessor.h>
+#include <glog/logging.h>
+#include "stage_timer.h"
+
+using namespace GnssMetadata;
+
+namespace
+{
+//! Bits of the chunk word holding the samples (Chunk::SizeWord(4))
+const unsigned int METADATA_WORD_BITS = 32;
+
+//! Encodings of the ION GNSS SDR metadata standard, and the names used by older files
+const char* const METADATA_ENCODINGS[] = { "TC", "OB", "SM", "MS", "OG", "FP", "INT8", "INT16" };
+}
+
+
+MetadataBuilder::MetadataBuilder(int session_id, const Date& start)
+    : session_id_(session_id), start_(start), latitude_(0.0), longitude_(0.0), height_(0.0),
+      quantization_(8), packed_bits_(16), encoding_("TC"), iq_(true), big_endian_(false),
+      sample_rate_(4.0e6), translated_frequency_(38400.0)
+{
+}
+
+
+void MetadataBuilder::set_position(long double latitude, long double longitude, long double height)
+{
+    latitude_ = latitude;
+    longitude_ = longitude;
+    height_ = height;
+}
+
+
+void MetadataBuilder::set_stream(unsigned int quantization, unsigned int packed_bits, const std::string& encoding, bool iq, bool big_endian)
+{
+    quantization_ = quantization;
+    packed_bits_ = packed_bits;
+    encoding_ = encoding;
+    iq_ = iq;
+    big_endian_ = big_endian;
+}
+
+
+void MetadataBuilder::add_band(const std::string& name, double center_frequency_hz)
+{
+    Metadata_Band band;
+    band.name = name;
+    band.center_frequency = center_frequency_hz;
+    bands_.push_back(band);
+}
+
+
+std::vector<std::string> MetadataBuilder::validate() const
+{
+    std::vector<std::string> problems;
+    if (!(std::fabs(latitude_) <= 90.0) || !(std::fabs(longitude_) <= 180.0) || !std::isfinite(static_cast<double>(height_)))
+        {
+            problems.push_back("Session position out of range");
+        }
+
+    unsigned int sample_bits = iq_ ? 2 * quantization_ : quantization_;
+    if (quantization_ == 0 || sample_bits > packed_bits_)
+        {
+            problems.push_back("Quantization does not fit the packed sample");
+        }
+    if (packed_bits_ > METADATA_WORD_BITS)
+        {
+            problems.push_back("Packed sample larger than the chunk word");
+        }
+    bool known = false;
+    for (size_t e = 0; e < sizeof(METADATA_ENCODINGS) / sizeof(METADATA_ENCODINGS[0]); e++)
+        {
+            known = known || encoding_ == METADATA_ENCODINGS[e];
+        }
+    if (!known)
+        {
+            problems.push_back("Unknown stream encoding " + encoding_);
+        }
+    if (!(sample_rate_ > 0.0) || !std::isfinite(sample_rate_))
+        {
+            problems.push_back("Sample rate not positive");
+        }
+
+    if (bands_.empty())
+        {
+            problems.push_back("No band to describe");
+        }
+    for (size_t b = 0; b < bands_.size(); b++)
+        {
+            std::ostringstream band;
+            band << "Band " << b + 1;
+            if (bands_[b].name.empty())
+                {
+                    problems.push_back(band.str() + " has no name");
+                }
+            if (!(bands_[b].center_frequency > 0.0) || !std::isfinite(bands_[b].center_frequency))
+                {
+                    problems.push_back(band.str() + " has no valid center frequency");
+                }
+        }
+    return problems;
+}
+
+
+std::vector<std::string> MetadataBuilder::write(const std::string& prefix)
+{
+    std::vector<std::string> written;
+    std::vector<std::string> problems = validate();
+    if (!problems.empty())
+        {
+            for (size_t p = 0; p < problems.size(); p++)
+                {
+                    LOG(WARNING) << "Metadata not written: " << problems[p];
+                }
+            return written;
+        }
+
+    ////////////////////////////////
+    //Session, System, Source, Cluster and Stream format, common to all the bands.
+    Session sess("%d", session_id_);
+    sess.Scenario("Example %d", session_id_);
+    sess.Campaign("GNSS Metadata API");
+    sess.Contact("CTTC");
+    sess.Position( Position(latitude_, longitude_, height_));
+    sess.AddComment("This locates the satellite with metadata specification having interleaved streams.");
+
+    System sys("A2300-1");
+    sys.BaseFrequency( Frequency( sample_rate_, Frequency::Hz));
+    sys.Equipment("ASR-2300");
+    sys.AddComment( "ASR-2300 configured with standard firmware and FPGA id=1, version=1.18.");
+
+    Cluster clstr("Antenna");
+
+    Source src( Source::Patch, Source::RHCP, "L1 C/A");
+    src.IdCluster("Antenna");
+
+    sys.AddSource(src);
+    sys.AddCluster(clstr);
+
+    Stream format("L1ca");
+    format.RateFactor(1);
+    format.Quantization(quantization_);
+    format.Packedbits(packed_bits_);
+    format.Encoding(encoding_);
+    format.Format(iq_ ? Stream::IQ : Stream::IF);
+
+    // The System goes once into the Metadata object; lanes, files and streams are swapped per band
+    Metadata md;
+    md.Systems().push_back(sys);
+    XmlProcessor proc;
+
+    for (size_t b = 0; b < bands_.size(); b++)
+        {
+            std::ostringstream base;
+            base << prefix << b + 1;
+            String sfile = base.str() + ".bds";
+            String sfilemd = base.str() + ".xml";
+
+            ////////////////////////////////
+            //Band of this RF channel, its Stream and its Lane.
+            Band ch(bands_[b].name);
+            ch.CenterFrequency(Frequency( bands_[b].center_frequency, Frequency::Hz));
+            ch.TranslatedFrequency(Frequency( translated_frequency_, Frequency::Hz));
+
+            //Stream sm is added to the metadata and as a reference to the lump.
+            Stream sm(format);
+            sm.Bands().push_back(ch);
+
+            Lump lump;
+            lump.Streams().push_back(sm.ToReference<Stream>());
+
+            Chunk chunk;
+            chunk.SizeWord(4);
+            chunk.CountWords(1);
+            chunk.Endian(big_endian_ ? Chunk::Big : Chunk::Little);
+            chunk.Lumps().push_back(lump);
+
+            Block blk(METADATA_BLOCK_WORDS);
+            blk.Chunks().push_back(chunk);
+
+            Lane lane("GPS SPS Data");
+            lane.Sessions().push_back(sess);
+            lane.Blocks().push_back(blk);
+            lane.AddBandSource(ch, src);
+            lane.Systems().push_back( sys.ToReference<System>());
+
+            File df;
+            df.Url(sfile);
+            df.TimeStamp(start_);
+            df.Lane( lane, true);
+
+            md.Lanes().clear();
+            md.Files().clear();
+            md.Streams().clear();
+            md.Lanes().push_back(lane);
+            md.Files().push_back(df);
+            md.Streams().push_back(sm);
+
+            try
+                {
+                    StageTimer timer(STAGE_XML_WRITE);
+                    proc.Save(sfilemd.c_str(), md);
+                    written.push_back(sfilemd);
+                }
+            catch (ApiException& e)
+                {
+                    printf("An error occurred while saving the xml file: %s\n", e.what());
+                }
+        }
+    return written;
+}
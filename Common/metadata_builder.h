@@ -0,0 +1,93 @@
+/*!
+* \file metadata_builder.h
+* \brief Writes the GNSS metadata files of all the bands of a capture in one pass.
+*
+* Every band file holds the same Session, System, Source and Cluster and
+* the same Stream format; only the Band, the Lane and the File differ.
+* The shared objects are built once, the System goes into one Metadata
+* object reused for every file, and each band only adds its own Band,
+* Stream, Lane and File before the XML is saved. No receiver run is
+* involved: the position is the one already evaluated by the caller.
+*
+* The description is checked in memory before anything is serialized,
+* instead of loading every file back with XmlProcessor::Load; the
+* mains only reparse the files with --metadata_reparse, for debugging.
+*
+* -------------------------------------------------------------------------
+*
+*/
+
+#ifndef GNSS_SDR_METADATA_BUILDER_H_
+#define GNSS_SDR_METADATA_BUILDER_H_
+
+#include <string>
+#include <vector>
+#include <GnssMetadata/Metadata.h>
+
+//! 4 byte chunk words in each Block of the files written (the Block cycles)
+const unsigned int METADATA_BLOCK_WORDS = 256;
+
+struct Metadata_Band
+{
+    std::string name;
+    double center_frequency;   //!< [Hz]
+};
+
+class MetadataBuilder
+{
+public:
+    /*!
+    * \param session_id Number of the Session of the capture
+    * \param start Time of the first sample
+    */
+    MetadataBuilder(int session_id, const GnssMetadata::Date& start);
+
+    //! Receiver position of the Session [deg, deg, m]
+    void set_position(long double latitude, long double longitude, long double height);
+
+    /*!
+    * \brief Sample format shared by the streams of all the bands.
+    * \param encoding Encoding name of the metadata standard (TC, OB, ...)
+    */
+    void set_stream(unsigned int quantization, unsigned int packed_bits, const std::string& encoding, bool iq, bool big_endian);
+
+    //! Sample rate of the streams, the base frequency of the System (4 MHz if not set)
+    void set_sample_rate(double sample_rate_hz) { sample_rate_ = sample_rate_hz; }
+
+    //! Frequency the bands are translated to in the samples (38.4 kHz if not set)
+    void set_translated_frequency(double frequency_hz) { translated_frequency_ = frequency_hz; }
+
+    void add_band(const std::string& name, double center_frequency_hz);
+    const std::vector<Metadata_Band>& bands() const { return bands_; }
+
+    /*!
+    * \brief Problems that would give invalid metadata (position out of range, quantization
+    * not fitting the packed sample or the chunk word, unknown encoding, no sample rate,
+    * band without name or frequency). Empty if the files can be written.
+    */
+    std::vector<std::string> validate() const;
+
+    /*!
+    * \brief Writes <prefix><n>.xml, describing <prefix><n>.bds, for band n = 1, 2, ...
+    * Nothing is written if validate() finds a problem; each one is logged.
+    * Returns the names of the files saved; a file that cannot be saved is reported and skipped.
+    */
+    std::vector<std::string> write(const std::string& prefix);
+
+private:
+    int session_id_;
+    GnssMetadata::Date start_;
+    long double latitude_;
+    long double longitude_;
+    long double height_;
+    unsigned int quantization_;
+    unsigned int packed_bits_;
+    std::string encoding_;
+    bool iq_;
+    bool big_endian_;
+    double sample_rate_;
+    double translated_frequency_;
+    std::vector<Metadata_Band> bands_;
+};
+
+#endif
@@ -0,0 +1,475 @@
+/*!
+* \file metadata_cache.cc
+* \brief Binary image of a metadata XML file, mapped instead of parsed.
+*
+* -------------------------------------------------------------------------
+*
+*/
+
+#include "metadata_cache.h"
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+const char CACHE_MAGIC[8] = { 'G', 'N', 'S', 'S', 'M', 'D', 'C', '\0' };
+
+//! Bumped whenever a record or the header changes
+const uint32_t CACHE_VERSION = 2;
+
+//! Written as is: an image from a machine of the other byte order is rebuilt
+const uint32_t CACHE_BYTE_ORDER = 0x01020304;
+
+//! Sections start on multiples of this, so the records can be read in place
+const size_t CACHE_ALIGNMENT = 8;
+
+struct Cache_Section
+{
+    uint32_t offset;
+    uint32_t count;     //!< Records (bytes for the string table)
+};
+
+struct Cache_Header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t xml_hash;
+    uint64_t xml_bytes;
+    Cache_Section strings;
+    Cache_Section refs;
+    Cache_Section files;
+    Cache_Section streams;
+    Cache_Section lanes;
+    Cache_Section systems;
+    Cache_Section bands;
+    Cache_Section sessions;
+    Cache_Section blocks;
+    Cache_Section chunks;
+    Cache_Section lumps;
+};
+
+//! Distinct strings of the image, the empty one at offset 0
+class String_Table
+{
+public:
+    String_Table() : bytes_(1, '\0') { offsets_[std::string()] = 0; }
+
+    uint32_t add(const char* text)
+    {
+        std::string value(text ? text : "");
+        std::unordered_map<std::string, uint32_t>::const_iterator found = offsets_.find(value);
+        if (found != offsets_.end())
+            {
+                return found->second;
+            }
+        uint32_t offset = static_cast<uint32_t>(bytes_.size());
+        bytes_.insert(bytes_.end(), value.c_str(), value.c_str() + value.size() + 1);
+        offsets_[value] = offset;
+        return offset;
+    }
+
+    const std::vector<char>& bytes() const { return bytes_; }
+
+private:
+    std::vector<char> bytes_;
+    std::unordered_map<std::string, uint32_t> offsets_;
+};
+
+//! Appends the ids of a list to the table of ids; returns the index of the first one
+uint32_t add_refs(const Metadata_Ref* list, String_Table& strings, std::vector<uint32_t>& refs, uint32_t& count)
+{
+    uint32_t first = static_cast<uint32_t>(refs.size());
+    for (; list; list = list->next)
+        {
+            refs.push_back(strings.add(list->id));
+        }
+    count = static_cast<uint32_t>(refs.size()) - first;
+    return first;
+}
+
+template <class T>
+void append_section(const std::vector<T>& records, std::vector<char>& image, Cache_Section& section)
+{
+    image.resize((image.size() + CACHE_ALIGNMENT - 1) / CACHE_ALIGNMENT * CACHE_ALIGNMENT, '\0');
+    section.offset = static_cast<uint32_t>(image.size());
+    section.count = static_cast<uint32_t>(records.size());
+    if (!records.empty())
+        {
+            const char* data = reinterpret_cast<const char*>(&records[0]);
+            image.insert(image.end(), data, data + records.size() * sizeof(T));
+        }
+}
+
+bool in_image(const Cache_Section& section, size_t record_bytes, size_t image_bytes)
+{
+    return section.offset % CACHE_ALIGNMENT == 0
+           && static_cast<uint64_t>(section.offset) + static_cast<uint64_t>(section.count) * record_bytes <= image_bytes;
+}
+}
+
+
+MetadataCache::MetadataCache()
+    : mapping_(0), mapping_bytes_(0), rebuilt_(false)
+{
+    close();
+}
+
+
+MetadataCache::~MetadataCache()
+{
+    close();
+}
+
+
+std::string MetadataCache::cache_name(const std::string& xml_filename)
+{
+    return xml_filename + ".cache";
+}
+
+
+bool MetadataCache::hash_file(const std::string& filename, uint64_t& hash, uint64_t& bytes)
+{
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        {
+            return false;
+        }
+    struct stat status;
+    if (fstat(fd, &status) != 0)
+        {
+            ::close(fd);
+            return false;
+        }
+    bytes = status.st_size;
+    hash = 14695981039346656037ull;
+    if (bytes == 0)
+        {
+            ::close(fd);
+            return true;
+        }
+    void* mapping = mmap(0, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED)
+        {
+            return false;
+        }
+    madvise(mapping, bytes, MADV_SEQUENTIAL);
+    const unsigned char* data = static_cast<const unsigned char*>(mapping);
+    for (uint64_t i = 0; i < bytes; i++)
+        {
+            hash ^= data[i];
+            hash *= 1099511628211ull;
+        }
+    munmap(mapping, bytes);
+    return true;
+}
+
+
+void MetadataCache::serialize(const MetadataLoader& loader, uint64_t xml_hash, uint64_t xml_bytes, std::vector<char>& image)
+{
+    String_Table strings;
+    std::vector<uint32_t> refs;
+
+    std::vector<Cache_File> files(loader.files().size());
+    for (size_t f = 0; f < files.size(); f++)
+        {
+            const Metadata_File& file = *loader.files()[f];
+            files[f].id = strings.add(file.id);
+            files[f].url = strings.add(file.url);
+            files[f].time_stamp = strings.add(file.time_stamp);
+            files[f].lane = strings.add(file.lane);
+            files[f].offset = file.offset;
+        }
+    std::vector<Cache_Stream> streams(loader.streams().size());
+    for (size_t s = 0; s < streams.size(); s++)
+        {
+            const Metadata_Stream& stream = *loader.streams()[s];
+            streams[s].id = strings.add(stream.id);
+            streams[s].rate_factor = stream.rate_factor;
+            streams[s].quantization = stream.quantization;
+            streams[s].packed_bits = stream.packed_bits;
+            streams[s].alignment = strings.add(stream.alignment);
+            streams[s].encoding = strings.add(stream.encoding);
+            streams[s].format = strings.add(stream.format);
+            streams[s].first_band = add_refs(stream.bands, strings, refs, streams[s].band_count);
+        }
+    std::vector<Cache_Lane> lanes(loader.lanes().size());
+    for (size_t l = 0; l < lanes.size(); l++)
+        {
+            lanes[l].id = strings.add(loader.lanes()[l]->id);
+            lanes[l].first_system = add_refs(loader.lanes()[l]->systems, strings, refs, lanes[l].system_count);
+            lanes[l].first_session = add_refs(loader.lanes()[l]->sessions, strings, refs, lanes[l].session_count);
+        }
+    std::vector<Cache_System> systems(loader.systems().size());
+    for (size_t s = 0; s < systems.size(); s++)
+        {
+            const Metadata_System& system = *loader.systems()[s];
+            systems[s].id = strings.add(system.id);
+            systems[s].equipment = strings.add(system.equipment);
+            systems[s].first_source = add_refs(system.sources, strings, refs, systems[s].source_count);
+        }
+    std::vector<Cache_Band> bands(loader.bands().size());
+    for (size_t b = 0; b < bands.size(); b++)
+        {
+            const Metadata_Frequency_Band& band = *loader.bands()[b];
+            bands[b].id = strings.add(band.id);
+            bands[b].center_frequency = band.center_frequency;
+            bands[b].translated_frequency = band.translated_frequency;
+        }
+    std::vector<Cache_Session> sessions(loader.sessions().size());
+    for (size_t s = 0; s < sessions.size(); s++)
+        {
+            const Metadata_Session& session = *loader.sessions()[s];
+            sessions[s].id = strings.add(session.id);
+            sessions[s].toa = strings.add(session.toa);
+            sessions[s].scenario = strings.add(session.scenario);
+            sessions[s].campaign = strings.add(session.campaign);
+            sessions[s].contact = strings.add(session.contact);
+            sessions[s].latitude = session.latitude;
+            sessions[s].longitude = session.longitude;
+            sessions[s].height = session.height;
+        }
+    // The chunks of a block, and the lumps of a chunk, are stored one after the other
+    std::vector<Cache_Block> blocks(loader.blocks().size());
+    std::vector<Cache_Chunk> chunks;
+    std::vector<Cache_Lump> lumps;
+    for (size_t b = 0; b < blocks.size(); b++)
+        {
+            const Metadata_Block& block = *loader.blocks()[b];
+            blocks[b].lane = strings.add(block.lane);
+            blocks[b].cycles = block.cycles;
+            blocks[b].size_header = block.size_header;
+            blocks[b].size_footer = block.size_footer;
+            blocks[b].first_chunk = static_cast<uint32_t>(chunks.size());
+            for (const Metadata_Chunk* chunk = block.chunks; chunk; chunk = chunk->next)
+                {
+                    Cache_Chunk record = Cache_Chunk();
+                    record.size_word = chunk->size_word;
+                    record.count_words = chunk->count_words;
+                    record.endian = strings.add(chunk->endian);
+                    record.padding = strings.add(chunk->padding);
+                    record.word_shift = strings.add(chunk->word_shift);
+                    record.first_lump = static_cast<uint32_t>(lumps.size());
+                    for (const Metadata_Lump* lump = chunk->lumps; lump; lump = lump->next)
+                        {
+                            Cache_Lump streams = Cache_Lump();
+                            streams.first_stream = add_refs(lump->streams, strings, refs, streams.stream_count);
+                            lumps.push_back(streams);
+                        }
+                    record.lump_count = static_cast<uint32_t>(lumps.size()) - record.first_lump;
+                    chunks.push_back(record);
+                }
+            blocks[b].chunk_count = static_cast<uint32_t>(chunks.size()) - blocks[b].first_chunk;
+        }
+
+    Cache_Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+    header.version = CACHE_VERSION;
+    header.byte_order = CACHE_BYTE_ORDER;
+    header.xml_hash = xml_hash;
+    header.xml_bytes = xml_bytes;
+
+    image.assign(sizeof(header), '\0');
+    append_section(strings.bytes(), image, header.strings);
+    append_section(refs, image, header.refs);
+    append_section(files, image, header.files);
+    append_section(streams, image, header.streams);
+    append_section(lanes, image, header.lanes);
+    append_section(systems, image, header.systems);
+    append_section(bands, image, header.bands);
+    append_section(sessions, image, header.sessions);
+    append_section(blocks, image, header.blocks);
+    append_section(chunks, image, header.chunks);
+    append_section(lumps, image, header.lumps);
+    memcpy(&image[0], &header, sizeof(header));
+}
+
+
+bool MetadataCache::save(const std::string& filename, const std::vector<char>& image)
+{
+    // Written aside and renamed, so a reader never maps a partial image
+    std::string temporary = filename + ".tmp";
+    FILE* output = fopen(temporary.c_str(), "wb");
+    if (!output)
+        {
+            return false;
+        }
+    bool written = fwrite(&image[0], 1, image.size(), output) == image.size();
+    written = fclose(output) == 0 && written;
+    if (!written || rename(temporary.c_str(), filename.c_str()) != 0)
+        {
+            remove(temporary.c_str());
+            return false;
+        }
+    return true;
+}
+
+
+bool MetadataCache::build(const std::string& xml_filename, std::string* error)
+{
+    uint64_t hash = 0;
+    uint64_t bytes = 0;
+    MetadataLoader loader(MetadataLoader::ALL);
+    std::string reason;
+    if (!hash_file(xml_filename, hash, bytes))
+        {
+            reason = "Cannot read " + xml_filename;
+        }
+    else if (!loader.load(xml_filename))
+        {
+            reason = loader.error();
+        }
+    else
+        {
+            std::vector<char> image;
+            serialize(loader, hash, bytes, image);
+            if (!save(cache_name(xml_filename), image))
+                {
+                    reason = "Cannot write " + cache_name(xml_filename);
+                }
+        }
+    if (error)
+        {
+            *error = reason;
+        }
+    return reason.empty();
+}
+
+
+bool MetadataCache::open(const std::string& xml_filename)
+{
+    close();
+    rebuilt_ = false;
+    error_.clear();
+    uint64_t hash = 0;
+    uint64_t bytes = 0;
+    if (!hash_file(xml_filename, hash, bytes))
+        {
+            error_ = "Cannot read " + xml_filename;
+            return false;
+        }
+
+    std::string image_name = cache_name(xml_filename);
+    int fd = ::open(image_name.c_str(), O_RDONLY);
+    if (fd >= 0)
+        {
+            struct stat status;
+            void* mapping = MAP_FAILED;
+            if (fstat(fd, &status) == 0 && status.st_size > 0)
+                {
+                    mapping = mmap(0, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                }
+            ::close(fd);
+            if (mapping != MAP_FAILED)
+                {
+                    mapping_ = static_cast<const char*>(mapping);
+                    mapping_bytes_ = status.st_size;
+                    if (attach(mapping_, mapping_bytes_, hash, bytes))
+                        {
+                            return true;
+                        }
+                    close();
+                }
+        }
+
+    // Missing or stale image: parse the XML once and keep the result for the next time
+    MetadataLoader loader(MetadataLoader::ALL);
+    if (!loader.load(xml_filename))
+        {
+            error_ = loader.error();
+            return false;
+        }
+    serialize(loader, hash, bytes, memory_);
+    rebuilt_ = true;
+    save(image_name, memory_);
+    return attach(&memory_[0], memory_.size(), hash, bytes);
+}
+
+
+bool MetadataCache::attach(const char* image, size_t bytes, uint64_t xml_hash, uint64_t xml_bytes)
+{
+    Cache_Header header;
+    if (bytes < sizeof(header))
+        {
+            return false;
+        }
+    memcpy(&header, image, sizeof(header));
+    if (memcmp(header.magic, CACHE_MAGIC, sizeof(header.magic)) != 0 || header.version != CACHE_VERSION
+        || header.byte_order != CACHE_BYTE_ORDER || header.xml_hash != xml_hash || header.xml_bytes != xml_bytes)
+        {
+            return false;
+        }
+    if (!in_image(header.strings, 1, bytes) || header.strings.count == 0 || image[header.strings.offset + header.strings.count - 1] != '\0'
+        || !in_image(header.refs, sizeof(uint32_t), bytes) || !in_image(header.files, sizeof(Cache_File), bytes)
+        || !in_image(header.streams, sizeof(Cache_Stream), bytes) || !in_image(header.lanes, sizeof(Cache_Lane), bytes)
+        || !in_image(header.systems, sizeof(Cache_System), bytes) || !in_image(header.bands, sizeof(Cache_Band), bytes)
+        || !in_image(header.sessions, sizeof(Cache_Session), bytes) || !in_image(header.blocks, sizeof(Cache_Block), bytes)
+        || !in_image(header.chunks, sizeof(Cache_Chunk), bytes) || !in_image(header.lumps, sizeof(Cache_Lump), bytes))
+        {
+            return false;
+        }
+    strings_ = image + header.strings.offset;
+    string_bytes_ = header.strings.count;
+    refs_ = reinterpret_cast<const uint32_t*>(image + header.refs.offset);
+    ref_count_ = header.refs.count;
+    files_ = reinterpret_cast<const Cache_File*>(image + header.files.offset);
+    file_count_ = header.files.count;
+    streams_ = reinterpret_cast<const Cache_Stream*>(image + header.streams.offset);
+    stream_count_ = header.streams.count;
+    lanes_ = reinterpret_cast<const Cache_Lane*>(image + header.lanes.offset);
+    lane_count_ = header.lanes.count;
+    systems_ = reinterpret_cast<const Cache_System*>(image + header.systems.offset);
+    system_count_ = header.systems.count;
+    bands_ = reinterpret_cast<const Cache_Band*>(image + header.bands.offset);
+    band_count_ = header.bands.count;
+    sessions_ = reinterpret_cast<const Cache_Session*>(image + header.sessions.offset);
+    session_count_ = header.sessions.count;
+    blocks_ = reinterpret_cast<const Cache_Block*>(image + header.blocks.offset);
+    block_count_ = header.blocks.count;
+    chunks_ = reinterpret_cast<const Cache_Chunk*>(image + header.chunks.offset);
+    chunk_count_ = header.chunks.count;
+    lumps_ = reinterpret_cast<const Cache_Lump*>(image + header.lumps.offset);
+    lump_count_ = header.lumps.count;
+    return true;
+}
+
+
+void MetadataCache::close()
+{
+    if (mapping_)
+        {
+            munmap(const_cast<char*>(mapping_), mapping_bytes_);
+            mapping_ = 0;
+        }
+    mapping_bytes_ = 0;
+    memory_.clear();
+    strings_ = "";
+    string_bytes_ = 0;
+    refs_ = 0;
+    ref_count_ = 0;
+    files_ = 0;
+    file_count_ = 0;
+    streams_ = 0;
+    stream_count_ = 0;
+    lanes_ = 0;
+    lane_count_ = 0;
+    systems_ = 0;
+    system_count_ = 0;
+    bands_ = 0;
+    band_count_ = 0;
+    sessions_ = 0;
+    session_count_ = 0;
+    blocks_ = 0;
+    block_count_ = 0;
+    chunks_ = 0;
+    chunk_count_ = 0;
+    lumps_ = 0;
+    lump_count_ = 0;
+}
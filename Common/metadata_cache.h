@@ -0,0 +1,213 @@
+/*!
+* \file metadata_cache.h
+* \brief Binary image of a metadata XML file, mapped instead of parsed.
+*
+* The image holds the Files, Streams, Bands (with their frequencies),
+* Sessions, Lanes, Systems and Blocks (with their Chunks and Lumps) of a
+* document as fixed size records and one table of NUL terminated
+* strings, so a tool reading hundreds of metadata files maps each image
+* and reads the records in place, with no parsing and no allocation. The
+* image is written next to the XML file as <xml>.cache and carries a
+* format version and the FNV-1a hash of the XML bytes it was built from:
+* an image of another version, or of an XML file edited since, is rebuilt
+* from the XML the next time it is opened.
+*
+* -------------------------------------------------------------------------
+*
+*/
+
+#ifndef GNSS_SDR_METADATA_CACHE_H_
+#define GNSS_SDR_METADATA_CACHE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "metadata_loader.h"
+
+// Records of the image. Text fields are offsets in its string table (see text()),
+// lists are ranges of its table of ids (see ref()).
+
+struct Cache_File
+{
+    uint32_t id;
+    uint32_t url;
+    uint32_t time_stamp;
+    uint32_t lane;
+    uint64_t offset;           //!< Bytes before the first sample
+};
+
+struct Cache_Stream
+{
+    uint32_t id;
+    uint32_t rate_factor;
+    uint32_t quantization;
+    uint32_t packed_bits;
+    uint32_t alignment;
+    uint32_t encoding;
+    uint32_t format;
+    uint32_t first_band;
+    uint32_t band_count;
+};
+
+struct Cache_Band
+{
+    uint32_t id;
+    uint32_t reserved;
+    double center_frequency;       //!< [Hz]
+    double translated_frequency;   //!< [Hz]
+};
+
+struct Cache_Session
+{
+    uint32_t id;
+    uint32_t toa;
+    uint32_t scenario;
+    uint32_t campaign;
+    uint32_t contact;
+    uint32_t reserved;
+    double latitude;               //!< [deg]
+    double longitude;              //!< [deg]
+    double height;                 //!< [m]
+};
+
+struct Cache_Lane
+{
+    uint32_t id;
+    uint32_t first_system;
+    uint32_t system_count;
+    uint32_t first_session;
+    uint32_t session_count;
+};
+
+// Layout of the lanes: a block holds a range of the chunk records, a chunk a
+// range of the lump records, a lump a range of the table of ids (its streams)
+
+struct Cache_Block
+{
+    uint32_t lane;
+    uint32_t cycles;
+    uint32_t size_header;
+    uint32_t size_footer;
+    uint32_t first_chunk;
+    uint32_t chunk_count;
+};
+
+struct Cache_Chunk
+{
+    uint32_t size_word;
+    uint32_t count_words;
+    uint32_t endian;
+    uint32_t padding;
+    uint32_t word_shift;
+    uint32_t first_lump;
+    uint32_t lump_count;
+};
+
+struct Cache_Lump
+{
+    uint32_t first_stream;
+    uint32_t stream_count;
+};
+
+struct Cache_System
+{
+    uint32_t id;
+    uint32_t equipment;
+    uint32_t first_source;
+    uint32_t source_count;
+};
+
+class MetadataCache
+{
+public:
+    MetadataCache();
+    ~MetadataCache();
+
+    //! Image of an XML file: <xml>.cache
+    static std::string cache_name(const std::string& xml_filename);
+
+    /*!
+    * \brief Parses an XML file and writes its image next to it. Returns false, with the
+    * reason in error, if the XML cannot be read or the image cannot be written.
+    */
+    static bool build(const std::string& xml_filename, std::string* error = 0);
+
+    /*!
+    * \brief Maps the image of an XML file, rebuilding it first when it is missing, of
+    * another version or of other XML content. If the image cannot be written (read-only
+    * directory) the one just built is used from memory. Returns false if the XML cannot
+    * be read (see error()).
+    */
+    bool open(const std::string& xml_filename);
+    void close();
+
+    //! The last open() parsed the XML instead of mapping an up to date image
+    bool rebuilt() const { return rebuilt_; }
+    const std::string& error() const { return error_; }
+
+    size_t file_count() const { return file_count_; }
+    const Cache_File& file(size_t index) const { return files_[index]; }
+    size_t stream_count() const { return stream_count_; }
+    const Cache_Stream& stream(size_t index) const { return streams_[index]; }
+    size_t lane_count() const { return lane_count_; }
+    const Cache_Lane& lane(size_t index) const { return lanes_[index]; }
+    size_t system_count() const { return system_count_; }
+    const Cache_System& system(size_t index) const { return systems_[index]; }
+    size_t band_count() const { return band_count_; }
+    const Cache_Band& band(size_t index) const { return bands_[index]; }
+    size_t session_count() const { return session_count_; }
+    const Cache_Session& session(size_t index) const { return sessions_[index]; }
+    size_t block_count() const { return block_count_; }
+    const Cache_Block& block(size_t index) const { return blocks_[index]; }
+    size_t chunk_count() const { return chunk_count_; }
+    const Cache_Chunk& chunk(size_t index) const { return chunks_[index]; }
+    size_t lump_count() const { return lump_count_; }
+    const Cache_Lump& lump(size_t index) const { return lumps_[index]; }
+
+    //! String of a text field ("" if out of the table)
+    const char* text(uint32_t offset) const { return offset < string_bytes_ ? strings_ + offset : ""; }
+    //! Id number index of the table of ids, e.g. ref(stream.first_band + b)
+    const char* ref(uint32_t index) const { return index < ref_count_ ? text(refs_[index]) : ""; }
+
+private:
+    MetadataCache(const MetadataCache&);
+    MetadataCache& operator=(const MetadataCache&);
+
+    static bool hash_file(const std::string& filename, uint64_t& hash, uint64_t& bytes);
+    static void serialize(const MetadataLoader& loader, uint64_t xml_hash, uint64_t xml_bytes, std::vector<char>& image);
+    static bool save(const std::string& filename, const std::vector<char>& image);
+
+    //! Points the records into an image; false if it is not a complete image of this version
+    bool attach(const char* image, size_t bytes, uint64_t xml_hash, uint64_t xml_bytes);
+
+    const char* mapping_;
+    size_t mapping_bytes_;
+    std::vector<char> memory_;     //!< Image used from memory when it cannot be saved
+    const char* strings_;
+    uint32_t string_bytes_;
+    const uint32_t* refs_;
+    uint32_t ref_count_;
+    const Cache_File* files_;
+    uint32_t file_count_;
+    const Cache_Stream* streams_;
+    uint32_t stream_count_;
+    const Cache_Lane* lanes_;
+    uint32_t lane_count_;
+    const Cache_System* systems_;
+    uint32_t system_count_;
+    const Cache_Band* bands_;
+    uint32_t band_count_;
+    const Cache_Session* sessions_;
+    uint32_t session_count_;
+    const Cache_Block* blocks_;
+    uint32_t block_count_;
+    const Cache_Chunk* chunks_;
+    uint32_t chunk_count_;
+    const Cache_Lump* lumps_;
+    uint32_t lump_count_;
+    bool rebuilt_;
+    std::string error_;
+};
+
+#endif
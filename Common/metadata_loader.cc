@@ -0,0 +1,896 @@
+/*!
+* \file metadata_loader.cc
+* \brief Streaming reader of GNSS metadata XML files.
+*
+* -------------------------------------------------------------------------
+*
+*/
+
+#include "metadata_loader.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "stage_timer.h"
+
+namespace
+{
+//! Bytes read from the document at a time
+const size_t LOADER_CHUNK_BYTES = 65536;
+
+//! Elements that may hold streams (lane > block > chunk > lump > stream)
+const char* const LOADER_STREAM_CONTAINERS[] = { "lane", "block", "chunk", "lump" };
+
+enum Scanner_State
+{
+    TEXT,
+    TAG_OPEN,
+    START_NAME,
+    ATTRIBUTES,
+    ATTRIBUTE_NAME,
+    ATTRIBUTE_EQUALS,
+    ATTRIBUTE_QUOTE,
+    ATTRIBUTE_VALUE,
+    EMPTY_END,
+    END_NAME,
+    BANG,
+    COMMENT,
+    CDATA,
+    DECLARATION,
+    INSTRUCTION
+};
+
+bool is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+void trim(std::string& value)
+{
+    size_t first = 0;
+    while (first < value.size() && is_space(value[first]))
+        {
+            first++;
+        }
+    size_t last = value.size();
+    while (last > first && is_space(value[last - 1]))
+        {
+            last--;
+        }
+    value = value.substr(first, last - first);
+}
+
+//! Replaces the predefined and numeric character references
+void decode(std::string& value)
+{
+    if (value.find('&') == std::string::npos)
+        {
+            return;
+        }
+    std::string decoded;
+    decoded.reserve(value.size());
+    for (size_t i = 0; i < value.size(); i++)
+        {
+            size_t end = value[i] == '&' ? value.find(';', i) : std::string::npos;
+            if (end == std::string::npos)
+                {
+                    decoded += value[i];
+                    continue;
+                }
+            std::string entity = value.substr(i + 1, end - i - 1);
+            if (entity == "lt") decoded += '<';
+            else if (entity == "gt") decoded += '>';
+            else if (entity == "amp") decoded += '&';
+            else if (entity == "quot") decoded += '"';
+            else if (entity == "apos") decoded += '\'';
+            else if (entity.size() > 1 && entity[0] == '#')
+                {
+                    unsigned long code = entity[1] == 'x' ? strtoul(entity.c_str() + 2, 0, 16) : strtoul(entity.c_str() + 1, 0, 10);
+                    // Only the characters of the ids and urls of the metadata files are expected
+                    decoded += code < 128 ? static_cast<char>(code) : '?';
+                }
+            else
+                {
+                    decoded += value.substr(i, end - i + 1);
+                }
+            i = end;
+        }
+    value.swap(decoded);
+}
+
+unsigned int to_unsigned(const std::string& value)
+{
+    return static_cast<unsigned int>(strtoul(value.c_str(), 0, 10));
+}
+
+//! Hz per unit of a Frequency format attribute; 1 for Ratio, kept as written
+double frequency_scale(const std::string* format)
+{
+    if (!format) return 1.0;
+    if (*format == "kHz") return 1.0e3;
+    if (*format == "MHz") return 1.0e6;
+    if (*format == "GHz") return 1.0e9;
+    return 1.0;
+}
+}
+
+
+MetadataLoader::MetadataLoader(unsigned int sections)
+    : sections_(sections), depth_(0), skip_depth_(0), record_(NO_RECORD), record_depth_(0),
+      file_(0), stream_(0), system_(0), session_(0), last_ref_(0), lane_(0), lane_depth_(0), last_system_(0),
+      last_session_(0), lane_id_(""), band_(0), band_depth_(0), band_has_children_(false), block_(0), block_depth_(0),
+      chunk_(0), chunk_depth_(0), last_chunk_(0), lump_(0), lump_depth_(0), last_lump_(0), last_lump_stream_(0),
+      has_children_(false), stopped_(false)
+{
+}
+
+
+bool MetadataLoader::load(const std::string& filename)
+{
+    StageTimer timer(STAGE_XML_READ);
+    records_.clear();
+    files_.clear();
+    streams_.clear();
+    lanes_.clear();
+    systems_.clear();
+    bands_.clear();
+    sessions_.clear();
+    blocks_.clear();
+    stream_ids_.clear();
+    band_ids_.clear();
+    session_ids_.clear();
+    path_.clear();
+    text_.clear();
+    depth_ = 0;
+    skip_depth_ = 0;
+    record_ = NO_RECORD;
+    lane_ = 0;
+    lane_id_ = "";
+    band_ = 0;
+    block_ = 0;
+    chunk_ = 0;
+    lump_ = 0;
+    stopped_ = false;
+    error_.clear();
+
+    FILE* document = fopen(filename.c_str(), "rb");
+    if (!document)
+        {
+            error_ = "Cannot open " + filename;
+            return false;
+        }
+
+    std::vector<char> buffer(LOADER_CHUNK_BYTES);
+    Scanner_State state = TEXT;
+    char quote = '"';
+    std::string marker;
+    size_t match = 0;
+    int nesting = 0;
+    bool root = false;
+    while (!stopped_ && error_.empty())
+        {
+            size_t read = fread(&buffer[0], 1, buffer.size(), document);
+            if (read == 0)
+                {
+                    break;
+                }
+            for (size_t i = 0; i < read && !stopped_ && error_.empty(); i++)
+                {
+                    char c = buffer[i];
+                    bool capture = (record_ != NO_RECORD || band_ || block_) && skip_depth_ == 0;
+                    switch (state)
+                        {
+                        case TEXT:
+                            if (c == '<')
+                                {
+                                    state = TAG_OPEN;
+                                }
+                            else if (capture)
+                                {
+                                    text_ += c;
+                                }
+                            break;
+                        case TAG_OPEN:
+                            if (c == '/')
+                                {
+                                    name_.clear();
+                                    state = END_NAME;
+                                }
+                            else if (c == '!')
+                                {
+                                    marker.clear();
+                                    state = BANG;
+                                }
+                            else if (c == '?')
+                                {
+                                    match = 0;
+                                    state = INSTRUCTION;
+                                }
+                            else
+                                {
+                                    name_.assign(1, c);
+                                    attributes_.clear();
+                                    root = true;
+                                    state = START_NAME;
+                                }
+                            break;
+                        case START_NAME:
+                            if (is_space(c))
+                                {
+                                    state = ATTRIBUTES;
+                                }
+                            else if (c == '/')
+                                {
+                                    state = EMPTY_END;
+                                }
+                            else if (c == '>')
+                                {
+                                    start_element(false);
+                                    state = TEXT;
+                                }
+                            else
+                                {
+                                    name_ += c;
+                                }
+                            break;
+                        case ATTRIBUTES:
+                            if (c == '/')
+                                {
+                                    state = EMPTY_END;
+                                }
+                            else if (c == '>')
+                                {
+                                    start_element(false);
+                                    state = TEXT;
+                                }
+                            else if (!is_space(c))
+                                {
+                                    attributes_.push_back(std::make_pair(std::string(1, c), std::string()));
+                                    state = ATTRIBUTE_NAME;
+                                }
+                            break;
+                        case ATTRIBUTE_NAME:
+                            if (c == '=')
+                                {
+                                    state = ATTRIBUTE_QUOTE;
+                                }
+                            else if (is_space(c))
+                                {
+                                    state = ATTRIBUTE_EQUALS;
+                                }
+                            else
+                                {
+                                    attributes_.back().first += c;
+                                }
+                            break;
+                        case ATTRIBUTE_EQUALS:
+                            if (c == '=')
+                                {
+                                    state = ATTRIBUTE_QUOTE;
+                                }
+                            else if (!is_space(c))
+                                {
+                                    error_ = "Attribute " + attributes_.back().first + " without value";
+                                }
+                            break;
+                        case ATTRIBUTE_QUOTE:
+                            if (c == '"' || c == '\'')
+                                {
+                                    quote = c;
+                                    state = ATTRIBUTE_VALUE;
+                                }
+                            else if (!is_space(c))
+                                {
+                                    error_ = "Unquoted value of attribute " + attributes_.back().first;
+                                }
+                            break;
+                        case ATTRIBUTE_VALUE:
+                            if (c == quote)
+                                {
+                                    decode(attributes_.back().second);
+                                    state = ATTRIBUTES;
+                                }
+                            else
+                                {
+                                    attributes_.back().second += c;
+                                }
+                            break;
+                        case EMPTY_END:
+                            if (c != '>')
+                                {
+                                    error_ = "Expected > closing element " + name_;
+                                }
+                            else
+                                {
+                                    start_element(true);
+                                    state = TEXT;
+                                }
+                            break;
+                        case END_NAME:
+                            if (c == '>')
+                                {
+                                    end_element();
+                                    state = TEXT;
+                                }
+                            else if (!is_space(c))
+                                {
+                                    name_ += c;
+                                }
+                            break;
+                        case BANG:
+                            // Comment, CDATA section or declaration, told apart by what follows "<!"
+                            marker += c;
+                            if (marker == "--")
+                                {
+                                    match = 0;
+                                    state = COMMENT;
+                                }
+                            else if (marker == "[CDATA[")
+                                {
+                                    match = 0;
+                                    state = CDATA;
+                                }
+                            else if (std::string("--").compare(0, marker.size(), marker) != 0 && std::string("[CDATA[").compare(0, marker.size(), marker) != 0)
+                                {
+                                    nesting = c == '[' ? 1 : 0;
+                                    state = c == '>' ? TEXT : DECLARATION;
+                                }
+                            break;
+                        case COMMENT:
+                            if (c == '-')
+                                {
+                                    match = match < 2 ? match + 1 : 2;
+                                }
+                            else if (c == '>' && match == 2)
+                                {
+                                    state = TEXT;
+                                }
+                            else
+                                {
+                                    match = 0;
+                                }
+                            break;
+                        case CDATA:
+                            // The "]" are held back until it is known whether they end the section
+                            if (c == ']')
+                                {
+                                    match++;
+                                }
+                            else if (c == '>' && match >= 2)
+                                {
+                                    if (capture)
+                                        {
+                                            text_.append(match - 2, ']');
+                                        }
+                                    state = TEXT;
+                                }
+                            else
+                                {
+                                    if (capture)
+                                        {
+                                            text_.append(match, ']');
+                                            text_ += c;
+                                        }
+                                    match = 0;
+                                }
+                            break;
+                        case DECLARATION:
+                            if (c == '[')
+                                {
+                                    nesting++;
+                                }
+                            else if (c == ']')
+                                {
+                                    nesting--;
+                                }
+                            else if (c == '>' && nesting <= 0)
+                                {
+                                    state = TEXT;
+                                }
+                            break;
+                        case INSTRUCTION:
+                            if (c == '>' && match)
+                                {
+                                    state = TEXT;
+                                }
+                            else
+                                {
+                                    match = c == '?';
+                                }
+                            break;
+                        }
+                }
+        }
+    if (ferror(document))
+        {
+            error_ = "Cannot read " + filename;
+        }
+    fclose(document);
+
+    if (error_.empty() && !stopped_)
+        {
+            if (!root)
+                {
+                    error_ = "No element in " + filename;
+                }
+            else if (state != TEXT || depth_ != 0)
+                {
+                    error_ = "Unexpected end of " + filename;
+                }
+        }
+    return error_.empty();
+}
+
+
+const std::string* MetadataLoader::attribute(const char* name) const
+{
+    for (size_t a = 0; a < attributes_.size(); a++)
+        {
+            if (attributes_[a].first == name)
+                {
+                    return &attributes_[a].second;
+                }
+        }
+    return 0;
+}
+
+
+void MetadataLoader::start_element(bool empty)
+{
+    depth_++;
+    if (skip_depth_)
+        {
+            if (empty)
+                {
+                    depth_--;
+                }
+            return;
+        }
+    if (record_ == NO_RECORD && depth_ > 1)
+        {
+            const std::string* id = attribute("id");
+            if (name_ == "lane" && depth_ == 2)
+                {
+                    lane_id_ = intern(id ? *id : std::string());
+                }
+            if (lane_ && depth_ == lane_depth_ + 1 && (name_ == "system" || name_ == "session") && id)
+                {
+                    Metadata_Ref* ref = records_.create<Metadata_Ref>();
+                    ref->id = intern(*id);
+                    const Metadata_Ref**& last = name_ == "system" ? last_system_ : last_session_;
+                    *last = ref;
+                    last = &ref->next;
+                }
+            if (lump_ && depth_ == lump_depth_ + 1 && name_ == "stream" && id)
+                {
+                    Metadata_Ref* stream = records_.create<Metadata_Ref>();
+                    stream->id = intern(*id);
+                    *last_lump_stream_ = stream;
+                    last_lump_stream_ = &stream->next;
+                }
+            if (name_ == "file" && depth_ == 2 && (sections_ & FILES))
+                {
+                    file_ = records_.create<Metadata_File>();
+                    file_->id = copy(id ? *id : std::string());
+                    file_->url = "";
+                    file_->time_stamp = "";
+                    file_->lane = "";
+                    record_ = FILE_RECORD;
+                    record_depth_ = depth_;
+                }
+            else if (name_ == "stream" && (sections_ & (STREAMS | BANDS)))
+                {
+                    // Also read for its bands alone
+                    stream_ = records_.create<Metadata_Stream>();
+                    stream_->id = intern(id ? *id : std::string());
+                    stream_->alignment = "";
+                    stream_->encoding = "";
+                    stream_->format = "";
+                    last_ref_ = &stream_->bands;
+                    has_children_ = false;
+                    record_ = STREAM_RECORD;
+                    record_depth_ = depth_;
+                }
+            else if (name_ == "session" && (sections_ & SESSIONS))
+                {
+                    session_ = records_.create<Metadata_Session>();
+                    session_->id = intern(id ? *id : std::string());
+                    session_->toa = "";
+                    session_->scenario = "";
+                    session_->campaign = "";
+                    session_->contact = "";
+                    has_children_ = false;
+                    record_ = SESSION_RECORD;
+                    record_depth_ = depth_;
+                }
+            else if (name_ == "system" && depth_ == 2 && (sections_ & SYSTEMS))
+                {
+                    system_ = records_.create<Metadata_System>();
+                    system_->id = intern(id ? *id : std::string());
+                    system_->equipment = "";
+                    last_ref_ = &system_->sources;
+                    record_ = SYSTEM_RECORD;
+                    record_depth_ = depth_;
+                }
+            else if (name_ == "lane" && depth_ == 2 && (sections_ & LANES))
+                {
+                    // Not skipped: its direct children name the systems and sessions, its lumps the streams
+                    lane_ = records_.create<Metadata_Lane>();
+                    lane_->id = lane_id_;
+                    last_system_ = &lane_->systems;
+                    last_session_ = &lane_->sessions;
+                    lane_depth_ = depth_;
+                }
+            else if (name_ == "band" && !band_ && (sections_ & BANDS))
+                {
+                    band_ = records_.create<Metadata_Frequency_Band>();
+                    band_->id = intern(id ? *id : std::string());
+                    band_has_children_ = false;
+                    band_depth_ = depth_;
+                }
+            else if (band_ && depth_ == band_depth_ + 1)
+                {
+                    band_has_children_ = true;
+                }
+            else if (name_ == "block" && !block_ && (sections_ & BLOCKS))
+                {
+                    block_ = records_.create<Metadata_Block>();
+                    block_->lane = lane_id_;
+                    last_chunk_ = &block_->chunks;
+                    block_depth_ = depth_;
+                }
+            else if (block_ && !chunk_ && depth_ == block_depth_ + 1 && name_ == "chunk")
+                {
+                    chunk_ = records_.create<Metadata_Chunk>();
+                    chunk_->endian = "";
+                    chunk_->padding = "";
+                    chunk_->word_shift = "";
+                    last_lump_ = &chunk_->lumps;
+                    *last_chunk_ = chunk_;
+                    last_chunk_ = &chunk_->next;
+                    chunk_depth_ = depth_;
+                }
+            else if (chunk_ && !lump_ && depth_ == chunk_depth_ + 1 && name_ == "lump")
+                {
+                    lump_ = records_.create<Metadata_Lump>();
+                    last_lump_stream_ = &lump_->streams;
+                    *last_lump_ = lump_;
+                    last_lump_ = &lump_->next;
+                    lump_depth_ = depth_;
+                }
+            else if ((chunk_ && depth_ == chunk_depth_ + 1) || (block_ && !chunk_ && depth_ == block_depth_ + 1))
+                {
+                    // Field of the layout, read at its end
+                }
+            else
+                {
+                    bool container = false;
+                    for (size_t c = 0; c < sizeof(LOADER_STREAM_CONTAINERS) / sizeof(LOADER_STREAM_CONTAINERS[0]); c++)
+                        {
+                            container = container || name_ == LOADER_STREAM_CONTAINERS[c];
+                        }
+                    if (!container || !(sections_ & (STREAMS | BANDS | SESSIONS | BLOCKS)))
+                        {
+                            skip_depth_ = depth_;
+                        }
+                }
+        }
+    else if (record_ != NO_RECORD && depth_ == record_depth_ + 1)
+        {
+            // Field of the record; the references are read from the id attribute
+            const std::string* id = attribute("id");
+            has_children_ = true;
+            if (record_ == FILE_RECORD && name_ == "lane" && id)
+                {
+                    file_->lane = intern(*id);
+                }
+            else if ((record_ == STREAM_RECORD && name_ == "band" && id) || (record_ == SYSTEM_RECORD && name_ == "source" && id))
+                {
+                    Metadata_Ref* ref = records_.create<Metadata_Ref>();
+                    ref->id = intern(*id);
+                    *last_ref_ = ref;
+                    last_ref_ = &ref->next;
+                }
+            if (record_ == STREAM_RECORD && name_ == "band" && (sections_ & BANDS))
+                {
+                    band_ = records_.create<Metadata_Frequency_Band>();
+                    band_->id = intern(id ? *id : std::string());
+                    band_has_children_ = false;
+                    band_depth_ = depth_;
+                }
+        }
+    else if (band_ && depth_ == band_depth_ + 1)
+        {
+            band_has_children_ = true;
+        }
+    else if (record_ != NO_RECORD && !(record_ == SESSION_RECORD && depth_ == record_depth_ + 2 && path_.back() == "position"))
+        {
+            // Deeper than the fields of the record, except the coordinates of a session
+            skip_depth_ = depth_;
+        }
+
+    if (skip_depth_ == depth_)
+        {
+            if (empty)
+                {
+                    skip_depth_ = 0;
+                    depth_--;
+                }
+            return;
+        }
+    path_.push_back(name_);
+    text_.clear();
+    if (empty)
+        {
+            end_element();
+        }
+}
+
+
+void MetadataLoader::end_element()
+{
+    if (skip_depth_)
+        {
+            if (depth_ == skip_depth_)
+                {
+                    skip_depth_ = 0;
+                }
+            depth_--;
+            return;
+        }
+    if (path_.empty() || path_.back() != name_)
+        {
+            error_ = "Unexpected end of element " + name_;
+            return;
+        }
+    if (band_ && depth_ == band_depth_ + 1)
+        {
+            set_band_field();
+        }
+    else if (band_ && depth_ == band_depth_)
+        {
+            finish_band();
+        }
+    else if (record_ != NO_RECORD && depth_ > record_depth_)
+        {
+            set_field();
+        }
+    else if (record_ != NO_RECORD && depth_ == record_depth_)
+        {
+            finish_record();
+        }
+    else if (lump_ && depth_ == lump_depth_)
+        {
+            lump_ = 0;
+        }
+    else if (chunk_ && depth_ == chunk_depth_)
+        {
+            chunk_ = 0;
+        }
+    else if (block_ && depth_ == block_depth_)
+        {
+            blocks_.push_back(block_);
+            block_ = 0;
+        }
+    else if ((chunk_ && depth_ == chunk_depth_ + 1) || (block_ && !chunk_ && depth_ == block_depth_ + 1))
+        {
+            set_layout_field();
+        }
+    else if (lane_ && depth_ == lane_depth_)
+        {
+            lanes_.push_back(lane_);
+            lane_ = 0;
+        }
+    path_.pop_back();
+    depth_--;
+    text_.clear();
+}
+
+
+void MetadataLoader::set_field()
+{
+    trim(text_);
+    decode(text_);
+    const std::string& field = path_.back();
+    if (record_ == FILE_RECORD)
+        {
+            if (field == "url")
+                {
+                    file_->url = copy(text_);
+                }
+            else if (field == "timestamp")
+                {
+                    file_->time_stamp = copy(text_);
+                }
+            else if (field == "offset")
+                {
+                    file_->offset = strtoull(text_.c_str(), 0, 10);
+                }
+        }
+    else if (record_ == SYSTEM_RECORD)
+        {
+            if (field == "equipment")
+                {
+                    system_->equipment = copy(text_);
+                }
+        }
+    else if (record_ == SESSION_RECORD)
+        {
+            if (field == "toa")
+                {
+                    session_->toa = copy(text_);
+                }
+            else if (field == "scenario")
+                {
+                    session_->scenario = copy(text_);
+                }
+            else if (field == "campaign")
+                {
+                    session_->campaign = copy(text_);
+                }
+            else if (field == "contact")
+                {
+                    session_->contact = copy(text_);
+                }
+            else if (field == "lat")
+                {
+                    session_->latitude = strtod(text_.c_str(), 0);
+                }
+            else if (field == "lon")
+                {
+                    session_->longitude = strtod(text_.c_str(), 0);
+                }
+            else if (field == "height")
+                {
+                    session_->height = strtod(text_.c_str(), 0);
+                }
+        }
+    else
+        {
+            if (field == "ratefactor")
+                {
+                    stream_->rate_factor = to_unsigned(text_);
+                }
+            else if (field == "quantization")
+                {
+                    stream_->quantization = to_unsigned(text_);
+                }
+            else if (field == "packedbits")
+                {
+                    stream_->packed_bits = to_unsigned(text_);
+                }
+            else if (field == "alignment")
+                {
+                    stream_->alignment = intern(text_);
+                }
+            else if (field == "encoding")
+                {
+                    stream_->encoding = intern(text_);
+                }
+            else if (field == "format")
+                {
+                    stream_->format = intern(text_);
+                }
+        }
+}
+
+
+void MetadataLoader::set_band_field()
+{
+    trim(text_);
+    const std::string& field = path_.back();
+    // The attributes are still those of the field, which has no children
+    if (field == "centerfreq")
+        {
+            band_->center_frequency = strtod(text_.c_str(), 0) * frequency_scale(attribute("format"));
+        }
+    else if (field == "translatedfreq")
+        {
+            band_->translated_frequency = strtod(text_.c_str(), 0) * frequency_scale(attribute("format"));
+        }
+}
+
+
+void MetadataLoader::set_layout_field()
+{
+    trim(text_);
+    decode(text_);
+    const std::string& field = path_.back();
+    if (chunk_)
+        {
+            if (field == "sizeword")
+                {
+                    chunk_->size_word = to_unsigned(text_);
+                }
+            else if (field == "countwords")
+                {
+                    chunk_->count_words = to_unsigned(text_);
+                }
+            else if (field == "endian")
+                {
+                    chunk_->endian = intern(text_);
+                }
+            else if (field == "padding")
+                {
+                    chunk_->padding = intern(text_);
+                }
+            else if (field == "wordshift")
+                {
+                    chunk_->word_shift = intern(text_);
+                }
+        }
+    else
+        {
+            if (field == "cycles")
+                {
+                    block_->cycles = to_unsigned(text_);
+                }
+            else if (field == "sizeheader")
+                {
+                    block_->size_header = to_unsigned(text_);
+                }
+            else if (field == "sizefooter")
+                {
+                    block_->size_footer = to_unsigned(text_);
+                }
+        }
+}
+
+
+void MetadataLoader::finish_band()
+{
+    // As for the streams, a band without content is a reference
+    if (band_has_children_ && band_ids_.insert(band_->id).second)
+        {
+            bands_.push_back(band_);
+        }
+    band_ = 0;
+}
+
+
+void MetadataLoader::finish_record()
+{
+    // Records are only reused when none is being kept
+    bool reuse = (file_handler_ || !(sections_ & FILES)) && (stream_handler_ || !(sections_ & STREAMS))
+                 && !(sections_ & (LANES | SYSTEMS | BANDS | SESSIONS | BLOCKS));
+    bool keep = true;
+    if (record_ == SYSTEM_RECORD)
+        {
+            systems_.push_back(system_);
+        }
+    else if (record_ == SESSION_RECORD)
+        {
+            if (has_children_ && session_ids_.insert(session_->id).second)
+                {
+                    sessions_.push_back(session_);
+                }
+        }
+    else if (record_ == FILE_RECORD)
+        {
+            if (file_handler_)
+                {
+                    keep = file_handler_(*file_);
+                }
+            else
+                {
+                    files_.push_back(file_);
+                }
+        }
+    else if (has_children_ && (sections_ & STREAMS) && stream_ids_.insert(stream_->id).second)
+        {
+            // A stream without content is a reference to one defined elsewhere
+            if (stream_handler_)
+                {
+                    keep = stream_handler_(*stream_);
+                }
+            else
+                {
+                    streams_.push_back(stream_);
+                }
+        }
+    if (reuse)
+        {
+            records_.clear();
+        }
+    stopped_ = !keep;
+    record_ = NO_RECORD;
+}
@@ -0,0 +1,256 @@
+/*!
+* \file metadata_loader.h
+* \brief Streaming reader of GNSS metadata XML files.
+*
+* XmlProcessor::Load builds the complete Metadata object of a document,
+* which for a capture spread over thousands of files, each repeating its
+* Lane and Block definitions, takes long and holds everything in memory.
+* MetadataLoader reads the document in fixed size chunks and reacts to
+* every tag as it goes (SAX style): only the elements asked for (File,
+* Stream, Lane, System) are built, all the others are skipped without
+* copying. Records live in an arena and the names that repeat (ids of
+* lanes, bands and streams, encodings, formats) are interned, each stored
+* once. Bands are read where they are defined, within the streams or on
+* their own; sessions within the lanes or on their own; blocks with their
+* chunks and lumps within the lanes. Given handlers, the
+* loader passes every record to them and reuses its memory, so whatever
+* the size of the document the memory used stays bounded; a handler
+* returning false stops the reading there.
+*
+* -------------------------------------------------------------------------
+*
+*/
+
+#ifndef GNSS_SDR_METADATA_LOADER_H_
+#define GNSS_SDR_METADATA_LOADER_H_
+
+#include <cstddef>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include <boost/function.hpp>
+#include "string_pool.h"
+
+//! Element of a list of interned ids
+struct Metadata_Ref
+{
+    const char* id;
+    const Metadata_Ref* next;
+};
+
+struct Metadata_File
+{
+    const char* id;
+    const char* url;
+    const char* time_stamp;
+    const char* lane;              //!< Interned id of the lane held by the file
+    unsigned long long offset;     //!< Bytes before the first sample
+};
+
+struct Metadata_Stream
+{
+    const char* id;                //!< Interned
+    unsigned int rate_factor;
+    unsigned int quantization;
+    unsigned int packed_bits;
+    const char* alignment;         //!< Interned, as all the text fields below
+    const char* encoding;
+    const char* format;
+    const Metadata_Ref* bands;     //!< Ids of the bands, in document order
+};
+
+struct Metadata_Lane
+{
+    const char* id;                //!< Interned
+    const Metadata_Ref* systems;   //!< Ids of the systems that recorded the lane
+    const Metadata_Ref* sessions;  //!< Ids of its sessions
+};
+
+struct Metadata_System
+{
+    const char* id;                //!< Interned
+    const char* equipment;
+    const Metadata_Ref* sources;   //!< Ids of the antennas, in document order
+};
+
+//! Band definition (Metadata_Band is the band written by metadata_builder.h)
+struct Metadata_Frequency_Band
+{
+    const char* id;                //!< Interned
+    double center_frequency;       //!< [Hz]
+    double translated_frequency;   //!< [Hz]
+};
+
+struct Metadata_Session
+{
+    const char* id;                //!< Interned
+    const char* toa;               //!< Time of the first sample, as written
+    const char* scenario;
+    const char* campaign;
+    const char* contact;
+    double latitude;               //!< [deg]
+    double longitude;              //!< [deg]
+    double height;                 //!< [m]
+};
+
+//! Streams sharing the bits of a chunk
+struct Metadata_Lump
+{
+    const Metadata_Ref* streams;   //!< Ids of the streams, in document order
+    const Metadata_Lump* next;
+};
+
+struct Metadata_Chunk
+{
+    unsigned int size_word;        //!< Bytes of a word
+    unsigned int count_words;
+    const char* endian;            //!< Interned, as the two fields below
+    const char* padding;
+    const char* word_shift;
+    const Metadata_Lump* lumps;
+    const Metadata_Chunk* next;
+};
+
+struct Metadata_Block
+{
+    const char* lane;              //!< Interned id of the lane holding the block
+    unsigned int cycles;
+    unsigned int size_header;      //!< Bytes before the chunks
+    unsigned int size_footer;      //!< Bytes after them
+    const Metadata_Chunk* chunks;
+};
+
+class MetadataLoader
+{
+public:
+    //! Elements to build
+    enum Sections
+    {
+        FILES = 1,
+        STREAMS = 2,
+        LANES = 4,
+        SYSTEMS = 8,
+        BANDS = 16,
+        SESSIONS = 32,
+        BLOCKS = 64,
+        ALL = FILES | STREAMS | LANES | SYSTEMS | BANDS | SESSIONS | BLOCKS
+    };
+
+    //! Handlers receive each record as soon as it is complete; false stops the loading
+    typedef boost::function<bool(const Metadata_File& file)> File_Handler;
+    typedef boost::function<bool(const Metadata_Stream& stream)> Stream_Handler;
+
+    explicit MetadataLoader(unsigned int sections = ALL);
+
+    /*!
+    * \brief Records of the given kind go to the handler instead of files() or streams(),
+    * and their memory is reused once the handler returns. Lanes, systems, bands, sessions
+    * and blocks, a few per document, are always kept.
+    */
+    void on_file(const File_Handler& handler) { file_handler_ = handler; }
+    void on_stream(const Stream_Handler& handler) { stream_handler_ = handler; }
+
+    /*!
+    * \brief Reads a document. Returns false if it cannot be read or is not well formed
+    * (see error()); records already handed out stay valid.
+    */
+    bool load(const std::string& filename);
+
+    //! Records kept when no handler is set; valid until the next load()
+    const std::vector<const Metadata_File*>& files() const { return files_; }
+    const std::vector<const Metadata_Stream*>& streams() const { return streams_; }
+    const std::vector<const Metadata_Lane*>& lanes() const { return lanes_; }
+    const std::vector<const Metadata_System*>& systems() const { return systems_; }
+    const std::vector<const Metadata_Frequency_Band*>& bands() const { return bands_; }
+    const std::vector<const Metadata_Session*>& sessions() const { return sessions_; }
+    const std::vector<const Metadata_Block*>& blocks() const { return blocks_; }
+
+    //! A handler asked to stop before the end of the document
+    bool stopped() const { return stopped_; }
+    const std::string& error() const { return error_; }
+
+    //! Heap bytes held by the records and the interned strings
+    size_t bytes() const { return records_.bytes() + names_.bytes(); }
+
+private:
+    MetadataLoader(const MetadataLoader&);
+    MetadataLoader& operator=(const MetadataLoader&);
+
+    enum Record
+    {
+        NO_RECORD,
+        FILE_RECORD,
+        STREAM_RECORD,
+        SYSTEM_RECORD,
+        SESSION_RECORD
+    };
+
+    // Scanner events
+    void start_element(bool empty);
+    void end_element();
+
+    const char* intern(const std::string& value) { return names_.intern(value.data(), value.size()); }
+    const char* copy(const std::string& value) { return records_.copy(value.data(), value.size()); }
+    const std::string* attribute(const char* name) const;
+    void set_field();
+    void set_band_field();
+    void set_layout_field();
+    void finish_record();
+    void finish_band();
+
+    unsigned int sections_;
+    File_Handler file_handler_;
+    Stream_Handler stream_handler_;
+
+    Arena records_;
+    StringPool names_;
+    std::vector<const Metadata_File*> files_;
+    std::vector<const Metadata_Stream*> streams_;
+    std::vector<const Metadata_Lane*> lanes_;
+    std::vector<const Metadata_System*> systems_;
+    std::vector<const Metadata_Frequency_Band*> bands_;
+    std::vector<const Metadata_Session*> sessions_;
+    std::vector<const Metadata_Block*> blocks_;
+    std::unordered_set<const char*> stream_ids_;   //!< Interned: a stream repeated in the lanes is kept once
+    std::unordered_set<const char*> band_ids_;     //!< Same for the bands
+    std::unordered_set<const char*> session_ids_;  //!< and the sessions
+
+    // Scanner state
+    std::string name_;
+    std::string text_;
+    std::vector<std::pair<std::string, std::string> > attributes_;
+    std::vector<std::string> path_;     //!< Open elements up to the record and its fields
+    size_t depth_;                      //!< All open elements, skipped ones included
+    size_t skip_depth_;                 //!< Depth of the skipped subtree (0: none)
+    Record record_;
+    size_t record_depth_;
+    Metadata_File* file_;
+    Metadata_Stream* stream_;
+    Metadata_System* system_;
+    Metadata_Session* session_;
+    const Metadata_Ref** last_ref_;     //!< End of the id list of the record being built
+    // Lanes hold the streams, so they are tracked apart from the records
+    Metadata_Lane* lane_;
+    size_t lane_depth_;
+    const Metadata_Ref** last_system_;
+    const Metadata_Ref** last_session_;
+    const char* lane_id_;               //!< Interned id of the last lane opened
+    // So are the bands, defined within the streams, and the layout of the lanes
+    Metadata_Frequency_Band* band_;
+    size_t band_depth_;
+    bool band_has_children_;
+    Metadata_Block* block_;
+    size_t block_depth_;
+    Metadata_Chunk* chunk_;
+    size_t chunk_depth_;
+    const Metadata_Chunk** last_chunk_;
+    Metadata_Lump* lump_;
+    size_t lump_depth_;
+    const Metadata_Lump** last_lump_;
+    const Metadata_Ref** last_lump_stream_;
+    bool has_children_;
+    bool stopped_;
+    std::string error_;
+};
+
+#endif
@@ -0,0 +1,266 @@
+/*!
+* \file navigation_snapshot.cc
+* \brief Immutable snapshots of the navigation data for bulk consumers.
+*
+* Almanac parameters follow IS-GPS-200 Table 20-VI and the Galileo OS
+* SIS ICD section 5.1.10 (relative to the nominal orbit).
+*
+* -------------------------------------------------------------------------
+*
+*/
+
+#include "navigation_snapshot.h"
+
+namespace
+{
+const double SNAPSHOT_PI = 3.1415926535898;              //!< Pi as defined in IS-GPS-200
+const double GPS_ALMANAC_I0 = 0.30;                      //!< Reference inclination [semi-circles]
+const double GALILEO_NOMINAL_SQRT_A = 5440.588203494177; //!< sqrt(29600000 m)
+const double GALILEO_ALMANAC_I0 = 56.0 / 180.0;          //!< Reference inclination [semi-circles]
+
+//! Appends one orbit; angles in semi-circles, as in the almanacs
+void add_orbit(Navigation_Snapshot& snapshot, unsigned int slot, double toa, double sqrt_a, double e,
+        double i, double omega0, double omega, double omega_dot, double m0)
+{
+    snapshot.slot.push_back(slot);
+    snapshot.toa.push_back(toa);
+    snapshot.sqrt_a.push_back(sqrt_a);
+    snapshot.e.push_back(e);
+    snapshot.i.push_back(i * SNAPSHOT_PI);
+    snapshot.omega0.push_back(omega0 * SNAPSHOT_PI);
+    snapshot.omega.push_back(omega * SNAPSHOT_PI);
+    snapshot.omega_dot.push_back(omega_dot * SNAPSHOT_PI);
+    snapshot.m0.push_back(m0 * SNAPSHOT_PI);
+}
+
+void reserve_ephemerides(Navigation_Ephemerides& columns, size_t count)
+{
+    std::vector<double>* doubles[] = { &columns.toe, &columns.sqrt_a, &columns.e, &columns.i0, &columns.idot,
+        &columns.omega0, &columns.omega, &columns.omega_dot, &columns.m0, &columns.delta_n, &columns.cuc,
+        &columns.cus, &columns.crc, &columns.crs, &columns.cic, &columns.cis, &columns.toc, &columns.af0,
+        &columns.af1, &columns.af2 };
+    columns.slot.reserve(count);
+    for (size_t c = 0; c < sizeof(doubles) / sizeof(doubles[0]); c++)
+        {
+            doubles[c]->reserve(count);
+        }
+}
+
+//! Appends one broadcast orbit and clock
+void add_ephemeris(Navigation_Ephemerides& columns, unsigned int slot, double toe, double sqrt_a, double e,
+        double i0, double idot, double omega0, double omega, double omega_dot, double m0, double delta_n,
+        double cuc, double cus, double crc, double crs, double cic, double cis, double toc,
+        double af0, double af1, double af2)
+{
+    columns.slot.push_back(slot);
+    columns.toe.push_back(toe);
+    columns.sqrt_a.push_back(sqrt_a);
+    columns.e.push_back(e);
+    columns.i0.push_back(i0);
+    columns.idot.push_back(idot);
+    columns.omega0.push_back(omega0);
+    columns.omega.push_back(omega);
+    columns.omega_dot.push_back(omega_dot);
+    columns.m0.push_back(m0);
+    columns.delta_n.push_back(delta_n);
+    columns.cuc.push_back(cuc);
+    columns.cus.push_back(cus);
+    columns.crc.push_back(crc);
+    columns.crs.push_back(crs);
+    columns.cic.push_back(cic);
+    columns.cis.push_back(cis);
+    columns.toc.push_back(toc);
+    columns.af0.push_back(af0);
+    columns.af1.push_back(af1);
+    columns.af2.push_back(af2);
+}
+
+//! Appends one Galileo orbit if both signal health status (E1-B and E5b) are 0 (OK)
+void add_galileo_orbit(Navigation_Snapshot& snapshot, int svid, double e1b_hs, double e5b_hs, double toa,
+        double delta_sqrt_a, double e, double delta_i, double omega0, double omega, double omega_dot, double m0)
+{
+    if (svid < 1 || svid > static_cast<int>(NAVIGATION_GALILEO_SLOTS) || e1b_hs != 0 || e5b_hs != 0)
+        {
+            return;
+        }
+    add_orbit(snapshot, NAVIGATION_GPS_SLOTS + svid - 1, toa, GALILEO_NOMINAL_SQRT_A + delta_sqrt_a, e,
+            GALILEO_ALMANAC_I0 + delta_i, omega0, omega, omega_dot, m0);
+}
+}
+
+
+Navigation_Snapshot::Navigation_Snapshot()
+    : version(0), gps_iono_valid(false), gps_utc_valid(false), gps_utc_a0(0.0), gps_utc_a1(0.0),
+      gps_utc_tot(0.0), gps_utc_wnt(0), gps_utc_delta_t_ls(0.0), galileo_iono_valid(false), galileo_utc_valid(false),
+      galileo_utc_a0(0.0), galileo_utc_a1(0.0), galileo_utc_tot(0.0), galileo_utc_wnt(0), galileo_utc_delta_t_ls(0.0)
+{
+    for (int k = 0; k < 4; k++)
+        {
+            gps_alpha[k] = 0.0;
+            gps_beta[k] = 0.0;
+        }
+    for (int k = 0; k < 3; k++)
+        {
+            galileo_ai[k] = 0.0;
+        }
+}
+
+
+Navigation_Snapshot make_navigation_snapshot(const std::map<int, Gps_Almanac>& gps_almanacs,
+        const std::map<int, Galileo_Almanac>& galileo_almanacs,
+        const std::map<int, Gps_Iono>& gps_iono,
+        const std::map<int, Gps_Utc_Model>& gps_utc_models,
+        const std::map<int, Galileo_Iono>& galileo_iono,
+        const std::map<int, Gps_Ephemeris>& gps_ephemerides,
+        const std::map<int, Galileo_Ephemeris>& galileo_ephemerides,
+        const std::map<int, Galileo_Utc_Model>& galileo_utc_models)
+{
+    Navigation_Snapshot snapshot;
+    size_t orbits = gps_almanacs.size() + 3 * galileo_almanacs.size();
+    snapshot.slot.reserve(orbits);
+    snapshot.toa.reserve(orbits);
+    snapshot.sqrt_a.reserve(orbits);
+    snapshot.e.reserve(orbits);
+    snapshot.i.reserve(orbits);
+    snapshot.omega0.reserve(orbits);
+    snapshot.omega.reserve(orbits);
+    snapshot.omega_dot.reserve(orbits);
+    snapshot.m0.reserve(orbits);
+    reserve_ephemerides(snapshot.ephemerides, gps_ephemerides.size() + galileo_ephemerides.size());
+
+    for (std::map<int, Gps_Almanac>::const_iterator it = gps_almanacs.begin(); it != gps_almanacs.end(); ++it)
+        {
+            const Gps_Almanac& alm = it->second;
+            if (alm.i_satellite_PRN < 1 || alm.i_satellite_PRN > NAVIGATION_GPS_SLOTS || alm.i_SV_health != 0)
+                {
+                    continue;
+                }
+            add_orbit(snapshot, alm.i_satellite_PRN - 1, alm.d_Toa, alm.d_sqrt_A, alm.d_e_eccentricity,
+                    GPS_ALMANAC_I0 + alm.d_Delta_i, alm.d_OMEGA0, alm.d_OMEGA, alm.d_OMEGA_DOT, alm.d_M_0);
+        }
+
+    // Each Galileo almanac batch (word types 7 to 10) carries three satellites;
+    // the health of each one comes in the word after the start of its orbit
+    for (std::map<int, Galileo_Almanac>::const_iterator it = galileo_almanacs.begin(); it != galileo_almanacs.end(); ++it)
+        {
+            const Galileo_Almanac& alm = it->second;
+            add_galileo_orbit(snapshot, alm.SVID1_7, alm.E1B_HS_8, alm.E5b_HS_8, alm.t0a_7, alm.DELTA_A_7, alm.e_7,
+                    alm.delta_i_7, alm.Omega0_7, alm.omega_7, alm.Omega_dot_7, alm.M0_7);
+            add_galileo_orbit(snapshot, alm.SVID2_8, alm.E1B_HS_9, alm.E5b_HS_9, alm.t0a_7, alm.DELTA_A_8, alm.e_8,
+                    alm.delta_i_8, alm.Omega0_8, alm.omega_8, alm.Omega_dot_8, alm.M0_9);
+            add_galileo_orbit(snapshot, alm.SVID3_9, alm.E1B_HS_10, alm.E5b_HS_10, alm.t0a_7, alm.DELTA_A_9, alm.e_9,
+                    alm.delta_i_9, alm.Omega0_10, alm.omega_9, alm.Omega_dot_10, alm.M0_10);
+        }
+
+    for (std::map<int, Gps_Ephemeris>::const_iterator it = gps_ephemerides.begin(); it != gps_ephemerides.end(); ++it)
+        {
+            const Gps_Ephemeris& eph = it->second;
+            if (eph.i_satellite_PRN < 1 || eph.i_satellite_PRN > NAVIGATION_GPS_SLOTS || eph.i_SV_health != 0)
+                {
+                    continue;
+                }
+            add_ephemeris(snapshot.ephemerides, eph.i_satellite_PRN - 1, eph.d_Toe, eph.d_sqrt_A, eph.d_e_eccentricity,
+                    eph.d_i_0, eph.d_IDOT, eph.d_OMEGA0, eph.d_OMEGA, eph.d_OMEGA_DOT, eph.d_M_0, eph.d_Delta_n,
+                    eph.d_Cuc, eph.d_Cus, eph.d_Crc, eph.d_Crs, eph.d_Cic, eph.d_Cis, eph.d_Toc,
+                    eph.d_A_f0, eph.d_A_f1, eph.d_A_f2);
+        }
+    for (std::map<int, Galileo_Ephemeris>::const_iterator it = galileo_ephemerides.begin(); it != galileo_ephemerides.end(); ++it)
+        {
+            const Galileo_Ephemeris& eph = it->second;
+            if (eph.i_satellite_PRN < 1 || eph.i_satellite_PRN > static_cast<int>(NAVIGATION_GALILEO_SLOTS)
+                || eph.E1B_HS_5 != 0 || eph.E5b_HS_5 != 0)
+                {
+                    continue;
+                }
+            add_ephemeris(snapshot.ephemerides, NAVIGATION_GPS_SLOTS + eph.i_satellite_PRN - 1, eph.t0e_1, eph.A_1, eph.e_1,
+                    eph.i_0_2, eph.iDot_2, eph.OMEGA_0_2, eph.omega_2, eph.OMEGA_dot_3, eph.M0_1, eph.delta_n_3,
+                    eph.C_uc_3, eph.C_us_3, eph.C_rc_3, eph.C_rs_3, eph.C_ic_4, eph.C_is_4, eph.t0c_4,
+                    eph.af0_4, eph.af1_4, eph.af2_4);
+        }
+
+    // Iono and UTC models are written under key 0
+    std::map<int, Gps_Iono>::const_iterator iono = gps_iono.find(0);
+    if (iono != gps_iono.end() && iono->second.valid)
+        {
+            snapshot.gps_iono_valid = true;
+            snapshot.gps_alpha[0] = iono->second.d_alpha0;
+            snapshot.gps_alpha[1] = iono->second.d_alpha1;
+            snapshot.gps_alpha[2] = iono->second.d_alpha2;
+            snapshot.gps_alpha[3] = iono->second.d_alpha3;
+            snapshot.gps_beta[0] = iono->second.d_beta0;
+            snapshot.gps_beta[1] = iono->second.d_beta1;
+            snapshot.gps_beta[2] = iono->second.d_beta2;
+            snapshot.gps_beta[3] = iono->second.d_beta3;
+        }
+    std::map<int, Gps_Utc_Model>::const_iterator utc = gps_utc_models.find(0);
+    if (utc != gps_utc_models.end() && utc->second.valid)
+        {
+            snapshot.gps_utc_valid = true;
+            snapshot.gps_utc_a0 = utc->second.d_A0;
+            snapshot.gps_utc_a1 = utc->second.d_A1;
+            snapshot.gps_utc_tot = utc->second.d_t_OT;
+            snapshot.gps_utc_wnt = utc->second.i_WN_T;
+            snapshot.gps_utc_delta_t_ls = utc->second.d_DeltaT_LS;
+        }
+    std::map<int, Galileo_Iono>::const_iterator galileo = galileo_iono.find(0);
+    if (galileo != galileo_iono.end())
+        {
+            snapshot.galileo_iono_valid = true;
+            snapshot.galileo_ai[0] = galileo->second.ai0_5;
+            snapshot.galileo_ai[1] = galileo->second.ai1_5;
+            snapshot.galileo_ai[2] = galileo->second.ai2_5;
+        }
+    std::map<int, Galileo_Utc_Model>::const_iterator galileo_utc = galileo_utc_models.find(0);
+    if (galileo_utc != galileo_utc_models.end())
+        {
+            snapshot.galileo_utc_valid = true;
+            snapshot.galileo_utc_a0 = galileo_utc->second.A0_6;
+            snapshot.galileo_utc_a1 = galileo_utc->second.A1_6;
+            snapshot.galileo_utc_tot = galileo_utc->second.t0t_6;
+            snapshot.galileo_utc_wnt = galileo_utc->second.WNot_6;
+            snapshot.galileo_utc_delta_t_ls = galileo_utc->second.Delta_tLS_6;
+        }
+    return snapshot;
+}
+
+
+NavigationPublisher::NavigationPublisher()
+    : current_(std::make_shared<Navigation_Snapshot>()), version_(0)
+{
+}
+
+
+std::shared_ptr<const Navigation_Snapshot> NavigationPublisher::current() const
+{
+    return std::atomic_load(&current_);
+}
+
+
+std::shared_ptr<const Navigation_Snapshot> NavigationPublisher::publish(const Navigation_Snapshot& snapshot)
+{
+    // The copy is made before the swap, so readers only ever see complete snapshots
+    std::shared_ptr<Navigation_Snapshot> next = std::make_shared<Navigation_Snapshot>(snapshot);
+    boost::mutex::scoped_lock lock(publish_mutex_);
+    next->version = ++version_;
+    std::shared_ptr<const Navigation_Snapshot> published = next;
+    std::atomic_store(&current_, published);
+    return published;
+}
+
+
+std::shared_ptr<const Navigation_Snapshot> NavigationPublisher::publish(const std::function<Navigation_Snapshot()>& build)
+{
+    boost::mutex::scoped_lock lock(publish_mutex_);
+    std::shared_ptr<Navigation_Snapshot> next = std::make_shared<Navigation_Snapshot>(build());
+    next->version = ++version_;
+    std::shared_ptr<const Navigation_Snapshot> published = next;
+    std::atomic_store(&current_, published);
+    return published;
+}
+
+
+NavigationPublisher& navigation_publisher()
+{
+    static NavigationPublisher publisher;
+    return publisher;
+}
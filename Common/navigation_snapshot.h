@@ -0,0 +1,174 @@
+/*!
+* \file navigation_snapshot.h
+* \brief Immutable snapshots of the navigation data for bulk consumers.
+*
+* The position sweep and other batch queries read the ephemerides,
+* almanacs, iono and UTC models far more often than the data collectors
+* write them. Instead of going through the global maps for every query,
+* they take the current Navigation_Snapshot once: a copy of the navigation
+* data laid out as one contiguous column per ephemeris and almanac
+* element, never modified after it is published. A new snapshot is built
+* when the data change and replaces the current one with an atomic pointer
+* swap; consumers holding the old one keep it alive and consistent until
+* they release it.
+*
+* Publications are serialized, and the maps are read for a publication
+* only once it holds the publish lock, so a snapshot is never replaced by
+* one built from older content of the maps.
+*
+* -------------------------------------------------------------------------
+*
+*/
+
+#ifndef GNSS_SDR_NAVIGATION_SNAPSHOT_H_
+#define GNSS_SDR_NAVIGATION_SNAPSHOT_H_
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <vector>
+#include <boost/thread.hpp>
+#include "galileo_almanac.h"
+#include "galileo_ephemeris.h"
+#include "galileo_iono.h"
+#include "galileo_utc_model.h"
+#include "gps_almanac.h"
+#include "gps_ephemeris.h"
+#include "gps_iono.h"
+#include "gps_utc_model.h"
+
+const unsigned int NAVIGATION_GPS_SLOTS = 32;      //!< GPS PRN 1..32
+const unsigned int NAVIGATION_GALILEO_SLOTS = 36;  //!< Galileo SVID 1..36
+
+/*!
+* \brief Broadcast ephemerides of the healthy satellites, one column per
+* element: ephemeris k is element k of every column. Values are those of
+* Gps_Ephemeris and Galileo_Ephemeris, in their units.
+*/
+struct Navigation_Ephemerides
+{
+    std::vector<unsigned int> slot;    //!< PRN - 1 for GPS, NAVIGATION_GPS_SLOTS + SVID - 1 for Galileo
+    std::vector<double> toe;           //!< Ephemeris reference time of week
+    std::vector<double> sqrt_a;        //!< Square root of the semi-major axis [sqrt(m)]
+    std::vector<double> e;             //!< Eccentricity
+    std::vector<double> i0;            //!< Inclination at reference time
+    std::vector<double> idot;          //!< Rate of inclination
+    std::vector<double> omega0;        //!< Longitude of the ascending node at weekly epoch
+    std::vector<double> omega;         //!< Argument of perigee
+    std::vector<double> omega_dot;     //!< Rate of right ascension
+    std::vector<double> m0;            //!< Mean anomaly at reference time
+    std::vector<double> delta_n;       //!< Mean motion difference
+    std::vector<double> cuc;           //!< Cosine correction of the argument of latitude
+    std::vector<double> cus;           //!< Sine correction of the argument of latitude
+    std::vector<double> crc;           //!< Cosine correction of the orbit radius
+    std::vector<double> crs;           //!< Sine correction of the orbit radius
+    std::vector<double> cic;           //!< Cosine correction of the inclination
+    std::vector<double> cis;           //!< Sine correction of the inclination
+    std::vector<double> toc;           //!< Clock reference time of week
+    std::vector<double> af0;           //!< Clock bias
+    std::vector<double> af1;           //!< Clock drift
+    std::vector<double> af2;           //!< Clock drift rate
+
+    unsigned int satellites() const { return slot.size(); }
+};
+
+/*!
+* \brief Navigation data at one point in time, read only once published.
+* Orbit k of the almanacs is element k of every almanac column; angles are
+* in radians, times in seconds.
+*/
+struct Navigation_Snapshot
+{
+    unsigned long long version;        //!< Publication number, 0 before the first one
+
+    // Almanac orbits of the healthy GPS and Galileo satellites
+    std::vector<unsigned int> slot;    //!< PRN - 1 for GPS, NAVIGATION_GPS_SLOTS + SVID - 1 for Galileo
+    std::vector<double> toa;           //!< Almanac reference time of week
+    std::vector<double> sqrt_a;        //!< Square root of the semi-major axis [sqrt(m)]
+    std::vector<double> e;             //!< Eccentricity
+    std::vector<double> i;             //!< Inclination
+    std::vector<double> omega0;        //!< Longitude of the ascending node at weekly epoch
+    std::vector<double> omega;         //!< Argument of perigee
+    std::vector<double> omega_dot;     //!< Rate of right ascension [rad/s]
+    std::vector<double> m0;            //!< Mean anomaly at reference time
+
+    // Broadcast orbits and clocks of the healthy GPS and Galileo satellites
+    Navigation_Ephemerides ephemerides;
+
+    // GPS Klobuchar model
+    bool gps_iono_valid;
+    double gps_alpha[4];
+    double gps_beta[4];
+
+    // GPS to UTC
+    bool gps_utc_valid;
+    double gps_utc_a0;                 //!< [s]
+    double gps_utc_a1;                 //!< [s/s]
+    double gps_utc_tot;                //!< Reference time of week [s]
+    int gps_utc_wnt;                   //!< Reference week
+    double gps_utc_delta_t_ls;         //!< Leap seconds [s]
+
+    // Galileo NeQuick effective ionisation level coefficients
+    bool galileo_iono_valid;
+    double galileo_ai[3];
+
+    // Galileo to UTC
+    bool galileo_utc_valid;
+    double galileo_utc_a0;             //!< [s]
+    double galileo_utc_a1;             //!< [s/s]
+    double galileo_utc_tot;            //!< Reference time of week [s]
+    int galileo_utc_wnt;               //!< Reference week
+    double galileo_utc_delta_t_ls;     //!< Leap seconds [s]
+
+    Navigation_Snapshot();
+
+    unsigned int satellites() const { return slot.size(); }
+};
+
+/*!
+* \brief Snapshot of the given almanacs, iono and UTC models and ephemerides. Keys
+* and values are those of the global maps; unhealthy satellites are left out.
+*/
+Navigation_Snapshot make_navigation_snapshot(const std::map<int, Gps_Almanac>& gps_almanacs,
+        const std::map<int, Galileo_Almanac>& galileo_almanacs,
+        const std::map<int, Gps_Iono>& gps_iono = std::map<int, Gps_Iono>(),
+        const std::map<int, Gps_Utc_Model>& gps_utc_models = std::map<int, Gps_Utc_Model>(),
+        const std::map<int, Galileo_Iono>& galileo_iono = std::map<int, Galileo_Iono>(),
+        const std::map<int, Gps_Ephemeris>& gps_ephemerides = std::map<int, Gps_Ephemeris>(),
+        const std::map<int, Galileo_Ephemeris>& galileo_ephemerides = std::map<int, Galileo_Ephemeris>(),
+        const std::map<int, Galileo_Utc_Model>& galileo_utc_models = std::map<int, Galileo_Utc_Model>());
+
+/*!
+* \brief Holds the current snapshot. current() never waits for publish() to
+* build its data: it only copies the shared pointer.
+*/
+class NavigationPublisher
+{
+public:
+    NavigationPublisher();
+
+    std::shared_ptr<const Navigation_Snapshot> current() const;
+
+    /*!
+    * \brief Numbers the snapshot, makes it the current one and returns it.
+    */
+    std::shared_ptr<const Navigation_Snapshot> publish(const Navigation_Snapshot& snapshot);
+
+    /*!
+    * \brief Same, with the snapshot built by build() under the publish lock: when it
+    * reads the global maps, publications follow the order of their content.
+    */
+    std::shared_ptr<const Navigation_Snapshot> publish(const std::function<Navigation_Snapshot()>& build);
+
+private:
+    std::shared_ptr<const Navigation_Snapshot> current_;
+    boost::mutex publish_mutex_;
+    unsigned long long version_;
+};
+
+/*!
+* \brief Publisher shared by the whole program.
+*/
+NavigationPublisher& navigation_publisher();
+
+#endif
@@ -0,0 +1,183 @@
+/*!
+* \file position_index.cc
+* \brief k-d tree over the positions of a PositionStore.
+*
+* -------------------------------------------------------------------------
+*
+*/
+
+#include "position_index.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+const double WGS84_A = 6378137.0;          //!< WGS84 semi-major axis [m]
+const double WGS84_E2 = 6.69437999014e-3;  //!< WGS84 first eccentricity squared
+const double DEG_TO_RAD = 3.1415926535898 / 180.0;
+
+void geodetic_to_ecef(double latitude_deg, double longitude_deg, double height_m, double* xyz)
+{
+    double lat = latitude_deg * DEG_TO_RAD;
+    double lon = longitude_deg * DEG_TO_RAD;
+    double sin_lat = sin(lat);
+    double n = WGS84_A / sqrt(1.0 - WGS84_E2 * sin_lat * sin_lat);
+    xyz[0] = (n + height_m) * cos(lat) * cos(lon);
+    xyz[1] = (n + height_m) * cos(lat) * sin(lon);
+    xyz[2] = (n * (1.0 - WGS84_E2) + height_m) * sin_lat;
+}
+
+struct Axis_Less
+{
+    const std::vector<double>* xyz;
+    unsigned int axis;
+    bool operator()(size_t a, size_t b) const { return (*xyz)[3 * a + axis] < (*xyz)[3 * b + axis]; }
+};
+}
+
+
+PositionIndex::PositionIndex(const PositionStore& store)
+{
+    size_t n = store.size();
+    std::vector<double> xyz(3 * n);
+    for (size_t c = 0; c < store.chunks(); c++)
+        {
+            const double* lat = store.latitudes(c);
+            const double* lon = store.longitudes(c);
+            const float* height = store.heights(c);
+            size_t base = c * PositionStore::CHUNK_POINTS;
+            for (size_t k = 0; k < store.chunk_points(c); k++)
+                {
+                    geodetic_to_ecef(lat[k], lon[k], height[k], &xyz[3 * (base + k)]);
+                }
+        }
+
+    index_.resize(n);
+    for (size_t k = 0; k < n; k++)
+        {
+            index_[k] = k;
+        }
+
+    // Sort the store indices into tree order, then lay the coordinates out in that order
+    xyz_.swap(xyz);
+    build(0, n, 0);
+    std::vector<double> ordered(3 * n);
+    for (size_t k = 0; k < n; k++)
+        {
+            ordered[3 * k] = xyz_[3 * index_[k]];
+            ordered[3 * k + 1] = xyz_[3 * index_[k] + 1];
+            ordered[3 * k + 2] = xyz_[3 * index_[k] + 2];
+        }
+    xyz_.swap(ordered);
+}
+
+
+void PositionIndex::build(size_t first, size_t last, unsigned int axis)
+{
+    if (last - first <= 1)
+        {
+            return;
+        }
+    size_t middle = first + (last - first) / 2;
+    Axis_Less less;
+    less.xyz = &xyz_;
+    less.axis = axis;
+    std::nth_element(index_.begin() + first, index_.begin() + middle, index_.begin() + last, less);
+    build(first, middle, (axis + 1) % 3);
+    build(middle + 1, last, (axis + 1) % 3);
+}
+
+
+double PositionIndex::distance2(size_t node, const double* query) const
+{
+    double dx = xyz_[3 * node] - query[0];
+    double dy = xyz_[3 * node + 1] - query[1];
+    double dz = xyz_[3 * node + 2] - query[2];
+    return dx * dx + dy * dy + dz * dz;
+}
+
+
+bool PositionIndex::nearest(double latitude_deg, double longitude_deg, double height_m,
+        size_t& store_index, double& distance_m) const
+{
+    if (index_.empty())
+        {
+            return false;
+        }
+    double query[3];
+    geodetic_to_ecef(latitude_deg, longitude_deg, height_m, query);
+    size_t best = 0;
+    double best_d2 = std::numeric_limits<double>::max();
+    search_nearest(0, index_.size(), 0, query, best, best_d2);
+    store_index = index_[best];
+    distance_m = sqrt(best_d2);
+    return true;
+}
+
+
+void PositionIndex::search_nearest(size_t first, size_t last, unsigned int axis, const double* query,
+        size_t& best, double& best_d2) const
+{
+    if (first >= last)
+        {
+            return;
+        }
+    size_t middle = first + (last - first) / 2;
+    double d2 = distance2(middle, query);
+    if (d2 < best_d2)
+        {
+            best_d2 = d2;
+            best = middle;
+        }
+
+    // Visit the side of the query first; the other one only if the splitting plane is closer than the best match
+    double delta = query[axis] - coordinate(middle, axis);
+    unsigned int next_axis = (axis + 1) % 3;
+    if (delta < 0.0)
+        {
+            search_nearest(first, middle, next_axis, query, best, best_d2);
+            if (delta * delta < best_d2) search_nearest(middle + 1, last, next_axis, query, best, best_d2);
+        }
+    else
+        {
+            search_nearest(middle + 1, last, next_axis, query, best, best_d2);
+            if (delta * delta < best_d2) search_nearest(first, middle, next_axis, query, best, best_d2);
+        }
+}
+
+
+std::vector<size_t> PositionIndex::within(double latitude_deg, double longitude_deg, double height_m, double radius_m) const
+{
+    std::vector<size_t> found;
+    double query[3];
+    geodetic_to_ecef(latitude_deg, longitude_deg, height_m, query);
+    search_within(0, index_.size(), 0, query, radius_m * radius_m, found);
+    std::sort(found.begin(), found.end());
+    return found;
+}
+
+
+void PositionIndex::search_within(size_t first, size_t last, unsigned int axis, const double* query,
+        double radius2, std::vector<size_t>& found) const
+{
+    if (first >= last)
+        {
+            return;
+        }
+    size_t middle = first + (last - first) / 2;
+    if (distance2(middle, query) <= radius2)
+        {
+            found.push_back(index_[middle]);
+        }
+    double delta = query[axis] - coordinate(middle, axis);
+    unsigned int next_axis = (axis + 1) % 3;
+    if (delta <= 0.0 || delta * delta <= radius2)
+        {
+            search_within(first, middle, next_axis, query, radius2, found);
+        }
+    if (delta >= 0.0 || delta * delta <= radius2)
+        {
+            search_within(middle + 1, last, next_axis, query, radius2, found);
+        }
+}
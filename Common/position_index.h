@@ -0,0 +1,57 @@
+/*!
+* \file position_index.h
+* \brief k-d tree over the positions of a PositionStore.
+*
+* Positions are converted to WGS84 ECEF coordinates, so distances and
+* tolerances are in meters and behave across the poles and the 180 deg
+* meridian. The tree is stored implicitly in permuted arrays: the median
+* of every range along the splitting axis sits in the middle of the range.
+*
+* -------------------------------------------------------------------------
+*
+*/
+
+#ifndef GNSS_SDR_POSITION_INDEX_H_
+#define GNSS_SDR_POSITION_INDEX_H_
+
+#include <cstddef>
+#include <vector>
+#include "position_store.h"
+
+class PositionIndex
+{
+public:
+    /*!
+    * \brief Builds the tree over every point of the store, in O(n log n).
+    */
+    explicit PositionIndex(const PositionStore& store);
+
+    size_t size() const { return index_.size(); }
+    bool empty() const { return index_.empty(); }
+
+    /*!
+    * \brief Store index of the point closest to the given position, and its distance [m].
+    * Returns false if the index is empty.
+    */
+    bool nearest(double latitude_deg, double longitude_deg, double height_m,
+            size_t& store_index, double& distance_m) const;
+
+    /*!
+    * \brief Store indices of every point not farther than radius_m from the given position, in store order.
+    */
+    std::vector<size_t> within(double latitude_deg, double longitude_deg, double height_m, double radius_m) const;
+
+private:
+    void build(size_t first, size_t last, unsigned int axis);
+    void search_nearest(size_t first, size_t last, unsigned int axis, const double* query,
+            size_t& best, double& best_d2) const;
+    void search_within(size_t first, size_t last, unsigned int axis, const double* query,
+            double radius2, std::vector<size_t>& found) const;
+    double coordinate(size_t node, unsigned int axis) const { return xyz_[3 * node + axis]; }
+    double distance2(size_t node, const double* query) const;
+
+    std::vector<double> xyz_;     //!< ECEF coordinates in tree order [m]
+    std::vector<size_t> index_;   //!< Store index of each tree node
+};
+
+#endif
@@ -0,0 +1,147 @@
+/*!
+* \file position_store.cc
+* \brief Growable column store of recorded receiver positions.
+*
+* -------------------------------------------------------------------------
+*
+*/
+
+#include "position_store.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+namespace
+{
+const size_t STORE_ALIGNMENT = 64;
+}
+
+const size_t PositionStore::CHUNK_SHIFT;
+const size_t PositionStore::CHUNK_POINTS;
+const size_t PositionStore::MAX_CHUNKS;
+
+
+PositionStore::PositionStore()
+    : chunks_(new std::atomic<Chunk*>[MAX_CHUNKS]), size_(0)
+{
+    for (size_t c = 0; c < MAX_CHUNKS; c++)
+        {
+            chunks_[c].store(0, std::memory_order_relaxed);
+        }
+}
+
+
+PositionStore::~PositionStore()
+{
+    clear();
+}
+
+
+void PositionStore::clear()
+{
+    for (size_t c = 0; c < MAX_CHUNKS; c++)
+        {
+            Chunk* old = chunks_[c].exchange(0);
+            if (old == 0)
+                {
+                    break;
+                }
+            free(old->memory);
+            delete old;
+        }
+    size_.store(0);
+}
+
+
+size_t PositionStore::claim(size_t count)
+{
+    size_t first = size_.fetch_add(count);
+    if (first + count > MAX_CHUNKS * CHUNK_POINTS)
+        {
+            size_.fetch_sub(count);
+            throw std::length_error("PositionStore: too many positions");
+        }
+    if (count > 0)
+        {
+            ensure_chunk((first + count - 1) >> CHUNK_SHIFT);
+        }
+    return first;
+}
+
+
+PositionStore::Chunk* PositionStore::ensure_chunk(size_t c)
+{
+    Chunk* existing = chunks_[c].load(std::memory_order_acquire);
+    if (existing != 0)
+        {
+            return existing;
+        }
+
+    // Chunks are created in order, so every chunk before c exists once this returns
+    boost::mutex::scoped_lock lock(grow_mutex_);
+    for (size_t k = 0; k <= c; k++)
+        {
+            if (chunks_[k].load(std::memory_order_relaxed) != 0)
+                {
+                    continue;
+                }
+            void* memory = 0;
+            size_t bytes = CHUNK_POINTS * (2 * sizeof(double) + 2 * sizeof(float));
+            if (posix_memalign(&memory, STORE_ALIGNMENT, bytes) != 0)
+                {
+                    throw std::bad_alloc();
+                }
+            Chunk* created = new Chunk();
+            created->memory = memory;
+            created->latitude = static_cast<double*>(memory);
+            created->longitude = created->latitude + CHUNK_POINTS;
+            created->height = reinterpret_cast<float*>(created->longitude + CHUNK_POINTS);
+            created->active_time = created->height + CHUNK_POINTS;
+            chunks_[k].store(created, std::memory_order_release);
+        }
+    return chunks_[c].load(std::memory_order_relaxed);
+}
+
+
+void PositionStore::write(size_t first, const double* latitude, const double* longitude,
+        const float* height, const float* active_time, size_t count)
+{
+    size_t done = 0;
+    while (done < count)
+        {
+            size_t index = first + done;
+            Chunk* target = chunks_[index >> CHUNK_SHIFT].load(std::memory_order_acquire);
+            size_t offset = index & (CHUNK_POINTS - 1);
+            size_t n = std::min(count - done, CHUNK_POINTS - offset);
+            memcpy(target->latitude + offset, latitude + done, n * sizeof(double));
+            memcpy(target->longitude + offset, longitude + done, n * sizeof(double));
+            memcpy(target->height + offset, height + done, n * sizeof(float));
+            memcpy(target->active_time + offset, active_time + done, n * sizeof(float));
+            done += n;
+        }
+}
+
+
+size_t PositionStore::append(const double* latitude, const double* longitude,
+        const float* height, const float* active_time, size_t count)
+{
+    size_t first = claim(count);
+    write(first, latitude, longitude, height, active_time, count);
+    return first;
+}
+
+
+void PositionStore::push_back(double latitude, double longitude, float height, float active_time)
+{
+    append(&latitude, &longitude, &height, &active_time, 1);
+}
+
+
+size_t PositionStore::chunk_points(size_t c) const
+{
+    size_t total = size();
+    size_t first = c << CHUNK_SHIFT;
+    return std::min(total - first, CHUNK_POINTS);
+}
@@ -0,0 +1,102 @@
+/*!
+* \file position_store.h
+* \brief Growable column store of recorded receiver positions.
+*
+* Positions are kept as separate columns (latitude, longitude, height,
+* active time) inside fixed size, cache line aligned chunks. Growing the
+* store allocates a new chunk and never moves the recorded points, so
+* several threads can append at the same time, and each chunk can be
+* walked as plain contiguous arrays.
+*
+* -------------------------------------------------------------------------
+*
+*/
+
+#ifndef GNSS_SDR_POSITION_STORE_H_
+#define GNSS_SDR_POSITION_STORE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <boost/thread/mutex.hpp>
+
+class PositionStore
+{
+public:
+    static const size_t CHUNK_SHIFT = 16;
+    static const size_t CHUNK_POINTS = static_cast<size_t>(1) << CHUNK_SHIFT;  //!< Points per chunk
+    static const size_t MAX_CHUNKS = 16384;                                       //!< 2^30 points
+
+    PositionStore();
+    ~PositionStore();
+
+    /*!
+    * \brief Number of points. Only exact once every pending append has returned.
+    */
+    size_t size() const { return size_.load(std::memory_order_acquire); }
+    bool empty() const { return size() == 0; }
+
+    /*!
+    * \brief Forgets every point and releases the chunks. Not thread safe.
+    */
+    void clear();
+
+    /*!
+    * \brief Reserves count consecutive points and returns the index of the first one.
+    * Thread safe. Throws std::length_error beyond MAX_CHUNKS * CHUNK_POINTS points.
+    */
+    size_t claim(size_t count);
+
+    /*!
+    * \brief Fills points [first, first + count) previously obtained with claim().
+    * Thread safe as long as the ranges written by different threads do not overlap.
+    */
+    void write(size_t first, const double* latitude, const double* longitude,
+            const float* height, const float* active_time, size_t count);
+
+    /*!
+    * \brief claim() followed by write(). Returns the index of the first point.
+    */
+    size_t append(const double* latitude, const double* longitude,
+            const float* height, const float* active_time, size_t count);
+
+    void push_back(double latitude, double longitude, float height, float active_time);
+
+    double latitude(size_t index) const { return chunk(index >> CHUNK_SHIFT)->latitude[index & (CHUNK_POINTS - 1)]; }
+    double longitude(size_t index) const { return chunk(index >> CHUNK_SHIFT)->longitude[index & (CHUNK_POINTS - 1)]; }
+    float height(size_t index) const { return chunk(index >> CHUNK_SHIFT)->height[index & (CHUNK_POINTS - 1)]; }
+    float active_time(size_t index) const { return chunk(index >> CHUNK_SHIFT)->active_time[index & (CHUNK_POINTS - 1)]; }
+
+    /*!
+    * \brief Chunk by chunk access: chunk c holds points [c * CHUNK_POINTS, c * CHUNK_POINTS + chunk_points(c)).
+    * Every column of a chunk starts on a 64 byte boundary.
+    */
+    size_t chunks() const { return (size() + CHUNK_POINTS - 1) >> CHUNK_SHIFT; }
+    size_t chunk_points(size_t c) const;
+    const double* latitudes(size_t c) const { return chunk(c)->latitude; }
+    const double* longitudes(size_t c) const { return chunk(c)->longitude; }
+    const float* heights(size_t c) const { return chunk(c)->height; }
+    const float* active_times(size_t c) const { return chunk(c)->active_time; }
+
+private:
+    struct Chunk
+    {
+        double* latitude;
+        double* longitude;
+        float* height;
+        float* active_time;
+        void* memory;
+    };
+
+    PositionStore(const PositionStore&);
+    PositionStore& operator=(const PositionStore&);
+
+    const Chunk* chunk(size_t c) const { return chunks_[c].load(std::memory_order_acquire); }
+    Chunk* ensure_chunk(size_t c);
+
+    std::unique_ptr<std::atomic<Chunk*>[]> chunks_;
+    std::atomic<size_t> size_;
+    boost::mutex grow_mutex_;
+};
+
+#endif
@@ -0,0 +1,196 @@
+/*!
+* \file prn_table.h
+* \brief Navigation data indexed by satellite, with the interface of concurrent_map.
+*
+* concurrent_map keeps the items in a std::map behind one mutex, so every
+* read walks a tree under the same lock the data collectors take to write.
+* PrnTable keeps one slot per key in a fixed array: the key (PRN, SVID, or
+* 0 for iono and UTC models) is the index.
+*
+* Each slot holds two copies of its item and the index of the current one.
+* A reader announces itself on the current copy, checks that it is still
+* the current one and copies it; it never waits for a writer and retries
+* only if a write was published in between. A writer fills the other copy,
+* once the readers still on it have left, then makes it current and bumps
+* the slot version, so no item is ever read half written, whatever its
+* type (ephemerides hold std::map members, so a plain seqlock copy racing
+* with a write is not an option). Writers are serialized, one slot at a
+* time. The copies of a slot are allocated on its first write. Keys
+* outside [0, Capacity) go to a std::map behind a mutex, as in
+* concurrent_map. Each reader count has a cache line of its own, so the
+* readers of one copy do not slow down those of the other copy or of the
+* next slot.
+*
+* global_maps.h makes the global navigation maps PrnTable with
+* GLOBAL_MAP_PRN_TABLE.
+*
+* -------------------------------------------------------------------------
+*
+*/
+
+#ifndef GNSS_SDR_PRN_TABLE_H_
+#define GNSS_SDR_PRN_TABLE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <map>
+#include <thread>
+#include <boost/thread.hpp>
+
+//! Slots of a table: GPS and Galileo PRNs and SBAS PRNs 120 .. 158
+const size_t PRN_TABLE_CAPACITY = 160;
+
+//! Alignment of the slots and of their reader counts
+const size_t PRN_TABLE_CACHE_LINE = 64;
+
+template <typename Data, size_t Capacity = PRN_TABLE_CAPACITY>
+class PrnTable
+{
+public:
+    PrnTable()
+    {
+        for (size_t k = 0; k < Capacity; k++)
+            {
+                slots_[k].items.store(0, std::memory_order_relaxed);
+                slots_[k].current.store(0, std::memory_order_relaxed);
+                slots_[k].readers[0].count.store(0, std::memory_order_relaxed);
+                slots_[k].readers[1].count.store(0, std::memory_order_relaxed);
+                slots_[k].version.store(0, std::memory_order_relaxed);
+            }
+    }
+
+    ~PrnTable()
+    {
+        for (size_t k = 0; k < Capacity; k++)
+            {
+                delete[] slots_[k].items.load(std::memory_order_relaxed);
+            }
+    }
+
+    void write(int key, const Data& data)
+    {
+        boost::mutex::scoped_lock lock(write_mutex_);
+        if (!in_range(key))
+            {
+                overflow_[key] = data;
+                return;
+            }
+        Slot& slot = slots_[key];
+        Data* items = slot.items.load(std::memory_order_relaxed);
+        if (items == 0)
+            {
+                items = new Data[2];
+                items[0] = data;
+                slot.items.store(items, std::memory_order_release);
+            }
+        else
+            {
+                unsigned int next = 1 - slot.current.load(std::memory_order_relaxed);
+                while (slot.readers[next].count.load(std::memory_order_seq_cst) != 0)
+                    {
+                        std::this_thread::yield();
+                    }
+                items[next] = data;
+                slot.current.store(next, std::memory_order_seq_cst);
+            }
+        slot.version.fetch_add(1, std::memory_order_release);
+    }
+
+    bool read(int key, Data& p) const
+    {
+        if (!in_range(key))
+            {
+                boost::mutex::scoped_lock lock(write_mutex_);
+                typename std::map<int, Data>::const_iterator it = overflow_.find(key);
+                if (it == overflow_.end())
+                    {
+                        return false;
+                    }
+                p = it->second;
+                return true;
+            }
+        const Slot& slot = slots_[key];
+        const Data* items = slot.items.load(std::memory_order_acquire);
+        if (items == 0)
+            {
+                return false;
+            }
+        for (;;)
+            {
+                unsigned int current = slot.current.load(std::memory_order_seq_cst);
+                slot.readers[current].count.fetch_add(1, std::memory_order_seq_cst);
+                if (slot.current.load(std::memory_order_seq_cst) == current)
+                    {
+                        p = items[current];
+                        slot.readers[current].count.fetch_sub(1, std::memory_order_release);
+                        return true;
+                    }
+                slot.readers[current].count.fetch_sub(1, std::memory_order_relaxed);
+            }
+    }
+
+    /*!
+    * \brief Number of writes of the key so far, to tell whether it changed
+    * since a previous read. Always 0 for keys outside the slots.
+    */
+    unsigned int version(int key) const
+    {
+        return in_range(key) ? slots_[key].version.load(std::memory_order_acquire) : 0;
+    }
+
+    std::map<int, Data> get_map_copy() const
+    {
+        std::map<int, Data> copy;
+        Data item;
+        for (size_t k = 0; k < Capacity; k++)
+            {
+                if (read(static_cast<int>(k), item))
+                    {
+                        copy.insert(copy.end(), std::make_pair(static_cast<int>(k), item));
+                    }
+            }
+        boost::mutex::scoped_lock lock(write_mutex_);
+        copy.insert(overflow_.begin(), overflow_.end());
+        return copy;
+    }
+
+    int size() const
+    {
+        int count = 0;
+        for (size_t k = 0; k < Capacity; k++)
+            {
+                if (slots_[k].items.load(std::memory_order_acquire) != 0)
+                    {
+                        count++;
+                    }
+            }
+        boost::mutex::scoped_lock lock(write_mutex_);
+        return count + static_cast<int>(overflow_.size());
+    }
+
+private:
+    //! Readers inside one copy, alone on its cache line
+    struct alignas(PRN_TABLE_CACHE_LINE) Reader_Count
+    {
+        mutable std::atomic<unsigned int> count;
+    };
+
+    struct Slot
+    {
+        std::atomic<Data*> items;                         //!< Two copies, null until the first write
+        std::atomic<unsigned int> current;                //!< Copy the readers take
+        std::atomic<unsigned int> version;
+        Reader_Count readers[2];
+    };
+
+    PrnTable(const PrnTable&);
+    PrnTable& operator=(const PrnTable&);
+
+    static bool in_range(int key) { return key >= 0 && static_cast<size_t>(key) < Capacity; }
+
+    Slot slots_[Capacity];
+    mutable boost::mutex write_mutex_;
+    std::map<int, Data> overflow_;
+};
+
+#endif
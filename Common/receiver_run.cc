@@ -0,0 +1,34 @@
+/*!
+* \file receiver_run.cc
+* \brief Timed receiver run, and publication of the navigation data it collected.
+*
+* -------------------------------------------------------------------------
+*
+*/
+
+#include "receiver_run.h"
+#include "control_thread.h"
+#include "global_maps.h"
+#include "stage_timer.h"
+
+
+long long int run_receiver(std::shared_ptr<ConfigurationInterface> configuration)
+{
+    StageTimer timer(STAGE_RECEIVER_RUN);
+    std::unique_ptr<ControlThread> control_thread(new ControlThread(configuration));
+    control_thread->run();
+    return timer.stop();
+}
+
+
+std::shared_ptr<const Navigation_Snapshot> publish_navigation_snapshot()
+{
+    // The maps are read under the publish lock: a snapshot of older content never replaces a newer one
+    return navigation_publisher().publish([]()
+            {
+                return make_navigation_snapshot(global_gps_almanac_map.get_map_copy(), global_galileo_almanac_map.get_map_copy(),
+                        global_gps_iono_map.get_map_copy(), global_gps_utc_model_map.get_map_copy(),
+                        global_galileo_iono_map.get_map_copy(), global_gps_ephemeris_map.get_map_copy(),
+                        global_galileo_ephemeris_map.get_map_copy(), global_galileo_utc_model_map.get_map_copy());
+            });
+}
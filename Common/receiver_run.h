@@ -0,0 +1,36 @@
+/*!
+* \file receiver_run.h
+* \brief Timed receiver run, and publication of the navigation data it collected.
+*
+* Each run is a ControlThread built from the configuration: it connects a
+* GNSS-SDR flowgraph, starts its own data collectors, which move what the
+* telemetry decoders push into the global queues to the global maps, and
+* tears everything down once the flowgraph stops. GNSSFlowgraph can
+* neither rewind its signal source nor reset its channels, so a flowgraph
+* cannot be kept and restarted for another run over the same input.
+*
+* -------------------------------------------------------------------------
+*
+*/
+
+#ifndef GNSS_SDR_RECEIVER_RUN_H_
+#define GNSS_SDR_RECEIVER_RUN_H_
+
+#include <memory>
+#include "configuration_interface.h"
+#include "navigation_snapshot.h"
+
+/*!
+* \brief Runs a ControlThread on the configuration until the receiver stops.
+* Returns the run time [us].
+*/
+long long int run_receiver(std::shared_ptr<ConfigurationInterface> configuration);
+
+/*!
+* \brief Publishes the content of the global ephemeris, almanac, iono and UTC maps
+* as the current navigation snapshot, and returns it. Consumers take it with
+* navigation_publisher().current().
+*/
+std::shared_ptr<const Navigation_Snapshot> publish_navigation_snapshot();
+
+#endif
@@ -0,0 +1,472 @@
+/*!
+* \file recording_generator.cc
+* \brief Synthetic GNSS recordings in the sample layouts of the metadata files.
+*
+* -------------------------------------------------------------------------
+*
+*/
+
+#include "recording_generator.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <sstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include "auto_conf_flags.h"
+#include "metadata_builder.h"
+
+namespace
+{
+const double GENERATOR_PI = 3.1415926535898;
+const double CA_CHIP_RATE = 1.023e6;            //!< [chips/s]
+const double GPS_L1_FREQUENCY = 1575.42e6;      //!< [Hz]
+const unsigned int CA_CODE_LENGTH = 1023;       //!< [chips]
+const unsigned int CA_PERIODS_PER_BIT = 20;     //!< 50 bit/s data on a 1 ms code
+const unsigned int CA_BIT_CHIPS = CA_CODE_LENGTH * CA_PERIODS_PER_BIT;
+
+//! Samples computed at once: the float scratch of a block stays in the L2 cache
+const size_t GENERATOR_BLOCK_SAMPLES = 32768;
+
+//! Gaussian values of the noise table, a power of two
+const uint32_t GENERATOR_NOISE_VALUES = 65536;
+
+//! Bits of the carrier phase indexing the sine table
+const unsigned int GENERATOR_CARRIER_BITS = 12;
+
+const uint64_t GOLDEN_GAMMA = 0x9e3779b97f4a7c15ull;
+
+//! G2 taps giving the code phase of PRN 1..32 (IS-GPS-200 Table 3-Ia)
+const unsigned int CA_G2_TAPS[32][2] = {
+    { 2, 6 }, { 3, 7 }, { 4, 8 }, { 5, 9 }, { 1, 9 }, { 2, 10 }, { 1, 8 }, { 2, 9 },
+    { 3, 10 }, { 2, 3 }, { 3, 4 }, { 5, 6 }, { 6, 7 }, { 7, 8 }, { 8, 9 }, { 9, 10 },
+    { 1, 4 }, { 2, 5 }, { 3, 6 }, { 4, 7 }, { 5, 8 }, { 6, 9 }, { 1, 3 }, { 4, 6 },
+    { 5, 7 }, { 6, 8 }, { 7, 9 }, { 8, 10 }, { 1, 6 }, { 2, 7 }, { 3, 8 }, { 4, 9 }
+};
+
+//! splitmix64 output function: the noise of a value is a function of its index only
+inline uint64_t mix(uint64_t z)
+{
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+//! One C/A code period, chip 1 first; a 0 chip gives +1
+void ca_code(unsigned int prn, float* code)
+{
+    int g1[10];
+    int g2[10];
+    for (int k = 0; k < 10; k++)
+        {
+            g1[k] = 1;
+            g2[k] = 1;
+        }
+    unsigned int tap1 = CA_G2_TAPS[prn - 1][0] - 1;
+    unsigned int tap2 = CA_G2_TAPS[prn - 1][1] - 1;
+    for (unsigned int chip = 0; chip < CA_CODE_LENGTH; chip++)
+        {
+            int value = g1[9] ^ g2[tap1] ^ g2[tap2];
+            code[chip] = value ? -1.0f : 1.0f;
+            int feedback1 = g1[2] ^ g1[9];
+            int feedback2 = g2[1] ^ g2[2] ^ g2[5] ^ g2[7] ^ g2[8] ^ g2[9];
+            for (int k = 9; k > 0; k--)
+                {
+                    g1[k] = g1[k - 1];
+                    g2[k] = g2[k - 1];
+                }
+            g1[0] = feedback1;
+            g2[0] = feedback2;
+        }
+}
+}
+
+
+Synthetic_Recording default_synthetic_recording()
+{
+    Synthetic_Recording recording;
+    recording.sample_rate = FLAGS_sample_rate;
+    recording.intermediate_frequency = FLAGS_synthetic_if;
+    recording.quantization = std::max(FLAGS_synthetic_quantization, 0);
+    recording.packed_bits = std::max(FLAGS_synthetic_packed_bits, 0);
+    recording.encoding = FLAGS_synthetic_encoding;
+    recording.iq = FLAGS_synthetic_iq;
+    recording.big_endian = FLAGS_synthetic_big_endian;
+    recording.noise_lsb = FLAGS_synthetic_noise_lsb;
+    recording.navigation_data = FLAGS_synthetic_navigation_data;
+    recording.seed = static_cast<uint64_t>(FLAGS_synthetic_seed);
+    parse_synthetic_satellites(FLAGS_synthetic_satellites, recording.satellites);
+    return recording;
+}
+
+
+bool parse_synthetic_satellites(const std::string& text, std::vector<Synthetic_Satellite>& satellites)
+{
+    std::vector<Synthetic_Satellite> parsed;
+    std::istringstream entries(text);
+    std::string entry;
+    while (std::getline(entries, entry, ','))
+        {
+            if (entry.find_first_not_of(" \t") == std::string::npos)
+                {
+                    continue;
+                }
+            Synthetic_Satellite satellite;
+            char separator[3];
+            std::istringstream fields(entry);
+            fields >> satellite.prn >> separator[0] >> satellite.doppler >> separator[1]
+                   >> satellite.code_phase >> separator[2] >> satellite.cn0;
+            if (fields.fail() || separator[0] != ':' || separator[1] != ':' || separator[2] != ':')
+                {
+                    return false;
+                }
+            parsed.push_back(satellite);
+        }
+    satellites.swap(parsed);
+    return true;
+}
+
+
+RecordingGenerator::RecordingGenerator(const Synthetic_Recording& recording)
+    : recording_(recording), noise_lsb_(recording.noise_lsb)
+{
+    unsigned int values = recording_.iq ? 2 : 1;
+    if (!(recording_.sample_rate > 0.0))
+        {
+            error_ = "Sample rate not positive";
+        }
+    else if (recording_.quantization < 1 || recording_.quantization > 16)
+        {
+            error_ = "Quantization not in 1 .. 16 bits";
+        }
+    else if (recording_.packed_bits == 0 || recording_.packed_bits % values != 0
+            || 32 % recording_.packed_bits != 0 || recording_.packed_bits / values < recording_.quantization)
+        {
+            error_ = "Packed bits do not hold the quantization or do not divide the 32 bit word";
+        }
+    else if (recording_.encoding != "TC" && recording_.encoding != "OB")
+        {
+            error_ = "Encoding " + recording_.encoding + " not generated (TC or OB)";
+        }
+    for (size_t s = 0; s < recording_.satellites.size() && error_.empty(); s++)
+        {
+            if (recording_.satellites[s].prn < 1 || recording_.satellites[s].prn > 32)
+                {
+                    error_ = "C/A code PRN not in 1 .. 32";
+                }
+        }
+    if (!error_.empty())
+        {
+            return;
+        }
+
+    // Noise spread over the levels: about one step for 1 and 2 bits, a third of the range above
+    if (!(noise_lsb_ > 0.0))
+        {
+            noise_lsb_ = recording_.quantization <= 2 ? 1.0 : std::ldexp(1.0, recording_.quantization - 1) / 3.0;
+        }
+
+    // Box-Muller pairs, scaled to the noise level
+    noise_.resize(GENERATOR_NOISE_VALUES);
+    uint64_t stream = mix(recording_.seed ^ GOLDEN_GAMMA);
+    for (uint32_t k = 0; k < GENERATOR_NOISE_VALUES; k += 2)
+        {
+            uint64_t random = mix(stream + k * GOLDEN_GAMMA);
+            double u1 = (static_cast<double>(random >> 32) + 1.0) / 4294967296.0;
+            double u2 = static_cast<double>(random & 0xffffffffull) / 4294967296.0;
+            double radius = noise_lsb_ * std::sqrt(-2.0 * std::log(u1));
+            noise_[k] = static_cast<float>(radius * std::cos(2.0 * GENERATOR_PI * u2));
+            noise_[k + 1] = static_cast<float>(radius * std::sin(2.0 * GENERATOR_PI * u2));
+        }
+
+    size_t steps = 1 << GENERATOR_CARRIER_BITS;
+    carrier_.resize(2 * steps);
+    for (size_t k = 0; k < steps; k++)
+        {
+            double angle = 2.0 * GENERATOR_PI * (k + 0.5) / steps;
+            carrier_[2 * k] = static_cast<float>(std::cos(angle));
+            carrier_[2 * k + 1] = static_cast<float>(std::sin(angle));
+        }
+
+    // C = C/N0 * N0, with N0 = 2 sigma^2 / fs for both the complex and the real noise
+    double noise_density = 2.0 * noise_lsb_ * noise_lsb_ / recording_.sample_rate;
+    float period[CA_CODE_LENGTH];
+    for (size_t s = 0; s < recording_.satellites.size(); s++)
+        {
+            const Synthetic_Satellite& source = recording_.satellites[s];
+            Satellite_Signal satellite;
+            satellite.prn = source.prn;
+            double carrier_power = std::pow(10.0, source.cn0 / 10.0) * noise_density;
+            satellite.amplitude = recording_.iq ? std::sqrt(carrier_power) : std::sqrt(2.0 * carrier_power);
+            satellite.carrier = recording_.intermediate_frequency + source.doppler;
+            satellite.chip_rate = CA_CHIP_RATE * (1.0 + source.doppler / GPS_L1_FREQUENCY);
+            satellite.code_phase = source.code_phase - CA_CODE_LENGTH * std::floor(source.code_phase / CA_CODE_LENGTH);
+            ca_code(source.prn, period);
+            satellite.code.resize(CA_BIT_CHIPS);
+            for (unsigned int p = 0; p < CA_PERIODS_PER_BIT; p++)
+                {
+                    std::copy(period, period + CA_CODE_LENGTH, satellite.code.begin() + p * CA_CODE_LENGTH);
+                }
+            satellites_.push_back(satellite);
+        }
+}
+
+
+Unpack_Layout RecordingGenerator::layout() const
+{
+    return make_unpack_layout(recording_.quantization, recording_.packed_bits, recording_.encoding, recording_.iq, recording_.big_endian);
+}
+
+
+unsigned long long RecordingGenerator::bytes(unsigned long long samples) const
+{
+    if (!valid())
+        {
+            return 0;
+        }
+    return (samples + samples_per_word() - 1) / samples_per_word() * 4;
+}
+
+
+unsigned long long RecordingGenerator::samples_per_block() const
+{
+    if (!valid())
+        {
+            return 0;
+        }
+    return static_cast<unsigned long long>(METADATA_BLOCK_WORDS) * samples_per_word();
+}
+
+
+unsigned long long RecordingGenerator::recorded_samples(unsigned long long samples) const
+{
+    if (!valid())
+        {
+            return 0;
+        }
+    return (samples + samples_per_block() - 1) / samples_per_block() * samples_per_block();
+}
+
+
+bool RecordingGenerator::generate(unsigned long long first, size_t count, uint8_t* out) const
+{
+    if (!valid() || first % samples_per_word() != 0)
+        {
+            return false;
+        }
+    std::vector<float> values(2 * GENERATOR_BLOCK_SAMPLES);
+    for (size_t done = 0; done < count; done += GENERATOR_BLOCK_SAMPLES)
+        {
+            size_t samples = std::min(count - done, GENERATOR_BLOCK_SAMPLES);
+            block(first + done, samples, &values[0], out + bytes(done));
+        }
+    return true;
+}
+
+
+bool RecordingGenerator::write(const std::string& filename, unsigned long long samples, WorkStealingPool& pool)
+{
+    if (!valid())
+        {
+            return false;
+        }
+    // The metadata declares fixed size Blocks: the signal goes on to the end of the last one
+    samples = recorded_samples(samples);
+    int fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        {
+            error_ = "Cannot create " + filename;
+            return false;
+        }
+    if (ftruncate(fd, static_cast<off_t>(bytes(samples))) != 0)
+        {
+            ::close(fd);
+            error_ = "Cannot size " + filename;
+            return false;
+        }
+
+    // Each worker keeps its scratch and output buffers; blocks land at their own offsets
+    size_t tasks = static_cast<size_t>((samples + GENERATOR_BLOCK_SAMPLES - 1) / GENERATOR_BLOCK_SAMPLES);
+    size_t block_bytes = static_cast<size_t>(bytes(GENERATOR_BLOCK_SAMPLES));
+    std::vector<std::vector<float> > values(pool.workers(), std::vector<float>(2 * GENERATOR_BLOCK_SAMPLES));
+    std::vector<std::vector<uint8_t> > output(pool.workers(), std::vector<uint8_t>(block_bytes));
+    std::atomic<bool> failed(false);
+    pool.parallel_for(tasks, [&](size_t task, unsigned int worker)
+        {
+            unsigned long long first = static_cast<unsigned long long>(task) * GENERATOR_BLOCK_SAMPLES;
+            size_t count = static_cast<size_t>(std::min<unsigned long long>(samples - first, GENERATOR_BLOCK_SAMPLES));
+            block(first, count, &values[worker][0], &output[worker][0]);
+            size_t length = static_cast<size_t>(bytes(count));
+            off_t offset = static_cast<off_t>(task) * static_cast<off_t>(block_bytes);
+            size_t written = 0;
+            while (written < length)
+                {
+                    ssize_t result = pwrite(fd, &output[worker][written], length - written, offset + written);
+                    if (result <= 0)
+                        {
+                            failed = true;
+                            return;
+                        }
+                    written += static_cast<size_t>(result);
+                }
+        });
+
+    if (::close(fd) != 0 || failed)
+        {
+            error_ = "Cannot write " + filename;
+            return false;
+        }
+    return true;
+}
+
+
+void RecordingGenerator::block(unsigned long long first, size_t count, float* values, uint8_t* out) const
+{
+    // Whole words: the last samples of a recording that does not end on a word are computed too
+    size_t per_word = samples_per_word();
+    size_t samples = (count + per_word - 1) / per_word * per_word;
+    size_t stride = recording_.iq ? 2 : 1;
+    noise(stride * first, stride * samples, values);
+    for (size_t s = 0; s < satellites_.size(); s++)
+        {
+            add_satellite(satellites_[s], first, samples, values);
+        }
+    pack(values, stride * samples, out);
+}
+
+
+void RecordingGenerator::noise(unsigned long long first, size_t count, float* values) const
+{
+    // Each run of GENERATOR_NOISE_VALUES values walks the whole table from its own start with its own odd stride
+    const float* table = &noise_[0];
+    uint64_t stream = mix(recording_.seed);
+    size_t n = 0;
+    while (n < count)
+        {
+            unsigned long long value = first + n;
+            uint64_t walk = mix(stream + (value / GENERATOR_NOISE_VALUES) * GOLDEN_GAMMA);
+            uint32_t start = static_cast<uint32_t>(walk);
+            uint32_t stride = static_cast<uint32_t>(walk >> 32) | 1;
+            uint32_t index = start + static_cast<uint32_t>(value % GENERATOR_NOISE_VALUES) * stride;
+            size_t run = static_cast<size_t>(std::min<unsigned long long>(count - n, GENERATOR_NOISE_VALUES - value % GENERATOR_NOISE_VALUES));
+            for (size_t k = 0; k < run; k++)
+                {
+                    values[n + k] = table[index & (GENERATOR_NOISE_VALUES - 1)];
+                    index += stride;
+                }
+            n += run;
+        }
+}
+
+
+void RecordingGenerator::add_satellite(const Satellite_Signal& satellite, unsigned long long first, size_t count, float* values) const
+{
+    double fs = recording_.sample_rate;
+
+    // Carrier phase of the first sample, from its index alone, and its step, in 0.32 fixed point cycles
+    double cycles = static_cast<double>(first) * (satellite.carrier / fs);
+    double rate = satellite.carrier / fs;
+    uint32_t phase = static_cast<uint32_t>(static_cast<uint64_t>((cycles - std::floor(cycles)) * 4294967296.0));
+    uint32_t rotation = static_cast<uint32_t>(static_cast<uint64_t>((rate - std::floor(rate)) * 4294967296.0 + 0.5));
+
+    // Code position in 32.32 fixed point chips within the current data bit
+    double chips = satellite.code_phase + static_cast<double>(first) * (satellite.chip_rate / fs);
+    double whole = std::floor(chips);
+    unsigned long long bit = static_cast<unsigned long long>(whole / CA_BIT_CHIPS);
+    double chip_in_bit = whole - static_cast<double>(bit) * CA_BIT_CHIPS;
+    const uint64_t bit_span = static_cast<uint64_t>(CA_BIT_CHIPS) << 32;
+    uint64_t position = (static_cast<uint64_t>(chip_in_bit) << 32) + static_cast<uint64_t>((chips - whole) * 4294967296.0);
+    uint64_t step = static_cast<uint64_t>(satellite.chip_rate / fs * 4294967296.0 + 0.5);
+    uint64_t data_stream = mix(recording_.seed ^ (static_cast<uint64_t>(satellite.prn) << 40));
+
+    const float* code = &satellite.code[0];
+    const float* carrier = &carrier_[0];
+    unsigned int table_shift = 32 - GENERATOR_CARRIER_BITS;
+    size_t n = 0;
+    while (n < count)
+        {
+            if (position >= bit_span)
+                {
+                    position -= bit_span;
+                    bit++;
+                }
+            float level = static_cast<float>(satellite.amplitude);
+            if (recording_.navigation_data && (mix(data_stream + bit * GOLDEN_GAMMA) & 1))
+                {
+                    level = -level;
+                }
+
+            // Run of samples up to the end of the data bit: no test in the loop
+            size_t run = static_cast<size_t>(std::min<uint64_t>(count - n, (bit_span - position + step - 1) / step));
+            if (recording_.iq)
+                {
+                    float* sample = values + 2 * n;
+                    for (size_t k = 0; k < run; k++)
+                        {
+                            float chip = level * code[position >> 32];
+                            const float* phasor = carrier + 2 * (phase >> table_shift);
+                            sample[2 * k] += chip * phasor[0];
+                            sample[2 * k + 1] += chip * phasor[1];
+                            phase += rotation;
+                            position += step;
+                        }
+                }
+            else
+                {
+                    float* sample = values + n;
+                    for (size_t k = 0; k < run; k++)
+                        {
+                            sample[k] += level * code[position >> 32] * carrier[2 * (phase >> table_shift)];
+                            phase += rotation;
+                            position += step;
+                        }
+                }
+            n += run;
+        }
+}
+
+
+void RecordingGenerator::pack(const float* values, size_t count, uint8_t* out) const
+{
+    unsigned int field_bits = recording_.packed_bits / (recording_.iq ? 2 : 1);
+    unsigned int fields_per_word = 32 / field_bits;
+    unsigned int shifts[32];
+    for (unsigned int f = 0; f < fields_per_word; f++)
+        {
+            shifts[f] = recording_.big_endian ? 32 - field_bits * (f + 1) : field_bits * f;
+        }
+
+    // Mid-rise levels: code k stands for k + 0.5 steps, as the unpackers read it. The value is
+    // moved to 0 .. 2^q - 1 so that truncation is the floor; two's complement moves it back.
+    int levels = 1 << recording_.quantization;
+    float lowest = -static_cast<float>(levels / 2);
+    float span = static_cast<float>(levels);
+    uint32_t mask = static_cast<uint32_t>(levels - 1);
+    uint32_t shift_back = recording_.encoding == "OB" ? 0 : static_cast<uint32_t>(levels / 2);
+    for (size_t v = 0; v + fields_per_word <= count; v += fields_per_word)
+        {
+            uint32_t word = 0;
+            for (unsigned int f = 0; f < fields_per_word; f++)
+                {
+                    float x = std::min(std::max(values[v + f] - lowest, 0.0f), span);
+                    uint32_t level = std::min(static_cast<uint32_t>(x), mask);
+                    word |= ((level + shift_back) & mask) << shifts[f];
+                }
+            if (recording_.big_endian)
+                {
+                    out[0] = static_cast<uint8_t>(word >> 24);
+                    out[1] = static_cast<uint8_t>(word >> 16);
+                    out[2] = static_cast<uint8_t>(word >> 8);
+                    out[3] = static_cast<uint8_t>(word);
+                }
+            else
+                {
+                    out[0] = static_cast<uint8_t>(word);
+                    out[1] = static_cast<uint8_t>(word >> 8);
+                    out[2] = static_cast<uint8_t>(word >> 16);
+                    out[3] = static_cast<uint8_t>(word >> 24);
+                }
+            out += 4;
+        }
+}
@@ -0,0 +1,132 @@
+/*!
+* \file recording_generator.h
+* \brief Synthetic GNSS recordings in the sample layouts of the metadata files.
+*
+* Stands in for a front-end: the GPS L1 C/A signals of the given PRNs, each
+* with its Doppler, code phase and C/N0 (and optionally 50 bit/s data), are
+* summed at an intermediate frequency over white noise, quantized (two's
+* complement or offset binary, 1 to 16 bits) and packed into the 32 bit
+* chunk words written by MetadataBuilder, so the recording reads back with
+* make_unpack_layout() and the metadata of the same Stream.
+*
+* Every sample is computed from its index alone (carrier and code phase
+* from the sample number, noise from a table of Gaussian values walked
+* with a start and stride drawn for each run of 65536 values), so blocks
+* are made in parallel and the recording does not depend on the number of
+* threads. The carrier comes from a sine table and the code from a fixed
+* point phase, so a sample costs a few multiply-adds per satellite.
+*
+* -------------------------------------------------------------------------
+*
+*/
+
+#ifndef GNSS_SDR_RECORDING_GENERATOR_H_
+#define GNSS_SDR_RECORDING_GENERATOR_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "sample_unpacker.h"
+#include "work_stealing_pool.h"
+
+struct Synthetic_Satellite
+{
+    unsigned int prn;         //!< GPS PRN 1..32
+    double doppler;           //!< [Hz], also applied to the code rate
+    double code_phase;        //!< Code phase of the first sample [chips]
+    double cn0;               //!< Carrier to noise density ratio [dB-Hz]
+};
+
+struct Synthetic_Recording
+{
+    double sample_rate;                 //!< [Hz]
+    double intermediate_frequency;      //!< Carrier of a satellite without Doppler [Hz]
+    unsigned int quantization;          //!< Bits of each I, Q or real value, 1 to 16
+    unsigned int packed_bits;           //!< Bits of one sample, I and Q together (Stream::Packedbits)
+    std::string encoding;               //!< TC or OB
+    bool iq;                            //!< Complex samples rather than real ones
+    bool big_endian;                    //!< First sample in the high bits of each chunk word
+    double noise_lsb;                   //!< Noise standard deviation [quantization steps] (0: suited to the quantization)
+    bool navigation_data;               //!< Pseudo random 50 bit/s data on the codes
+    uint64_t seed;
+    std::vector<Synthetic_Satellite> satellites;
+};
+
+/*!
+* \brief Recording described by the --synthetic_* flags, at --sample_rate.
+*/
+Synthetic_Recording default_synthetic_recording();
+
+/*!
+* \brief Parses satellites written as PRN:Doppler:code phase:C/N0, separated by commas.
+* Returns false, leaving satellites untouched, if an entry is malformed.
+*/
+bool parse_synthetic_satellites(const std::string& text, std::vector<Synthetic_Satellite>& satellites);
+
+class RecordingGenerator
+{
+public:
+    explicit RecordingGenerator(const Synthetic_Recording& recording);
+
+    //! Why the recording cannot be generated, empty if it can
+    const std::string& error() const { return error_; }
+    bool valid() const { return error_.empty(); }
+
+    const Synthetic_Recording& recording() const { return recording_; }
+
+    //! Layout to read the recording back with a SampleUnpacker
+    Unpack_Layout layout() const;
+
+    //! Samples in each 32 bit chunk word
+    unsigned int samples_per_word() const { return 32 / recording_.packed_bits; }
+
+    //! Bytes holding the given number of samples, rounded up to whole words
+    unsigned long long bytes(unsigned long long samples) const;
+
+    //! Samples in each Block of the metadata, METADATA_BLOCK_WORDS chunk words
+    unsigned long long samples_per_block() const;
+
+    //! Samples of a recording of at least the given number of samples, in whole Blocks
+    unsigned long long recorded_samples(unsigned long long samples) const;
+
+    /*!
+    * \brief Packs samples [first, first + count) into out, bytes(count) of them. first must be a
+    * multiple of samples_per_word(). Returns false if the recording is not valid.
+    */
+    bool generate(unsigned long long first, size_t count, uint8_t* out) const;
+
+    /*!
+    * \brief Writes a recording of recorded_samples(samples) samples, so the file holds whole
+    * Blocks of its metadata, its blocks shared among the workers of the pool.
+    * Returns false if the recording is not valid or the file cannot be written.
+    */
+    bool write(const std::string& filename, unsigned long long samples, WorkStealingPool& pool);
+
+private:
+    struct Satellite_Signal
+    {
+        std::vector<float> code;   //!< C/A code over one data bit (20 periods), +1 / -1
+        double amplitude;          //!< [quantization steps]
+        double carrier;            //!< [Hz]
+        double chip_rate;          //!< [chips/s]
+        double code_phase;         //!< [chips]
+        unsigned int prn;
+    };
+
+    //! values: scratch of 2 * count floats (I/Q interleaved, or real values)
+    void block(unsigned long long first, size_t count, float* values, uint8_t* out) const;
+    //! Noise of values [first, first + count), counted as the floats of the scratch
+    void noise(unsigned long long first, size_t count, float* values) const;
+    void add_satellite(const Satellite_Signal& satellite, unsigned long long first, size_t count, float* values) const;
+    void pack(const float* values, size_t count, uint8_t* out) const;
+
+    Synthetic_Recording recording_;
+    std::vector<Satellite_Signal> satellites_;
+    std::vector<float> noise_;     //!< Gaussian values [quantization steps]
+    std::vector<float> carrier_;   //!< Cosine and sine pairs, indexed by the high bits of the carrier phase
+    double noise_lsb_;
+    std::string error_;
+};
+
+#endif
@@ -0,0 +1,26 @@
+/*!
+* \file sample_count.h
+* \brief Conversion of a duration of the recording into a number of samples.
+*
+* Shared by the programs and the benchmarks, so both run the same code.
+*
+* -------------------------------------------------------------------------
+*
+*/
+
+#ifndef GNSS_SDR_SAMPLE_COUNT_H_
+#define GNSS_SDR_SAMPLE_COUNT_H_
+
+/*!
+* \brief Converts milliseconds to samples of buffer.
+* @param ms the time in milliseconds, truncated to whole milliseconds
+* @param SampleRate the sample rate [Hz] of each channel
+* @param channels the number of channels sampled together
+* @return the size of the buffer in samples
+*/
+inline double msToSamples(double ms, double SampleRate, double channels)
+{
+    return static_cast<double>(static_cast<long>(ms)) * SampleRate * channels / 1000.0;
+}
+
+#endif
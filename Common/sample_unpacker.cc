@@ -0,0 +1,440 @@
+/*!
+* \file sample_unpacker.cc
+* \brief Decodes recordings described by GNSS metadata into complex float samples.
+*
+* -------------------------------------------------------------------------
+*
+*/
+
+#include "sample_unpacker.h"
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+namespace
+{
+//! Chunks of the files written by MetadataBuilder (Block(256), Chunk::SizeWord(4), CountWords(1))
+const unsigned int UNPACK_BLOCK_CYCLES = 256;
+const unsigned int UNPACK_WORD_BYTES = 4;
+
+//! The interpreter gathers words in 64 bits: a word and the rest of a value must fit
+const unsigned int UNPACK_MAX_WORD_BYTES = 4;
+const unsigned int UNPACK_MAX_BITS = 32;
+
+//! Recording bytes decoded by each task of the parallel decoding
+const size_t UNPACK_TASK_BYTES = 1 << 20;
+
+uint32_t low_bits(unsigned int bits)
+{
+    return bits >= 32 ? 0xFFFFFFFFu : (1u << bits) - 1;
+}
+
+/*
+* 2 and 4 bit values: every byte value has its floats in the table, zero
+* imaginary parts of real samples included.
+*/
+template <unsigned int Floats>
+void unpack_table(const uint8_t* in, size_t bytes, const float* table, float* out)
+{
+    for (size_t i = 0; i < bytes; i++)
+        {
+            const float* entry = table + in[i] * Floats;
+            for (unsigned int k = 0; k < Floats; k++)
+                {
+                    out[k] = entry[k];
+                }
+            out += Floats;
+        }
+}
+
+template <bool OffsetBinary, bool Iq>
+void unpack_8(const uint8_t* in, size_t bytes, const float*, float* out)
+{
+    for (size_t i = 0; i < bytes; i++)
+        {
+            float value = OffsetBinary ? static_cast<float>(in[i]) - 127.5f : static_cast<float>(static_cast<int8_t>(in[i])) + 0.5f;
+            if (Iq)
+                {
+                    out[i] = value;
+                }
+            else
+                {
+                    out[2 * i] = value;
+                    out[2 * i + 1] = 0.0f;
+                }
+        }
+}
+
+template <bool BigEndian, bool OffsetBinary, bool Iq>
+void unpack_16(const uint8_t* in, size_t bytes, const float*, float* out)
+{
+    size_t values = bytes / 2;
+    for (size_t i = 0; i < values; i++)
+        {
+            uint16_t raw = BigEndian ? (in[2 * i] << 8) | in[2 * i + 1] : in[2 * i] | (in[2 * i + 1] << 8);
+            float value = OffsetBinary ? static_cast<float>(raw) - 32767.5f : static_cast<float>(static_cast<int16_t>(raw)) + 0.5f;
+            if (Iq)
+                {
+                    out[i] = value;
+                }
+            else
+                {
+                    out[2 * i] = value;
+                    out[2 * i + 1] = 0.0f;
+                }
+        }
+}
+}
+
+
+Unpack_Layout make_unpack_layout(unsigned int quantization, unsigned int packed_bits, const std::string& encoding, bool iq, bool big_endian)
+{
+    Unpack_Layout layout;
+    layout.quantization = quantization;
+    layout.packed_bits = packed_bits;
+    layout.encoding = encoding;
+    layout.iq = iq;
+    layout.left_aligned = false;
+    layout.word_bytes = UNPACK_WORD_BYTES;
+    layout.count_words = 1;
+    layout.big_endian = big_endian;
+    layout.block_cycles = UNPACK_BLOCK_CYCLES;
+    layout.block_header_bytes = 0;
+    layout.block_footer_bytes = 0;
+    return layout;
+}
+
+
+SampleUnpacker::SampleUnpacker()
+    : encoding_(TWOS_COMPLEMENT), kernel_(0), vectorized_(false), chunk_bytes_(1), chunk_samples_(0), unit_bytes_(1), unit_samples_(0), field_bits_(8)
+{
+    compile(make_unpack_layout(8, 16, "TC", true, false));
+}
+
+
+bool SampleUnpacker::compile(const Unpack_Layout& layout)
+{
+    error_.clear();
+    Value_Encoding encoding = TWOS_COMPLEMENT;
+    if (layout.encoding == "OB")
+        {
+            encoding = OFFSET_BINARY;
+        }
+    else if (layout.encoding == "SM")
+        {
+            encoding = SIGN_MAGNITUDE;
+        }
+    else if (layout.encoding == "MS")
+        {
+            encoding = MAGNITUDE_SIGN;
+        }
+    else if (layout.encoding == "OG")
+        {
+            encoding = OFFSET_GRAY;
+        }
+    else if (layout.encoding == "FP")
+        {
+            encoding = FLOATING_POINT;
+        }
+    else if (layout.encoding != "TC" && layout.encoding != "INT8" && layout.encoding != "INT16")
+        {
+            error_ = "Unknown encoding " + layout.encoding;
+        }
+
+    unsigned int values = layout.iq ? 2 : 1;
+    unsigned int chunk_bits = 8 * layout.word_bytes * layout.count_words;
+    if (layout.quantization == 0 || layout.quantization > UNPACK_MAX_BITS || layout.packed_bits > UNPACK_MAX_BITS
+        || layout.packed_bits % values != 0 || layout.packed_bits / values < layout.quantization)
+        {
+            error_ = "Quantization does not fit the packed sample";
+        }
+    else if (encoding == FLOATING_POINT && layout.quantization != 32)
+        {
+            error_ = "Floating point values must have 32 bits";
+        }
+    else if (layout.word_bytes == 0 || layout.word_bytes > UNPACK_MAX_WORD_BYTES || layout.count_words == 0)
+        {
+            error_ = "Unsupported chunk word size";
+        }
+    else if (chunk_bits < layout.packed_bits)
+        {
+            error_ = "Packed sample larger than the chunk";
+        }
+    if (!error_.empty())
+        {
+            return false;
+        }
+
+    layout_ = layout;
+    encoding_ = encoding;
+    field_bits_ = layout.packed_bits / values;
+    chunk_bytes_ = layout.word_bytes * layout.count_words;
+    chunk_samples_ = chunk_bits / layout.packed_bits;
+    if (layout.block_cycles)
+        {
+            unit_bytes_ = layout.block_header_bytes + layout.block_cycles * chunk_bytes_ + layout.block_footer_bytes;
+            unit_samples_ = layout.block_cycles * chunk_samples_;
+        }
+    else
+        {
+            unit_bytes_ = chunk_bytes_;
+            unit_samples_ = chunk_samples_;
+        }
+
+    // Values filling the words without padding read as a flat run, whatever the chunk
+    kernel_ = 0;
+    vectorized_ = false;
+    table_.clear();
+    unsigned int bits = layout.quantization;
+    bool flat = field_bits_ == bits && (bits == 1 || bits == 2 || bits == 4 || bits == 8 || bits == 16)
+                && (8 * layout.word_bytes) % bits == 0 && chunk_bits % layout.packed_bits == 0
+                && (encoding == TWOS_COMPLEMENT || encoding == OFFSET_BINARY);
+    std::ostringstream name;
+    if (!flat)
+        {
+            name << "interpreter";
+        }
+    else if (bits <= 8 && layout.iq)
+        {
+            // I/Q values of a byte or less: the SSE2/AVX2 unpackers write the complex samples directly
+            packed_format_.bits = bits;
+            packed_format_.offset_binary = encoding == OFFSET_BINARY;
+            packed_format_.msb_first = layout.big_endian;
+            vectorized_ = true;
+            name << "unpack_bits<" << bits << ", " << layout.encoding << ", " << bit_unpacker_isa() << ">";
+        }
+    else if (bits < 8)
+        {
+            unsigned int per_byte = 8 / bits;
+            unsigned int floats = layout.iq ? per_byte : 2 * per_byte;
+            table_.assign(256 * floats, 0.0f);
+            for (unsigned int byte = 0; byte < 256; byte++)
+                {
+                    for (unsigned int k = 0; k < per_byte; k++)
+                        {
+                            unsigned int shift = layout.big_endian ? 8 - bits * (k + 1) : bits * k;
+                            float value = level((byte >> shift) & low_bits(bits));
+                            table_[byte * floats + (layout.iq ? k : 2 * k)] = value;
+                        }
+                }
+            switch (floats)
+                {
+                case 2: kernel_ = &unpack_table<2>; break;
+                case 4: kernel_ = &unpack_table<4>; break;
+                case 8: kernel_ = &unpack_table<8>; break;
+                default: kernel_ = &unpack_table<16>; break;
+                }
+            name << "table<" << floats << ">";
+        }
+    else if (bits == 8)
+        {
+            bool offset = encoding == OFFSET_BINARY;
+            kernel_ = offset ? (layout.iq ? &unpack_8<true, true> : &unpack_8<true, false>)
+                             : (layout.iq ? &unpack_8<false, true> : &unpack_8<false, false>);
+            name << "unpack_8<" << layout.encoding << (layout.iq ? ", IQ>" : ", IF>");
+        }
+    else
+        {
+            bool offset = encoding == OFFSET_BINARY;
+            if (layout.big_endian)
+                {
+                    kernel_ = offset ? (layout.iq ? &unpack_16<true, true, true> : &unpack_16<true, true, false>)
+                                     : (layout.iq ? &unpack_16<true, false, true> : &unpack_16<true, false, false>);
+                }
+            else
+                {
+                    kernel_ = offset ? (layout.iq ? &unpack_16<false, true, true> : &unpack_16<false, true, false>)
+                                     : (layout.iq ? &unpack_16<false, false, true> : &unpack_16<false, false, false>);
+                }
+            name << "unpack_16<" << (layout.big_endian ? "big, " : "little, ") << layout.encoding << (layout.iq ? ", IQ>" : ", IF>");
+        }
+    kernel_name_ = name.str();
+    return true;
+}
+
+
+float SampleUnpacker::level(uint32_t raw) const
+{
+    unsigned int bits = layout_.quantization;
+    double half_range = static_cast<double>(1ull << (bits - 1));
+    double value = 0.0;
+    switch (encoding_)
+        {
+        case TWOS_COMPLEMENT:
+            value = (raw >= half_range ? static_cast<double>(raw) - 2.0 * half_range : raw) + 0.5;
+            break;
+        case OFFSET_GRAY:
+            for (unsigned int shift = 1; shift < 32; shift <<= 1)
+                {
+                    raw ^= raw >> shift;
+                }
+            value = raw - half_range + 0.5;
+            break;
+        case OFFSET_BINARY:
+            value = raw - half_range + 0.5;
+            break;
+        case SIGN_MAGNITUDE:
+            value = ((raw >> (bits - 1)) & 1) ? -((raw & low_bits(bits - 1)) + 0.5) : (raw & low_bits(bits - 1)) + 0.5;
+            break;
+        case MAGNITUDE_SIGN:
+            value = (raw & 1) ? -((raw >> 1) + 0.5) : (raw >> 1) + 0.5;
+            break;
+        case FLOATING_POINT:
+            {
+                float real;
+                memcpy(&real, &raw, sizeof(real));
+                value = real;
+            }
+            break;
+        }
+    return static_cast<float>(value);
+}
+
+
+void SampleUnpacker::interpret(const uint8_t* chunk, float* out) const
+{
+    // The chunk read as one string of bits, from the end of each word read first
+    unsigned int word_bits = 8 * layout_.word_bytes;
+    unsigned int values = layout_.iq ? 2 : 1;
+    uint64_t pending = 0;
+    unsigned int pending_bits = 0;
+    const uint8_t* word = chunk;
+    for (size_t s = 0; s < chunk_samples_; s++)
+        {
+            for (unsigned int v = 0; v < values; v++)
+                {
+                    while (pending_bits < field_bits_)
+                        {
+                            uint64_t next = 0;
+                            for (unsigned int b = 0; b < layout_.word_bytes; b++)
+                                {
+                                    unsigned int byte = layout_.big_endian ? b : layout_.word_bytes - 1 - b;
+                                    next = (next << 8) | word[byte];
+                                }
+                            word += layout_.word_bytes;
+                            if (layout_.big_endian)
+                                {
+                                    pending = (pending << word_bits) | next;
+                                }
+                            else
+                                {
+                                    pending |= next << pending_bits;
+                                }
+                            pending_bits += word_bits;
+                        }
+                    uint32_t field;
+                    if (layout_.big_endian)
+                        {
+                            field = static_cast<uint32_t>(pending >> (pending_bits - field_bits_)) & low_bits(field_bits_);
+                        }
+                    else
+                        {
+                            field = static_cast<uint32_t>(pending) & low_bits(field_bits_);
+                            pending >>= field_bits_;
+                        }
+                    pending_bits -= field_bits_;
+                    uint32_t raw = layout_.left_aligned ? field >> (field_bits_ - layout_.quantization) : field & low_bits(layout_.quantization);
+                    out[2 * s + v] = level(raw);
+                }
+            if (!layout_.iq)
+                {
+                    out[2 * s + 1] = 0.0f;
+                }
+        }
+}
+
+
+size_t SampleUnpacker::unpack(const uint8_t* data, size_t bytes, std::complex<float>* out) const
+{
+    size_t units = bytes / unit_bytes_;
+    float* values = reinterpret_cast<float*>(out);
+    if (kernel_ && !layout_.block_cycles)
+        {
+            // A plain run of chunks is one run of values
+            kernel_(data, units * unit_bytes_, table_.empty() ? 0 : &table_[0], values);
+            return units * unit_samples_;
+        }
+    if (vectorized_ && !layout_.block_cycles)
+        {
+            unpack_bits(data, units * unit_bytes_, packed_format_, out);
+            return units * unit_samples_;
+        }
+    size_t header = layout_.block_cycles ? layout_.block_header_bytes : 0;
+    size_t chunks = layout_.block_cycles ? layout_.block_cycles : 1;
+    for (size_t u = 0; u < units; u++)
+        {
+            const uint8_t* payload = data + u * unit_bytes_ + header;
+            float* unit_values = values + 2 * u * unit_samples_;
+            if (kernel_)
+                {
+                    kernel_(payload, chunks * chunk_bytes_, table_.empty() ? 0 : &table_[0], unit_values);
+                    continue;
+                }
+            if (vectorized_)
+                {
+                    unpack_bits(payload, chunks * chunk_bytes_, packed_format_, out + u * unit_samples_);
+                    continue;
+                }
+            for (size_t c = 0; c < chunks; c++)
+                {
+                    interpret(payload + c * chunk_bytes_, unit_values + 2 * c * chunk_samples_);
+                }
+        }
+    return units * unit_samples_;
+}
+
+
+size_t SampleUnpacker::unpack_samples(const uint8_t* data, size_t bytes, size_t first, size_t count, std::complex<float>* out) const
+{
+    size_t total = samples(bytes);
+    if (first >= total)
+        {
+            return 0;
+        }
+    count = std::min(count, total - first);
+
+    // Units cut by either end of the range go through scratch, the others straight to out
+    size_t unit = first / unit_samples_;
+    size_t skip = first - unit * unit_samples_;
+    size_t written = 0;
+    std::vector<std::complex<float> > scratch;
+    if (skip > 0)
+        {
+            scratch.resize(unit_samples_);
+            unpack(data + unit * unit_bytes_, unit_bytes_, &scratch[0]);
+            written = std::min(count, unit_samples_ - skip);
+            std::copy(scratch.begin() + skip, scratch.begin() + skip + written, out);
+            unit++;
+        }
+    size_t whole = (count - written) / unit_samples_;
+    if (whole > 0)
+        {
+            written += unpack(data + unit * unit_bytes_, whole * unit_bytes_, out + written);
+            unit += whole;
+        }
+    if (written < count)
+        {
+            scratch.resize(unit_samples_);
+            unpack(data + unit * unit_bytes_, unit_bytes_, &scratch[0]);
+            std::copy(scratch.begin(), scratch.begin() + (count - written), out + written);
+            written = count;
+        }
+    return written;
+}
+
+
+size_t SampleUnpacker::unpack(const uint8_t* data, size_t bytes, std::complex<float>* out, WorkStealingPool& pool) const
+{
+    size_t units = bytes / unit_bytes_;
+    size_t units_per_task = std::max<size_t>(1, UNPACK_TASK_BYTES / unit_bytes_);
+    size_t tasks = (units + units_per_task - 1) / units_per_task;
+    size_t unit_bytes = unit_bytes_;
+    size_t unit_samples = unit_samples_;
+    pool.parallel_for(tasks, [this, data, out, units, units_per_task, unit_bytes, unit_samples](size_t task, unsigned int)
+            {
+                size_t begin = task * units_per_task;
+                size_t count = std::min(units_per_task, units - begin);
+                unpack(data + begin * unit_bytes, count * unit_bytes, out + begin * unit_samples);
+            });
+    return units * unit_samples_;
+}
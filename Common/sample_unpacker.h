@@ -0,0 +1,128 @@
+/*!
+* \file sample_unpacker.h
+* \brief Decodes recordings described by GNSS metadata into complex float samples.
+*
+* The layout written in the metadata (Block cycles, header and footer,
+* Chunk word size, word count and byte order, Stream quantization, packed
+* bits, alignment, encoding and format) is compiled once into a decoder.
+* The common layouts, where the values fill the words without padding
+* (1, 2, 4, 8 or 16 bit two's complement or offset binary), reduce to a
+* flat run of values: I/Q values of up to 8 bits go to the SSE2/AVX2
+* unpackers of bit_unpacker.h, real ones to kernels specialized at compile
+* time (a per-byte table below 8 bits, a straight conversion for 8), and
+* 16 bit values to a straight conversion. Any other layout is decoded by
+* a generic interpreter that walks the chunk bit by bit. Values are read
+* as symmetric (mid-rise) levels, as the sample format classifier does:
+* -1.5 .. 1.5 for 2 bits.
+*
+* In a chunk word the first sample is at the most significant end for
+* big endian chunks and at the least significant end for little endian
+* ones, so for whole-byte samples the samples follow the memory order.
+* Within a sample, I comes before Q.
+*
+* -------------------------------------------------------------------------
+*
+*/
+
+#ifndef GNSS_SDR_SAMPLE_UNPACKER_H_
+#define GNSS_SDR_SAMPLE_UNPACKER_H_
+
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "bit_unpacker.h"
+#include "work_stealing_pool.h"
+
+struct Unpack_Layout
+{
+    unsigned int quantization;          //!< Bits of each I, Q or real value
+    unsigned int packed_bits;           //!< Bits of one sample, I and Q together
+    std::string encoding;               //!< TC, OB, SM, MS, OG, FP, INT8 or INT16
+    bool iq;                            //!< Interleaved I/Q rather than real samples
+    bool left_aligned;                  //!< Values in the high bits of their share of the packed sample
+    unsigned int word_bytes;            //!< Chunk::SizeWord
+    unsigned int count_words;           //!< Chunk::CountWords
+    bool big_endian;                    //!< Chunk::Endian
+    unsigned int block_cycles;          //!< Chunks of a Block (0: the recording is a plain run of chunks)
+    unsigned int block_header_bytes;
+    unsigned int block_footer_bytes;
+};
+
+/*!
+* \brief Layout of the files written by MetadataBuilder: Block(256) of one-word,
+* four-byte chunks holding one stream.
+*/
+Unpack_Layout make_unpack_layout(unsigned int quantization, unsigned int packed_bits, const std::string& encoding, bool iq, bool big_endian);
+
+class SampleUnpacker
+{
+public:
+    SampleUnpacker();
+
+    /*!
+    * \brief Compiles a layout. Returns false if it cannot be decoded (see error()); the
+    * previous layout is kept.
+    */
+    bool compile(const Unpack_Layout& layout);
+
+    //! Layout compiled last
+    const Unpack_Layout& layout() const { return layout_; }
+    //! Decoding by a kernel specialized for the layout rather than by the interpreter
+    bool specialized() const { return kernel_ != 0 || vectorized_; }
+    const std::string& kernel_name() const { return kernel_name_; }
+    const std::string& error() const { return error_; }
+
+    //! Recordings are decoded in multiples of this (a Block, or a Chunk without blocks)
+    size_t unit_bytes() const { return unit_bytes_; }
+    //! Samples decoded from bytes (whole units only)
+    size_t samples(size_t bytes) const { return bytes / unit_bytes_ * unit_samples_; }
+
+    /*!
+    * \brief Decodes the whole units of data, which starts on a unit. Real samples get a
+    * zero imaginary part. Returns the samples written to out.
+    */
+    size_t unpack(const uint8_t* data, size_t bytes, std::complex<float>* out) const;
+
+    //! Same, the units shared among the workers of the pool
+    size_t unpack(const uint8_t* data, size_t bytes, std::complex<float>* out, WorkStealingPool& pool) const;
+
+    /*!
+    * \brief Decodes samples [first, first + count) of the whole units of data, a recording
+    * starting on a unit. Returns the samples written to out, fewer than count at its end.
+    */
+    size_t unpack_samples(const uint8_t* data, size_t bytes, size_t first, size_t count, std::complex<float>* out) const;
+
+private:
+    typedef void (*Unpack_Kernel)(const uint8_t* in, size_t bytes, const float* table, float* out);
+
+    enum Value_Encoding
+    {
+        TWOS_COMPLEMENT,
+        OFFSET_BINARY,
+        SIGN_MAGNITUDE,
+        MAGNITUDE_SIGN,
+        OFFSET_GRAY,
+        FLOATING_POINT
+    };
+
+    void interpret(const uint8_t* chunk, float* out) const;
+    float level(uint32_t raw) const;
+
+    Unpack_Layout layout_;
+    Value_Encoding encoding_;
+    Unpack_Kernel kernel_;
+    bool vectorized_;                   //!< Flat I/Q run of 1, 2, 4 or 8 bit values decoded by unpack_bits
+    Packed_Format packed_format_;
+    std::string kernel_name_;
+    std::vector<float> table_;          //!< Floats written for each byte value (table kernels)
+    size_t chunk_bytes_;
+    size_t chunk_samples_;
+    size_t unit_bytes_;
+    size_t unit_samples_;
+    unsigned int field_bits_;           //!< Share of the packed sample of each value
+    std::string error_;
+};
+
+#endif
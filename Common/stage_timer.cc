@@ -0,0 +1,249 @@
+/*!
+* \file stage_timer.cc
+* \brief Monotonic timing of the stages of the programs, with latency histograms.
+*
+* -------------------------------------------------------------------------
+*
+*/
+
+#include "stage_timer.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <mutex>
+
+namespace
+{
+const char* const STAGE_NAMES[STAGE_COUNT] = { "Receiver run", "Recording analysis", "Metadata write", "Metadata read" };
+
+/*
+* Counters of one thread. Only that thread writes them, so plain relaxed
+* loads and stores are enough; the atomics only make the reads of a
+* report, from another thread, well defined.
+*/
+struct Thread_Stages
+{
+    std::atomic<uint64_t> count[STAGE_COUNT];
+    std::atomic<uint64_t> total_us[STAGE_COUNT];
+    std::atomic<uint64_t> min_us[STAGE_COUNT];
+    std::atomic<uint64_t> max_us[STAGE_COUNT];
+    std::atomic<uint64_t> buckets[STAGE_COUNT][STAGE_BUCKETS];
+};
+
+struct Stage_Registry
+{
+    std::mutex mutex;
+    std::vector<Thread_Stages*> threads;
+};
+
+// Never destroyed: threads may still record, and the exit report read, while statics go away
+Stage_Registry& registry()
+{
+    static Stage_Registry* stages = new Stage_Registry;
+    return *stages;
+}
+
+Thread_Stages& thread_stages()
+{
+    static thread_local Thread_Stages* stages = 0;
+    if (!stages)
+        {
+            stages = new Thread_Stages();
+            Stage_Registry& all = registry();
+            std::lock_guard<std::mutex> lock(all.mutex);
+            all.threads.push_back(stages);
+        }
+    return *stages;
+}
+
+unsigned int bucket(uint64_t microseconds)
+{
+    unsigned int b = 0;
+    while (microseconds && b < STAGE_BUCKETS - 1)
+        {
+            microseconds >>= 1;
+            b++;
+        }
+    return b;
+}
+
+void add(std::atomic<uint64_t>& counter, uint64_t value)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+void print_report()
+{
+    print_stage_report(std::cout);
+}
+}
+
+
+const char* stage_name(Stage stage)
+{
+    return stage < STAGE_COUNT ? STAGE_NAMES[stage] : "Unknown stage";
+}
+
+
+uint64_t Stage_Summary::percentile(double fraction) const
+{
+    uint64_t wanted = static_cast<uint64_t>(fraction * count + 0.5);
+    uint64_t seen = 0;
+    for (unsigned int b = 0; b < STAGE_BUCKETS; b++)
+        {
+            seen += buckets[b];
+            if (seen >= wanted && seen > 0)
+                {
+                    uint64_t upper = b == 0 ? 0 : (1ull << b) - 1;
+                    return std::max(min_us, std::min(upper, max_us));
+                }
+        }
+    return max_us;
+}
+
+
+StageTimer::StageTimer(Stage stage)
+    : stage_(stage), begin_(std::chrono::steady_clock::now()), elapsed_(0), stopped_(false)
+{
+}
+
+
+StageTimer::~StageTimer()
+{
+    stop();
+}
+
+
+long long int StageTimer::elapsed_us() const
+{
+    if (stopped_)
+        {
+            return elapsed_;
+        }
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin_).count();
+}
+
+
+long long int StageTimer::stop()
+{
+    if (!stopped_)
+        {
+            elapsed_ = elapsed_us();
+            stopped_ = true;
+            record_stage(stage_, elapsed_);
+        }
+    return elapsed_;
+}
+
+
+void record_stage(Stage stage, long long int microseconds)
+{
+    if (stage >= STAGE_COUNT)
+        {
+            return;
+        }
+    uint64_t duration = microseconds > 0 ? static_cast<uint64_t>(microseconds) : 0;
+    Thread_Stages& stages = thread_stages();
+    uint64_t count = stages.count[stage].load(std::memory_order_relaxed);
+    if (count == 0 || duration < stages.min_us[stage].load(std::memory_order_relaxed))
+        {
+            stages.min_us[stage].store(duration, std::memory_order_relaxed);
+        }
+    if (duration > stages.max_us[stage].load(std::memory_order_relaxed))
+        {
+            stages.max_us[stage].store(duration, std::memory_order_relaxed);
+        }
+    add(stages.total_us[stage], duration);
+    add(stages.buckets[stage][bucket(duration)], 1);
+    // The count goes last, so a report never sees it ahead of the rest
+    stages.count[stage].store(count + 1, std::memory_order_release);
+}
+
+
+std::vector<Stage_Summary> stage_summaries()
+{
+    std::vector<Stage_Summary> summaries(STAGE_COUNT);
+    for (unsigned int s = 0; s < STAGE_COUNT; s++)
+        {
+            Stage_Summary& summary = summaries[s];
+            summary.stage = static_cast<Stage>(s);
+            summary.count = 0;
+            summary.total_us = 0;
+            summary.min_us = std::numeric_limits<uint64_t>::max();
+            summary.max_us = 0;
+            std::fill(summary.buckets, summary.buckets + STAGE_BUCKETS, 0);
+        }
+
+    Stage_Registry& all = registry();
+    std::lock_guard<std::mutex> lock(all.mutex);
+    for (size_t t = 0; t < all.threads.size(); t++)
+        {
+            Thread_Stages& stages = *all.threads[t];
+            for (unsigned int s = 0; s < STAGE_COUNT; s++)
+                {
+                    uint64_t count = stages.count[s].load(std::memory_order_acquire);
+                    if (count == 0)
+                        {
+                            continue;
+                        }
+                    Stage_Summary& summary = summaries[s];
+                    summary.count += count;
+                    summary.total_us += stages.total_us[s].load(std::memory_order_relaxed);
+                    summary.min_us = std::min(summary.min_us, stages.min_us[s].load(std::memory_order_relaxed));
+                    summary.max_us = std::max(summary.max_us, stages.max_us[s].load(std::memory_order_relaxed));
+                    for (unsigned int b = 0; b < STAGE_BUCKETS; b++)
+                        {
+                            summary.buckets[b] += stages.buckets[s][b].load(std::memory_order_relaxed);
+                        }
+                }
+        }
+    for (unsigned int s = 0; s < STAGE_COUNT; s++)
+        {
+            if (summaries[s].count == 0)
+                {
+                    summaries[s].min_us = 0;
+                }
+        }
+    return summaries;
+}
+
+
+void print_stage_report(std::ostream& out)
+{
+    std::vector<Stage_Summary> summaries = stage_summaries();
+    std::ios::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << std::endl << "Stage timing [ms]" << std::endl
+        << std::left << std::setw(20) << "stage" << std::right
+        << std::setw(8) << "count" << std::setw(12) << "total" << std::setw(11) << "mean"
+        << std::setw(11) << "min" << std::setw(11) << "p50" << std::setw(11) << "p99" << std::setw(11) << "max" << std::endl;
+    out << std::fixed << std::setprecision(3);
+    for (size_t s = 0; s < summaries.size(); s++)
+        {
+            const Stage_Summary& summary = summaries[s];
+            if (summary.count == 0)
+                {
+                    continue;
+                }
+            out << std::left << std::setw(20) << stage_name(summary.stage) << std::right
+                << std::setw(8) << summary.count
+                << std::setw(12) << summary.total_us / 1000.0
+                << std::setw(11) << summary.total_us / 1000.0 / summary.count
+                << std::setw(11) << summary.min_us / 1000.0
+                << std::setw(11) << summary.percentile(0.5) / 1000.0
+                << std::setw(11) << summary.percentile(0.99) / 1000.0
+                << std::setw(11) << summary.max_us / 1000.0 << std::endl;
+        }
+    out.flags(flags);
+    out.precision(precision);
+}
+
+
+void report_stages_at_exit()
+{
+    static std::once_flag registered;
+    std::call_once(registered, []() { std::atexit(&print_report); });
+}
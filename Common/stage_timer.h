@@ -0,0 +1,87 @@
+/*!
+* \file stage_timer.h
+* \brief Monotonic timing of the stages of the programs, with latency histograms.
+*
+* A StageTimer measures one execution of a stage (receiver run,
+* recording analysis, metadata write and read) with the
+* steady clock, from its construction to stop() or its destruction. Every
+* thread adds its measurements to its own counters and log2 histogram
+* (microsecond buckets), in a block of its own and with no lock; a report
+* merges the threads. report_stages_at_exit() prints the report to the
+* standard output when the program ends.
+*
+* -------------------------------------------------------------------------
+*
+*/
+
+#ifndef GNSS_SDR_STAGE_TIMER_H_
+#define GNSS_SDR_STAGE_TIMER_H_
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+enum Stage
+{
+    STAGE_RECEIVER_RUN,
+    STAGE_ANALYSIS,
+    STAGE_XML_WRITE,
+    STAGE_XML_READ,
+    STAGE_COUNT
+};
+
+//! Histogram bucket b > 0 holds the durations in [2^(b-1), 2^b) us, bucket 0 the null ones
+const unsigned int STAGE_BUCKETS = 40;
+
+const char* stage_name(Stage stage);
+
+struct Stage_Summary
+{
+    Stage stage;
+    uint64_t count;
+    uint64_t total_us;
+    uint64_t min_us;
+    uint64_t max_us;
+    uint64_t buckets[STAGE_BUCKETS];
+
+    //! Upper bound of the bucket holding the given fraction of the measurements [us]
+    uint64_t percentile(double fraction) const;
+};
+
+class StageTimer
+{
+public:
+    explicit StageTimer(Stage stage);
+    //! Records the stage if stop() was not called
+    ~StageTimer();
+
+    //! Time since the construction [us]
+    long long int elapsed_us() const;
+
+    //! Records the stage and returns its duration [us]; later calls return the same
+    long long int stop();
+
+private:
+    StageTimer(const StageTimer&);
+    StageTimer& operator=(const StageTimer&);
+
+    Stage stage_;
+    std::chrono::steady_clock::time_point begin_;
+    long long int elapsed_;
+    bool stopped_;
+};
+
+//! Adds a duration measured otherwise to the calling thread's counters
+void record_stage(Stage stage, long long int microseconds);
+
+//! Measurements of every stage, merged over all the threads
+std::vector<Stage_Summary> stage_summaries();
+
+//! Count, total, mean, minimum, median, 99th percentile and maximum of the stages run
+void print_stage_report(std::ostream& out);
+
+//! Prints the report on the standard output at exit (registered once)
+void report_stages_at_exit();
+
+#endif
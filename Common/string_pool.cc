@@ -0,0 +1,157 @@
+/*!
+* \file string_pool.cc
+* \brief Bump allocator and interned strings for the metadata loader.
+*
+* -------------------------------------------------------------------------
+*
+*/
+
+#include "string_pool.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+//! Initial number of slots of the string table
+const size_t POOL_INITIAL_SLOTS = 256;
+
+uint32_t fnv1a(const char* data, size_t length)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++)
+        {
+            hash ^= static_cast<unsigned char>(data[i]);
+            hash *= 16777619u;
+        }
+    return hash;
+}
+}
+
+
+Arena::Arena(size_t block_bytes)
+    : block_bytes_(block_bytes), blocks_(0), cursor_(0), end_(0), bytes_(0)
+{
+}
+
+
+Arena::~Arena()
+{
+    while (blocks_)
+        {
+            Block* next = blocks_->next;
+            free(blocks_);
+            blocks_ = next;
+        }
+}
+
+
+void* Arena::allocate(size_t bytes, size_t alignment)
+{
+    uintptr_t aligned = (reinterpret_cast<uintptr_t>(cursor_) + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1);
+    if (!cursor_ || aligned + bytes > reinterpret_cast<uintptr_t>(end_))
+        {
+            // Oversized requests get a block of their own
+            size_t size = std::max(block_bytes_, bytes + alignment + sizeof(Block));
+            Block* block = static_cast<Block*>(malloc(size));
+            if (!block)
+                {
+                    throw std::bad_alloc();
+                }
+            block->next = blocks_;
+            block->size = size;
+            blocks_ = block;
+            bytes_ += size;
+            cursor_ = reinterpret_cast<char*>(block + 1);
+            end_ = reinterpret_cast<char*>(block) + size;
+            aligned = (reinterpret_cast<uintptr_t>(cursor_) + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1);
+        }
+    cursor_ = reinterpret_cast<char*>(aligned + bytes);
+    return reinterpret_cast<void*>(aligned);
+}
+
+
+const char* Arena::copy(const char* data, size_t length)
+{
+    char* text = static_cast<char*>(allocate(length + 1, 1));
+    memcpy(text, data, length);
+    text[length] = '\0';
+    return text;
+}
+
+
+void Arena::clear()
+{
+    if (!blocks_)
+        {
+            return;
+        }
+    // The oldest block is the last of the list
+    while (blocks_->next)
+        {
+            Block* next = blocks_->next;
+            bytes_ -= blocks_->size;
+            free(blocks_);
+            blocks_ = next;
+        }
+    cursor_ = reinterpret_cast<char*>(blocks_ + 1);
+    end_ = reinterpret_cast<char*>(blocks_) + blocks_->size;
+}
+
+
+StringPool::StringPool()
+    : arena_(16384), count_(0)
+{
+    Entry empty = { 0, 0, 0 };
+    table_.assign(POOL_INITIAL_SLOTS, empty);
+}
+
+
+const char* StringPool::intern(const char* data, size_t length)
+{
+    uint32_t hash = fnv1a(data, length);
+    size_t mask = table_.size() - 1;
+    for (size_t slot = hash & mask;; slot = (slot + 1) & mask)
+        {
+            Entry& entry = table_[slot];
+            if (!entry.text)
+                {
+                    entry.text = arena_.copy(data, length);
+                    entry.length = static_cast<uint32_t>(length);
+                    entry.hash = hash;
+                    const char* text = entry.text;
+                    // Keep the table at most half full so probes stay short
+                    if (++count_ * 2 > table_.size())
+                        {
+                            grow();
+                        }
+                    return text;
+                }
+            if (entry.hash == hash && entry.length == length && memcmp(entry.text, data, length) == 0)
+                {
+                    return entry.text;
+                }
+        }
+}
+
+
+void StringPool::grow()
+{
+    Entry empty = { 0, 0, 0 };
+    std::vector<Entry> table(table_.size() * 2, empty);
+    size_t mask = table.size() - 1;
+    for (size_t i = 0; i < table_.size(); i++)
+        {
+            if (!table_[i].text)
+                {
+                    continue;
+                }
+            size_t slot = table_[i].hash & mask;
+            while (table[slot].text)
+                {
+                    slot = (slot + 1) & mask;
+                }
+            table[slot] = table_[i];
+        }
+    table_.swap(table);
+}
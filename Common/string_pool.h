@@ -0,0 +1,93 @@
+/*!
+* \file string_pool.h
+* \brief Bump allocator and interned strings for the metadata loader.
+*
+* Arena hands out memory from large blocks and frees it all at once, so
+* the many small records of a metadata document cost neither a heap call
+* nor a header each. StringPool keeps a single copy of every distinct
+* string in an arena: names that repeat through a document (lane, band and
+* stream ids, encodings) are stored once and compared by pointer.
+*
+* -------------------------------------------------------------------------
+*
+*/
+
+#ifndef GNSS_SDR_STRING_POOL_H_
+#define GNSS_SDR_STRING_POOL_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+
+class Arena
+{
+public:
+    //! \param block_bytes Size of the blocks requested from the heap
+    explicit Arena(size_t block_bytes = 65536);
+    ~Arena();
+
+    void* allocate(size_t bytes, size_t alignment = sizeof(void*));
+
+    //! NUL terminated copy of length characters
+    const char* copy(const char* data, size_t length);
+
+    //! Object built in the arena; its destructor is never called
+    template <class T>
+    T* create()
+    {
+        return new (allocate(sizeof(T), alignof(T))) T();
+    }
+
+    //! Frees everything allocated, keeping the first block for the next uses
+    void clear();
+
+    //! Bytes taken from the heap
+    size_t bytes() const { return bytes_; }
+
+private:
+    Arena(const Arena&);
+    Arena& operator=(const Arena&);
+
+    struct Block
+    {
+        Block* next;
+        size_t size;
+    };
+
+    size_t block_bytes_;
+    Block* blocks_;     //!< Most recent first
+    char* cursor_;
+    char* end_;
+    size_t bytes_;
+};
+
+class StringPool
+{
+public:
+    StringPool();
+
+    //! The single copy of a string, added on first use
+    const char* intern(const char* data, size_t length);
+
+    //! Distinct strings held
+    size_t size() const { return count_; }
+    //! Heap bytes used by the strings and the table
+    size_t bytes() const { return arena_.bytes() + table_.capacity() * sizeof(Entry); }
+
+private:
+    struct Entry
+    {
+        const char* text;
+        uint32_t length;
+        uint32_t hash;
+    };
+
+    void grow();
+
+    Arena arena_;
+    std::vector<Entry> table_;   //!< Open addressing, power of two size
+    size_t count_;
+};
+
+#endif
@@ -0,0 +1,213 @@
+/*!
+* \file work_stealing_pool.cc
+* \brief Fixed size thread pool whose workers steal tasks from each other.
+*
+* -------------------------------------------------------------------------
+*
+*/
+
+#include "work_stealing_pool.h"
+#include <iterator>
+#include <boost/bind.hpp>
+
+namespace
+{
+// Pool and worker index of the pool thread running the caller, if any
+thread_local const WorkStealingPool* this_pool = 0;
+thread_local unsigned int this_worker = 0;
+}
+
+
+WorkStealingPool::WorkStealingPool(unsigned int workers)
+    : generation_(0), stop_(false)
+{
+    if (workers == 0)
+        {
+            workers = boost::thread::hardware_concurrency();
+        }
+    if (workers == 0)
+        {
+            workers = 1;
+        }
+    for (unsigned int w = 0; w < workers; w++)
+        {
+            queues_.push_back(std::unique_ptr<Worker_Queue>(new Worker_Queue()));
+        }
+    for (unsigned int w = 0; w < workers; w++)
+        {
+            threads_.create_thread(boost::bind(&WorkStealingPool::worker_loop, this, w));
+        }
+}
+
+
+WorkStealingPool::~WorkStealingPool()
+{
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        stop_ = true;
+    }
+    work_cond_.notify_all();
+    threads_.join_all();
+}
+
+
+void WorkStealingPool::parallel_for(size_t tasks, const Task_Body& body)
+{
+    if (tasks == 0)
+        {
+            return;
+        }
+
+    Batch batch;
+    batch.body = &body;
+    batch.queued.store(tasks);
+    batch.remaining.store(tasks);
+
+    size_t n_workers = queues_.size();
+    for (size_t w = 0; w < n_workers; w++)
+        {
+            size_t first = tasks * w / n_workers;
+            size_t last = tasks * (w + 1) / n_workers;
+            boost::mutex::scoped_lock queue_lock(queues_[w]->mutex);
+            for (size_t t = first; t < last; t++)
+                {
+                    Pending_Task pending = {&batch, t};
+                    queues_[w]->tasks.push_back(pending);
+                }
+        }
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        generation_++;
+    }
+    work_cond_.notify_all();
+
+    if (this_pool == this)
+        {
+            // A worker waiting here only takes tasks of its own batch: the
+            // outer task it interrupted may hold that worker's private state
+            Pending_Task pending;
+            while (next_task_of(batch, this_worker, pending))
+                {
+                    run_task(pending, this_worker);
+                }
+        }
+
+    boost::mutex::scoped_lock lock(mutex_);
+    while (batch.remaining.load() != 0)
+        {
+            done_cond_.wait(lock);
+        }
+    if (batch.error)
+        {
+            boost::rethrow_exception(batch.error);
+        }
+}
+
+
+void WorkStealingPool::worker_loop(unsigned int worker)
+{
+    this_pool = this;
+    this_worker = worker;
+    unsigned long seen = 0;
+    for (;;)
+        {
+            {
+                boost::mutex::scoped_lock lock(mutex_);
+                while (!stop_ && generation_ == seen)
+                    {
+                        work_cond_.wait(lock);
+                    }
+                if (stop_)
+                    {
+                        return;
+                    }
+                seen = generation_;
+            }
+
+            Pending_Task pending;
+            while (next_task(worker, pending))
+                {
+                    run_task(pending, worker);
+                }
+        }
+}
+
+
+void WorkStealingPool::run_task(const Pending_Task& pending, unsigned int worker)
+{
+    Batch& batch = *pending.batch;
+    try
+    {
+            (*batch.body)(pending.task, worker);
+    }
+    catch (...)
+    {
+            boost::mutex::scoped_lock lock(mutex_);
+            if (!batch.error)
+                {
+                    batch.error = boost::current_exception();
+                }
+    }
+    // The caller may return as soon as the count reaches zero: the batch
+    // is not touched after it
+    if (batch.remaining.fetch_sub(1) == 1)
+        {
+            boost::mutex::scoped_lock lock(mutex_);
+            done_cond_.notify_all();
+        }
+}
+
+
+bool WorkStealingPool::next_task(unsigned int worker, Pending_Task& pending)
+{
+    {
+        Worker_Queue& own = *queues_[worker];
+        boost::mutex::scoped_lock lock(own.mutex);
+        if (!own.tasks.empty())
+            {
+                pending = own.tasks.front();
+                own.tasks.pop_front();
+                pending.batch->queued.fetch_sub(1);
+                return true;
+            }
+    }
+
+    // Steal from the far end of another worker's range
+    size_t n_workers = queues_.size();
+    for (size_t k = 1; k < n_workers; k++)
+        {
+            Worker_Queue& victim = *queues_[(worker + k) % n_workers];
+            boost::mutex::scoped_lock lock(victim.mutex);
+            if (!victim.tasks.empty())
+                {
+                    pending = victim.tasks.back();
+                    victim.tasks.pop_back();
+                    pending.batch->queued.fetch_sub(1);
+                    return true;
+                }
+        }
+    return false;
+}
+
+
+bool WorkStealingPool::next_task_of(Batch& batch, unsigned int worker, Pending_Task& pending)
+{
+    size_t n_workers = queues_.size();
+    for (size_t k = 0; k < n_workers && batch.queued.load() != 0; k++)
+        {
+            // The tasks of a nested batch were queued after those of the outer one
+            Worker_Queue& queue = *queues_[(worker + k) % n_workers];
+            boost::mutex::scoped_lock lock(queue.mutex);
+            for (std::deque<Pending_Task>::reverse_iterator it = queue.tasks.rbegin(); it != queue.tasks.rend(); ++it)
+                {
+                    if (it->batch == &batch)
+                        {
+                            pending = *it;
+                            queue.tasks.erase(std::next(it).base());
+                            batch.queued.fetch_sub(1);
+                            return true;
+                        }
+                }
+        }
+    return false;
+}
@@ -0,0 +1,89 @@
+/*!
+* \file work_stealing_pool.h
+* \brief Fixed size thread pool whose workers steal tasks from each other.
+*
+* A batch of tasks is split in contiguous ranges, one per worker. Each
+* worker drains its own range from the front and, once it is empty, steals
+* from the back of the other workers' ranges, so uneven tasks still keep
+* every core busy until the end of the batch.
+*
+* Every parallel_for() call waits for its own batch only, so several
+* threads may share the pool and a task may itself call parallel_for():
+* the worker running it then takes the tasks of the nested batch while it
+* waits, instead of blocking a thread the batch may need.
+*
+* -------------------------------------------------------------------------
+*
+*/
+
+#ifndef GNSS_SDR_WORK_STEALING_POOL_H_
+#define GNSS_SDR_WORK_STEALING_POOL_H_
+
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <vector>
+#include <boost/exception_ptr.hpp>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+
+class WorkStealingPool
+{
+public:
+    //! Task body: receives the task index and the index of the worker running it
+    typedef boost::function<void(size_t task, unsigned int worker)> Task_Body;
+
+    /*!
+    * \brief Starts the workers. Zero means one worker per hardware thread.
+    */
+    explicit WorkStealingPool(unsigned int workers = 0);
+    ~WorkStealingPool();
+
+    unsigned int workers() const { return queues_.size(); }
+
+    /*!
+    * \brief Runs body(task, worker) for every task in [0, tasks) and waits for all of them.
+    * The first exception thrown by a task is rethrown here once the batch is over.
+    * Called from a task, the nested tasks run with the worker index of that task.
+    */
+    void parallel_for(size_t tasks, const Task_Body& body);
+
+private:
+    //! One parallel_for() call, kept on the stack of its caller
+    struct Batch
+    {
+        const Task_Body* body;
+        std::atomic<size_t> queued;     //!< Tasks not taken by any thread yet
+        std::atomic<size_t> remaining;  //!< Tasks not finished yet
+        boost::exception_ptr error;     //!< Guarded by mutex_
+    };
+
+    struct Pending_Task
+    {
+        Batch* batch;
+        size_t task;
+    };
+
+    struct Worker_Queue
+    {
+        boost::mutex mutex;
+        std::deque<Pending_Task> tasks;
+    };
+
+    void worker_loop(unsigned int worker);
+    bool next_task(unsigned int worker, Pending_Task& pending);
+    bool next_task_of(Batch& batch, unsigned int worker, Pending_Task& pending);
+    void run_task(const Pending_Task& pending, unsigned int worker);
+
+    std::vector<std::unique_ptr<Worker_Queue> > queues_;
+    boost::thread_group threads_;
+
+    boost::mutex mutex_;
+    boost::condition_variable work_cond_;
+    boost::condition_variable done_cond_;
+    unsigned long generation_;
+    bool stop_;
+};
+
+#endif
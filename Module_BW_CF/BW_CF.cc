@@ -3,7 +3,8 @@
 *
 * It sets up the logging system, creates a ControlThread object,
 * makes it run, and releases memory back when the main thread has ended.
-* It also finds the bandwidth and center frequency of the signal.
+* It also finds the bandwidth and center frequency of the signal from the
+* Welch power spectral density of the recording (see psd_estimator.h).
 *
 * -------------------------------------------------------------------------
 */
@@ -21,9 +22,8 @@
 #include <gflags/gflags.h>
 #include <glog/logging.h>
 #include <gnuradio/msg_queue.h>
+#include "auto_conf_flags.h"
 #include "control_thread.h"
-#include "concurrent_queue.h"
-#include "concurrent_map.h"
 #include "gps_ephemeris.h"
 #include "gps_almanac.h"
 #include "gps_iono.h"
@@ -37,59 +37,24 @@
 #include "sbas_satellite_correction.h"
 #include "sbas_ephemeris.h"
 #include "sbas_time.h"
+#include "bds_file_reader.h"
+#include "psd_estimator.h"
+#include "sample_format_classifier.h"
+#include "sample_unpacker.h"
+#include "stage_timer.h"
+#include "work_stealing_pool.h"
 
 
 using google::LogMessage;
 
 DECLARE_string(log_dir);
 
-/*!
-* \todo make this queue generic for all the GNSS systems (javi)
-*/
-
 /*
-* Concurrent queues that communicates the Telemetry Decoder
-* to the Observables modules
+* The queues that communicate the Telemetry Decoder to the Observables
+* modules, and the maps of the navigation data collected from them, are
+* defined once, in global_queues.cc and global_maps.cc
 */
 
-// For GPS NAVIGATION
-concurrent_queue<Gps_Ephemeris> global_gps_ephemeris_queue;
-concurrent_queue<Gps_Iono> global_gps_iono_queue;
-concurrent_queue<Gps_Utc_Model> global_gps_utc_model_queue;
-concurrent_queue<Gps_Almanac> global_gps_almanac_queue;
-concurrent_queue<Gps_Acq_Assist> global_gps_acq_assist_queue;
-concurrent_queue<Gps_Ref_Location> global_gps_ref_location_queue;
-concurrent_queue<Gps_Ref_Time> global_gps_ref_time_queue;
-
-concurrent_map<Gps_Ephemeris> global_gps_ephemeris_map;
-concurrent_map<Gps_Iono> global_gps_iono_map;
-concurrent_map<Gps_Utc_Model> global_gps_utc_model_map;
-concurrent_map<Gps_Almanac> global_gps_almanac_map;
-concurrent_map<Gps_Acq_Assist> global_gps_acq_assist_map;
-concurrent_map<Gps_Ref_Time> global_gps_ref_time_map;
-concurrent_map<Gps_Ref_Location> global_gps_ref_location_map;
-
-// For GALILEO NAVIGATION
-concurrent_queue<Galileo_Ephemeris> global_galileo_ephemeris_queue;
-concurrent_queue<Galileo_Iono> global_galileo_iono_queue;
-concurrent_queue<Galileo_Utc_Model> global_galileo_utc_model_queue;
-concurrent_queue<Galileo_Almanac> global_galileo_almanac_queue;
-
-concurrent_map<Galileo_Ephemeris> global_galileo_ephemeris_map;
-concurrent_map<Galileo_Iono> global_galileo_iono_map;
-concurrent_map<Galileo_Utc_Model> global_galileo_utc_model_map;
-concurrent_map<Galileo_Almanac> global_galileo_almanac_map;
-
-// For SBAS CORRECTIONS
-concurrent_queue<Sbas_Raw_Msg> global_sbas_raw_msg_queue;
-concurrent_queue<Sbas_Ionosphere_Correction> global_sbas_iono_queue;
-concurrent_queue<Sbas_Satellite_Correction> global_sbas_sat_corr_queue;
-concurrent_queue<Sbas_Ephemeris> global_sbas_ephemeris_queue;
-
-concurrent_map<Sbas_Ionosphere_Correction> global_sbas_iono_map;
-concurrent_map<Sbas_Satellite_Correction> global_sbas_sat_corr_map;
-concurrent_map<Sbas_Ephemeris> global_sbas_ephemeris_map;
-
 int main(int argc, char** argv)
 {
     const std::string intro_help(
@@ -105,6 +70,10 @@ int main(int argc, char** argv)
     google::SetUsageMessage(intro_help);
     google::SetVersionString(gnss_sdr_version);
     google::ParseCommandLineFlags(&argc, &argv, true);
+    if (FLAGS_stage_report)
+        {
+            report_stages_at_exit();
+        }
     std::cout << "Initializing GNSS-SDR v" << gnss_sdr_version << " ... Please wait." << std::endl;
 
     google::InitGoogleLogging(argv[0]);
@@ -133,10 +102,8 @@ int main(int argc, char** argv)
 
     std::unique_ptr<ControlThread> control_thread(new ControlThread());
 
-    // record startup time
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    long long int begin = tv.tv_sec * 1000000 + tv.tv_usec;
+    // time the run on the monotonic clock
+    StageTimer run_timer(STAGE_RECEIVER_RUN);
 
     try
     {
@@ -151,23 +118,39 @@ int main(int argc, char** argv)
             LOG(FATAL) << "STD exception: " << ex.what();
     }
     // report the elapsed time
-    gettimeofday(&tv, NULL);
-    long long int end = tv.tv_sec * 1000000 + tv.tv_usec;
-    long long int total_time = end - begin;
+    long long int total_time = run_timer.stop();
     std::cout << "Total GNSS-SDR run time "
               << (static_cast<double>(total_time)) / 1000000.0
               << " [seconds]" << std::endl;
 
-    // retrieve the bandwidth of the signal
-    long long int bandwidth = 1000000.0/total_time;
+    // Welch PSD of the memory-mapped recording, its windows shared among all the cores
+    WorkStealingPool pool(FLAGS_sweep_threads);
+    BdsFileReader recording(FLAGS_bds_window_kb * 1024, FLAGS_bds_huge_pages);
+    recording.open(FLAGS_recording_file, FLAGS_recording_header_bytes);
+    // Sample layout of the recording, scored on its first bytes: the spectrum is that of the samples decoded with it
+    SampleFormatClassifier format_classifier;
+    Sample_Layout layout = format_classifier.classify(recording);
+    std::cout << "Sample Format of the recording : " << layout.name() << std::endl;
+    SampleUnpacker unpacker;
+    unpacker.compile(layout.unpack_layout());
+    PsdEstimator spectrum(FLAGS_psd_fft_size, FLAGS_sample_rate, FLAGS_rf_center_frequency);
+    if (!estimate_psd(recording, unpacker, spectrum, pool))
+        {
+            LOG(WARNING) << "Unable to read the recording " << FLAGS_recording_file;
+        }
+    std::cout << "Averaged " << spectrum.segments() << " segments of "
+              << spectrum.fft_size() << " samples" << std::endl;
+
+    // retrieve the bandwidth of the signal: 99 % of the power
+    double bandwidth = spectrum.occupied_bandwidth();
     std::cout << "Total Bandwidth "
-              << (static_cast<double>(bandwidth))  
+              << bandwidth
               << " [hertz]" << std::endl;
 
-    // finding the center frequency
-    long long int center_freq = mean(bandwidth);
+    // finding the center frequency: middle of the occupied band
+    double center_freq = spectrum.center_frequency();
     std::cout << "Center Frequency  "
-              << (static_cast<double>(center_freq))  
+              << center_freq
               << " [hertz]" << std::endl;
 
     google::ShutDownCommandLineFlags();
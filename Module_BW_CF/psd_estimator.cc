@@ -0,0 +1,210 @@
+/*!
+* \file psd_estimator.cc
+* \brief Welch power spectral density of a complex baseband recording.
+*
+* -------------------------------------------------------------------------
+*
+*/
+
+#include "psd_estimator.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <volk/volk.h>
+
+namespace
+{
+const double PSD_TWO_PI = 6.283185307179586;
+//! The noise floor is the PSD bin at 1/PSD_FLOOR_DIVISOR of the sorted spectrum
+const unsigned int PSD_FLOOR_DIVISOR = 10;
+}
+
+
+PsdEstimator::PsdEstimator(unsigned int fft_size, double sample_rate_hz, double center_frequency_hz)
+    : fft_size_(fft_size), sample_rate_(sample_rate_hz), center_frequency_(center_frequency_hz),
+      pending_count_(0), accumulated_(fft_size, 0.0), segments_(0)
+{
+    size_t alignment = volk_get_alignment();
+    fft_ = new gr::fft::fft_complex(fft_size_, true);
+    window_ = static_cast<float*>(volk_malloc(fft_size_ * sizeof(float), alignment));
+    pending_ = static_cast<std::complex<float>*>(volk_malloc(fft_size_ * sizeof(std::complex<float>), alignment));
+    magnitude_ = static_cast<float*>(volk_malloc(fft_size_ * sizeof(float), alignment));
+
+    // Hann window
+    window_power_ = 0.0;
+    for (unsigned int k = 0; k < fft_size_; k++)
+        {
+            window_[k] = static_cast<float>(0.5 - 0.5 * cos(PSD_TWO_PI * k / fft_size_));
+            window_power_ += static_cast<double>(window_[k]) * window_[k];
+        }
+}
+
+
+PsdEstimator::~PsdEstimator()
+{
+    delete fft_;
+    volk_free(window_);
+    volk_free(pending_);
+    volk_free(magnitude_);
+}
+
+
+void PsdEstimator::process(const std::complex<float>* samples, size_t count)
+{
+    while (count > 0)
+        {
+            size_t n = std::min<size_t>(count, fft_size_ - pending_count_);
+            memcpy(pending_ + pending_count_, samples, n * sizeof(std::complex<float>));
+            pending_count_ += n;
+            samples += n;
+            count -= n;
+            if (pending_count_ == fft_size_)
+                {
+                    segment_ready();
+                }
+        }
+}
+
+
+void PsdEstimator::segment_ready()
+{
+    volk_32fc_32f_multiply_32fc(fft_->get_inbuf(), pending_, window_, fft_size_);
+    fft_->execute();
+    volk_32fc_magnitude_squared_32f(magnitude_, fft_->get_outbuf(), fft_size_);
+    for (unsigned int k = 0; k < fft_size_; k++)
+        {
+            accumulated_[k] += magnitude_[k];
+        }
+    segments_++;
+
+    // 50 % overlap: the second half becomes the first half of the next segment
+    unsigned int half = fft_size_ / 2;
+    memmove(pending_, pending_ + half, (fft_size_ - half) * sizeof(std::complex<float>));
+    pending_count_ = fft_size_ - half;
+}
+
+
+void PsdEstimator::merge(const PsdEstimator& other)
+{
+    for (unsigned int k = 0; k < fft_size_; k++)
+        {
+            accumulated_[k] += other.accumulated_[k];
+        }
+    segments_ += other.segments_;
+}
+
+
+std::vector<double> PsdEstimator::psd() const
+{
+    std::vector<double> result(fft_size_, 0.0);
+    if (segments_ == 0)
+        {
+            return result;
+        }
+    double scale = 1.0 / (static_cast<double>(segments_) * sample_rate_ * window_power_);
+    unsigned int half = fft_size_ / 2;
+    for (unsigned int k = 0; k < fft_size_; k++)
+        {
+            // FFT order (DC first) to -fs/2 .. fs/2
+            result[(k + half) % fft_size_] = accumulated_[k] * scale;
+        }
+    return result;
+}
+
+
+void PsdEstimator::occupied_band(double power_fraction, double& low_hz, double& high_hz) const
+{
+    std::vector<double> spectrum = psd();
+
+    // Remove the noise floor outside the signal band, taken as a low percentile of the bins
+    std::vector<double> sorted(spectrum);
+    std::nth_element(sorted.begin(), sorted.begin() + fft_size_ / PSD_FLOOR_DIVISOR, sorted.end());
+    double floor = sorted[fft_size_ / PSD_FLOOR_DIVISOR];
+    double total = 0.0;
+    for (unsigned int k = 0; k < fft_size_; k++)
+        {
+            spectrum[k] = std::max(spectrum[k] - floor, 0.0);
+            total += spectrum[k];
+        }
+    double bin_hz = sample_rate_ / fft_size_;
+    low_hz = -sample_rate_ / 2.0;
+    high_hz = sample_rate_ / 2.0;
+    if (total <= 0.0)
+        {
+            return;
+        }
+
+    double tail = total * (1.0 - power_fraction) / 2.0;
+    double cumulative = 0.0;
+    unsigned int low_bin = 0;
+    while (low_bin < fft_size_ - 1 && cumulative + spectrum[low_bin] <= tail)
+        {
+            cumulative += spectrum[low_bin++];
+        }
+    cumulative = 0.0;
+    unsigned int high_bin = fft_size_ - 1;
+    while (high_bin > low_bin && cumulative + spectrum[high_bin] <= tail)
+        {
+            cumulative += spectrum[high_bin--];
+        }
+    low_hz = (static_cast<double>(low_bin) - fft_size_ / 2.0 - 0.5) * bin_hz;
+    high_hz = (static_cast<double>(high_bin) - fft_size_ / 2.0 + 0.5) * bin_hz;
+}
+
+
+double PsdEstimator::occupied_bandwidth(double power_fraction) const
+{
+    double low_hz, high_hz;
+    occupied_band(power_fraction, low_hz, high_hz);
+    return high_hz - low_hz;
+}
+
+
+double PsdEstimator::center_frequency(double power_fraction) const
+{
+    double low_hz, high_hz;
+    occupied_band(power_fraction, low_hz, high_hz);
+    return center_frequency_ + (low_hz + high_hz) / 2.0;
+}
+
+
+bool estimate_psd(const BdsFileReader& recording, const SampleUnpacker& unpacker, PsdEstimator& psd, WorkStealingPool& pool)
+{
+    // Each task of the pipeline walks a run of consecutive windows as one stream
+    AnalysisPipeline pipeline(recording, unpacker, pool);
+    PsdStage stage(psd);
+    pipeline.add(stage);
+    return pipeline.run();
+}
+
+
+void PsdStage::start(const BdsFileReader&, const SampleUnpacker&, unsigned int workers)
+{
+    estimators_.resize(workers);
+    for (size_t w = 0; w < estimators_.size(); w++)
+        {
+            estimators_[w] = std::unique_ptr<PsdEstimator>(new PsdEstimator(psd_.fft_size(), psd_.sample_rate(), 0.0));
+        }
+}
+
+
+void PsdStage::process(const Bds_Window&, const Decoded_Samples& decoded, bool run_start, unsigned int worker)
+{
+    PsdEstimator& estimator = *estimators_[worker];
+    if (run_start)
+        {
+            estimator.restart();
+        }
+    estimator.process(decoded.samples, decoded.count);
+}
+
+
+void PsdStage::finish()
+{
+    for (size_t w = 0; w < estimators_.size(); w++)
+        {
+            psd_.merge(*estimators_[w]);
+        }
+    estimators_.clear();
+}
@@ -0,0 +1,126 @@
+/*!
+* \file psd_estimator.h
+* \brief Welch power spectral density of a complex baseband recording.
+*
+* Samples are cut in Hann windowed segments overlapping by half; the
+* squared magnitude of the FFT of every segment is averaged. The FFT and
+* the vector operations go through gr::fft and VOLK, as in the GNSS-SDR
+* acquisition blocks, so the kernels use the SIMD instructions of the
+* machine. The occupied bandwidth and the center frequency of the signal
+* are derived from the averaged spectrum.
+*
+* -------------------------------------------------------------------------
+*
+*/
+
+#ifndef GNSS_SDR_PSD_ESTIMATOR_H_
+#define GNSS_SDR_PSD_ESTIMATOR_H_
+
+#include <complex>
+#include <cstddef>
+#include <vector>
+#include <memory>
+#include <gnuradio/fft/fft.h>
+#include "analysis_pipeline.h"
+#include "bds_file_reader.h"
+
+class WorkStealingPool;
+
+class PsdEstimator
+{
+public:
+    /*!
+    * \param fft_size Length of the Welch segments
+    * \param sample_rate_hz Complex sample rate of the recording
+    * \param center_frequency_hz Frequency of the DC bin (0 for baseband results)
+    */
+    PsdEstimator(unsigned int fft_size, double sample_rate_hz, double center_frequency_hz);
+    ~PsdEstimator();
+
+    /*!
+    * \brief Feeds complex samples. Consecutive calls form one continuous stream.
+    */
+    void process(const std::complex<float>* samples, size_t count);
+
+    /*!
+    * \brief Drops the samples waiting for a full segment: the next call starts a new stream.
+    */
+    void restart() { pending_count_ = 0; }
+
+    /*!
+    * \brief Adds the segments averaged by another estimator of the same size and rate.
+    */
+    void merge(const PsdEstimator& other);
+
+    unsigned long long segments() const { return segments_; }
+    unsigned int fft_size() const { return fft_size_; }
+    double sample_rate() const { return sample_rate_; }
+
+    /*!
+    * \brief Rate used to scale the results, for a rate only known once the samples are averaged.
+    */
+    void set_sample_rate(double sample_rate_hz) { sample_rate_ = sample_rate_hz; }
+
+    /*!
+    * \brief Averaged PSD [1/Hz], from -fs/2 to fs/2 (DC in the middle).
+    */
+    std::vector<double> psd() const;
+
+    /*!
+    * \brief Width [Hz] of the band holding the given fraction of the power above the noise
+    * floor, the same amount being left out on each side.
+    */
+    double occupied_bandwidth(double power_fraction = 0.99) const;
+
+    /*!
+    * \brief Middle of the occupied band [Hz], center_frequency_hz included.
+    */
+    double center_frequency(double power_fraction = 0.99) const;
+
+private:
+    PsdEstimator(const PsdEstimator&);
+    PsdEstimator& operator=(const PsdEstimator&);
+
+    void segment_ready();
+    void occupied_band(double power_fraction, double& low_hz, double& high_hz) const;
+
+    unsigned int fft_size_;
+    double sample_rate_;
+    double center_frequency_;
+    double window_power_;
+
+    gr::fft::fft_complex* fft_;
+    float* window_;
+    std::complex<float>* pending_;   //!< Samples waiting for a full segment
+    float* magnitude_;
+    unsigned int pending_count_;
+    std::vector<double> accumulated_;
+    unsigned long long segments_;
+};
+
+/*!
+* \brief Welch PSD of a whole recording, decoded by unpacker. Runs of windows of the
+* mapping are shared among the workers of the pool, one estimator each, and the results
+* merged into psd. Returns false if the recording is not open.
+*/
+bool estimate_psd(const BdsFileReader& recording, const SampleUnpacker& unpacker, PsdEstimator& psd, WorkStealingPool& pool);
+
+/*!
+* \brief Welch PSD as a stage of an AnalysisPipeline: one estimator per worker, restarted
+* at every run of windows and merged into psd by finish().
+*/
+class PsdStage : public PipelineStage
+{
+public:
+    explicit PsdStage(PsdEstimator& psd) : psd_(psd) {}
+
+    void start(const BdsFileReader& recording, const SampleUnpacker& unpacker, unsigned int workers);
+    void process(const Bds_Window& part, const Decoded_Samples& decoded, bool run_start, unsigned int worker);
+    void finish();
+
+private:
+    PsdEstimator& psd_;
+    std::vector<std::unique_ptr<PsdEstimator> > estimators_;
+};
+
+#endif
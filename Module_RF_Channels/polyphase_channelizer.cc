@@ -0,0 +1,444 @@
+/*!
+* \file polyphase_channelizer.cc
+* \brief Polyphase filter bank splitting a wideband recording in sub-bands.
+*
+* -------------------------------------------------------------------------
+*
+*/
+
+#include "polyphase_channelizer.h"
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <memory>
+#include <sstream>
+#include <gnuradio/fft/fft.h>
+#include <volk/volk.h>
+#include "work_stealing_pool.h"
+
+namespace
+{
+const double CHANNELIZER_PI = 3.141592653589793;
+//! Samples channelized per round of the pool; the converted chunk stays in the L2 cache
+const size_t CHANNELIZER_CHUNK_SAMPLES = 65536;
+//! Samples decoded by each task
+const size_t CHANNELIZER_DECODE_SAMPLES = 8192;
+//! Polyphase branches folded by each task
+const size_t CHANNELIZER_BRANCHES_PER_TASK = 16;
+//! Blocks transformed by each task
+const size_t CHANNELIZER_BLOCKS_PER_TASK = 256;
+//! The noise floor is the sub-band at 1/CHANNELIZER_FLOOR_DIVISOR of the sorted powers
+const unsigned int CHANNELIZER_FLOOR_DIVISOR = 10;
+//! Narrower runs are taken as spurs (DC offset, CW interference), not RF channels
+const unsigned int CHANNELIZER_MIN_CHANNELS = 2;
+
+struct Gnss_Band
+{
+    const char* name;
+    double frequency;   //!< Carrier [Hz]
+};
+
+const Gnss_Band GNSS_BANDS[] = {
+    {"L1E1", 1575.42e6},
+    {"B1", 1561.098e6},
+    {"G1", 1602.0e6},
+    {"E6", 1278.75e6},
+    {"B3", 1268.52e6},
+    {"G2", 1246.0e6},
+    {"L2", 1227.60e6},
+    {"E5bB2", 1207.14e6},
+    {"E5", 1191.795e6},
+    {"L5E5a", 1176.45e6}
+};
+
+//! FFT and sub-band powers of one worker of the pool
+struct Channelizer_Worker
+{
+    explicit Channelizer_Worker(unsigned int channels)
+        : fft(channels, true), channels(channels), power(channels, 0.0)
+    {
+        magnitude = static_cast<float*>(volk_malloc(channels * sizeof(float), volk_get_alignment()));
+    }
+    ~Channelizer_Worker() { volk_free(magnitude); }
+
+    //! One FFT per folded block gives one sample of every sub-band
+    void transform(const float* folded, size_t count)
+    {
+        for (size_t b = 0; b < count; b++)
+            {
+                const std::complex<float>* row = reinterpret_cast<const std::complex<float>*>(folded + 2 * b * channels);
+                std::copy(row, row + channels, fft.get_inbuf());
+                fft.execute();
+                volk_32fc_magnitude_squared_32f(magnitude, fft.get_outbuf(), channels);
+                for (unsigned int k = 0; k < channels; k++)
+                    {
+                        power[k] += magnitude[k];
+                    }
+            }
+    }
+
+    gr::fft::fft_complex fft;
+    unsigned int channels;
+    float* magnitude;
+    std::vector<double> power;
+};
+}
+
+
+PolyphaseChannelizer::PolyphaseChannelizer(unsigned int channels, unsigned int taps_per_channel, double sample_rate_hz, double center_frequency_hz)
+    : channels_(channels), taps_(taps_per_channel), sample_rate_(sample_rate_hz),
+      center_frequency_(center_frequency_hz), accumulated_(channels, 0.0), blocks_(0)
+{
+    // Windowed-sinc low-pass, cut at half a sub-band, Blackman window, unit energy
+    size_t length = static_cast<size_t>(channels_) * taps_;
+    prototype_ = static_cast<float*>(volk_malloc(2 * length * sizeof(float), volk_get_alignment()));
+    std::vector<double> taps(length);
+    double middle = (length - 1) / 2.0;
+    double energy = 0.0;
+    for (size_t n = 0; n < length; n++)
+        {
+            double x = (n - middle) / channels_;
+            double sinc = (x == 0.0) ? 1.0 : sin(CHANNELIZER_PI * x) / (CHANNELIZER_PI * x);
+            double phase = 2.0 * CHANNELIZER_PI * n / (length - 1);
+            taps[n] = sinc * (0.42 - 0.5 * cos(phase) + 0.08 * cos(2.0 * phase));
+            energy += taps[n] * taps[n];
+        }
+    // White noise keeps its power in every sub-band
+    double scale = 1.0 / sqrt(energy);
+    for (size_t n = 0; n < length; n++)
+        {
+            prototype_[2 * n] = static_cast<float>(taps[n] * scale);
+            prototype_[2 * n + 1] = prototype_[2 * n];
+        }
+}
+
+
+PolyphaseChannelizer::~PolyphaseChannelizer()
+{
+    volk_free(prototype_);
+}
+
+
+bool PolyphaseChannelizer::process(const BdsFileReader& recording, const SampleUnpacker& unpacker, WorkStealingPool& pool, size_t max_samples)
+{
+    if (!recording.is_open())
+        {
+            return false;
+        }
+    size_t samples = unpacker.samples(recording.size());
+    if (max_samples > 0)
+        {
+            samples = std::min(samples, max_samples);
+        }
+    size_t length = static_cast<size_t>(channels_) * taps_;
+    if (samples < length)
+        {
+            return true;
+        }
+
+    // Block b covers samples b * M .. b * M + length - 1: chunks overlap by length - M samples
+    size_t total_blocks = (samples - length) / channels_ + 1;
+    size_t chunk_blocks = std::max<size_t>(1, CHANNELIZER_CHUNK_SAMPLES / channels_);
+    size_t width = 2 * static_cast<size_t>(channels_);   // floats per block
+    size_t alignment = volk_get_alignment();
+    float* input = static_cast<float*>(volk_malloc(((chunk_blocks - 1) * width + 2 * length) * sizeof(float), alignment));
+    float* folded = static_cast<float*>(volk_malloc(chunk_blocks * width * sizeof(float), alignment));
+
+    std::vector<std::unique_ptr<Channelizer_Worker> > workers(pool.workers());
+    for (size_t w = 0; w < workers.size(); w++)
+        {
+            workers[w] = std::unique_ptr<Channelizer_Worker>(new Channelizer_Worker(channels_));
+        }
+
+    const uint8_t* source = recording.data();
+    size_t source_bytes = recording.size();
+    size_t released = 0;
+    for (size_t first = 0; first < total_blocks; first += chunk_blocks)
+        {
+            size_t count = std::min(chunk_blocks, total_blocks - first);
+            size_t chunk_samples = (count - 1) * channels_ + length;
+            size_t chunk_first = first * channels_;
+
+            // Samples decoded from the mapping, in slices
+            size_t slices = (chunk_samples + CHANNELIZER_DECODE_SAMPLES - 1) / CHANNELIZER_DECODE_SAMPLES;
+            pool.parallel_for(slices, [&unpacker, source, source_bytes, input, chunk_first, chunk_samples](size_t slice, unsigned int)
+                    {
+                        size_t begin = slice * CHANNELIZER_DECODE_SAMPLES;
+                        size_t n = std::min(CHANNELIZER_DECODE_SAMPLES, chunk_samples - begin);
+                        unpacker.unpack_samples(source, source_bytes, chunk_first + begin, n,
+                                reinterpret_cast<std::complex<float>*>(input + 2 * begin));
+                    });
+
+            // Polyphase branches: each task folds a group of sub-bands over all the blocks of the chunk
+            size_t groups = (channels_ + CHANNELIZER_BRANCHES_PER_TASK - 1) / CHANNELIZER_BRANCHES_PER_TASK;
+            pool.parallel_for(groups, [this, input, folded, count, width](size_t group, unsigned int)
+                    {
+                        size_t begin = 2 * group * CHANNELIZER_BRANCHES_PER_TASK;
+                        fold(input, folded, count, begin, std::min(begin + 2 * CHANNELIZER_BRANCHES_PER_TASK, width));
+                    });
+
+            // FFTs of the blocks, by runs
+            size_t runs = (count + CHANNELIZER_BLOCKS_PER_TASK - 1) / CHANNELIZER_BLOCKS_PER_TASK;
+            pool.parallel_for(runs, [folded, count, width, &workers](size_t run, unsigned int worker)
+                    {
+                        size_t begin = run * CHANNELIZER_BLOCKS_PER_TASK;
+                        size_t last = std::min(begin + CHANNELIZER_BLOCKS_PER_TASK, count);
+                        workers[worker]->transform(folded + begin * width, last - begin);
+                    });
+            blocks_ += count;
+
+            // Windows entirely before the units of the next chunk are not needed anymore
+            size_t unit_samples = unpacker.samples(unpacker.unit_bytes());
+            size_t next_byte = (first + count) * channels_ / unit_samples * unpacker.unit_bytes();
+            while (released < recording.windows())
+                {
+                    Bds_Window window = recording.window(released);
+                    if (window.offset + window.bytes > next_byte)
+                        {
+                            break;
+                        }
+                    recording.release(released++);
+                }
+        }
+
+    for (size_t w = 0; w < workers.size(); w++)
+        {
+            for (unsigned int k = 0; k < channels_; k++)
+                {
+                    accumulated_[k] += workers[w]->power[k];
+                }
+        }
+    volk_free(input);
+    volk_free(folded);
+    return true;
+}
+
+
+void PolyphaseChannelizer::fold(const float* input, float* folded, size_t count, size_t begin, size_t end) const
+{
+    // Every tap multiplies I and Q alike, so the inner loops run on contiguous floats
+    size_t width = 2 * static_cast<size_t>(channels_);
+    for (size_t b = 0; b < count; b++)
+        {
+            float* u = folded + b * width;
+            const float* x = input + b * width;
+            for (size_t i = begin; i < end; i++)
+                {
+                    u[i] = prototype_[i] * x[i];
+                }
+            for (unsigned int t = 1; t < taps_; t++)
+                {
+                    const float* h = prototype_ + t * width;
+                    const float* xt = x + t * width;
+                    for (size_t i = begin; i < end; i++)
+                        {
+                            u[i] += h[i] * xt[i];
+                        }
+                }
+        }
+}
+
+
+std::vector<double> PolyphaseChannelizer::channel_power() const
+{
+    std::vector<double> result(channels_, 0.0);
+    if (blocks_ == 0)
+        {
+            return result;
+        }
+    unsigned int half = channels_ / 2;
+    for (unsigned int k = 0; k < channels_; k++)
+        {
+            // FFT order (DC first) to -fs/2 .. fs/2
+            result[(k + half) % channels_] = accumulated_[k] / blocks_;
+        }
+    return result;
+}
+
+
+double PolyphaseChannelizer::channel_frequency(unsigned int channel) const
+{
+    return center_frequency_ + (static_cast<double>(channel) - channels_ / 2.0) * sample_rate_ / channels_;
+}
+
+
+Rf_Band PolyphaseChannelizer::make_band(unsigned int first, unsigned int last, double snr_db) const
+{
+    double channel_hz = sample_rate_ / channels_;
+    double low_hz = channel_frequency(first) - channel_hz / 2.0;
+    double high_hz = channel_frequency(last) + channel_hz / 2.0;
+    Rf_Band band;
+    band.center_frequency = (low_hz + high_hz) / 2.0;
+    band.bandwidth = high_hz - low_hz;
+    band.snr_db = snr_db;
+    band.first_channel = first;
+    band.last_channel = last;
+
+    // GNSS carrier inside the band (one sub-band of margin), the nearest to its middle
+    double nearest = high_hz - low_hz;
+    for (size_t g = 0; g < sizeof(GNSS_BANDS) / sizeof(GNSS_BANDS[0]); g++)
+        {
+            double frequency = GNSS_BANDS[g].frequency;
+            if (frequency >= low_hz - channel_hz && frequency <= high_hz + channel_hz
+                    && std::abs(frequency - band.center_frequency) < nearest)
+                {
+                    nearest = std::abs(frequency - band.center_frequency);
+                    band.name = GNSS_BANDS[g].name;
+                }
+        }
+    return band;
+}
+
+
+std::vector<Rf_Band> PolyphaseChannelizer::bands(double threshold_db) const
+{
+    std::vector<Rf_Band> result;
+    std::vector<double> power = channel_power();
+    std::vector<double> sorted(power);
+    std::nth_element(sorted.begin(), sorted.begin() + channels_ / CHANNELIZER_FLOOR_DIVISOR, sorted.end());
+    double floor = sorted[channels_ / CHANNELIZER_FLOOR_DIVISOR];
+    if (floor <= 0.0)
+        {
+            return result;
+        }
+
+    double threshold = floor * pow(10.0, threshold_db / 10.0);
+    unsigned int c = 0;
+    while (c < channels_)
+        {
+            if (power[c] < threshold)
+                {
+                    c++;
+                    continue;
+                }
+            unsigned int first = c;
+            double sum = 0.0;
+            while (c < channels_ && power[c] >= threshold)
+                {
+                    sum += power[c++];
+                }
+            if (c - first >= CHANNELIZER_MIN_CHANNELS)
+                {
+                    result.push_back(make_band(first, c - 1, 10.0 * log10(sum / (c - first) / floor)));
+                }
+        }
+
+    // Nothing stands out: the front-end filter fills the whole capture
+    if (result.empty())
+        {
+            double sum = 0.0;
+            for (unsigned int k = 0; k < channels_; k++)
+                {
+                    sum += power[k];
+                }
+            result.push_back(make_band(0, channels_ - 1, 10.0 * log10(sum / channels_ / floor)));
+        }
+
+    for (size_t b = 0; b < result.size(); b++)
+        {
+            if (result[b].name.empty())
+                {
+                    std::ostringstream name;
+                    name << "Band" << b + 1;
+                    result[b].name = name.str();
+                }
+        }
+    return result;
+}
+
+
+/*
+* Scratch and sub-band powers of one worker of the pipeline, which
+* channelizes the blocks starting in its parts on its own.
+*/
+struct ChannelizerStage::Worker_State
+{
+    explicit Worker_State(unsigned int channels)
+        : worker(channels), blocks(0)
+    {
+        size_t chunk_blocks = std::max<size_t>(1, CHANNELIZER_CHUNK_SAMPLES / channels);
+        folded = static_cast<float*>(volk_malloc(chunk_blocks * 2 * channels * sizeof(float), volk_get_alignment()));
+    }
+    ~Worker_State()
+    {
+        volk_free(folded);
+    }
+
+    Channelizer_Worker worker;
+    float* folded;
+    unsigned long long blocks;
+};
+
+
+ChannelizerStage::ChannelizerStage(PolyphaseChannelizer& channelizer)
+    : channelizer_(channelizer), total_blocks_(0)
+{
+}
+
+
+ChannelizerStage::~ChannelizerStage()
+{
+}
+
+
+void ChannelizerStage::start(const BdsFileReader& recording, const SampleUnpacker& unpacker, unsigned int workers)
+{
+    size_t length = static_cast<size_t>(channelizer_.channels_) * channelizer_.taps_;
+    size_t samples = unpacker.samples(recording.size());
+    total_blocks_ = samples < length ? 0 : (samples - length) / channelizer_.channels_ + 1;
+    workers_.clear();
+    workers_.resize(workers);
+}
+
+
+size_t ChannelizerStage::lookahead_samples() const
+{
+    // Tail of the last block starting in a part
+    return static_cast<size_t>(channelizer_.channels_) * channelizer_.taps_ - 1;
+}
+
+
+void ChannelizerStage::process(const Bds_Window&, const Decoded_Samples& decoded, bool, unsigned int worker)
+{
+    // Blocks starting in the part; the last ones read their tail from the samples that follow it
+    size_t channels = channelizer_.channels_;
+    size_t first = (decoded.first + channels - 1) / channels;
+    size_t end = std::min((decoded.first + decoded.count + channels - 1) / channels, total_blocks_);
+    if (first >= end)
+        {
+            return;
+        }
+    if (!workers_[worker])
+        {
+            workers_[worker] = std::unique_ptr<Worker_State>(new Worker_State(channelizer_.channels_));
+        }
+    Worker_State& w = *workers_[worker];
+
+    size_t chunk_blocks = std::max<size_t>(1, CHANNELIZER_CHUNK_SAMPLES / channels);
+    for (size_t b = first; b < end; b += chunk_blocks)
+        {
+            size_t count = std::min(chunk_blocks, end - b);
+            const float* input = reinterpret_cast<const float*>(decoded.samples + (b * channels - decoded.first));
+            channelizer_.fold(input, w.folded, count, 0, 2 * channels);
+            w.worker.transform(w.folded, count);
+            w.blocks += count;
+        }
+}
+
+void ChannelizerStage::finish()
+{
+    for (size_t w = 0; w < workers_.size(); w++)
+        {
+            if (!workers_[w])
+                {
+                    continue;
+                }
+            for (unsigned int k = 0; k < channelizer_.channels_; k++)
+                {
+                    channelizer_.accumulated_[k] += workers_[w]->worker.power[k];
+                }
+            channelizer_.blocks_ += workers_[w]->blocks;
+        }
+    workers_.clear();
+}
@@ -0,0 +1,130 @@
+/*!
+* \file polyphase_channelizer.h
+* \brief Polyphase filter bank splitting a wideband recording in sub-bands.
+*
+* The recording is cut in blocks of M samples; each block of M * taps
+* samples is weighted by a windowed-sinc prototype low-pass filter, folded
+* on its M polyphase branches and transformed with an M point FFT, which
+* gives one sample of each of the M sub-bands (critically sampled
+* analysis filter bank). The branch products are plain float loops the
+* compiler vectorizes; the FFT and the magnitudes go through gr::fft and
+* VOLK. The averaged power of every sub-band tells which parts of the
+* capture hold a signal: runs of sub-bands above the noise floor are the
+* RF channels of the front-end, named after the GNSS band they cover.
+*
+* -------------------------------------------------------------------------
+*
+*/
+
+#ifndef GNSS_SDR_POLYPHASE_CHANNELIZER_H_
+#define GNSS_SDR_POLYPHASE_CHANNELIZER_H_
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+#include "analysis_pipeline.h"
+#include "bds_file_reader.h"
+
+class WorkStealingPool;
+
+struct Rf_Band
+{
+    std::string name;              //!< GNSS band covered (L1E1, L2, L5E5a, ...), BandN if none
+    double center_frequency;       //!< [Hz], RF
+    double bandwidth;              //!< [Hz]
+    double snr_db;                 //!< Mean power of its sub-bands over the noise floor
+    unsigned int first_channel;    //!< Sub-bands, in -fs/2 .. fs/2 order
+    unsigned int last_channel;
+};
+
+class PolyphaseChannelizer
+{
+public:
+    /*!
+    * \param channels Number of sub-bands M, a power of two
+    * \param taps_per_channel Length of each polyphase branch
+    * \param sample_rate_hz Complex sample rate of the recording
+    * \param center_frequency_hz RF frequency of the DC bin
+    */
+    PolyphaseChannelizer(unsigned int channels, unsigned int taps_per_channel, double sample_rate_hz, double center_frequency_hz);
+    ~PolyphaseChannelizer();
+
+    /*!
+    * \brief Channelizes a recording decoded by unpacker (max_samples of it, 0 for all) and
+    * accumulates the power of each sub-band. The branches of the filter bank and then the
+    * FFTs of the blocks are shared among the workers of the pool.
+    * Returns false if the recording is not open.
+    */
+    bool process(const BdsFileReader& recording, const SampleUnpacker& unpacker, WorkStealingPool& pool, size_t max_samples = 0);
+
+    unsigned int channels() const { return channels_; }
+    unsigned long long blocks() const { return blocks_; }
+    double sample_rate() const { return sample_rate_; }
+
+    /*!
+    * \brief Rate used to place the sub-bands, for a rate only known once the samples are channelized.
+    */
+    void set_sample_rate(double sample_rate_hz) { sample_rate_ = sample_rate_hz; }
+
+    /*!
+    * \brief Mean power of every sub-band, from -fs/2 to fs/2 (DC in the middle).
+    */
+    std::vector<double> channel_power() const;
+
+    /*!
+    * \brief RF center frequency [Hz] of a sub-band of channel_power().
+    */
+    double channel_frequency(unsigned int channel) const;
+
+    /*!
+    * \brief Runs of sub-bands at least threshold_db over the noise floor, one per RF channel.
+    * A capture filled by a single front-end band gives that band.
+    */
+    std::vector<Rf_Band> bands(double threshold_db = 3.0) const;
+
+private:
+    friend class ChannelizerStage;
+
+    PolyphaseChannelizer(const PolyphaseChannelizer&);
+    PolyphaseChannelizer& operator=(const PolyphaseChannelizer&);
+
+    //! Polyphase branches [begin, end) (in floats) of count blocks
+    void fold(const float* input, float* folded, size_t count, size_t begin, size_t end) const;
+    Rf_Band make_band(unsigned int first, unsigned int last, double snr_db) const;
+
+    unsigned int channels_;
+    unsigned int taps_;
+    double sample_rate_;
+    double center_frequency_;
+    float* prototype_;     //!< Prototype filter, each tap twice for the I and Q floats
+    std::vector<double> accumulated_;
+    unsigned long long blocks_;
+};
+
+/*!
+* \brief Channelizer as a stage of an AnalysisPipeline. Each worker channelizes the blocks
+* starting in its parts of the windows, all the sub-bands at once, from the samples the
+* pipeline decodes after the part; the powers are added to the
+* channelizer by finish().
+*/
+class ChannelizerStage : public PipelineStage
+{
+public:
+    explicit ChannelizerStage(PolyphaseChannelizer& channelizer);
+    ~ChannelizerStage();
+
+    void start(const BdsFileReader& recording, const SampleUnpacker& unpacker, unsigned int workers);
+    size_t lookahead_samples() const;
+    void process(const Bds_Window& part, const Decoded_Samples& decoded, bool run_start, unsigned int worker);
+    void finish();
+
+private:
+    struct Worker_State;
+
+    PolyphaseChannelizer& channelizer_;
+    size_t total_blocks_;
+    std::vector<std::unique_ptr<Worker_State> > workers_;
+};
+
+#endif
@@ -0,0 +1,246 @@
+/*!
+* \file sample_format_classifier.cc
+* \brief Guesses the sample layout of a recording from its first bytes.
+*
+* -------------------------------------------------------------------------
+*
+*/
+
+#include "sample_format_classifier.h"
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <sstream>
+#include "psd_estimator.h"
+
+namespace
+{
+const unsigned int CLASSIFIER_FFT_SIZE = 256;
+//! Values going into each spectrum: 64 segments are enough for the flatness
+const size_t CLASSIFIER_SPECTRUM_VALUES = 32 * CLASSIFIER_FFT_SIZE;
+//! Kurtosis of Gaussian noise quantized with 2 bits (levels at +-1, +-3, threshold at one sigma)
+const double KURTOSIS_2_BITS = 2.1;
+const double KURTOSIS_GAUSSIAN = 3.0;
+
+/*
+* Decodes samples of the given width and order; both encodings are
+* read as symmetric (mid-rise) levels, e.g. -1.5 .. 1.5 for 2 bits.
+*/
+void decode(const uint8_t* data, size_t bytes, const Sample_Layout& layout, std::vector<float>& values)
+{
+    values.clear();
+    unsigned int bits = layout.bits;
+    double half_range = static_cast<double>(1u << (bits - 1));
+    uint32_t mask = bits == 16 ? 0xFFFF : (1u << bits) - 1;
+    size_t per_byte = bits < 8 ? 8 / bits : 1;
+    size_t step = bits == 16 ? 2 : 1;
+    values.reserve(bytes * per_byte / step);
+    for (size_t i = 0; i + step <= bytes; i += step)
+        {
+            for (size_t k = 0; k < per_byte; k++)
+                {
+                    uint32_t raw;
+                    if (bits == 16)
+                        {
+                            raw = layout.big_endian ? (data[i] << 8) | data[i + 1] : (data[i + 1] << 8) | data[i];
+                        }
+                    else if (bits == 8)
+                        {
+                            raw = data[i];
+                        }
+                    else
+                        {
+                            unsigned int shift = layout.big_endian ? 8 - bits * (k + 1) : bits * k;
+                            raw = (data[i] >> shift) & mask;
+                        }
+                    double value;
+                    if (layout.offset_binary)
+                        {
+                            value = raw - half_range;
+                        }
+                    else
+                        {
+                            value = raw >= half_range ? static_cast<double>(raw) - 2.0 * half_range : raw;
+                        }
+                    values.push_back(static_cast<float>(value + 0.5));
+                }
+        }
+}
+
+/*
+* Welch PSD of the values, read as real samples or as I/Q pairs.
+*/
+std::vector<double> spectrum(const std::vector<float>& values, bool iq)
+{
+    PsdEstimator psd(CLASSIFIER_FFT_SIZE, 1.0, 0.0);
+    size_t count = std::min(values.size(), CLASSIFIER_SPECTRUM_VALUES);
+    std::vector<std::complex<float> > samples;
+    if (iq)
+        {
+            samples.resize(count / 2);
+            for (size_t n = 0; n < samples.size(); n++)
+                {
+                    samples[n] = std::complex<float>(values[2 * n], values[2 * n + 1]);
+                }
+        }
+    else
+        {
+            samples.assign(values.begin(), values.begin() + count);
+        }
+    if (!samples.empty())
+        {
+            psd.process(&samples[0], samples.size());
+        }
+    return psd.psd();
+}
+}
+
+
+std::string Sample_Layout::name() const
+{
+    std::ostringstream stream;
+    stream << bits << " bit " << encoding() << (iq ? " I/Q" : " real");
+    if (bits != 8)
+        {
+            stream << (big_endian ? " big" : " little") << " endian";
+        }
+    return stream.str();
+}
+
+
+SampleFormatClassifier::SampleFormatClassifier(size_t prefix_bytes)
+    : prefix_bytes_(prefix_bytes)
+{
+}
+
+
+Sample_Layout SampleFormatClassifier::classify(const BdsFileReader& recording)
+{
+    if (!recording.is_open())
+        {
+            return classify(0, 0);
+        }
+    // The mapping is contiguous: the prefix is read in place
+    return classify(recording.data(), recording.size());
+}
+
+
+Sample_Layout SampleFormatClassifier::classify(const uint8_t* data, size_t bytes)
+{
+    scores_.clear();
+    Sample_Layout fallback;
+    fallback.bits = 8;
+    fallback.iq = true;
+    fallback.offset_binary = false;
+    fallback.big_endian = false;
+    if (bytes == 0)
+        {
+            return fallback;
+        }
+    bytes = std::min(prefix_bytes_, bytes);
+
+    // Bytes of 16 bit words split in a peaked high byte and a near uniform low byte; bytes of
+    // narrower samples all follow the same law whatever their position
+    double even[256] = { 0.0 }, odd[256] = { 0.0 };
+    for (size_t i = 0; i + 1 < bytes; i += 2)
+        {
+            even[data[i]] += 1.0;
+            odd[data[i + 1]] += 1.0;
+        }
+    double byte_distance = 0.0;
+    for (int v = 0; v < 256; v++)
+        {
+            byte_distance += fabs(even[v] - odd[v]);
+        }
+    byte_distance /= std::max<size_t>(bytes, 2);
+
+    static const unsigned int widths[] = { 2, 4, 8, 16 };
+    std::vector<float> values;
+    for (unsigned int w = 0; w < 4; w++)
+        {
+            for (int order = 0; order < (widths[w] == 8 ? 1 : 2); order++)
+                {
+                    for (int encoding = 0; encoding < 2; encoding++)
+                        {
+                            Sample_Layout layout;
+                            layout.bits = widths[w];
+                            layout.big_endian = order == 1;
+                            layout.offset_binary = encoding == 1;
+                            decode(data, bytes, layout, values);
+
+                            // Where the power of the sequence read as real lies: I/Q or real IF
+                            std::vector<double> real_psd = spectrum(values, false);
+                            double quarter = 0.0, total = 0.0;
+                            for (unsigned int k = 0; k < CLASSIFIER_FFT_SIZE; k++)
+                                {
+                                    unsigned int distance = k > CLASSIFIER_FFT_SIZE / 2 ? k - CLASSIFIER_FFT_SIZE / 2 : CLASSIFIER_FFT_SIZE / 2 - k;
+                                    if (distance >= CLASSIFIER_FFT_SIZE / 8 && distance < 3 * CLASSIFIER_FFT_SIZE / 8)
+                                        {
+                                            quarter += real_psd[k];
+                                        }
+                                    total += real_psd[k];
+                                }
+                            double quarter_power = total > 0.0 ? quarter / total : 0.5;
+
+                            double width_penalty = layout.bits == 16 ? 1.0 - byte_distance : byte_distance;
+                            layout.iq = true;
+                            scores_.push_back(score(layout, values, quarter_power, width_penalty));
+                            layout.iq = false;
+                            scores_.push_back(score(layout, values, quarter_power, width_penalty));
+                        }
+                }
+        }
+
+    // Stable: on a tie the earlier candidate (I/Q before real) wins
+    std::stable_sort(scores_.begin(), scores_.end(),
+            [](const Layout_Score& a, const Layout_Score& b) { return a.penalty < b.penalty; });
+    return scores_.front().layout;
+}
+
+
+Layout_Score SampleFormatClassifier::score(const Sample_Layout& layout, const std::vector<float>& values,
+        double quarter_power, double width_penalty) const
+{
+    Layout_Score result;
+    result.layout = layout;
+    result.quarter_power = quarter_power;
+
+    double sum = 0.0;
+    for (size_t n = 0; n < values.size(); n++)
+        {
+            sum += values[n];
+        }
+    double mean = values.empty() ? 0.0 : sum / values.size();
+    double m2 = 0.0, m4 = 0.0;
+    for (size_t n = 0; n < values.size(); n++)
+        {
+            double d = values[n] - mean;
+            m2 += d * d;
+            m4 += d * d * d * d;
+        }
+    m2 = values.empty() ? 0.0 : m2 / values.size();
+    m4 = values.empty() ? 0.0 : m4 / values.size();
+    result.centering = m2 > 0.0 ? fabs(mean) / sqrt(m2) : 1.0;
+    result.kurtosis = m2 > 0.0 ? m4 / (m2 * m2) : 0.0;
+
+    std::vector<double> psd = spectrum(values, layout.iq);
+    double log_sum = 0.0, linear_sum = 0.0;
+    for (unsigned int k = 0; k < CLASSIFIER_FFT_SIZE; k++)
+        {
+            double p = std::max(psd[k], 1e-30);
+            log_sum += log(p);
+            linear_sum += p;
+        }
+    result.flatness = linear_sum > 0.0 ? exp(log_sum / CLASSIFIER_FFT_SIZE) / (linear_sum / CLASSIFIER_FFT_SIZE) : 1.0;
+
+    // Quantized noise is a little flatter than Gaussian at 2 bits; flat-topped or bimodal values are penalized
+    double expected_kurtosis = layout.bits == 2 ? KURTOSIS_2_BITS : KURTOSIS_GAUSSIAN;
+    double kurtosis_penalty = fabs(result.kurtosis - expected_kurtosis) / expected_kurtosis;
+
+    // Real IF samples have more power around fs/4 than white noise, I/Q samples read as real less
+    double format_penalty = layout.iq ? std::max(0.0, quarter_power - 0.5) : std::max(0.0, 0.5 - quarter_power);
+
+    result.penalty = result.centering + kurtosis_penalty + result.flatness + 2.0 * format_penalty + width_penalty;
+    return result;
+}
+
@@ -0,0 +1,88 @@
+/*!
+* \file sample_format_classifier.h
+* \brief Guesses the sample layout of a recording from its first bytes.
+*
+* Each candidate layout (2, 4, 8 or 16 bit samples, two's complement or
+* offset binary, order of the samples in a byte or of the bytes in a word,
+* interleaved I/Q or real) decodes a bounded prefix of the recording. A
+* right guess gives front-end noise: centered, close to Gaussian and
+* shaped by the front-end filter; a wrong one gives skewed, flat-topped or
+* bimodal values with a white spectrum. The two bytes of 16 bit words do
+* not follow the same law, those of narrower samples do. Real IF samples put their power
+* around a quarter of the sample rate, I/Q samples read as real put it
+* around DC and half the rate, which separates the two formats. The
+* layout with the smallest penalty wins.
+*
+* -------------------------------------------------------------------------
+*
+*/
+
+#ifndef GNSS_SDR_SAMPLE_FORMAT_CLASSIFIER_H_
+#define GNSS_SDR_SAMPLE_FORMAT_CLASSIFIER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "bds_file_reader.h"
+#include "sample_unpacker.h"
+
+struct Sample_Layout
+{
+    unsigned int bits;      //!< Bits per I, Q or real sample: 2, 4, 8 or 16
+    bool iq;                //!< Interleaved I/Q rather than real samples
+    bool offset_binary;     //!< Offset binary rather than two's complement
+    bool big_endian;        //!< Most significant byte first (16 bit) or first sample in the high bits (2 and 4 bit)
+
+    //! Encoding name of the ION GNSS SDR metadata standard
+    std::string encoding() const { return offset_binary ? "OB" : "TC"; }
+    //! Bits of one complete sample (I and Q together for I/Q)
+    unsigned int packed_bits() const { return iq ? 2 * bits : bits; }
+    //! Layout of the metadata written for the recording, to decode it
+    Unpack_Layout unpack_layout() const { return make_unpack_layout(bits, packed_bits(), encoding(), iq, big_endian); }
+    std::string name() const;
+};
+
+struct Layout_Score
+{
+    Sample_Layout layout;
+    double centering;       //!< |mean| / standard deviation
+    double kurtosis;
+    double flatness;        //!< Spectral flatness, 1 for white noise
+    double quarter_power;   //!< Fraction of the power of the real sequence between fs/8 and 3fs/8
+    double penalty;         //!< Sum of the tests, smaller is better
+};
+
+class SampleFormatClassifier
+{
+public:
+    /*!
+    * \param prefix_bytes Bytes of the recording decoded by every candidate
+    */
+    explicit SampleFormatClassifier(size_t prefix_bytes = 262144);
+
+    /*!
+    * \brief Scores every candidate on the start of the recording and returns the best.
+    * Returns 8 bit two's complement I/Q if the recording is not open or empty.
+    */
+    Sample_Layout classify(const BdsFileReader& recording);
+
+    /*!
+    * \brief Same, on the first bytes of a recording already in memory.
+    */
+    Sample_Layout classify(const uint8_t* data, size_t bytes);
+
+    size_t prefix_bytes() const { return prefix_bytes_; }
+
+    //! Scores of the last classification, best first
+    const std::vector<Layout_Score>& scores() const { return scores_; }
+
+private:
+    Layout_Score score(const Sample_Layout& layout, const std::vector<float>& values,
+            double quarter_power, double width_penalty) const;
+
+    size_t prefix_bytes_;
+    std::vector<Layout_Score> scores_;
+};
+
+#endif
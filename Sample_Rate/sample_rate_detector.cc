@@ -0,0 +1,299 @@
+/*!
+* \file sample_rate_detector.cc
+* \brief Infers the sample rate of a recording from the GPS L1 C/A chipping rate.
+*
+* -------------------------------------------------------------------------
+*
+*/
+
+#include "sample_rate_detector.h"
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <memory>
+#include <volk/volk.h>
+#include "psd_estimator.h"
+
+namespace
+{
+//! Sample rates of common GNSS front-ends [Hz]
+const double FRONT_END_RATES[] = { 2.048e6, 2.5e6, 4.0e6, 4.092e6, 5.0e6, 6.0e6, 8.0e6, 8.184e6, 10.0e6,
+        12.5e6, 16.0e6, 16.368e6, 20.0e6, 20.46e6, 25.0e6, 30.69e6, 40.0e6, 40.92e6, 50.0e6 };
+//! Minimum height of a detected line over the noise, in standard deviations
+const double DETECTION_THRESHOLD = 6.0;
+//! Relative error of the front-end clock covered by the search
+const double CLOCK_TOLERANCE = 50e-6;
+//! Bins on each side of the search range averaged for the noise level
+const long FLOOR_BINS = 256;
+//! Lines closer than this to DC are hidden by the autocorrelation of the noise
+const long DC_GUARD_BINS = 16;
+//! Delay products computed at a time
+const size_t PRODUCT_SAMPLES = 8192;
+}
+
+
+SampleRateDetector::SampleRateDetector(unsigned int fft_size, double chip_rate_hz)
+    : fft_size_(fft_size), chip_rate_(chip_rate_hz),
+      candidates_(FRONT_END_RATES, FRONT_END_RATES + sizeof(FRONT_END_RATES) / sizeof(FRONT_END_RATES[0])),
+      confidence_(0.0)
+{
+}
+
+
+void SampleRateDetector::add_candidate(double rate_hz)
+{
+    if (rate_hz > 0.0 && std::find(candidates_.begin(), candidates_.end(), rate_hz) == candidates_.end())
+        {
+            candidates_.push_back(rate_hz);
+        }
+}
+
+
+unsigned int SampleRateDetector::lag(double rate_hz) const
+{
+    // The chip rate line is strongest for a lag of half a chip; powers of two keep few lags to compute
+    double half_chip = rate_hz / (2.0 * chip_rate_);
+    unsigned int lag = 1;
+    while (2.0 * lag <= half_chip * sqrt(2.0))
+        {
+            lag *= 2;
+        }
+    return lag;
+}
+
+
+double SampleRateDetector::detect(const BdsFileReader& recording, const SampleUnpacker& unpacker, size_t max_samples, WorkStealingPool& pool)
+{
+    // One delay product spectrum per lag used by the candidates, the windows shared among the workers
+    AnalysisPipeline pipeline(recording, unpacker, pool);
+    SampleRateStage stage(*this, max_samples);
+    pipeline.add(stage);
+    if (!pipeline.run())
+        {
+            confidence_ = 0.0;
+            return 0.0;
+        }
+    return stage.rate();
+}
+
+
+std::vector<unsigned int> SampleRateDetector::lags() const
+{
+    std::vector<unsigned int> result;
+    for (size_t c = 0; c < candidates_.size(); c++)
+        {
+            if (std::find(result.begin(), result.end(), lag(candidates_[c])) == result.end())
+                {
+                    result.push_back(lag(candidates_[c]));
+                }
+        }
+    return result;
+}
+
+
+double SampleRateDetector::decide(const std::vector<unsigned int>& lags, const std::vector<const PsdEstimator*>& spectra)
+{
+    std::vector<double> scores(candidates_.size());
+    size_t best = 0;
+    for (size_t l = 0; l < lags.size(); l++)
+        {
+            std::vector<double> spectrum = spectra[l]->psd();
+            for (size_t c = 0; c < candidates_.size(); c++)
+                {
+                    if (lag(candidates_[c]) == lags[l])
+                        {
+                            scores[c] = score(spectrum, spectra[l]->segments(), candidates_[c]);
+                            if (scores[c] > scores[best])
+                                {
+                                    best = c;
+                                }
+                        }
+                }
+        }
+    confidence_ = scores.empty() ? 0.0 : scores[best];
+    if (confidence_ < DETECTION_THRESHOLD)
+        {
+            return 0.0;
+        }
+
+    // The chip transitions also give lines at the harmonics of the chipping rate, so the
+    // line of a rate can be a harmonic seen at an integer multiple of it: keep the multiple
+    double detected_rate = candidates_[best];
+    for (size_t c = 0; c < candidates_.size(); c++)
+        {
+            double ratio = candidates_[c] / candidates_[best];
+            if (candidates_[c] > detected_rate && fabs(ratio - floor(ratio + 0.5)) < 1e-6
+                    && scores[c] >= DETECTION_THRESHOLD)
+                {
+                    detected_rate = candidates_[c];
+                }
+        }
+    return detected_rate;
+}
+
+
+double SampleRateDetector::score(const std::vector<double>& spectrum, unsigned long long segments, double rate_hz) const
+{
+    // Position of the chipping rate line, folded into [-0.5, 0.5] cycles per sample
+    double cycles = chip_rate_ / rate_hz;
+    double folded = cycles - floor(cycles + 0.5);
+    long center = fft_size_ / 2;
+    long offset = lround(fabs(folded) * fft_size_);
+
+    // A clock error of the front-end moves the line in proportion to the unfolded frequency
+    long spread = 1 + static_cast<long>(ceil(cycles * CLOCK_TOLERANCE * fft_size_));
+    long floor_span = spread + FLOOR_BINS;
+    if (segments == 0 || offset < floor_span + DC_GUARD_BINS)
+        {
+            return 0.0;
+        }
+
+    // The product of real chips is real: the line shows on both sides of DC. Bins wrap
+    // around at -0.5 cycles per sample, where lines close to half the rate fall
+    long size = fft_size_;
+    double best = 0.0;
+    for (int side = -1; side <= 1; side += 2)
+        {
+            long line = center + side * offset;
+            double peak = 0.0;
+            for (long k = -spread; k <= spread; k++)
+                {
+                    peak = std::max(peak, spectrum[(line + k + size) % size]);
+                }
+            // Noise level from the bins around the search range: the spectrum of the delay product is not flat
+            double noise = 0.0;
+            for (long k = spread + 1; k <= floor_span; k++)
+                {
+                    noise += spectrum[(line - k + size) % size] + spectrum[(line + k) % size];
+                }
+            noise /= 2.0 * FLOOR_BINS;
+            if (noise > 0.0)
+                {
+                    // An average of K periodograms has a standard deviation of about its mean over sqrt(K)
+                    best = std::max(best, (peak / noise - 1.0) * sqrt(static_cast<double>(segments)));
+                }
+        }
+    return best;
+}
+
+
+/*
+* Delay product spectra of the windows given to one worker of the pipeline,
+* one per lag.
+*/
+struct SampleRateStage::Worker_Spectra
+{
+    Worker_Spectra(unsigned int fft_size, const std::vector<unsigned int>& lags)
+        : spectra(lags.size())
+    {
+        for (size_t l = 0; l < lags.size(); l++)
+            {
+                spectra[l] = std::unique_ptr<PsdEstimator>(new PsdEstimator(fft_size, 1.0, 0.0));
+            }
+        product = static_cast<std::complex<float>*>(volk_malloc(PRODUCT_SAMPLES * sizeof(std::complex<float>), volk_get_alignment()));
+    }
+    ~Worker_Spectra()
+    {
+        volk_free(product);
+    }
+
+    std::vector<std::unique_ptr<PsdEstimator> > spectra;
+    std::complex<float>* product;
+};
+
+
+SampleRateStage::SampleRateStage(SampleRateDetector& detector, size_t max_samples)
+    : detector_(detector), max_samples_(max_samples), wanted_bytes_(0), rate_(0.0)
+{
+}
+
+
+SampleRateStage::~SampleRateStage()
+{
+}
+
+
+void SampleRateStage::start(const BdsFileReader&, const SampleUnpacker& unpacker, unsigned int workers)
+{
+    // Whole units holding the first max_samples samples
+    size_t unit_samples = unpacker.samples(unpacker.unit_bytes());
+    wanted_bytes_ = std::max<size_t>(1, (max_samples_ + unit_samples - 1) / unit_samples) * unpacker.unit_bytes();
+    lags_ = detector_.lags();
+    detector_.confidence_ = 0.0;
+    workers_.clear();
+    workers_.resize(workers);
+    rate_ = 0.0;
+}
+
+
+size_t SampleRateStage::history_samples() const
+{
+    return lags_.empty() ? 0 : *std::max_element(lags_.begin(), lags_.end());
+}
+
+
+void SampleRateStage::process(const Bds_Window&, const Decoded_Samples& decoded, bool run_start, unsigned int worker)
+{
+    if (lags_.empty() || decoded.first >= max_samples_)
+        {
+            return;
+        }
+    // Spectra are large: only the workers that get a window of the prefix build theirs
+    if (!workers_[worker])
+        {
+            workers_[worker] = std::unique_ptr<Worker_Spectra>(new Worker_Spectra(detector_.fft_size_, lags_));
+        }
+    Worker_Spectra& w = *workers_[worker];
+    if (run_start)
+        {
+            for (size_t l = 0; l < lags_.size(); l++)
+                {
+                    w.spectra[l]->restart();
+                }
+        }
+
+    // The lagged samples before the part are in the history the pipeline decodes, zeros before the recording
+    size_t samples = std::min(decoded.count, max_samples_ - decoded.first);
+    for (size_t position = 0; position < samples; position += PRODUCT_SAMPLES)
+        {
+            size_t n = std::min(samples - position, PRODUCT_SAMPLES);
+            const std::complex<float>* x = decoded.samples + position;
+            for (size_t l = 0; l < lags_.size(); l++)
+                {
+                    volk_32fc_x2_multiply_conjugate_32fc(w.product, x, x - lags_[l], n);
+                    w.spectra[l]->process(w.product, n);
+                }
+        }
+}
+
+
+void SampleRateStage::finish()
+{
+    std::vector<const PsdEstimator*> results(lags_.size(), static_cast<const PsdEstimator*>(0));
+    Worker_Spectra* total = 0;
+    for (size_t w = 0; w < workers_.size(); w++)
+        {
+            if (!workers_[w])
+                {
+                    continue;
+                }
+            if (!total)
+                {
+                    total = workers_[w].get();
+                    continue;
+                }
+            for (size_t l = 0; l < lags_.size(); l++)
+                {
+                    total->spectra[l]->merge(*workers_[w]->spectra[l]);
+                }
+        }
+    if (total)
+        {
+            for (size_t l = 0; l < lags_.size(); l++)
+                {
+                    results[l] = total->spectra[l].get();
+                }
+            rate_ = detector_.decide(lags_, results);
+        }
+    workers_.clear();
+}
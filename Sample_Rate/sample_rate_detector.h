@@ -0,0 +1,100 @@
+/*!
+* \file sample_rate_detector.h
+* \brief Infers the sample rate of a recording from the GPS L1 C/A chipping rate.
+*
+* The product of every sample with the conjugate of a delayed one removes
+* the carriers and leaves, for each BPSK signal, the product of chips
+* half a chip apart, whose spectrum holds a line at the chipping rate
+* (1.023 MHz). Expressed in cycles per sample, and folded back into
+* [-0.5, 0.5] when the rate is below it, that line tells the sample rate.
+* The Welch spectrum of the delay product is computed over a bounded
+* window at the start of the recording, for the few power of two lags
+* close to half a chip at the candidate rates. Every candidate rate is
+* scored by the height, in standard deviations of the noise, of the
+* strongest bin around the position its line would have.
+*
+* -------------------------------------------------------------------------
+*
+*/
+
+#ifndef GNSS_SDR_SAMPLE_RATE_DETECTOR_H_
+#define GNSS_SDR_SAMPLE_RATE_DETECTOR_H_
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include "analysis_pipeline.h"
+#include "bds_file_reader.h"
+
+class PsdEstimator;
+class WorkStealingPool;
+
+class SampleRateDetector
+{
+public:
+    /*!
+    * \param fft_size Length of the Welch segments of the delay product
+    * \param chip_rate_hz Rate of the line searched for
+    */
+    explicit SampleRateDetector(unsigned int fft_size = 262144, double chip_rate_hz = 1.023e6);
+
+    /*!
+    * \brief Adds a rate to the usual front-end rates (2.048 to 50 MHz) tried by detect().
+    */
+    void add_candidate(double rate_hz);
+    const std::vector<double>& candidates() const { return candidates_; }
+
+    /*!
+    * \brief Sample rate [Hz] of a recording decoded by unpacker, from at most max_samples
+    * samples. Returns 0 if no candidate line stands above the noise.
+    */
+    double detect(const BdsFileReader& recording, const SampleUnpacker& unpacker, size_t max_samples, WorkStealingPool& pool);
+
+    //! Height of the detected line over the noise [standard deviations] (best candidate if none was detected)
+    double confidence() const { return confidence_; }
+
+private:
+    friend class SampleRateStage;
+
+    unsigned int lag(double rate_hz) const;
+    std::vector<unsigned int> lags() const;
+    double decide(const std::vector<unsigned int>& lags, const std::vector<const PsdEstimator*>& spectra);
+    double score(const std::vector<double>& spectrum, unsigned long long segments, double rate_hz) const;
+
+    unsigned int fft_size_;
+    double chip_rate_;
+    std::vector<double> candidates_;
+    double confidence_;
+};
+
+/*!
+* \brief Sample rate detection as a stage of an AnalysisPipeline, on the first max_samples
+* samples. The workers that read them keep their own delay product spectra, merged by finish().
+*/
+class SampleRateStage : public PipelineStage
+{
+public:
+    SampleRateStage(SampleRateDetector& detector, size_t max_samples);
+    ~SampleRateStage();
+
+    void start(const BdsFileReader& recording, const SampleUnpacker& unpacker, unsigned int workers);
+    size_t wanted_bytes() const { return wanted_bytes_; }
+    size_t history_samples() const;
+    void process(const Bds_Window& part, const Decoded_Samples& decoded, bool run_start, unsigned int worker);
+    void finish();
+
+    //! Rate found by the last pass [Hz], 0 if no line stood above the noise
+    double rate() const { return rate_; }
+
+private:
+    struct Worker_Spectra;
+
+    SampleRateDetector& detector_;
+    size_t max_samples_;
+    size_t wanted_bytes_;
+    std::vector<unsigned int> lags_;
+    std::vector<std::unique_ptr<Worker_Spectra> > workers_;
+    double rate_;
+};
+
+#endif
@@ -0,0 +1,299 @@
+/*!
+* \file bit_depth_analyzer.cc
+* \brief Effective quantization of the samples of a recording.
+*
+* -------------------------------------------------------------------------
+*
+*/
+
+#include "bit_depth_analyzer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+//! Decoded values brought back to their codes at a time
+const size_t BIT_DEPTH_CODES = 4096;
+
+struct Reduction
+{
+    int8_t min;
+    int8_t max;
+    uint8_t bits_or;
+    uint8_t bits_and;
+};
+
+void reduce_scalar(const uint8_t* data, size_t bytes, Reduction& r)
+{
+    for (size_t i = 0; i < bytes; i++)
+        {
+            int8_t v = static_cast<int8_t>(data[i]);
+            r.min = std::min(r.min, v);
+            r.max = std::max(r.max, v);
+            r.bits_or |= data[i];
+            r.bits_and &= data[i];
+        }
+}
+
+/*
+* Min, max, OR and AND of every byte. The vector part handles whole
+* registers, the scalar loop the tail.
+*/
+void reduce(const uint8_t* data, size_t bytes, Reduction& r)
+{
+    size_t done = 0;
+#if defined(__AVX2__)
+    if (bytes >= 32)
+        {
+            __m256i vmin = _mm256_set1_epi8(r.min);
+            __m256i vmax = _mm256_set1_epi8(r.max);
+            __m256i vor = _mm256_setzero_si256();
+            __m256i vand = _mm256_set1_epi8(-1);
+            for (; done + 32 <= bytes; done += 32)
+                {
+                    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + done));
+                    vmin = _mm256_min_epi8(vmin, v);
+                    vmax = _mm256_max_epi8(vmax, v);
+                    vor = _mm256_or_si256(vor, v);
+                    vand = _mm256_and_si256(vand, v);
+                }
+            int8_t lanes[4][32];
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes[0]), vmin);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes[1]), vmax);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes[2]), vor);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes[3]), vand);
+            for (int k = 0; k < 32; k++)
+                {
+                    r.min = std::min(r.min, lanes[0][k]);
+                    r.max = std::max(r.max, lanes[1][k]);
+                    r.bits_or |= static_cast<uint8_t>(lanes[2][k]);
+                    r.bits_and &= static_cast<uint8_t>(lanes[3][k]);
+                }
+        }
+#elif defined(__SSE2__)
+    if (bytes >= 16)
+        {
+            // SSE2 only has unsigned byte min/max: flipping the sign bit maps signed order onto unsigned order
+            const __m128i sign = _mm_set1_epi8(-128);
+            __m128i vmin = _mm_xor_si128(_mm_set1_epi8(r.min), sign);
+            __m128i vmax = _mm_xor_si128(_mm_set1_epi8(r.max), sign);
+            __m128i vor = _mm_setzero_si128();
+            __m128i vand = _mm_set1_epi8(-1);
+            for (; done + 16 <= bytes; done += 16)
+                {
+                    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + done));
+                    __m128i u = _mm_xor_si128(v, sign);
+                    vmin = _mm_min_epu8(vmin, u);
+                    vmax = _mm_max_epu8(vmax, u);
+                    vor = _mm_or_si128(vor, v);
+                    vand = _mm_and_si128(vand, v);
+                }
+            uint8_t lanes[4][16];
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes[0]), _mm_xor_si128(vmin, sign));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes[1]), _mm_xor_si128(vmax, sign));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes[2]), vor);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes[3]), vand);
+            for (int k = 0; k < 16; k++)
+                {
+                    r.min = std::min(r.min, static_cast<int8_t>(lanes[0][k]));
+                    r.max = std::max(r.max, static_cast<int8_t>(lanes[1][k]));
+                    r.bits_or |= lanes[2][k];
+                    r.bits_and &= lanes[3][k];
+                }
+        }
+#endif
+    reduce_scalar(data + done, bytes - done, r);
+}
+
+/*
+* Histogram in four tables: consecutive equal bytes, frequent in low
+* resolution recordings, would otherwise wait on each other's increments.
+*/
+void count(const uint8_t* data, size_t bytes, unsigned long long* histogram)
+{
+    std::vector<uint32_t> tables(4 * 256, 0);
+    uint32_t* t0 = &tables[0];
+    uint32_t* t1 = t0 + 256;
+    uint32_t* t2 = t1 + 256;
+    uint32_t* t3 = t2 + 256;
+    size_t i = 0;
+    while (i < bytes)
+        {
+            // Flush before the 32 bit counters can overflow
+            size_t end = i + std::min<size_t>(bytes - i, 0x40000000);
+            for (; i + 8 <= end; i += 8)
+                {
+                    // One 64 bit load feeds eight increments
+                    uint64_t word;
+                    memcpy(&word, data + i, sizeof(word));
+                    t0[word & 0xFF]++;
+                    t1[(word >> 8) & 0xFF]++;
+                    t2[(word >> 16) & 0xFF]++;
+                    t3[(word >> 24) & 0xFF]++;
+                    t0[(word >> 32) & 0xFF]++;
+                    t1[(word >> 40) & 0xFF]++;
+                    t2[(word >> 48) & 0xFF]++;
+                    t3[word >> 56]++;
+                }
+            for (; i < end; i++)
+                {
+                    t0[data[i]]++;
+                }
+            for (int v = 0; v < 256; v++)
+                {
+                    // Index by signed value + 128
+                    histogram[static_cast<uint8_t>(v + 128)] += static_cast<unsigned long long>(t0[v]) + t1[v] + t2[v] + t3[v];
+                    t0[v] = t1[v] = t2[v] = t3[v] = 0;
+                }
+        }
+}
+}
+
+
+BitDepthAnalyzer::BitDepthAnalyzer()
+    : min_(127), max_(-128), or_(0), and_(0xFF), samples_(0)
+{
+    memset(histogram_, 0, sizeof(histogram_));
+}
+
+
+void BitDepthAnalyzer::process(const uint8_t* data, size_t bytes)
+{
+    Reduction r;
+    r.min = min_;
+    r.max = max_;
+    r.bits_or = or_;
+    r.bits_and = and_;
+    reduce(data, bytes, r);
+    min_ = r.min;
+    max_ = r.max;
+    or_ = r.bits_or;
+    and_ = r.bits_and;
+    count(data, bytes, histogram_);
+    samples_ += bytes;
+}
+
+
+void BitDepthAnalyzer::process(const std::complex<float>* samples, size_t count, bool iq)
+{
+    // Levels sit half a step above their code, so the floor gives the code back
+    const float* values = reinterpret_cast<const float*>(samples);
+    size_t stride = iq ? 1 : 2;
+    size_t total = iq ? 2 * count : count;
+    uint8_t codes[BIT_DEPTH_CODES];
+    for (size_t done = 0; done < total; done += BIT_DEPTH_CODES)
+        {
+            size_t n = std::min(total - done, BIT_DEPTH_CODES);
+            for (size_t k = 0; k < n; k++)
+                {
+                    float code = std::floor(values[(done + k) * stride]);
+                    code = std::min(std::max(code, -128.0f), 127.0f);
+                    codes[k] = static_cast<uint8_t>(static_cast<int8_t>(code));
+                }
+            process(codes, n);
+        }
+}
+
+
+void BitDepthAnalyzer::merge(const BitDepthAnalyzer& other)
+{
+    for (int k = 0; k < 256; k++)
+        {
+            histogram_[k] += other.histogram_[k];
+        }
+    min_ = std::min(min_, other.min_);
+    max_ = std::max(max_, other.max_);
+    or_ |= other.or_;
+    and_ &= other.and_;
+    samples_ += other.samples_;
+}
+
+
+Bit_Depth BitDepthAnalyzer::result() const
+{
+    Bit_Depth depth;
+    depth.samples = samples_;
+    depth.min_value = samples_ ? min_ : 0;
+    depth.max_value = samples_ ? max_ : 0;
+    depth.constant_ones = samples_ ? and_ : 0;
+    depth.constant_zeros = samples_ ? static_cast<uint8_t>(~or_) : 0;
+    depth.used_levels = 0;
+    depth.entropy_bits = 0.0;
+
+    // The levels are spaced by the largest power of two dividing every distance to the minimum
+    unsigned int distances = 0;
+    for (int k = 0; k < 256; k++)
+        {
+            if (histogram_[k] > 0)
+                {
+                    depth.used_levels++;
+                    distances |= static_cast<unsigned int>(k - 128 - depth.min_value);
+                    double p = static_cast<double>(histogram_[k]) / samples_;
+                    depth.entropy_bits -= p * log2(p);
+                }
+        }
+    depth.step = 1;
+    while (distances != 0 && (distances & depth.step) == 0)
+        {
+            depth.step <<= 1;
+        }
+
+    unsigned int span = static_cast<unsigned int>(depth.max_value - depth.min_value) / depth.step + 1;
+    depth.bits = 1;
+    while ((1u << depth.bits) < span)
+        {
+            depth.bits++;
+        }
+    return depth;
+}
+
+
+bool analyze_bit_depth(const BdsFileReader& recording, const SampleUnpacker& unpacker, BitDepthAnalyzer& analyzer,
+        WorkStealingPool& pool, size_t max_bytes)
+{
+    AnalysisPipeline pipeline(recording, unpacker, pool);
+    BitDepthStage stage(analyzer, max_bytes);
+    pipeline.add(stage);
+    return pipeline.run();
+}
+
+
+void BitDepthStage::start(const BdsFileReader&, const SampleUnpacker& unpacker, unsigned int workers)
+{
+    const Unpack_Layout& layout = unpacker.layout();
+    measured_ = layout.quantization <= 8 && (layout.encoding == "TC" || layout.encoding == "OB");
+    iq_ = layout.iq;
+    analyzers_.resize(workers);
+    for (size_t w = 0; w < analyzers_.size(); w++)
+        {
+            analyzers_[w] = std::unique_ptr<BitDepthAnalyzer>(new BitDepthAnalyzer());
+        }
+}
+
+
+void BitDepthStage::process(const Bds_Window&, const Decoded_Samples& decoded, bool, unsigned int worker)
+{
+    if (measured_)
+        {
+            analyzers_[worker]->process(decoded.samples, decoded.count, iq_);
+        }
+}
+
+
+void BitDepthStage::finish()
+{
+    for (size_t w = 0; w < analyzers_.size(); w++)
+        {
+            analyzer_.merge(*analyzers_[w]);
+        }
+    analyzers_.clear();
+}
@@ -0,0 +1,111 @@
+/*!
+* \file bit_depth_analyzer.h
+* \brief Effective quantization of the samples of a recording.
+*
+* Every value of up to 8 bits, taken as a signed code (an int8 byte, or a
+* packed value decoded with the layout of the recording and brought back
+* to its code), goes through a value histogram and through
+* vector min, max, OR and AND reductions (AVX2 or SSE2, whichever the
+* compiler targets, with a scalar fallback). From them come the range
+* of the values, the spacing of the levels (left-justified or odd-level
+* ADCs leave low bits constant) and the number of levels in use, hence the
+* number of bits the ADC really delivers inside its container.
+*
+* -------------------------------------------------------------------------
+*
+*/
+
+#ifndef GNSS_SDR_BIT_DEPTH_ANALYZER_H_
+#define GNSS_SDR_BIT_DEPTH_ANALYZER_H_
+
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "analysis_pipeline.h"
+#include "bds_file_reader.h"
+
+class WorkStealingPool;
+
+struct Bit_Depth
+{
+    unsigned int bits;           //!< Effective quantization, for Stream::Quantization
+    unsigned int used_levels;    //!< Distinct values found
+    unsigned int step;           //!< Spacing of the levels
+    int min_value;
+    int max_value;
+    uint8_t constant_ones;       //!< Bits set in every sample
+    uint8_t constant_zeros;      //!< Bits clear in every sample
+    double entropy_bits;         //!< Entropy of the value distribution
+    unsigned long long samples;
+};
+
+class BitDepthAnalyzer
+{
+public:
+    BitDepthAnalyzer();
+
+    /*!
+    * \brief Adds bytes to the statistics; each byte is a two's complement sample.
+    */
+    void process(const uint8_t* data, size_t bytes);
+
+    /*!
+    * \brief Adds samples decoded by a SampleUnpacker from two's complement or offset binary
+    * values of at most 8 bits: each I, Q or real value counts as its code, level - 0.5.
+    */
+    void process(const std::complex<float>* samples, size_t count, bool iq);
+
+    /*!
+    * \brief Adds the statistics of another analyzer.
+    */
+    void merge(const BitDepthAnalyzer& other);
+
+    Bit_Depth result() const;
+
+    //! Occurrences of value v at index v + 128
+    const unsigned long long* histogram() const { return histogram_; }
+
+private:
+    unsigned long long histogram_[256];
+    int8_t min_;
+    int8_t max_;
+    uint8_t or_;
+    uint8_t and_;
+    unsigned long long samples_;
+};
+
+/*!
+* \brief Statistics of a whole recording decoded by unpacker (or of its first max_bytes if
+* not 0), its windows shared among the workers of the pool. Returns false if the recording
+* is not open.
+*/
+bool analyze_bit_depth(const BdsFileReader& recording, const SampleUnpacker& unpacker, BitDepthAnalyzer& analyzer,
+        WorkStealingPool& pool, size_t max_bytes = 0);
+
+/*!
+* \brief Bit depth statistics as a stage of an AnalysisPipeline (first max_bytes of the
+* recording if not 0), one analyzer per worker merged into analyzer by finish(). Only
+* layouts of two's complement or offset binary values of at most 8 bits are measured:
+* wider ones leave the analyzer empty.
+*/
+class BitDepthStage : public PipelineStage
+{
+public:
+    BitDepthStage(BitDepthAnalyzer& analyzer, size_t max_bytes = 0) : analyzer_(analyzer), max_bytes_(max_bytes), measured_(false), iq_(true) {}
+
+    size_t wanted_bytes() const { return max_bytes_; }
+    void start(const BdsFileReader& recording, const SampleUnpacker& unpacker, unsigned int workers);
+    void process(const Bds_Window& part, const Decoded_Samples& decoded, bool run_start, unsigned int worker);
+    void finish();
+
+private:
+    BitDepthAnalyzer& analyzer_;
+    size_t max_bytes_;
+    bool measured_;      //!< The layout of the pass can be measured
+    bool iq_;
+    std::vector<std::unique_ptr<BitDepthAnalyzer> > analyzers_;
+};
+
+#endif
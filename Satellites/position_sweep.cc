@@ -0,0 +1,306 @@
+/*!
+* \file position_sweep.cc
+* \brief Tiled, multi-threaded sweep of receiver positions.
+*
+* -------------------------------------------------------------------------
+*
+*/
+
+#include "position_sweep.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include "auto_conf_flags.h"
+
+namespace
+{
+//! Longitudes evaluated per tile: enough work to amortise scheduling, small enough to balance
+const long int SWEEP_TILE_LONGITUDES = 64;
+
+/*!
+* Moving the receiver by an arc of x rad changes sin(elevation) by less than
+* x * (1 + R_earth / range), below 1.5 x for satellites above 19000 km.
+* Moving it vertically by h m changes it by less than h / range.
+*/
+const double SWEEP_ARC_SENSITIVITY = 1.5;
+const double SWEEP_MIN_SATELLITE_RANGE = 1.0e7;  //!< [m]
+const double SWEEP_DEG_TO_RAD = 3.1415926535898 / 180.0;
+
+bool segment_before(const std::pair<size_t, std::pair<size_t, size_t> >& a,
+        const std::pair<size_t, std::pair<size_t, size_t> >& b)
+{
+    return a.first < b.first;
+}
+}
+
+
+long int Sweep_Grid::lat_points() const
+{
+    return static_cast<long int>((lat_max - lat_min) / step_deg + 1e-9) + 1;
+}
+
+
+long int Sweep_Grid::lon_points() const
+{
+    return static_cast<long int>((lon_max - lon_min) / step_deg + 1e-9) + 1;
+}
+
+
+long int Sweep_Grid::height_points() const
+{
+    return (height_max - height_min) / height_step + 1;
+}
+
+
+unsigned long long Sweep_Grid::points() const
+{
+    return static_cast<unsigned long long>(lat_points()) * lon_points() * height_points();
+}
+
+
+Sweep_Grid default_sweep_grid()
+{
+    Sweep_Grid grid;
+    grid.lat_min = -90.0;
+    grid.lat_max = 90.0;
+    grid.lon_min = -180.0;
+    grid.lon_max = 180.0;
+    grid.step_deg = FLAGS_sweep_step_deg;
+    grid.height_min = 2000;
+    grid.height_max = 20000;
+    grid.height_step = FLAGS_sweep_height_step;
+    return grid;
+}
+
+
+PositionSweep::PositionSweep(const SatelliteVisibility& visibility, WorkStealingPool& pool)
+    : visibility_(visibility), pool_(pool), evaluated_(0), in_view_(0)
+{
+}
+
+
+void PositionSweep::start_buffers()
+{
+    buffers_.assign(pool_.workers(), Thread_Buffer());
+    for (size_t w = 0; w < buffers_.size(); w++)
+        {
+            buffers_[w].evaluated = 0;
+            buffers_[w].in_view = 0;
+        }
+}
+
+
+void PositionSweep::run(const Sweep_Grid& grid)
+{
+    start_buffers();
+
+    size_t lon_tiles = (grid.lon_points() + SWEEP_TILE_LONGITUDES - 1) / SWEEP_TILE_LONGITUDES;
+    size_t tiles = static_cast<size_t>(grid.lat_points()) * lon_tiles;
+
+    pool_.parallel_for(tiles, [this, &grid](size_t tile, unsigned int worker)
+            {
+                evaluate_tile(grid, tile, buffers_[worker]);
+            });
+
+    merge();
+}
+
+
+void PositionSweep::evaluate_tile(const Sweep_Grid& grid, size_t tile, Thread_Buffer& buffer) const
+{
+    size_t lon_tiles = (grid.lon_points() + SWEEP_TILE_LONGITUDES - 1) / SWEEP_TILE_LONGITUDES;
+    long int lat_index = tile / lon_tiles;
+    long int lon_first = (tile % lon_tiles) * SWEEP_TILE_LONGITUDES;
+    long int lon_last = std::min(lon_first + SWEEP_TILE_LONGITUDES, grid.lon_points());
+    double lat = grid.lat_min + lat_index * grid.step_deg;
+
+    Tile_Segment segment;
+    segment.tile = tile;
+    segment.offset = buffer.latitude.size();
+    unsigned long long evaluated = 0;
+
+    for (long int lon_index = lon_first; lon_index < lon_last; lon_index++)
+        {
+            double longi = grid.lon_min + lon_index * grid.step_deg;
+            for (long int height = grid.height_min; height <= grid.height_max; height += grid.height_step)
+                {
+                    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+                    Visible_Set in_view = visibility_.visible(lat, longi, height);
+                    if (in_view.any())
+                        {
+                            std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+                            buffer.latitude.push_back(lat);
+                            buffer.longitude.push_back(longi);
+                            buffer.height.push_back(static_cast<float>(height));
+                            buffer.active_time.push_back(std::chrono::duration<float, std::micro>(end - begin).count());
+                            buffer.located |= in_view;
+                        }
+                    evaluated++;
+                }
+        }
+    buffer.evaluated += evaluated;
+
+    segment.count = buffer.latitude.size() - segment.offset;
+    buffer.in_view += segment.count;
+    if (segment.count > 0)
+        {
+            buffer.segments.push_back(segment);
+        }
+}
+
+
+void PositionSweep::run_adaptive(const Sweep_Grid& grid)
+{
+    start_buffers();
+
+    long int coarse = std::max(FLAGS_sweep_coarse_cells, 1);
+    size_t lon_cells = (grid.lon_points() + coarse - 1) / coarse;
+    size_t lat_cells = (grid.lat_points() + coarse - 1) / coarse;
+
+    pool_.parallel_for(lat_cells * lon_cells, [this, &grid, coarse, lon_cells](size_t tile, unsigned int worker)
+            {
+                Grid_Cell cell;
+                cell.lat0 = (tile / lon_cells) * coarse;
+                cell.lat1 = std::min(cell.lat0 + coarse, grid.lat_points());
+                cell.lon0 = (tile % lon_cells) * coarse;
+                cell.lon1 = std::min(cell.lon0 + coarse, grid.lon_points());
+                cell.h0 = 0;
+                cell.h1 = grid.height_points();
+
+                Thread_Buffer& buffer = buffers_[worker];
+                Tile_Segment segment;
+                segment.tile = tile;
+                segment.offset = buffer.latitude.size();
+                refine_cell(grid, cell, buffer);
+                segment.count = buffer.latitude.size() - segment.offset;
+                if (segment.count > 0)
+                    {
+                        buffer.segments.push_back(segment);
+                    }
+            });
+
+    merge();
+}
+
+
+void PositionSweep::refine_cell(const Sweep_Grid& grid, const Grid_Cell& cell, Thread_Buffer& buffer) const
+{
+    long int lat_mid = (cell.lat0 + cell.lat1 - 1) / 2;
+    long int lon_mid = (cell.lon0 + cell.lon1 - 1) / 2;
+    long int h_mid = (cell.h0 + cell.h1 - 1) / 2;
+    double lat = grid.lat_min + lat_mid * grid.step_deg;
+    double longi = grid.lon_min + lon_mid * grid.step_deg;
+    double height = grid.height_min + h_mid * grid.height_step;
+
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    double margin;
+    Visible_Set in_view = visibility_.visible(lat, longi, height, margin);
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    buffer.evaluated++;
+
+    // Largest distance, in each dimension, from the evaluated point to the cell boundary
+    double lat_arc = std::max(lat_mid - cell.lat0, cell.lat1 - 1 - lat_mid) * grid.step_deg * SWEEP_DEG_TO_RAD;
+    double lon_arc = std::max(lon_mid - cell.lon0, cell.lon1 - 1 - lon_mid) * grid.step_deg * SWEEP_DEG_TO_RAD;
+    double h_range = std::max(h_mid - cell.h0, cell.h1 - 1 - h_mid) * static_cast<double>(grid.height_step);
+    double bound = SWEEP_ARC_SENSITIVITY * sqrt(lat_arc * lat_arc + lon_arc * lon_arc) + h_range / SWEEP_MIN_SATELLITE_RANGE;
+
+    long int lat_extent = cell.lat1 - cell.lat0;
+    long int lon_extent = cell.lon1 - cell.lon0;
+    long int h_extent = cell.h1 - cell.h0;
+    if (margin > bound || (lat_extent == 1 && lon_extent == 1 && h_extent == 1))
+        {
+            // No satellite crosses the mask inside the cell (or the cell is a single
+            // grid point): every point of the cell shares this visible set
+            if (in_view.any())
+                {
+                    record_cell(grid, cell, std::chrono::duration<float, std::micro>(end - begin).count(), buffer);
+                    buffer.located |= in_view;
+                }
+            return;
+        }
+
+    // Split the dimension that contributes most to the bound
+    double lat_weight = lat_extent > 1 ? lat_arc : -1.0;
+    double lon_weight = lon_extent > 1 ? lon_arc : -1.0;
+    double h_weight = h_extent > 1 ? h_range / SWEEP_MIN_SATELLITE_RANGE : -1.0;
+    Grid_Cell low = cell;
+    Grid_Cell high = cell;
+    if (lat_weight >= lon_weight && lat_weight >= h_weight)
+        {
+            low.lat1 = high.lat0 = cell.lat0 + lat_extent / 2;
+        }
+    else if (lon_weight >= h_weight)
+        {
+            low.lon1 = high.lon0 = cell.lon0 + lon_extent / 2;
+        }
+    else
+        {
+            low.h1 = high.h0 = cell.h0 + h_extent / 2;
+        }
+    refine_cell(grid, low, buffer);
+    refine_cell(grid, high, buffer);
+}
+
+
+void PositionSweep::record_cell(const Sweep_Grid& grid, const Grid_Cell& cell, float active_time, Thread_Buffer& buffer) const
+{
+    for (long int lat_index = cell.lat0; lat_index < cell.lat1; lat_index++)
+        {
+            double lat = grid.lat_min + lat_index * grid.step_deg;
+            for (long int lon_index = cell.lon0; lon_index < cell.lon1; lon_index++)
+                {
+                    double longi = grid.lon_min + lon_index * grid.step_deg;
+                    for (long int h_index = cell.h0; h_index < cell.h1; h_index++)
+                        {
+                            buffer.latitude.push_back(lat);
+                            buffer.longitude.push_back(longi);
+                            buffer.height.push_back(static_cast<float>(grid.height_min + h_index * grid.height_step));
+                            buffer.active_time.push_back(active_time);
+                        }
+                }
+        }
+    buffer.in_view += static_cast<unsigned long long>(cell.lat1 - cell.lat0) * (cell.lon1 - cell.lon0) * (cell.h1 - cell.h0);
+}
+
+
+void PositionSweep::merge()
+{
+    // (tile, (buffer, segment)) so that the output follows the grid order
+    std::vector<std::pair<size_t, std::pair<size_t, size_t> > > order;
+    size_t total = 0;
+    located_.reset();
+    evaluated_ = 0;
+    in_view_ = 0;
+    for (size_t w = 0; w < buffers_.size(); w++)
+        {
+            for (size_t s = 0; s < buffers_[w].segments.size(); s++)
+                {
+                    order.push_back(std::make_pair(buffers_[w].segments[s].tile, std::make_pair(w, s)));
+                }
+            total += buffers_[w].latitude.size();
+            located_ |= buffers_[w].located;
+            evaluated_ += buffers_[w].evaluated;
+            in_view_ += buffers_[w].in_view;
+        }
+    std::sort(order.begin(), order.end(), segment_before);
+
+    // Each segment gets its place in the store, then the workers copy them in parallel
+    positions_.clear();
+    size_t first = positions_.claim(total);
+    std::vector<size_t> destination(order.size());
+    for (size_t k = 0; k < order.size(); k++)
+        {
+            destination[k] = first;
+            first += buffers_[order[k].second.first].segments[order[k].second.second].count;
+        }
+
+    pool_.parallel_for(order.size(), [this, &order, &destination](size_t k, unsigned int)
+            {
+                const Thread_Buffer& buffer = buffers_[order[k].second.first];
+                const Tile_Segment& segment = buffer.segments[order[k].second.second];
+                size_t offset = segment.offset;
+                positions_.write(destination[k], &buffer.latitude[offset], &buffer.longitude[offset],
+                        &buffer.height[offset], &buffer.active_time[offset], segment.count);
+            });
+    buffers_.clear();
+}
@@ -0,0 +1,129 @@
+/*!
+* \file position_sweep.h
+* \brief Tiled, multi-threaded sweep of receiver positions.
+*
+* The latitude / longitude / height grid is cut in tiles (one latitude row
+* and a run of longitudes, all heights). Tiles are evaluated with the
+* SatelliteVisibility engine on a WorkStealingPool; every worker appends
+* the positions that see at least one satellite to its own buffer, and the
+* buffers are merged in tile order at the end, so the result does not
+* depend on the number of threads.
+*
+* The adaptive mode evaluates coarse cells and splits only those where a
+* satellite may cross the elevation mask, so regions with a constant
+* visible constellation cost a single evaluation.
+*
+* -------------------------------------------------------------------------
+*
+*/
+
+#ifndef GNSS_SDR_POSITION_SWEEP_H_
+#define GNSS_SDR_POSITION_SWEEP_H_
+
+#include <cstddef>
+#include <vector>
+#include "position_store.h"
+#include "satellite_visibility.h"
+#include "work_stealing_pool.h"
+
+/*!
+* \brief Uniform grid of receiver positions. Bounds are inclusive.
+*/
+struct Sweep_Grid
+{
+    double lat_min;        //!< [deg]
+    double lat_max;        //!< [deg]
+    double lon_min;        //!< [deg]
+    double lon_max;        //!< [deg]
+    double step_deg;       //!< Latitude and longitude step [deg]
+    long int height_min;   //!< [m]
+    long int height_max;   //!< [m]
+    long int height_step;  //!< [m]
+
+    long int lat_points() const;
+    long int lon_points() const;
+    long int height_points() const;
+    unsigned long long points() const;
+};
+
+/*!
+* \brief Whole globe, 2000 m to 20000 m, with the resolution given by --sweep_step_deg and --sweep_height_step.
+*/
+Sweep_Grid default_sweep_grid();
+
+class PositionSweep
+{
+public:
+    PositionSweep(const SatelliteVisibility& visibility, WorkStealingPool& pool);
+
+    /*!
+    * \brief Evaluates every point of the grid and keeps those with satellites in view.
+    */
+    void run(const Sweep_Grid& grid);
+
+    /*!
+    * \brief Coarse-to-fine version of run() giving the same located(), in_view_points() and
+    * recorded positions. Cells of --sweep_coarse_cells points per side are split until every
+    * satellite stays on the same side of the elevation mask over the whole cell; all the grid
+    * points of such a cell are then recorded from its single evaluation, in cell order.
+    */
+    void run_adaptive(const Sweep_Grid& grid);
+
+    //! Positions with at least one satellite in view, in grid (run()) or cell (run_adaptive()) order,
+    //! with their evaluation time [us]
+    const PositionStore& positions() const { return positions_; }
+
+    size_t points() const { return positions_.size(); }
+    unsigned long long evaluated_points() const { return evaluated_; }
+    //! Number of grid points with at least one satellite in view
+    unsigned long long in_view_points() const { return in_view_; }
+
+    //! Union of the satellites seen from all the grid points
+    Visible_Set located() const { return located_; }
+
+private:
+    struct Tile_Segment
+    {
+        size_t tile;
+        size_t offset;
+        size_t count;
+    };
+
+    //! Half-open range of grid indices
+    struct Grid_Cell
+    {
+        long int lat0, lat1;
+        long int lon0, lon1;
+        long int h0, h1;
+    };
+
+    struct Thread_Buffer
+    {
+        std::vector<double> latitude;
+        std::vector<double> longitude;
+        std::vector<float> height;
+        std::vector<float> active_time;
+        std::vector<Tile_Segment> segments;
+        Visible_Set located;
+        unsigned long long evaluated;
+        unsigned long long in_view;
+        char padding[64];  // keeps the buffers of two workers off the same cache line
+    };
+
+    void evaluate_tile(const Sweep_Grid& grid, size_t tile, Thread_Buffer& buffer) const;
+    void refine_cell(const Sweep_Grid& grid, const Grid_Cell& cell, Thread_Buffer& buffer) const;
+    void record_cell(const Sweep_Grid& grid, const Grid_Cell& cell, float active_time, Thread_Buffer& buffer) const;
+    void start_buffers();
+    void merge();
+
+    const SatelliteVisibility& visibility_;
+    WorkStealingPool& pool_;
+    std::vector<Thread_Buffer> buffers_;
+
+    PositionStore positions_;
+    Visible_Set located_;
+    unsigned long long evaluated_;
+    unsigned long long in_view_;
+};
+
+#endif
@@ -0,0 +1,184 @@
+/*!
+* \file satellite_visibility.cc
+* \brief Almanac based satellite visibility engine.
+*
+* Orbit propagation follows IS-GPS-200 Table 20-IV. The almanacs of both
+* systems are converted to Keplerian elements in navigation_snapshot.cc.
+*
+* -------------------------------------------------------------------------
+*
+*/
+
+#include "satellite_visibility.h"
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+
+namespace
+{
+const double VISIBILITY_PI = 3.1415926535898;           //!< Pi as defined in IS-GPS-200
+const double GM = 3.986005e14;                           //!< Earth gravitational constant [m^3/s^2]
+const double OMEGA_EARTH_DOT = 7.2921151467e-5;         //!< Earth rotation rate [rad/s]
+const double WGS84_A = 6378137.0;                        //!< WGS84 semi-major axis [m]
+const double WGS84_E2 = 6.69437999014e-3;                //!< WGS84 first eccentricity squared
+const double HALF_WEEK = 302400.0;                       //!< [s]
+const double GPS_UNIX_EPOCH = 315964800.0;               //!< 6-Jan-1980 in Unix time [s]
+const double GPS_LEAP_SECONDS = 18.0;                    //!< GPS - UTC since 1-Jan-2017 [s], without a UTC model
+}
+
+
+SatelliteVisibility::SatelliteVisibility(double elevation_mask_deg)
+    : snapshot_(std::make_shared<Navigation_Snapshot>())
+{
+    sin_mask_ = sin(elevation_mask_deg * VISIBILITY_PI / 180.0);
+    sin2_mask_ = sin_mask_ * sin_mask_;
+    negative_mask_ = elevation_mask_deg < 0.0;
+}
+
+
+void SatelliteVisibility::load_almanacs(const std::map<int, Gps_Almanac>& gps_almanacs,
+        const std::map<int, Galileo_Almanac>& galileo_almanacs)
+{
+    load_snapshot(std::make_shared<Navigation_Snapshot>(make_navigation_snapshot(gps_almanacs, galileo_almanacs)));
+}
+
+
+void SatelliteVisibility::load_snapshot(const std::shared_ptr<const Navigation_Snapshot>& snapshot)
+{
+    snapshot_ = snapshot ? snapshot : std::make_shared<Navigation_Snapshot>();
+    sat_x_.assign(snapshot_->satellites(), 0.0);
+    sat_y_.assign(snapshot_->satellites(), 0.0);
+    sat_z_.assign(snapshot_->satellites(), 0.0);
+}
+
+
+void SatelliteVisibility::set_epoch(double gps_tow)
+{
+    // One pass over the columns of the snapshot
+    const Navigation_Snapshot& orbits = *snapshot_;
+    for (unsigned int k = 0; k < orbits.satellites(); k++)
+        {
+            double a = orbits.sqrt_a[k] * orbits.sqrt_a[k];
+            double n0 = sqrt(GM / (a * a * a));
+
+            double tk = gps_tow - orbits.toa[k];
+            if (tk > HALF_WEEK) tk -= 2.0 * HALF_WEEK;
+            if (tk < -HALF_WEEK) tk += 2.0 * HALF_WEEK;
+
+            // Kepler's equation by fixed point iteration
+            double m = orbits.m0[k] + n0 * tk;
+            double ek = m;
+            for (int iter = 0; iter < 20; iter++)
+                {
+                    double ek_new = m + orbits.e[k] * sin(ek);
+                    if (fabs(ek_new - ek) < 1e-13)
+                        {
+                            ek = ek_new;
+                            break;
+                        }
+                    ek = ek_new;
+                }
+
+            double nu = atan2(sqrt(1.0 - orbits.e[k] * orbits.e[k]) * sin(ek), cos(ek) - orbits.e[k]);
+            double phi = nu + orbits.omega[k];
+            double r = a * (1.0 - orbits.e[k] * cos(ek));
+            double x_orb = r * cos(phi);
+            double y_orb = r * sin(phi);
+            double node = orbits.omega0[k] + (orbits.omega_dot[k] - OMEGA_EARTH_DOT) * tk - OMEGA_EARTH_DOT * orbits.toa[k];
+
+            sat_x_[k] = x_orb * cos(node) - y_orb * cos(orbits.i[k]) * sin(node);
+            sat_y_[k] = x_orb * sin(node) + y_orb * cos(orbits.i[k]) * cos(node);
+            sat_z_[k] = y_orb * sin(orbits.i[k]);
+        }
+}
+
+
+Visible_Set SatelliteVisibility::visible(double latitude_deg, double longitude_deg, double height_m) const
+{
+    return visible_from(latitude_deg, longitude_deg, height_m, 0);
+}
+
+
+Visible_Set SatelliteVisibility::visible(double latitude_deg, double longitude_deg, double height_m, double& min_margin) const
+{
+    return visible_from(latitude_deg, longitude_deg, height_m, &min_margin);
+}
+
+
+Visible_Set SatelliteVisibility::visible_from(double latitude_deg, double longitude_deg, double height_m, double* min_margin) const
+{
+    double lat = latitude_deg * VISIBILITY_PI / 180.0;
+    double lon = longitude_deg * VISIBILITY_PI / 180.0;
+    double sin_lat = sin(lat);
+    double cos_lat = cos(lat);
+    double sin_lon = sin(lon);
+    double cos_lon = cos(lon);
+
+    // Receiver ECEF position and local vertical
+    double n = WGS84_A / sqrt(1.0 - WGS84_E2 * sin_lat * sin_lat);
+    double rx = (n + height_m) * cos_lat * cos_lon;
+    double ry = (n + height_m) * cos_lat * sin_lon;
+    double rz = (n * (1.0 - WGS84_E2) + height_m) * sin_lat;
+    double ux = cos_lat * cos_lon;
+    double uy = cos_lat * sin_lon;
+    double uz = sin_lat;
+
+    Visible_Set in_view;
+    if (min_margin)
+        {
+            *min_margin = 2.0;
+        }
+    const std::vector<unsigned int>& slot = snapshot_->slot;
+    for (unsigned int k = 0; k < slot.size(); k++)
+        {
+            double dx = sat_x_[k] - rx;
+            double dy = sat_y_[k] - ry;
+            double dz = sat_z_[k] - rz;
+            double up = dx * ux + dy * uy + dz * uz;
+            double range2 = dx * dx + dy * dy + dz * dz;
+            bool above;
+            if (min_margin)
+                {
+                    double margin = up / sqrt(range2) - sin_mask_;
+                    above = margin > 0.0;
+                    if (fabs(margin) < *min_margin)
+                        {
+                            *min_margin = fabs(margin);
+                        }
+                }
+            else
+                {
+                    // sin(elevation) = (d . u) / |d| is compared against the mask without sqrt
+                    double threshold = range2 * sin2_mask_;
+                    above = negative_mask_ ? (up >= 0.0 || up * up < threshold) : (up > 0.0 && up * up > threshold);
+                }
+            if (above)
+                {
+                    in_view.set(slot[k]);
+                }
+        }
+    return in_view;
+}
+
+
+std::string SatelliteVisibility::slot_name(unsigned int slot)
+{
+    char name[16];
+    if (slot < VISIBILITY_GPS_SLOTS)
+        {
+            snprintf(name, sizeof(name), "G%02u", slot + 1);
+        }
+    else
+        {
+            snprintf(name, sizeof(name), "E%02u", slot - VISIBILITY_GPS_SLOTS + 1);
+        }
+    return std::string(name);
+}
+
+
+double SatelliteVisibility::current_gps_tow() const
+{
+    double leap_seconds = snapshot_->gps_utc_valid ? snapshot_->gps_utc_delta_t_ls : GPS_LEAP_SECONDS;
+    double gps_seconds = static_cast<double>(time(NULL)) - GPS_UNIX_EPOCH + leap_seconds;
+    return fmod(gps_seconds, 2.0 * HALF_WEEK);
+}
@@ -0,0 +1,101 @@
+/*!
+* \file satellite_visibility.h
+* \brief Almanac based satellite visibility engine.
+*
+* The orbits of the GPS and Galileo satellites are propagated from the
+* almanacs decoded by the receiver. Once the constellation has been placed
+* at a given epoch, the set of satellites in view from any receiver
+* position is obtained with a few multiply-adds per satellite, so a
+* position sweep no longer needs a receiver run per grid point.
+*
+* -------------------------------------------------------------------------
+*
+*/
+
+#ifndef GNSS_SDR_SATELLITE_VISIBILITY_H_
+#define GNSS_SDR_SATELLITE_VISIBILITY_H_
+
+#include <bitset>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "gps_almanac.h"
+#include "galileo_almanac.h"
+#include "navigation_snapshot.h"
+
+const unsigned int VISIBILITY_GPS_SLOTS = NAVIGATION_GPS_SLOTS;          //!< GPS PRN 1..32
+const unsigned int VISIBILITY_GALILEO_SLOTS = NAVIGATION_GALILEO_SLOTS;  //!< Galileo SVID 1..36
+const unsigned int VISIBILITY_SLOTS = VISIBILITY_GPS_SLOTS + VISIBILITY_GALILEO_SLOTS;
+
+/*!
+* \brief Set of satellites in view. Bit (PRN - 1) is GPS PRN,
+* bit (VISIBILITY_GPS_SLOTS + SVID - 1) is Galileo SVID.
+*/
+typedef std::bitset<VISIBILITY_SLOTS> Visible_Set;
+
+/*!
+* \brief Computes which satellites are above the elevation mask of a receiver.
+*/
+class SatelliteVisibility
+{
+public:
+    SatelliteVisibility(double elevation_mask_deg);
+
+    /*!
+    * \brief Replaces the orbits with the healthy satellites of the given almanacs.
+    * Keys and values are those of global_gps_almanac_map and global_galileo_almanac_map.
+    */
+    void load_almanacs(const std::map<int, Gps_Almanac>& gps_almanacs,
+            const std::map<int, Galileo_Almanac>& galileo_almanacs);
+
+    /*!
+    * \brief Replaces the orbits with those of a published snapshot, kept (not copied)
+    * until the next load.
+    */
+    void load_snapshot(const std::shared_ptr<const Navigation_Snapshot>& snapshot);
+
+    /*!
+    * \brief Propagates every orbit to the given GPS time of week and caches the ECEF positions.
+    */
+    void set_epoch(double gps_tow);
+
+    /*!
+    * \brief Satellites above the elevation mask of a receiver at the given geodetic position.
+    */
+    Visible_Set visible(double latitude_deg, double longitude_deg, double height_m) const;
+
+    /*!
+    * \brief As visible(), also returning the smallest |sin(elevation) - sin(mask)| over all satellites.
+    * The visible set cannot change within a neighbourhood where no satellite moves by that much.
+    */
+    Visible_Set visible(double latitude_deg, double longitude_deg, double height_m, double& min_margin) const;
+
+    unsigned int satellites() const { return snapshot_->satellites(); }
+
+    /*!
+    * \brief Human readable name (e.g. "G07", "E11") of a Visible_Set bit.
+    */
+    static std::string slot_name(unsigned int slot);
+
+    /*!
+    * \brief Current GPS time of week [s], taken from the system clock. The leap
+    * seconds are those of the UTC model of the snapshot, if it has one.
+    */
+    double current_gps_tow() const;
+
+private:
+    //! Both visible(); the margin is only computed when min_margin is not null
+    Visible_Set visible_from(double latitude_deg, double longitude_deg, double height_m, double* min_margin) const;
+
+    std::shared_ptr<const Navigation_Snapshot> snapshot_;
+    // ECEF position of each orbit of the snapshot at the current epoch [m]
+    std::vector<double> sat_x_;
+    std::vector<double> sat_y_;
+    std::vector<double> sat_z_;
+    double sin_mask_;
+    double sin2_mask_;
+    bool negative_mask_;
+};
+
+#endif
@@ -0,0 +1,111 @@
+/*!
+* \file Synthetic_Recording.cc
+*
+* Writes a synthetic GPS L1 C/A recording (<prefix>1.bds) and its GNSS
+* metadata (<prefix>1.xml), without any front-end or receiver run, so the
+* other programs, the benchmarks and the metadata readers can be exercised
+* on a known signal. The satellites, the intermediate frequency, the
+* quantization and the packing are set with the --synthetic_* flags and
+* the sample rate with --sample_rate.
+*
+* -------------------------------------------------------------------------
+*
+*/
+
+#ifndef GNSS_SDR_VERSION
+#define GNSS_SDR_VERSION "0.0.5"
+#endif
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <GnssMetadata/Metadata.h>
+#include "auto_conf_flags.h"
+#include "metadata_builder.h"
+#include "metadata_cache.h"
+#include "recording_generator.h"
+#include "stage_timer.h"
+#include "work_stealing_pool.h"
+
+using namespace GnssMetadata;
+
+
+int main(int argc, char** argv)
+{
+    const std::string intro_help(
+            std::string("\nWrites a synthetic GPS L1 C/A recording and its GNSS metadata\n")
+    +
+    "Usage: Synthetic_Recording --synthetic_prefix=<prefix> --synthetic_seconds=<s> [--synthetic_* ...]\n \n");
+
+    const std::string gnss_sdr_version(GNSS_SDR_VERSION);
+    google::SetUsageMessage(intro_help);
+    google::SetVersionString(gnss_sdr_version);
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    if (FLAGS_stage_report)
+        {
+            report_stages_at_exit();
+        }
+    google::InitGoogleLogging(argv[0]);
+
+    Synthetic_Recording recording = default_synthetic_recording();
+    if (!parse_synthetic_satellites(FLAGS_synthetic_satellites, recording.satellites))
+        {
+            std::cout << "Malformed --synthetic_satellites (PRN:Doppler:code phase:C/N0,...): "
+                      << FLAGS_synthetic_satellites << std::endl;
+            return 1;
+        }
+    RecordingGenerator generator(recording);
+    if (!generator.valid())
+        {
+            std::cout << "Cannot generate the recording: " << generator.error() << std::endl;
+            return 1;
+        }
+
+    // Blocks of the recording computed on every core and written at their offsets
+    unsigned long long samples = generator.recorded_samples(static_cast<unsigned long long>(std::llround(FLAGS_synthetic_seconds * recording.sample_rate)));
+    std::string recording_file = FLAGS_synthetic_prefix + "1.bds";
+    WorkStealingPool pool(FLAGS_sweep_threads);
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    if (!generator.write(recording_file, samples, pool))
+        {
+            std::cout << generator.error() << std::endl;
+            return 1;
+        }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    double megabytes = generator.bytes(samples) / 1.0e6;
+    std::cout << "Recording " << recording_file << ": " << samples << " samples, "
+              << megabytes << " MB in " << seconds << " s ("
+              << (seconds > 0.0 ? megabytes / seconds : 0.0) << " MB/s, "
+              << pool.workers() << " threads)" << std::endl;
+    for (size_t s = 0; s < recording.satellites.size(); s++)
+        {
+            const Synthetic_Satellite& satellite = recording.satellites[s];
+            std::cout << "  G" << (satellite.prn < 10 ? "0" : "") << satellite.prn
+                      << "  Doppler " << satellite.doppler << " Hz, code phase " << satellite.code_phase
+                      << " chips, C/N0 " << satellite.cn0 << " dB-Hz" << std::endl;
+        }
+
+    //First sample at UTC 24-Aug-2015 21:05:05, GPS 1825/254334.906
+    MetadataBuilder metadata(1, Date( 254334.906, 1825));
+    metadata.set_sample_rate(recording.sample_rate);
+    metadata.set_translated_frequency(recording.intermediate_frequency);
+    metadata.set_stream(recording.quantization, recording.packed_bits, recording.encoding, recording.iq, recording.big_endian);
+    metadata.add_band("L1External", FLAGS_rf_center_frequency);
+    std::vector<std::string> xml_files = metadata.write(FLAGS_synthetic_prefix);
+    for (size_t f = 0; f < xml_files.size(); f++)
+        {
+            std::cout << "Metadata " << xml_files[f] << std::endl;
+            std::string error;
+            if (FLAGS_metadata_cache && !MetadataCache::build(xml_files[f], &error))
+                {
+                    LOG(WARNING) << "No binary metadata image for " << xml_files[f] << ": " << error;
+                }
+        }
+
+    google::ShutDownCommandLineFlags();
+    return xml_files.empty() ? 1 : 0;
+}
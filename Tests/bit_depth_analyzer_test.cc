@@ -0,0 +1,169 @@
+/*!
+* \file bit_depth_analyzer_test.cc
+* \brief Tests of the sample resolution measured on packed recordings.
+*
+* The resolution goes into the Stream Quantization next to the packed bits
+* of the layout found by the sample format classifier, so it must be
+* measured on the decoded values and never exceed their container: a 2 bit
+* I/Q recording is 2 bit, not the 8 bits of the bytes that hold it.
+*
+* -------------------------------------------------------------------------
+*
+*/
+
+#include <complex>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <boost/filesystem.hpp>
+#include <gtest/gtest.h>
+#include "bds_file_reader.h"
+#include "bit_depth_analyzer.h"
+#include "metadata_builder.h"
+#include "recording_generator.h"
+#include "sample_format_classifier.h"
+#include "sample_unpacker.h"
+#include "work_stealing_pool.h"
+
+namespace
+{
+const double TEST_SAMPLE_RATE = 4.0e6;    //!< [Hz]
+const unsigned int TEST_SEED = 20150801;
+const unsigned long long TEST_SAMPLES = 1 << 20;
+
+//! Interleaved I/Q recording of four C/A signals, noise suited to the quantization
+Synthetic_Recording test_recording(unsigned int quantization)
+{
+    Synthetic_Recording recording;
+    recording.sample_rate = TEST_SAMPLE_RATE;
+    recording.intermediate_frequency = 0.0;
+    recording.quantization = quantization;
+    recording.packed_bits = 2 * quantization;
+    recording.encoding = "TC";
+    recording.iq = true;
+    recording.big_endian = false;
+    recording.noise_lsb = 0.0;
+    recording.navigation_data = true;
+    recording.seed = TEST_SEED;
+    parse_synthetic_satellites("1:1200:0:45,7:-2300:311.5:45,13:400:720.25:45,24:3100:95:45", recording.satellites);
+    return recording;
+}
+
+//! Same steps as Auto_rx_conf: layout first, then the resolution of the decoded samples
+class BitDepthTest : public ::testing::Test
+{
+protected:
+    BitDepthTest()
+        : dir_(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("bit_depth_test-%%%%-%%%%")),
+          pool_(2)
+    {
+        boost::filesystem::create_directories(dir_);
+    }
+
+    ~BitDepthTest()
+    {
+        boost::system::error_code error;
+        boost::filesystem::remove_all(dir_, error);
+    }
+
+    Bit_Depth measure(unsigned int quantization, Sample_Layout& layout)
+    {
+        std::string filename = (dir_ / "recording.bds").string();
+        RecordingGenerator generator(test_recording(quantization));
+        EXPECT_TRUE(generator.write(filename, TEST_SAMPLES, pool_)) << generator.error();
+
+        BdsFileReader recording;
+        EXPECT_TRUE(recording.open(filename));
+        SampleFormatClassifier classifier;
+        layout = classifier.classify(recording);
+        SampleUnpacker unpacker;
+        EXPECT_TRUE(unpacker.compile(layout.unpack_layout())) << unpacker.error();
+        BitDepthAnalyzer analyzer;
+        EXPECT_TRUE(analyze_bit_depth(recording, unpacker, analyzer, pool_));
+        return analyzer.result();
+    }
+
+    boost::filesystem::path dir_;
+    WorkStealingPool pool_;
+};
+}
+
+
+TEST(BitDepthAnalyzer, CodesOfDecodedLevels)
+{
+    // Every 2 bit two's complement code of I and Q once each, packed four values per byte
+    std::vector<uint8_t> data(1024, 0);
+    for (size_t n = 0; n < data.size(); n++)
+        {
+            data[n] = static_cast<uint8_t>(n % 2 ? 0xE4 : 0x1B);
+        }
+    SampleUnpacker unpacker;
+    ASSERT_TRUE(unpacker.compile(make_unpack_layout(2, 4, "TC", true, false))) << unpacker.error();
+    std::vector<std::complex<float> > samples(unpacker.samples(data.size()));
+    ASSERT_EQ(samples.size(), unpacker.unpack(data.data(), data.size(), samples.data()));
+
+    BitDepthAnalyzer analyzer;
+    analyzer.process(samples.data(), samples.size(), true);
+    Bit_Depth depth = analyzer.result();
+    EXPECT_EQ(2u * samples.size(), depth.samples);
+    EXPECT_EQ(-2, depth.min_value);
+    EXPECT_EQ(1, depth.max_value);
+    EXPECT_EQ(4u, depth.used_levels);
+    EXPECT_EQ(1u, depth.step);
+    EXPECT_EQ(2u, depth.bits);
+}
+
+
+TEST(BitDepthAnalyzer, OffsetBinaryRealSamples)
+{
+    // 4 bit offset binary real samples using the even codes only: 3 bits of levels
+    std::vector<uint8_t> data(1024);
+    for (size_t n = 0; n < data.size(); n++)
+        {
+            data[n] = static_cast<uint8_t>(((2 * n) % 16) | (((2 * n + 6) % 16) << 4));
+        }
+    SampleUnpacker unpacker;
+    ASSERT_TRUE(unpacker.compile(make_unpack_layout(4, 4, "OB", false, false))) << unpacker.error();
+    std::vector<std::complex<float> > samples(unpacker.samples(data.size()));
+    unpacker.unpack(data.data(), data.size(), samples.data());
+
+    BitDepthAnalyzer analyzer;
+    analyzer.process(samples.data(), samples.size(), false);
+    Bit_Depth depth = analyzer.result();
+    EXPECT_EQ(samples.size(), depth.samples);
+    EXPECT_EQ(-8, depth.min_value);
+    EXPECT_EQ(6, depth.max_value);
+    EXPECT_EQ(2u, depth.step);
+    EXPECT_EQ(3u, depth.bits);
+}
+
+
+TEST_F(BitDepthTest, PackedTwoBitIq)
+{
+    Sample_Layout layout;
+    Bit_Depth resolution = measure(2, layout);
+    ASSERT_EQ(2u, layout.bits);
+    ASSERT_TRUE(layout.iq);
+    EXPECT_GT(resolution.samples, 0u);
+    EXPECT_EQ(2u, resolution.bits);
+    EXPECT_LE(resolution.bits, layout.bits);
+
+    // The Stream written for it passes the validation of the metadata
+    MetadataBuilder metadata(1, GnssMetadata::Date(254334.906, 1825));
+    metadata.set_position(41.27, 1.99, 100.0);
+    metadata.set_stream(resolution.bits, layout.packed_bits(), layout.encoding(), layout.iq, layout.big_endian);
+    metadata.add_band("L1E1", 1575.42e6);
+    std::vector<std::string> problems = metadata.validate();
+    EXPECT_TRUE(problems.empty()) << problems.front();
+}
+
+
+TEST_F(BitDepthTest, EightBitIq)
+{
+    Sample_Layout layout;
+    Bit_Depth resolution = measure(8, layout);
+    ASSERT_EQ(8u, layout.bits);
+    EXPECT_GT(resolution.samples, 0u);
+    EXPECT_GE(resolution.bits, 3u);
+    EXPECT_LE(resolution.bits, layout.bits);
+}
@@ -0,0 +1,242 @@
+/*!
+* \file bit_unpacker_test.cc
+* \brief Tests of every vectorized unpacker against the scalar reference.
+*
+* Each instruction set of bit_unpacker_isas() unpacks the same random
+* bytes, at 1, 2, 4 and 8 bits, in both bit orders and both encodings,
+* from unaligned addresses and with lengths leaving tails of every size
+* after the vector loops and the int16 and float batches. The sample
+* unpacker must hand its flat I/Q layouts of up to 8 bits to them.
+*
+* -------------------------------------------------------------------------
+*
+*/
+
+#include <complex>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+#include "bit_unpacker.h"
+#include "sample_unpacker.h"
+
+namespace
+{
+const unsigned int TEST_SEED = 20150824;
+
+//! Whole vectors, tails of every size around them, and more than one int16 or float batch
+const size_t TEST_LENGTHS[] = { 0, 1, 2, 3, 7, 15, 16, 17, 31, 32, 33, 47, 63, 64, 65, 100, 255, 1000, 1024, 4099 };
+
+//! Offsets of the first byte from a 64 byte boundary
+const size_t TEST_OFFSETS[] = { 0, 1, 3, 8, 13 };
+
+struct Unpack_Case
+{
+    std::string isa;
+    Packed_Format format;
+};
+
+std::string case_name(const ::testing::TestParamInfo<Unpack_Case>& info)
+{
+    const Unpack_Case& c = info.param;
+    return c.isa + "_" + std::to_string(c.format.bits) + "bit_" + (c.format.offset_binary ? "OB" : "TC") + (c.format.msb_first ? "_msb" : "_lsb");
+}
+
+std::vector<Unpack_Case> all_cases()
+{
+    std::vector<Unpack_Case> cases;
+    std::vector<std::string> isas = bit_unpacker_isas();
+    const unsigned int widths[] = { 1, 2, 4, 8 };
+    for (size_t i = 0; i < isas.size(); i++)
+        {
+            for (unsigned int w = 0; w < 4; w++)
+                {
+                    for (unsigned int variant = 0; variant < 4; variant++)
+                        {
+                            Unpack_Case c;
+                            c.isa = isas[i];
+                            c.format.bits = widths[w];
+                            c.format.offset_binary = variant & 1;
+                            c.format.msb_first = variant & 2;
+                            cases.push_back(c);
+                        }
+                }
+        }
+    return cases;
+}
+
+class BitUnpackerTest : public ::testing::TestWithParam<Unpack_Case>
+{
+protected:
+    BitUnpackerTest() : data_(8192 + 64)
+    {
+        std::mt19937 generator(TEST_SEED);
+        for (size_t i = 0; i < data_.size(); i++)
+            {
+                data_[i] = static_cast<uint8_t>(generator());
+            }
+    }
+
+    //! Reference values of bytes starting at the given offset
+    std::vector<int8_t> reference(size_t offset, size_t bytes) const
+    {
+        std::vector<int8_t> values(bytes * 8 / GetParam().format.bits);
+        unpack_bits_reference(&data_[offset], bytes, GetParam().format, values.data());
+        return values;
+    }
+
+    std::vector<uint8_t> data_;
+};
+}
+
+
+TEST(BitUnpacker, PicksTheBestInstructionSet)
+{
+    std::vector<std::string> isas = bit_unpacker_isas();
+    ASSERT_FALSE(isas.empty());
+    EXPECT_EQ("generic", isas.front());
+    EXPECT_EQ(std::string(bit_unpacker_isa()), isas.back());
+    int8_t out[8];
+    uint8_t in = 0;
+    Packed_Format format = { 2, false, false };
+    EXPECT_EQ(0u, unpack_bits_with("unknown", &in, 1, format, out));
+    format.bits = 3;
+    EXPECT_EQ(0u, unpack_bits(&in, 1, format, out));
+}
+
+
+TEST_P(BitUnpackerTest, Int8MatchesReference)
+{
+    const Unpack_Case& c = GetParam();
+    for (size_t o = 0; o < sizeof(TEST_OFFSETS) / sizeof(TEST_OFFSETS[0]); o++)
+        {
+            for (size_t l = 0; l < sizeof(TEST_LENGTHS) / sizeof(TEST_LENGTHS[0]); l++)
+                {
+                    size_t bytes = TEST_LENGTHS[l];
+                    std::vector<int8_t> expected = reference(TEST_OFFSETS[o], bytes);
+                    // One guard value after the end, which must stay untouched
+                    std::vector<int8_t> values(expected.size() + 1, 99);
+                    ASSERT_EQ(expected.size(), unpack_bits_with(c.isa, &data_[TEST_OFFSETS[o]], bytes, c.format, values.data()));
+                    EXPECT_EQ(99, values.back()) << bytes << " bytes at offset " << TEST_OFFSETS[o];
+                    values.pop_back();
+                    EXPECT_EQ(expected, values) << bytes << " bytes at offset " << TEST_OFFSETS[o];
+                }
+        }
+}
+
+
+TEST_P(BitUnpackerTest, Int16MatchesReference)
+{
+    const Unpack_Case& c = GetParam();
+    for (size_t o = 0; o < sizeof(TEST_OFFSETS) / sizeof(TEST_OFFSETS[0]); o++)
+        {
+            for (size_t l = 0; l < sizeof(TEST_LENGTHS) / sizeof(TEST_LENGTHS[0]); l++)
+                {
+                    size_t bytes = TEST_LENGTHS[l];
+                    std::vector<int8_t> expected = reference(TEST_OFFSETS[o], bytes);
+                    std::vector<int16_t> values(expected.size() + 1, 999);
+                    ASSERT_EQ(expected.size(), unpack_bits_with(c.isa, &data_[TEST_OFFSETS[o]], bytes, c.format, values.data()));
+                    EXPECT_EQ(999, values.back()) << bytes << " bytes at offset " << TEST_OFFSETS[o];
+                    for (size_t v = 0; v < expected.size(); v++)
+                        {
+                            ASSERT_EQ(expected[v], values[v]) << "value " << v << " of " << bytes << " bytes at offset " << TEST_OFFSETS[o];
+                        }
+                }
+        }
+}
+
+
+TEST_P(BitUnpackerTest, ComplexMatchesReference)
+{
+    const Unpack_Case& c = GetParam();
+    for (size_t o = 0; o < sizeof(TEST_OFFSETS) / sizeof(TEST_OFFSETS[0]); o++)
+        {
+            for (size_t l = 0; l < sizeof(TEST_LENGTHS) / sizeof(TEST_LENGTHS[0]); l++)
+                {
+                    size_t bytes = TEST_LENGTHS[l];
+                    std::vector<int8_t> expected = reference(TEST_OFFSETS[o], bytes);
+                    // A last unpaired value is dropped
+                    size_t samples = expected.size() / 2;
+                    std::vector<std::complex<float> > values(samples + 1, std::complex<float>(99.0f, 99.0f));
+                    ASSERT_EQ(samples, unpack_bits_with(c.isa, &data_[TEST_OFFSETS[o]], bytes, c.format, values.data()));
+                    EXPECT_EQ(std::complex<float>(99.0f, 99.0f), values.back()) << bytes << " bytes at offset " << TEST_OFFSETS[o];
+                    for (size_t n = 0; n < samples; n++)
+                        {
+                            // Mid-rise levels: the value plus one half, exact in float
+                            ASSERT_EQ(expected[2 * n] + 0.5f, values[n].real()) << "sample " << n << " of " << bytes << " bytes";
+                            ASSERT_EQ(expected[2 * n + 1] + 0.5f, values[n].imag()) << "sample " << n << " of " << bytes << " bytes";
+                        }
+                }
+        }
+}
+
+
+TEST(BitUnpacker, ReferenceDecodesKnownBytes)
+{
+    // 0x1B = 00 01 10 11: low bits first gives 3, 2, 1, 0 as raw 2 bit codes
+    const uint8_t in[1] = { 0x1B };
+    int8_t out[8];
+    Packed_Format format = { 2, false, false };
+    ASSERT_EQ(4u, unpack_bits_reference(in, 1, format, out));
+    EXPECT_EQ(-1, out[0]);
+    EXPECT_EQ(-2, out[1]);
+    EXPECT_EQ(1, out[2]);
+    EXPECT_EQ(0, out[3]);
+    format.msb_first = true;
+    format.offset_binary = true;
+    unpack_bits_reference(in, 1, format, out);
+    EXPECT_EQ(-2, out[0]);
+    EXPECT_EQ(-1, out[1]);
+    EXPECT_EQ(0, out[2]);
+    EXPECT_EQ(1, out[3]);
+    // 1 bit, high bits first: 0 0 0 1 1 0 1 1
+    format.bits = 1;
+    format.offset_binary = false;
+    ASSERT_EQ(8u, unpack_bits_reference(in, 1, format, out));
+    EXPECT_EQ(0, out[0]);
+    EXPECT_EQ(0, out[2]);
+    EXPECT_EQ(-1, out[3]);
+    EXPECT_EQ(-1, out[7]);
+}
+
+
+INSTANTIATE_TEST_SUITE_P(AllIsas, BitUnpackerTest, ::testing::ValuesIn(all_cases()), case_name);
+
+
+TEST(BitUnpacker, SampleUnpackerDecodesFlatIqLayoutsWithIt)
+{
+    std::mt19937 generator(TEST_SEED);
+    std::vector<uint8_t> data(8 * 1024);
+    for (size_t i = 0; i < data.size(); i++)
+        {
+            data[i] = static_cast<uint8_t>(generator());
+        }
+    const unsigned int widths[] = { 1, 2, 4, 8 };
+    for (unsigned int w = 0; w < 4; w++)
+        {
+            for (unsigned int variant = 0; variant < 4; variant++)
+                {
+                    Packed_Format format = { widths[w], (variant & 1) != 0, (variant & 2) != 0 };
+                    SampleUnpacker unpacker;
+                    ASSERT_TRUE(unpacker.compile(make_unpack_layout(format.bits, 2 * format.bits, format.offset_binary ? "OB" : "TC", true, format.msb_first)));
+                    EXPECT_EQ(0u, unpacker.kernel_name().find("unpack_bits<")) << unpacker.kernel_name();
+                    EXPECT_TRUE(unpacker.specialized());
+
+                    std::vector<int8_t> expected(data.size() * 8 / format.bits);
+                    unpack_bits_reference(data.data(), data.size(), format, expected.data());
+                    std::vector<std::complex<float> > samples(unpacker.samples(data.size()));
+                    ASSERT_EQ(expected.size() / 2, unpacker.unpack(data.data(), data.size(), samples.data()));
+                    for (size_t n = 0; n < samples.size(); n++)
+                        {
+                            ASSERT_EQ(expected[2 * n] + 0.5f, samples[n].real()) << format.bits << " bits, sample " << n;
+                            ASSERT_EQ(expected[2 * n + 1] + 0.5f, samples[n].imag()) << format.bits << " bits, sample " << n;
+                        }
+                }
+        }
+
+    // Real samples keep the table kernels: unpack_bits has no zero imaginary part to write
+    SampleUnpacker unpacker;
+    ASSERT_TRUE(unpacker.compile(make_unpack_layout(2, 2, "TC", false, false)));
+    EXPECT_EQ("table<8>", unpacker.kernel_name());
+}
@@ -0,0 +1,300 @@
+/*!
+* \file metadata_cache_test.cc
+* \brief Tests of the binary image of a metadata file against the parsed XML.
+*
+* Every record of the image, mapped or built from the XML, must hold what
+* MetadataLoader reads from the document: a tool opening the image sees
+* the same bands, sessions and layout as one parsing the file.
+*
+* -------------------------------------------------------------------------
+*
+*/
+
+#include <cstdio>
+#include <string>
+#include <boost/filesystem.hpp>
+#include <gtest/gtest.h>
+#include "metadata_cache.h"
+#include "metadata_loader.h"
+
+namespace
+{
+//! Two streams of one lane, a band defined in a stream and one on its own
+const char* const TEST_METADATA =
+    "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+    "<metadata xmlns=\"http://www.ion.org/standards/gnss-sdr/metadata\" version=\"1.0\">\n"
+    "    <file id=\"\">\n"
+    "        <url>141230-gps-4msps_1.bds</url>\n"
+    "        <timestamp>2015-08-24T21:05:05.906Z</timestamp>\n"
+    "        <offset>0</offset>\n"
+    "        <lane id=\"GPS SPS Data\"/>\n"
+    "    </file>\n"
+    "    <system id=\"A2300-1\">\n"
+    "        <basefreq format=\"Hz\">4000000</basefreq>\n"
+    "        <equipment>ASR-2300</equipment>\n"
+    "        <source id=\"L1 C/A\"><type>Patch</type></source>\n"
+    "    </system>\n"
+    "    <band id=\"E5a\">\n"
+    "        <centerfreq format=\"GHz\">1.17645</centerfreq>\n"
+    "        <translatedfreq format=\"kHz\">-12.5</translatedfreq>\n"
+    "    </band>\n"
+    "    <stream id=\"L1ca\">\n"
+    "        <ratefactor>1</ratefactor>\n"
+    "        <quantization>2</quantization>\n"
+    "        <packedbits>4</packedbits>\n"
+    "        <encoding>TC</encoding>\n"
+    "        <format>IQ</format>\n"
+    "        <band id=\"L1\">\n"
+    "            <centerfreq format=\"MHz\">1575.42</centerfreq>\n"
+    "            <translatedfreq format=\"Hz\">38400</translatedfreq>\n"
+    "        </band>\n"
+    "    </stream>\n"
+    "    <stream id=\"E5\">\n"
+    "        <ratefactor>1</ratefactor>\n"
+    "        <quantization>2</quantization>\n"
+    "        <packedbits>4</packedbits>\n"
+    "        <encoding>TC</encoding>\n"
+    "        <format>IQ</format>\n"
+    "        <band id=\"E5a\"/>\n"
+    "    </stream>\n"
+    "    <lane id=\"GPS SPS Data\">\n"
+    "        <session id=\"1\">\n"
+    "            <toa>2015-08-24T21:05:05.906Z</toa>\n"
+    "            <scenario>Example 1</scenario>\n"
+    "            <campaign>GNSS Metadata API</campaign>\n"
+    "            <contact>CTTC</contact>\n"
+    "            <position><lat>41.27</lat><lon>1.99</lon><height>100</height></position>\n"
+    "        </session>\n"
+    "        <system id=\"A2300-1\"/>\n"
+    "        <block>\n"
+    "            <cycles>256</cycles>\n"
+    "            <sizeheader>16</sizeheader>\n"
+    "            <sizefooter>0</sizefooter>\n"
+    "            <chunk>\n"
+    "                <sizeword>4</sizeword>\n"
+    "                <countwords>1</countwords>\n"
+    "                <endian>Little</endian>\n"
+    "                <padding>None</padding>\n"
+    "                <wordshift>Left</wordshift>\n"
+    "                <lump><stream id=\"L1ca\"/><stream id=\"E5\"/></lump>\n"
+    "            </chunk>\n"
+    "        </block>\n"
+    "    </lane>\n"
+    "</metadata>\n";
+
+//! Every record of the image holds the fields read from the XML
+void expect_same(const MetadataLoader& loader, const MetadataCache& cache)
+{
+    ASSERT_EQ(loader.files().size(), cache.file_count());
+    for (size_t f = 0; f < cache.file_count(); f++)
+        {
+            EXPECT_STREQ(loader.files()[f]->url, cache.text(cache.file(f).url));
+            EXPECT_STREQ(loader.files()[f]->time_stamp, cache.text(cache.file(f).time_stamp));
+            EXPECT_STREQ(loader.files()[f]->lane, cache.text(cache.file(f).lane));
+            EXPECT_EQ(loader.files()[f]->offset, cache.file(f).offset);
+        }
+
+    ASSERT_EQ(loader.streams().size(), cache.stream_count());
+    for (size_t s = 0; s < cache.stream_count(); s++)
+        {
+            const Metadata_Stream& stream = *loader.streams()[s];
+            const Cache_Stream& record = cache.stream(s);
+            EXPECT_STREQ(stream.id, cache.text(record.id));
+            EXPECT_EQ(stream.quantization, record.quantization);
+            EXPECT_EQ(stream.packed_bits, record.packed_bits);
+            EXPECT_STREQ(stream.encoding, cache.text(record.encoding));
+            EXPECT_STREQ(stream.format, cache.text(record.format));
+            const Metadata_Ref* band = stream.bands;
+            for (uint32_t b = 0; b < record.band_count; b++, band = band->next)
+                {
+                    ASSERT_TRUE(band != 0);
+                    EXPECT_STREQ(band->id, cache.ref(record.first_band + b));
+                }
+            EXPECT_TRUE(band == 0);
+        }
+
+    ASSERT_EQ(loader.bands().size(), cache.band_count());
+    for (size_t b = 0; b < cache.band_count(); b++)
+        {
+            EXPECT_STREQ(loader.bands()[b]->id, cache.text(cache.band(b).id));
+            EXPECT_EQ(loader.bands()[b]->center_frequency, cache.band(b).center_frequency);
+            EXPECT_EQ(loader.bands()[b]->translated_frequency, cache.band(b).translated_frequency);
+        }
+
+    ASSERT_EQ(loader.sessions().size(), cache.session_count());
+    for (size_t s = 0; s < cache.session_count(); s++)
+        {
+            const Metadata_Session& session = *loader.sessions()[s];
+            const Cache_Session& record = cache.session(s);
+            EXPECT_STREQ(session.id, cache.text(record.id));
+            EXPECT_STREQ(session.toa, cache.text(record.toa));
+            EXPECT_STREQ(session.scenario, cache.text(record.scenario));
+            EXPECT_STREQ(session.campaign, cache.text(record.campaign));
+            EXPECT_STREQ(session.contact, cache.text(record.contact));
+            EXPECT_EQ(session.latitude, record.latitude);
+            EXPECT_EQ(session.longitude, record.longitude);
+            EXPECT_EQ(session.height, record.height);
+        }
+
+    ASSERT_EQ(loader.lanes().size(), cache.lane_count());
+    for (size_t l = 0; l < cache.lane_count(); l++)
+        {
+            EXPECT_STREQ(loader.lanes()[l]->id, cache.text(cache.lane(l).id));
+            const Metadata_Ref* session = loader.lanes()[l]->sessions;
+            for (uint32_t s = 0; s < cache.lane(l).session_count; s++, session = session->next)
+                {
+                    ASSERT_TRUE(session != 0);
+                    EXPECT_STREQ(session->id, cache.ref(cache.lane(l).first_session + s));
+                }
+            EXPECT_TRUE(session == 0);
+        }
+
+    ASSERT_EQ(loader.blocks().size(), cache.block_count());
+    for (size_t b = 0; b < cache.block_count(); b++)
+        {
+            const Metadata_Block& block = *loader.blocks()[b];
+            const Cache_Block& record = cache.block(b);
+            EXPECT_STREQ(block.lane, cache.text(record.lane));
+            EXPECT_EQ(block.cycles, record.cycles);
+            EXPECT_EQ(block.size_header, record.size_header);
+            EXPECT_EQ(block.size_footer, record.size_footer);
+            const Metadata_Chunk* chunk = block.chunks;
+            for (uint32_t c = 0; c < record.chunk_count; c++, chunk = chunk->next)
+                {
+                    ASSERT_TRUE(chunk != 0);
+                    const Cache_Chunk& chunk_record = cache.chunk(record.first_chunk + c);
+                    EXPECT_EQ(chunk->size_word, chunk_record.size_word);
+                    EXPECT_EQ(chunk->count_words, chunk_record.count_words);
+                    EXPECT_STREQ(chunk->endian, cache.text(chunk_record.endian));
+                    EXPECT_STREQ(chunk->padding, cache.text(chunk_record.padding));
+                    EXPECT_STREQ(chunk->word_shift, cache.text(chunk_record.word_shift));
+                    const Metadata_Lump* lump = chunk->lumps;
+                    for (uint32_t k = 0; k < chunk_record.lump_count; k++, lump = lump->next)
+                        {
+                            ASSERT_TRUE(lump != 0);
+                            const Cache_Lump& lump_record = cache.lump(chunk_record.first_lump + k);
+                            const Metadata_Ref* stream = lump->streams;
+                            for (uint32_t s = 0; s < lump_record.stream_count; s++, stream = stream->next)
+                                {
+                                    ASSERT_TRUE(stream != 0);
+                                    EXPECT_STREQ(stream->id, cache.ref(lump_record.first_stream + s));
+                                }
+                            EXPECT_TRUE(stream == 0);
+                        }
+                    EXPECT_TRUE(lump == 0);
+                }
+            EXPECT_TRUE(chunk == 0);
+        }
+}
+
+class MetadataCacheTest : public ::testing::Test
+{
+protected:
+    MetadataCacheTest()
+        : dir_(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("metadata_cache_test-%%%%-%%%%"))
+    {
+        boost::filesystem::create_directories(dir_);
+        xml_ = (dir_ / "141230-gps-4msps_1.xml").string();
+        write(TEST_METADATA);
+    }
+
+    ~MetadataCacheTest()
+    {
+        boost::system::error_code error;
+        boost::filesystem::remove_all(dir_, error);
+    }
+
+    void write(const std::string& content)
+    {
+        FILE* output = fopen(xml_.c_str(), "wb");
+        ASSERT_TRUE(output != 0);
+        fwrite(content.data(), 1, content.size(), output);
+        fclose(output);
+    }
+
+    boost::filesystem::path dir_;
+    std::string xml_;
+};
+}
+
+
+TEST_F(MetadataCacheTest, LoaderReadsBandsSessionsAndLayout)
+{
+    MetadataLoader loader(MetadataLoader::ALL);
+    ASSERT_TRUE(loader.load(xml_)) << loader.error();
+
+    // The band referenced by the second stream is defined once, on its own
+    ASSERT_EQ(2u, loader.bands().size());
+    EXPECT_STREQ("E5a", loader.bands()[0]->id);
+    EXPECT_DOUBLE_EQ(1176.45e6, loader.bands()[0]->center_frequency);
+    EXPECT_DOUBLE_EQ(-12.5e3, loader.bands()[0]->translated_frequency);
+    EXPECT_STREQ("L1", loader.bands()[1]->id);
+    EXPECT_DOUBLE_EQ(1575.42e6, loader.bands()[1]->center_frequency);
+    EXPECT_DOUBLE_EQ(38400.0, loader.bands()[1]->translated_frequency);
+
+    ASSERT_EQ(1u, loader.sessions().size());
+    const Metadata_Session& session = *loader.sessions()[0];
+    EXPECT_STREQ("1", session.id);
+    EXPECT_STREQ("Example 1", session.scenario);
+    EXPECT_DOUBLE_EQ(41.27, session.latitude);
+    EXPECT_DOUBLE_EQ(1.99, session.longitude);
+    EXPECT_DOUBLE_EQ(100.0, session.height);
+    ASSERT_EQ(1u, loader.lanes().size());
+    ASSERT_TRUE(loader.lanes()[0]->sessions != 0);
+    EXPECT_STREQ("1", loader.lanes()[0]->sessions->id);
+
+    ASSERT_EQ(1u, loader.blocks().size());
+    const Metadata_Block& block = *loader.blocks()[0];
+    EXPECT_STREQ("GPS SPS Data", block.lane);
+    EXPECT_EQ(256u, block.cycles);
+    EXPECT_EQ(16u, block.size_header);
+    ASSERT_TRUE(block.chunks != 0);
+    EXPECT_TRUE(block.chunks->next == 0);
+    EXPECT_EQ(4u, block.chunks->size_word);
+    EXPECT_EQ(1u, block.chunks->count_words);
+    EXPECT_STREQ("Little", block.chunks->endian);
+    EXPECT_STREQ("Left", block.chunks->word_shift);
+    ASSERT_TRUE(block.chunks->lumps != 0);
+    const Metadata_Ref* stream = block.chunks->lumps->streams;
+    ASSERT_TRUE(stream != 0 && stream->next != 0);
+    EXPECT_STREQ("L1ca", stream->id);
+    EXPECT_STREQ("E5", stream->next->id);
+    EXPECT_EQ(2u, loader.streams().size());
+}
+
+
+TEST_F(MetadataCacheTest, ImageMatchesParsedXml)
+{
+    MetadataLoader loader(MetadataLoader::ALL);
+    ASSERT_TRUE(loader.load(xml_)) << loader.error();
+
+    // Built from the XML on the first open, then mapped
+    MetadataCache built;
+    ASSERT_TRUE(built.open(xml_)) << built.error();
+    EXPECT_TRUE(built.rebuilt());
+    EXPECT_EQ(2u, built.band_count());
+    EXPECT_EQ(1u, built.session_count());
+    EXPECT_EQ(1u, built.chunk_count());
+    EXPECT_EQ(1u, built.lump_count());
+    expect_same(loader, built);
+
+    MetadataCache mapped;
+    ASSERT_TRUE(mapped.open(xml_)) << mapped.error();
+    EXPECT_FALSE(mapped.rebuilt());
+    expect_same(loader, mapped);
+}
+
+
+TEST_F(MetadataCacheTest, EditedXmlRebuildsTheImage)
+{
+    ASSERT_TRUE(MetadataCache::build(xml_));
+    std::string edited(TEST_METADATA);
+    edited.replace(edited.find("<cycles>256</cycles>"), 20, "<cycles>512</cycles>");
+    write(edited);
+
+    MetadataCache cache;
+    ASSERT_TRUE(cache.open(xml_)) << cache.error();
+    EXPECT_TRUE(cache.rebuilt());
+    ASSERT_EQ(1u, cache.block_count());
+    EXPECT_EQ(512u, cache.block(0).cycles);
+}